@@ -0,0 +1,2122 @@
+/*
+ * tea_brewer.c
+ *
+ * Converts Wavefront OBJ models to the shzmdl format used by the Dreamcast
+ * Sprites of Sh4zam project, with optional STL and OBJ output for inspection.
+ * Native replacement for model_brewer.py, producing byte-identical output: all
+ * geometry maths is done in double precision in the same order as the Python
+ * reference, and the OBJ writer formats floats the way Python's repr() does.
+ *
+ * Parsing, normal generation and serialisation run on multiple threads, fan
+ * detection and the fan passes are applied in command-line order.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_THREADS 64
+#define MAX_FAN_OPS 256
+#define DEFAULT_FAN_MIN_TRIS 10
+#define DEFAULT_AUTO_CUT 0.2
+#define DEFAULT_TOLERANCE 0.01
+#define DEFAULT_SPRITE_TOLERANCE 0.01
+
+#define STL_HEADER_SIZE 84
+#define STL_RECORD_SIZE 50
+#define SHZMDL_HEADER_SIZE 29
+#define SHZMDL_TRI_SIZE 48
+#define SHZMDL_QUAD_SIZE 64
+#define SHZMDL_FAN_HEADER_SIZE 32
+#define SHZMDL_BLADE_SIZE 24
+#define SHZMDL_VEC3_SIZE 12
+#define SHZMDL_FLAG_SOA 0x1
+
+typedef struct {
+    double x, y, z;
+} vec3d_t;
+
+typedef struct {
+    double u, v;
+} texcoord_t;
+
+typedef struct {
+    int32_t vertex, normal, texcoord;  // zero based, -1 if not present
+} vert_idx_t;
+
+typedef struct {
+    vert_idx_t v[3];
+} tri_idx_t;
+
+typedef struct {
+    vert_idx_t v[4];
+    uint32_t flags;  // QUAD_FLAG_*
+} quad_idx_t;
+
+typedef struct {
+    vert_idx_t center;
+    vert_idx_t* blades;
+    size_t num_blades;
+} fan_t;
+
+#define ARRAY(T)     \
+    struct {         \
+        T* data;     \
+        size_t len;  \
+        size_t cap;  \
+    }
+
+typedef ARRAY(vec3d_t) vec3d_array_t;
+typedef ARRAY(texcoord_t) texcoord_array_t;
+typedef ARRAY(tri_idx_t) tri_array_t;
+typedef ARRAY(quad_idx_t) quad_array_t;
+typedef ARRAY(fan_t) fan_array_t;
+typedef ARRAY(char) char_array_t;
+
+typedef struct {
+    vec3d_array_t vertices;
+    vec3d_array_t normals;
+    texcoord_array_t texcoords;
+    tri_array_t tris;
+    quad_array_t quads;
+    fan_array_t fans;
+    int quads_classified;  // quad flags are valid, written as version 0.2
+} model_t;
+
+typedef enum {
+    OP_SHED_QUADS,
+    OP_FAN2TRIS,
+} fan_op_e;
+
+typedef struct {
+    fan_op_e op;
+    size_t fan;
+    double cut;  // OP_SHED_QUADS only
+} fan_op_t;
+
+static size_t num_threads = 1;
+static int verbose = 0;
+
+static int array_reserve(void** data, size_t* cap, size_t need,
+                         size_t elem_size) {
+    if (need <= *cap) {
+        return 1;
+    }
+    size_t new_cap = *cap ? *cap : 16;
+    while (new_cap < need) {
+        new_cap *= 2;
+    }
+    void* grown = realloc(*data, new_cap * elem_size);
+    if (!grown) {
+        printf("Error allocating memory for %zu elements\n", new_cap);
+        return 0;
+    }
+    *data = grown;
+    *cap = new_cap;
+    return 1;
+}
+
+#define ARRAY_RESERVE(arr, n)                                              \
+    array_reserve((void**)&(arr).data, &(arr).cap, (n), sizeof(*(arr).data))
+
+#define ARRAY_PUSH(arr) \
+    (ARRAY_RESERVE(arr, (arr).len + 1) ? &(arr).data[(arr).len++] : NULL)
+
+/* ---- threading ---------------------------------------------------------- */
+
+typedef void (*range_fn_t)(void* ctx, size_t begin, size_t end);
+
+typedef struct {
+    range_fn_t fn;
+    void* ctx;
+    size_t begin, end;
+} range_job_t;
+
+static void* run_range_job(void* arg) {
+    range_job_t* job = arg;
+    job->fn(job->ctx, job->begin, job->end);
+    return NULL;
+}
+
+/**
+ * @brief Split [0, count) into one contiguous range per thread and run fn on
+ * each, the calling thread takes the first range. Returns when all are done.
+ */
+static void parallel_for(size_t count, range_fn_t fn, void* ctx) {
+    size_t jobs = num_threads < count ? num_threads : count;
+    if (jobs <= 1) {
+        if (count > 0) {
+            fn(ctx, 0, count);
+        }
+        return;
+    }
+    pthread_t threads[MAX_THREADS];
+    int started[MAX_THREADS] = {0};
+    range_job_t job[MAX_THREADS];
+    for (size_t t = 0; t < jobs; t++) {
+        job[t] = (range_job_t){fn, ctx, count * t / jobs,
+                               count * (t + 1) / jobs};
+    }
+    for (size_t t = 1; t < jobs; t++) {
+        started[t] =
+            pthread_create(&threads[t], NULL, run_range_job, &job[t]) == 0;
+        if (!started[t]) {
+            run_range_job(&job[t]);
+        }
+    }
+    run_range_job(&job[0]);
+    for (size_t t = 1; t < jobs; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+}
+
+/* ---- vector maths, same operation order as model_brewer.py -------------- */
+
+static inline vec3d_t vec_minus(vec3d_t a, vec3d_t b) {
+    return (vec3d_t){a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+static inline vec3d_t vec_plus(vec3d_t a, vec3d_t b) {
+    return (vec3d_t){a.x + b.x, a.y + b.y, a.z + b.z};
+}
+
+static inline vec3d_t vec_scaled(vec3d_t a, double scalar) {
+    return (vec3d_t){a.x * scalar, a.y * scalar, a.z * scalar};
+}
+
+static inline vec3d_t vec_crossed(vec3d_t a, vec3d_t b) {
+    return (vec3d_t){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+                     a.x * b.y - a.y * b.x};
+}
+
+static inline vec3d_t vec_normalized(vec3d_t a) {
+    // python's ** on floats is C pow(), keep it for identical rounding
+    double length = pow(pow(a.x, 2.0) + pow(a.y, 2.0) + pow(a.z, 2.0), 0.5);
+    if (length == 0.0) {
+        return (vec3d_t){0.0, 0.0, 0.0};
+    }
+    return vec_scaled(a, 1.0 / length);
+}
+
+static inline double vec_length(vec3d_t a) {
+    return sqrt(a.x * a.x + a.y * a.y + a.z * a.z);
+}
+
+static inline double vec_dot(vec3d_t a, vec3d_t b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline vec3d_t face_normal(const model_t* model, vert_idx_t i0,
+                                  vert_idx_t i1, vert_idx_t i2) {
+    vec3d_t v0 = model->vertices.data[i0.vertex];
+    vec3d_t v1 = model->vertices.data[i1.vertex];
+    vec3d_t v2 = model->vertices.data[i2.vertex];
+    return vec_normalized(vec_crossed(vec_minus(v1, v0), vec_minus(v2, v0)));
+}
+
+/* quads use their first, second and last vertex, just like the reference */
+static inline vec3d_t quad_normal(const model_t* model, const quad_idx_t* q) {
+    return face_normal(model, q->v[0], q->v[1], q->v[3]);
+}
+
+/* ---- little endian serialisation ---------------------------------------- */
+
+static inline uint8_t* put_u32(uint8_t* dst, uint32_t value) {
+    dst[0] = value & 0xff;
+    dst[1] = (value >> 8) & 0xff;
+    dst[2] = (value >> 16) & 0xff;
+    dst[3] = (value >> 24) & 0xff;
+    return dst + 4;
+}
+
+static inline uint8_t* put_f32(uint8_t* dst, double value) {
+    float f = (float)value;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return put_u32(dst, bits);
+}
+
+static inline uint8_t* put_vec3(uint8_t* dst, vec3d_t v) {
+    dst = put_f32(dst, v.x);
+    dst = put_f32(dst, v.y);
+    return put_f32(dst, v.z);
+}
+
+static int write_file(const char* filepath, const void* data, size_t size) {
+    FILE* file = fopen(filepath, "wb");
+    if (!file) {
+        printf("Error opening %s for writing: %s\n", filepath,
+               strerror(errno));
+        return 0;
+    }
+    int success = fwrite(data, 1, size, file) == size;
+    if (fclose(file) != 0) {
+        success = 0;
+    }
+    if (!success) {
+        printf("Error writing %s\n", filepath);
+    }
+    return success;
+}
+
+/* ---- OBJ loading -------------------------------------------------------- */
+
+typedef struct {
+    const char* begin;
+    const char* end;
+    model_t part;
+    int error;
+} obj_chunk_t;
+
+static inline int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+static inline int is_eol(char c) { return c == '\n' || c == '\r'; }
+
+/* next whitespace separated token on the current line, 0 at the end of it */
+static inline int next_token(const char** cursor, const char* end,
+                             const char** tok, size_t* len) {
+    const char* p = *cursor;
+    while (p < end && is_space(*p)) {
+        p++;
+    }
+    if (p == end || is_eol(*p)) {
+        *cursor = p;
+        return 0;
+    }
+    *tok = p;
+    while (p < end && !is_space(*p) && !is_eol(*p)) {
+        p++;
+    }
+    *len = p - *tok;
+    *cursor = p;
+    return 1;
+}
+
+static int parse_double(const char* tok, size_t len, double* out) {
+    char buf[64];
+    if (len == 0 || len >= sizeof(buf)) {
+        return 0;
+    }
+    memcpy(buf, tok, len);
+    buf[len] = '\0';
+    char* endp;
+    *out = strtod(buf, &endp);
+    return endp == buf + len;
+}
+
+static int parse_index(const char* tok, size_t len, int32_t* out) {
+    char buf[16];
+    if (len == 0 || len >= sizeof(buf)) {
+        return 0;
+    }
+    memcpy(buf, tok, len);
+    buf[len] = '\0';
+    char* endp;
+    errno = 0;
+    long value = strtol(buf, &endp, 10);
+    if (endp != buf + len || errno != 0 || value < INT32_MIN + 1 ||
+        value > INT32_MAX) {
+        return 0;
+    }
+    *out = (int32_t)value - 1;
+    return 1;
+}
+
+/* v, v/t, v//n or v/t/n */
+static int parse_face_vertex(const char* tok, size_t len, vert_idx_t* out) {
+    const char* end = tok + len;
+    const char* field[3] = {tok, NULL, NULL};
+    size_t field_len[3] = {len, 0, 0};
+    int fields = 1;
+    for (const char* p = tok; p < end && fields < 3; p++) {
+        if (*p == '/') {
+            field_len[fields - 1] = p - field[fields - 1];
+            field[fields] = p + 1;
+            field_len[fields] = end - (p + 1);
+            fields++;
+        }
+    }
+    if (!parse_index(field[0], field_len[0], &out->vertex)) {
+        return 0;
+    }
+    out->texcoord = -1;
+    out->normal = -1;
+    if (fields > 1 && field_len[1] > 0 &&
+        !parse_index(field[1], field_len[1], &out->texcoord)) {
+        return 0;
+    }
+    if (fields > 2 && field_len[2] > 0 &&
+        !parse_index(field[2], field_len[2], &out->normal)) {
+        return 0;
+    }
+    return 1;
+}
+
+static int parse_line(model_t* part, const char** cursor, const char* end) {
+    const char* tok;
+    size_t len;
+    if (!next_token(cursor, end, &tok, &len)) {
+        return 1;  // blank line
+    }
+    if (len == 1 && tok[0] == 'v') {
+        vec3d_t* v = ARRAY_PUSH(part->vertices);
+        for (int i = 0; v && i < 3; i++) {
+            const char* num;
+            size_t num_len;
+            if (!next_token(cursor, end, &num, &num_len) ||
+                !parse_double(num, num_len, &((double*)v)[i])) {
+                return 0;
+            }
+        }
+        return v != NULL;
+    }
+    if (len == 2 && tok[0] == 'v' && tok[1] == 'n') {
+        vec3d_t* vn = ARRAY_PUSH(part->normals);
+        for (int i = 0; vn && i < 3; i++) {
+            const char* num;
+            size_t num_len;
+            if (!next_token(cursor, end, &num, &num_len) ||
+                !parse_double(num, num_len, &((double*)vn)[i])) {
+                return 0;
+            }
+        }
+        return vn != NULL;
+    }
+    if (len == 2 && tok[0] == 'v' && tok[1] == 't') {
+        texcoord_t* vt = ARRAY_PUSH(part->texcoords);
+        for (int i = 0; vt && i < 2; i++) {
+            const char* num;
+            size_t num_len;
+            if (!next_token(cursor, end, &num, &num_len) ||
+                !parse_double(num, num_len, &((double*)vt)[i])) {
+                return 0;
+            }
+        }
+        return vt != NULL;
+    }
+    if (len == 1 && tok[0] == 'f') {
+        vert_idx_t verts[4];
+        int count = 0;
+        const char* vtok;
+        size_t vlen;
+        while (next_token(cursor, end, &vtok, &vlen)) {
+            vert_idx_t vi;
+            if (!parse_face_vertex(vtok, vlen, &vi)) {
+                return 0;
+            }
+            if (count < 4) {
+                verts[count] = vi;
+            }
+            count++;
+        }
+        // like the reference, faces that are not triangles or quads are
+        // dropped
+        if (count == 3) {
+            tri_idx_t* tri = ARRAY_PUSH(part->tris);
+            if (!tri) {
+                return 0;
+            }
+            memcpy(tri->v, verts, sizeof(tri->v));
+        } else if (count == 4) {
+            quad_idx_t* quad = ARRAY_PUSH(part->quads);
+            if (!quad) {
+                return 0;
+            }
+            memcpy(quad->v, verts, sizeof(quad->v));
+            quad->flags = 0;
+        }
+    }
+    return 1;
+}
+
+static void parse_chunks(void* ctx, size_t begin, size_t end) {
+    obj_chunk_t* chunks = ctx;
+    for (size_t c = begin; c < end; c++) {
+        obj_chunk_t* chunk = &chunks[c];
+        const char* cursor = chunk->begin;
+        while (cursor < chunk->end) {
+            const char* line = cursor;
+            if (!parse_line(&chunk->part, &cursor, chunk->end)) {
+                const char* line_end = line;
+                while (line_end < chunk->end && !is_eol(*line_end)) {
+                    line_end++;
+                }
+                printf("Error parsing line \"%.*s\"\n", (int)(line_end - line),
+                       line);
+                chunk->error = 1;
+                return;
+            }
+            // skip whatever is left of the line, then the line break
+            while (cursor < chunk->end && !is_eol(*cursor)) {
+                cursor++;
+            }
+            while (cursor < chunk->end && is_eol(*cursor)) {
+                cursor++;
+            }
+        }
+    }
+}
+
+static void model_free(model_t* model) {
+    for (size_t f = 0; f < model->fans.len; f++) {
+        free(model->fans.data[f].blades);
+    }
+    free(model->vertices.data);
+    free(model->normals.data);
+    free(model->texcoords.data);
+    free(model->tris.data);
+    free(model->quads.data);
+    free(model->fans.data);
+    memset(model, 0, sizeof(model_t));
+}
+
+#define APPEND_PARTS(field)                                                 \
+    do {                                                                    \
+        size_t total = 0;                                                   \
+        for (size_t c = 0; c < num_chunks; c++) {                           \
+            total += chunks[c].part.field.len;                              \
+        }                                                                   \
+        if (!ARRAY_RESERVE(model->field, total)) {                          \
+            success = 0;                                                    \
+            break;                                                          \
+        }                                                                   \
+        for (size_t c = 0; c < num_chunks; c++) {                           \
+            memcpy(model->field.data + model->field.len,                    \
+                   chunks[c].part.field.data,                               \
+                   chunks[c].part.field.len * sizeof(*model->field.data));  \
+            model->field.len += chunks[c].part.field.len;                   \
+        }                                                                   \
+    } while (0)
+
+static int check_vertex_index(const model_t* model, vert_idx_t vi) {
+    if (vi.vertex < 0 || (size_t)vi.vertex >= model->vertices.len) {
+        printf("Error: face references vertex %ld, the model has %zu "
+               "(relative indices are not supported)\n",
+               (long)vi.vertex + 1, model->vertices.len);
+        return 0;
+    }
+    return 1;
+}
+
+static int load_obj(model_t* model, const char* filepath) {
+    FILE* file = fopen(filepath, "rb");
+    if (!file) {
+        printf("Error opening %s: %s\n", filepath, strerror(errno));
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = malloc(size > 0 ? size : 1);
+    if (!text) {
+        printf("Error allocating %ld bytes for %s\n", size, filepath);
+        fclose(file);
+        return 0;
+    }
+    if (size > 0 && fread(text, 1, size, file) != (size_t)size) {
+        printf("Error reading %s\n", filepath);
+        free(text);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+    // one chunk per thread, each ending on a line break
+    size_t num_chunks = num_threads;
+    obj_chunk_t chunks[MAX_THREADS] = {0};
+    const char* end = text + size;
+    const char* begin = text;
+    for (size_t c = 0; c < num_chunks; c++) {
+        const char* split = text + (size_t)size * (c + 1) / num_chunks;
+        if (split < begin) {
+            split = begin;
+        }
+        while (split < end && !is_eol(*split)) {
+            split++;
+        }
+        chunks[c].begin = begin;
+        chunks[c].end = split;
+        begin = split;
+    }
+    parallel_for(num_chunks, parse_chunks, chunks);
+
+    int success = 1;
+    for (size_t c = 0; c < num_chunks; c++) {
+        if (chunks[c].error) {
+            success = 0;
+        }
+    }
+    if (success) {
+        APPEND_PARTS(vertices);
+    }
+    if (success) {
+        APPEND_PARTS(normals);
+    }
+    if (success) {
+        APPEND_PARTS(texcoords);
+    }
+    if (success) {
+        APPEND_PARTS(tris);
+    }
+    if (success) {
+        APPEND_PARTS(quads);
+    }
+    for (size_t c = 0; c < num_chunks; c++) {
+        model_free(&chunks[c].part);
+    }
+    free(text);
+
+    for (size_t t = 0; success && t < model->tris.len; t++) {
+        for (int i = 0; success && i < 3; i++) {
+            success = check_vertex_index(model, model->tris.data[t].v[i]);
+        }
+    }
+    for (size_t q = 0; success && q < model->quads.len; q++) {
+        for (int i = 0; success && i < 4; i++) {
+            success = check_vertex_index(model, model->quads.data[q].v[i]);
+        }
+    }
+    return success;
+}
+
+/* ---- fan passes --------------------------------------------------------- */
+
+typedef struct {
+    int32_t key;   // vertex following the center in the triangle
+    int32_t next;  // vertex following the key
+    uint32_t tri;
+    uint32_t seq;  // insertion order, later entries replace earlier ones
+    int popped;
+} fan_pair_t;
+
+static int compare_pairs(const void* a, const void* b) {
+    const fan_pair_t* pa = a;
+    const fan_pair_t* pb = b;
+    if (pa->key != pb->key) {
+        return pa->key < pb->key ? -1 : 1;
+    }
+    return pa->seq < pb->seq ? -1 : (pa->seq > pb->seq);
+}
+
+static fan_pair_t* find_pair(fan_pair_t* pairs, size_t num_pairs,
+                             int32_t key) {
+    size_t lo = 0, hi = num_pairs;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (pairs[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < num_pairs && pairs[lo].key == key ? &pairs[lo] : NULL;
+}
+
+static vert_idx_t corner_of(const tri_idx_t* tri, int32_t vertex) {
+    for (int i = 0; i < 3; i++) {
+        if (tri->v[i].vertex == vertex) {
+            return tri->v[i];
+        }
+    }
+    return tri->v[0];  // unreachable, vertex is always part of the triangle
+}
+
+/**
+ * @brief Turn the triangles around every vertex shared by more than min_tris
+ * triangles into a fan, walking the rim from the lowest indexed vertex
+ * @return int 1 on success, 0 on failure
+ */
+static int find_fans(model_t* model, size_t min_tris) {
+    size_t num_verts = model->vertices.len;
+    size_t num_tris = model->tris.len;
+    uint32_t* counts = calloc(num_verts, sizeof(uint32_t));
+    uint32_t* starts = malloc((num_verts + 1) * sizeof(uint32_t));
+    uint32_t* tri_lists = malloc((num_tris * 3 + 1) * sizeof(uint32_t));
+    int32_t* centers = malloc((num_tris * 3 + 1) * sizeof(int32_t));
+    uint8_t* consumed = calloc(num_tris + 1, 1);
+    fan_pair_t* pairs = malloc((num_tris + 1) * sizeof(fan_pair_t));
+    uint32_t* order = malloc((num_tris + 2) * sizeof(uint32_t));
+    if (!counts || !starts || !tri_lists || !centers || !consumed || !pairs ||
+        !order) {
+        printf("Error allocating memory for fan detection\n");
+        free(counts), free(starts), free(tri_lists), free(centers);
+        free(consumed), free(pairs), free(order);
+        return 0;
+    }
+
+    // candidate centers in order of first use, with the triangles using them
+    size_t num_centers = 0;
+    for (size_t t = 0; t < num_tris; t++) {
+        for (int i = 0; i < 3; i++) {
+            int32_t vi = model->tris.data[t].v[i].vertex;
+            if (counts[vi]++ == 0) {
+                centers[num_centers++] = vi;
+            }
+        }
+    }
+    starts[0] = 0;
+    for (size_t v = 0; v < num_verts; v++) {
+        starts[v + 1] = starts[v] + counts[v];
+        counts[v] = 0;
+    }
+    for (size_t t = 0; t < num_tris; t++) {
+        for (int i = 0; i < 3; i++) {
+            int32_t vi = model->tris.data[t].v[i].vertex;
+            tri_lists[starts[vi] + counts[vi]++] = t;
+        }
+    }
+
+    int success = 1;
+    for (size_t c = 0; success && c < num_centers; c++) {
+        int32_t center = centers[c];
+        if (counts[center] <= min_tris) {
+            continue;
+        }
+        printf("Fan at vertex %ld has %lu triangles\n", (long)center,
+               (unsigned long)counts[center]);
+
+        size_t num_pairs = 0;
+        for (uint32_t l = starts[center]; l < starts[center + 1]; l++) {
+            uint32_t t = tri_lists[l];
+            if (consumed[t]) {
+                continue;  // already part of an earlier fan
+            }
+            const tri_idx_t* tri = &model->tris.data[t];
+            int32_t rim[2];
+            int n = 0, removed = 0;
+            for (int i = 0; i < 3; i++) {
+                if (!removed && tri->v[i].vertex == center) {
+                    removed = 1;
+                } else if (n < 2) {
+                    rim[n++] = tri->v[i].vertex;
+                }
+            }
+            pairs[num_pairs] = (fan_pair_t){rim[0], rim[1], t, num_pairs, 0};
+            num_pairs++;
+        }
+        if (num_pairs == 0) {
+            continue;
+        }
+        // sort by key and keep the last entry for every key
+        qsort(pairs, num_pairs, sizeof(fan_pair_t), compare_pairs);
+        size_t unique = 0;
+        for (size_t p = 0; p < num_pairs; p++) {
+            if (p + 1 < num_pairs && pairs[p + 1].key == pairs[p].key) {
+                continue;
+            }
+            pairs[unique++] = pairs[p];
+        }
+        num_pairs = unique;
+
+        // the lowest keyed pair starts the fan but stays in the set, so a
+        // closed fan ends on a repeat of its first triangle
+        size_t order_len = 0;
+        order[order_len++] = 0;
+        size_t remaining = num_pairs;
+        while (remaining > 0) {
+            fan_pair_t* nxt = find_pair(pairs, num_pairs,
+                                        pairs[order[order_len - 1]].next);
+            if (nxt == NULL || nxt->popped) {
+                break;
+            }
+            nxt->popped = 1;
+            remaining--;
+            order[order_len++] = nxt - pairs;
+        }
+        if (pairs[order[0]].tri == pairs[order[order_len - 1]].tri) {
+            order_len--;
+        }
+        if (order_len == 0) {
+            continue;
+        }
+
+        fan_t* fan = ARRAY_PUSH(model->fans);
+        vert_idx_t* blades = malloc(order_len * sizeof(vert_idx_t));
+        if (!fan || !blades) {
+            free(blades);
+            success = 0;
+            break;
+        }
+        fan->center = corner_of(&model->tris.data[pairs[order[0]].tri], center);
+        fan->blades = blades;
+        fan->num_blades = order_len;
+        for (size_t o = 0; o < order_len; o++) {
+            const fan_pair_t* pair = &pairs[order[o]];
+            blades[o] = corner_of(&model->tris.data[pair->tri], pair->next);
+            consumed[pair->tri] = 1;
+        }
+        if (verbose) {
+            printf("  Fan: ");
+            for (size_t o = 0; o < order_len; o++) {
+                printf("%ld->", (long)blades[o].vertex);
+            }
+            printf("\n");
+        }
+    }
+
+    if (success) {
+        size_t kept = 0;
+        for (size_t t = 0; t < num_tris; t++) {
+            if (!consumed[t]) {
+                model->tris.data[kept++] = model->tris.data[t];
+            }
+        }
+        model->tris.len = kept;
+    }
+    free(counts), free(starts), free(tri_lists), free(centers);
+    free(consumed), free(pairs), free(order);
+    return success;
+}
+
+/**
+ * @brief Cut a ring of quads off a fan, the blades move towards the center by
+ * cut_length_from_center of their distance to it
+ */
+static int fan_shed_quads(model_t* model, size_t fan_idx,
+                          double cut_length_from_center) {
+    fan_t* fan = &model->fans.data[fan_idx];
+    size_t n = fan->num_blades;
+    size_t first_new = model->vertices.len;
+    if (!ARRAY_RESERVE(model->vertices, first_new + n) ||
+        !ARRAY_RESERVE(model->quads, model->quads.len + n)) {
+        return 0;
+    }
+    vec3d_t center_coord = model->vertices.data[fan->center.vertex];
+    quad_idx_t* new_quads = model->quads.data + model->quads.len;
+    for (size_t i = 0; i < n; i++) {
+        vert_idx_t vi = fan->blades[i];
+        vec3d_t vert_coord = model->vertices.data[vi.vertex];
+        model->vertices.data[first_new + i] =
+            vec_plus(center_coord, vec_scaled(vec_minus(vert_coord,
+                                                        center_coord),
+                                              cut_length_from_center));
+        new_quads[i].v[2] = vi;
+        new_quads[i].v[3] =
+            (vert_idx_t){(int32_t)(first_new + i), vi.normal, vi.texcoord};
+        new_quads[i].flags = 0;
+        fan->blades[i] = new_quads[i].v[3];
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t prev = (i + n - 1 % n) % n;  // wraps around
+        new_quads[i].v[0] = new_quads[prev].v[3];
+        new_quads[i].v[1] = new_quads[prev].v[2];
+    }
+    model->vertices.len += n;
+    model->quads.len += n;
+    return 1;
+}
+
+/**
+ * @brief Replace a fan with triangles spanning its blades, halving the rim
+ * until fewer than four blades remain. The fan center is not used.
+ */
+static int fan2triangles(model_t* model, size_t fan_idx) {
+    fan_t fan = model->fans.data[fan_idx];
+    memmove(&model->fans.data[fan_idx], &model->fans.data[fan_idx + 1],
+            (model->fans.len - fan_idx - 1) * sizeof(fan_t));
+    model->fans.len--;
+
+    vert_idx_t* rim = fan.blades;
+    size_t len = fan.num_blades;
+    int success = 1;
+    while (success && len >= 4) {
+        if (len % 2 != 0) {
+            tri_idx_t* tri = ARRAY_PUSH(model->tris);
+            if (!tri) {
+                success = 0;
+                break;
+            }
+            *tri = (tri_idx_t){{rim[0], rim[1], rim[2]}};
+            memmove(&rim[1], &rim[2], (len - 2) * sizeof(vert_idx_t));
+            len--;
+        }
+        // in place, every write is at or before the blades still to be read
+        size_t next_len = 0;
+        for (size_t f = 0; f < len; f += 2) {
+            tri_idx_t* tri = ARRAY_PUSH(model->tris);
+            if (!tri) {
+                success = 0;
+                break;
+            }
+            *tri = (tri_idx_t){
+                {rim[f], rim[(f + 1) % len], rim[(f + 2) % len]}};
+            rim[next_len++] = rim[f];
+        }
+        len = next_len;
+    }
+    free(fan.blades);
+    return success;
+}
+
+/* ---- quad classification ------------------------------------------------ */
+
+#define QUAD_FLAG_SPLIT 0x1u     // SHZ_MDL_QUAD_SPLIT in shz_mdl.h
+#define QUAD_FLAG_NUDGE 0x100u   // shzmdl only, not written to the file
+#define QUAD_FILE_FLAGS QUAD_FLAG_SPLIT
+
+typedef enum {
+    QUAD_SPRITE,  // close enough to a parallelogram
+    QUAD_NUDGE,   // made a parallelogram by moving its corners
+    QUAD_SPLIT,   // drawn as a strip
+} quad_class_e;
+
+typedef struct {
+    double sprite_tolerance;  // negative if quads are not classified
+    double nudge_tolerance;   // 0 to never nudge
+} quad_options_t;
+
+/**
+ * @brief How far a quad is from the parallelogram a sprite draws, whose last
+ * corner the PVR derives as a + c - b. The distance is relative to the longer
+ * diagonal, so it does not change with scale, rotation or distance, and as
+ * affine maps keep parallelograms, only perspective adds to it on screen.
+ */
+static inline double parallelogram_error(vec3d_t a, vec3d_t b, vec3d_t c,
+                                         vec3d_t d) {
+    double diagonal_ac = vec_length(vec_minus(c, a));
+    double diagonal_bd = vec_length(vec_minus(d, b));
+    double size = diagonal_ac > diagonal_bd ? diagonal_ac : diagonal_bd;
+    if (size == 0.0) {
+        return 0.0;
+    }
+    return vec_length(vec_minus(vec_minus(vec_plus(a, c), b), d)) / size;
+}
+
+static inline quad_class_e classify_quad(const quad_options_t* opts,
+                                         vec3d_t a, vec3d_t b, vec3d_t c,
+                                         vec3d_t d) {
+    if (opts->sprite_tolerance < 0.0) {
+        return QUAD_SPRITE;
+    }
+    double err = parallelogram_error(a, b, c, d);
+    if (err <= opts->sprite_tolerance) {
+        return QUAD_SPRITE;
+    }
+    return err <= opts->nudge_tolerance ? QUAD_NUDGE : QUAD_SPLIT;
+}
+
+static inline quad_class_e classify_model_quad(const model_t* model,
+                                               const quad_options_t* opts,
+                                               const quad_idx_t* quad) {
+    const vec3d_t* verts = model->vertices.data;
+    return classify_quad(opts, verts[quad->v[0].vertex],
+                         verts[quad->v[1].vertex], verts[quad->v[2].vertex],
+                         verts[quad->v[3].vertex]);
+}
+
+/**
+ * @brief Corners of a quad, moved into a parallelogram for QUAD_FLAG_NUDGE.
+ * Every corner moves by a quarter of the error instead of the PVR moving d by
+ * all of it, so the seams to the neighbouring faces stay a quarter as wide.
+ * Only the shzmdl copy of the face is moved, STL and OBJ keep the mesh.
+ */
+static inline void nudge_quad(const model_t* model, const quad_idx_t* quad,
+                              vec3d_t corners[4]) {
+    for (int i = 0; i < 4; i++) {
+        corners[i] = model->vertices.data[quad->v[i].vertex];
+    }
+    if (!(quad->flags & QUAD_FLAG_NUDGE)) {
+        return;
+    }
+    vec3d_t quarter = vec_scaled(
+        vec_minus(vec_minus(vec_plus(corners[0], corners[2]), corners[1]),
+                  corners[3]),
+        0.25);
+    corners[0] = vec_minus(corners[0], quarter);
+    corners[1] = vec_plus(corners[1], quarter);
+    corners[2] = vec_minus(corners[2], quarter);
+    corners[3] = vec_plus(corners[3], quarter);
+}
+
+typedef struct {
+    const model_t* model;
+    const quad_options_t* opts;
+    uint8_t* classes;
+} classify_ctx_t;
+
+static void classify_range(void* ctx, size_t begin, size_t end) {
+    classify_ctx_t* cls = ctx;
+    for (size_t q = begin; q < end; q++) {
+        cls->classes[q] = classify_model_quad(cls->model, cls->opts,
+                                              &cls->model->quads.data[q]);
+    }
+}
+
+/**
+ * @brief Tag every quad that is not close to a parallelogram with
+ * QUAD_FLAG_SPLIT and move them in front of the sprites, so they follow the
+ * triangles without another polygon header. Near misses within the nudge
+ * tolerance are tagged QUAD_FLAG_NUDGE, see nudge_quad().
+ * @return int 1 on success, 0 on failure
+ */
+static int classify_quads(model_t* model, const quad_options_t* opts) {
+    size_t num_quads = model->quads.len;
+    uint8_t* classes = malloc(num_quads + 1);
+    quad_idx_t* sorted = malloc((num_quads + 1) * sizeof(quad_idx_t));
+    if (!classes || !sorted) {
+        printf("Error allocating memory for quad classification\n");
+        free(classes);
+        free(sorted);
+        return 0;
+    }
+    classify_ctx_t cls = {model, opts, classes};
+    parallel_for(num_quads, classify_range, &cls);
+
+    size_t count[3] = {0};
+    for (size_t q = 0; q < num_quads; q++) {
+        count[classes[q]]++;
+    }
+    size_t next_split = 0;
+    size_t next_sprite = count[QUAD_SPLIT];
+    for (size_t q = 0; q < num_quads; q++) {
+        quad_idx_t quad = model->quads.data[q];
+        if (classes[q] == QUAD_SPLIT) {
+            quad.flags = QUAD_FLAG_SPLIT;
+            sorted[next_split++] = quad;
+        } else {
+            quad.flags = classes[q] == QUAD_NUDGE ? QUAD_FLAG_NUDGE : 0;
+            sorted[next_sprite++] = quad;
+        }
+    }
+    memcpy(model->quads.data, sorted, num_quads * sizeof(quad_idx_t));
+    model->quads_classified = 1;
+    printf("Quads: %zu sprites, %zu nudged into sprites, %zu split\n",
+           count[QUAD_SPRITE], count[QUAD_NUDGE], count[QUAD_SPLIT]);
+    free(classes);
+    free(sorted);
+    return 1;
+}
+
+/* ---- cost model --------------------------------------------------------- */
+
+/*
+ * Candidate encodings for a fan, the first three are the runtime encodings of
+ * render_fan() in render_kernels.h, the last is done here with fan_shed_quads
+ * and fan2triangles and ends up as sprites and triangles in the model.
+ */
+typedef enum {
+    ENC_FANSTRIPS,
+    ENC_FAN2TRIS,
+    ENC_FAN2QUADS,
+    ENC_SHED_QUADS,
+    NUM_ENCODINGS,
+} encoding_e;
+
+static const char* encoding_names[NUM_ENCODINGS] = {
+    "FANSTRIPS", "FAN2TRIS", "FAN2QUADS", "SHED_QUADS"};
+
+/* what a primitive costs every frame, counted from the render kernels */
+typedef struct {
+    uint64_t ta_bytes;    // including headers
+    uint64_t headers;     // polygon and sprite headers
+    uint64_t transforms;  // project_vert() calls
+    uint64_t shades;      // shade_argb() calls
+} prim_cost_t;
+
+#define TA_CMD_SIZE 32
+#define TRI_COST ((prim_cost_t){3 * TA_CMD_SIZE, 0, 3, 1})
+#define QUAD_SPRITE_COST ((prim_cost_t){3 * TA_CMD_SIZE, 1, 4, 1})
+#define QUAD_STRIP_COST ((prim_cost_t){4 * TA_CMD_SIZE, 0, 4, 1})
+
+/**
+ * Nanoseconds per unit of work, calibrated from bench_kernels output. Without
+ * calibration every TA byte costs 1 and the rest is free, so encodings are
+ * ranked by TA bytes alone.
+ */
+typedef struct {
+    double ns_per_ta_byte;
+    double ns_per_transform;
+    double ns_per_shade;
+    int calibrated;
+} cost_model_t;
+
+typedef struct {
+    prim_cost_t cost[NUM_ENCODINGS];
+    int valid[NUM_ENCODINGS];
+    double flatness;        // center distance from the rim plane / radius
+    double parallelogram;   // worst FAN2QUADS sprite corner error / radius
+} fan_candidates_t;
+
+static inline void cost_add(prim_cost_t* sum, prim_cost_t cost, uint64_t n) {
+    sum->ta_bytes += cost.ta_bytes * n;
+    sum->headers += cost.headers * n;
+    sum->transforms += cost.transforms * n;
+    sum->shades += cost.shades * n;
+}
+
+static inline double cost_ns(const cost_model_t* cm, prim_cost_t cost) {
+    return cost.ta_bytes * cm->ns_per_ta_byte +
+           cost.transforms * cm->ns_per_transform +
+           cost.shades * cm->ns_per_shade;
+}
+
+/**
+ * @brief Read the ns/unit column of a bench_kernels run, the TA byte cost is
+ * what the triangles case spends beyond its shading and transforms
+ * @return int 1 on success, 0 if a required kernel is missing
+ */
+static int load_cost_model(cost_model_t* cm, const char* filepath) {
+    FILE* file = fopen(filepath, "r");
+    if (!file) {
+        printf("Error opening %s: %s\n", filepath, strerror(errno));
+        return 0;
+    }
+    double transform = -1.0, shade = -1.0, triangle = -1.0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char name[64];
+        double ns;
+        if (sscanf(line, "%63s %*u %*s %lf ns", name, &ns) != 2) {
+            continue;
+        }
+        if (strcmp(name, "perspective_n_swizzle") == 0) {
+            transform = ns;
+        } else if (strcmp(name, "shade_argb") == 0) {
+            shade = ns;
+        } else if (strcmp(name, "triangles") == 0) {
+            triangle = ns;
+        }
+    }
+    fclose(file);
+    if (transform < 0.0 || shade < 0.0 || triangle < 0.0) {
+        printf("Error: %s needs the perspective_n_swizzle, shade_argb and "
+               "triangles rows of bench_kernels\n",
+               filepath);
+        return 0;
+    }
+    double ta = triangle - shade - 3.0 * transform;
+    cm->ns_per_ta_byte = ta > 0.0 ? ta / TRI_COST.ta_bytes : 0.0;
+    cm->ns_per_transform = transform;
+    cm->ns_per_shade = shade;
+    cm->calibrated = 1;
+    return 1;
+}
+
+static size_t fan2triangles_count(size_t len) {
+    size_t tris = 0;
+    while (len >= 4) {
+        if (len % 2 != 0) {
+            tris++;
+            len--;
+        }
+        tris += len / 2;
+        len /= 2;
+    }
+    return tris;
+}
+
+/**
+ * @brief Count what every encoding of a fan costs per frame and check the
+ * lossy ones against the tolerance, relative to the mean blade length
+ */
+static void fan_candidates(const model_t* model, const fan_t* fan, double cut,
+                           double tolerance, const quad_options_t* quad_opts,
+                           fan_candidates_t* out) {
+    uint64_t n = fan->num_blades;
+    uint64_t sprites = (n + 1) / 2;
+    const vec3d_t* verts = model->vertices.data;
+    vec3d_t center = verts[fan->center.vertex];
+
+    // Newell normal and centroid of the rim
+    vec3d_t normal = {0.0, 0.0, 0.0};
+    vec3d_t centroid = {0.0, 0.0, 0.0};
+    double radius = 0.0;
+    for (size_t b = 0; b < n; b++) {
+        vec3d_t cur = verts[fan->blades[b].vertex];
+        vec3d_t nxt = verts[fan->blades[(b + 1) % n].vertex];
+        normal.x += (cur.y - nxt.y) * (cur.z + nxt.z);
+        normal.y += (cur.z - nxt.z) * (cur.x + nxt.x);
+        normal.z += (cur.x - nxt.x) * (cur.y + nxt.y);
+        centroid = vec_plus(centroid, cur);
+        radius += vec_length(vec_minus(cur, center));
+    }
+    centroid = vec_scaled(centroid, 1.0 / n);
+    radius = radius / n > 0.0 ? radius / n : 1.0;
+    double normal_len = vec_length(normal);
+    out->flatness =
+        normal_len > 0.0
+            ? fabs(vec_dot(vec_minus(center, centroid), normal)) / normal_len /
+                  radius
+            : 1.0;
+
+    // sprites derive their last corner as a + c - b
+    out->parallelogram = 0.0;
+    for (size_t f = 0; f + 1 < n; f += 2) {
+        vec3d_t b = verts[fan->blades[(f + n - 1) % n].vertex];
+        vec3d_t c = verts[fan->blades[f].vertex];
+        vec3d_t d = verts[fan->blades[f + 1].vertex];
+        double err =
+            vec_length(vec_minus(vec_minus(vec_plus(center, c), b), d)) / radius;
+        if (err > out->parallelogram) {
+            out->parallelogram = err;
+        }
+    }
+
+    out->cost[ENC_FANSTRIPS] =
+        (prim_cost_t){(2 * n + 3) * TA_CMD_SIZE, 0, n + 3, n + 1};
+    out->valid[ENC_FANSTRIPS] = 1;
+    out->cost[ENC_FAN2TRIS] = (prim_cost_t){n * 3 * TA_CMD_SIZE, 0, n + 2, n};
+    out->valid[ENC_FAN2TRIS] = 1;
+    // plus the polygon header resubmitted after the fan
+    out->cost[ENC_FAN2QUADS] =
+        (prim_cost_t){sprites * 3 * TA_CMD_SIZE + TA_CMD_SIZE, sprites + 1,
+                      2 + 2 * sprites, sprites};
+    out->valid[ENC_FAN2QUADS] =
+        n % 2 == 0 && out->parallelogram <= tolerance;
+    // the center is dropped, the inner rim moves by cut times its distance
+    // and the ring of quads is trapezoids, likely split when classified
+    prim_cost_t shed = {0};
+    for (size_t b = 0; b < n; b++) {
+        vec3d_t prev = verts[fan->blades[(b + n - 1) % n].vertex];
+        vec3d_t cur = verts[fan->blades[b].vertex];
+        vec3d_t prev_inner =
+            vec_plus(center, vec_scaled(vec_minus(prev, center), cut));
+        vec3d_t cur_inner =
+            vec_plus(center, vec_scaled(vec_minus(cur, center), cut));
+        cost_add(&shed,
+                 classify_quad(quad_opts, prev_inner, prev, cur, cur_inner) ==
+                         QUAD_SPLIT
+                     ? QUAD_STRIP_COST
+                     : QUAD_SPRITE_COST,
+                 1);
+    }
+    cost_add(&shed, TRI_COST, fan2triangles_count(n));
+    out->cost[ENC_SHED_QUADS] = shed;
+    out->valid[ENC_SHED_QUADS] = cut * out->flatness <= tolerance;
+}
+
+static inline double cost_scalar(const cost_model_t* cm, prim_cost_t cost) {
+    return cm->calibrated ? cost_ns(cm, cost) : (double)cost.ta_bytes;
+}
+
+typedef struct {
+    encoding_e runtime;        // FAN_ENCODING for the fans that are kept
+    encoding_e* per_fan;       // runtime or ENC_SHED_QUADS
+    fan_candidates_t* candidates;
+    size_t split_quads;        // of the model's quads, before the plan
+    prim_cost_t total;
+} encoding_plan_t;
+
+/**
+ * @brief Pick the runtime fan encoding and the fans to shed that together cost
+ * the least. The runtime encoding is a single FAN_ENCODING for the whole part,
+ * so a fan can either use it or be converted at build time.
+ * @return int 1 on success, 0 on failure
+ */
+static int plan_encodings(const model_t* model, const cost_model_t* cm,
+                          double cut, double tolerance,
+                          const quad_options_t* quad_opts,
+                          encoding_plan_t* plan) {
+    size_t num_fans = model->fans.len;
+    plan->candidates = calloc(num_fans + 1, sizeof(fan_candidates_t));
+    plan->per_fan = calloc(num_fans + 1, sizeof(encoding_e));
+    if (!plan->candidates || !plan->per_fan) {
+        printf("Error allocating memory for the encoding plan\n");
+        return 0;
+    }
+    for (size_t f = 0; f < num_fans; f++) {
+        fan_candidates(model, &model->fans.data[f], cut, tolerance, quad_opts,
+                       &plan->candidates[f]);
+    }
+
+    double best = INFINITY;
+    plan->runtime = ENC_FANSTRIPS;
+    for (encoding_e runtime = ENC_FANSTRIPS; runtime < ENC_SHED_QUADS;
+         runtime++) {
+        double total = 0.0;
+        for (size_t f = 0; f < num_fans && isfinite(total); f++) {
+            const fan_candidates_t* c = &plan->candidates[f];
+            double keep = c->valid[runtime]
+                              ? cost_scalar(cm, c->cost[runtime])
+                              : INFINITY;
+            double shed = c->valid[ENC_SHED_QUADS]
+                              ? cost_scalar(cm, c->cost[ENC_SHED_QUADS])
+                              : INFINITY;
+            total += keep < shed ? keep : shed;
+        }
+        if (total < best) {
+            best = total;
+            plan->runtime = runtime;
+        }
+    }
+
+    plan->split_quads = 0;
+    for (size_t q = 0; q < model->quads.len; q++) {
+        plan->split_quads += classify_model_quad(model, quad_opts,
+                                                 &model->quads.data[q]) ==
+                             QUAD_SPLIT;
+    }
+    memset(&plan->total, 0, sizeof(prim_cost_t));
+    cost_add(&plan->total, TRI_COST, model->tris.len);
+    cost_add(&plan->total, QUAD_SPRITE_COST,
+             model->quads.len - plan->split_quads);
+    cost_add(&plan->total, QUAD_STRIP_COST, plan->split_quads);
+    for (size_t f = 0; f < num_fans; f++) {
+        const fan_candidates_t* c = &plan->candidates[f];
+        int keep = c->valid[plan->runtime] &&
+                   (!c->valid[ENC_SHED_QUADS] ||
+                    cost_scalar(cm, c->cost[plan->runtime]) <=
+                        cost_scalar(cm, c->cost[ENC_SHED_QUADS]));
+        plan->per_fan[f] = keep ? plan->runtime : ENC_SHED_QUADS;
+        cost_add(&plan->total, c->cost[plan->per_fan[f]], 1);
+    }
+    return 1;
+}
+
+static void plan_free(encoding_plan_t* plan) {
+    free(plan->candidates);
+    free(plan->per_fan);
+    plan->candidates = NULL;
+    plan->per_fan = NULL;
+}
+
+static void print_cost(const cost_model_t* cm, prim_cost_t cost) {
+    printf("%8llu B %5llu hdr %6llu xf %6llu shade",
+           (unsigned long long)cost.ta_bytes, (unsigned long long)cost.headers,
+           (unsigned long long)cost.transforms,
+           (unsigned long long)cost.shades);
+    if (cm->calibrated) {
+        printf(" %9.1f us", cost_ns(cm, cost) / 1000.0);
+    }
+}
+
+static void print_plan(const model_t* model, const cost_model_t* cm,
+                       const encoding_plan_t* plan) {
+    printf("Cost model: %s\n",
+           cm->calibrated ? "calibrated" : "uncalibrated, ranked by TA bytes");
+    if (cm->calibrated) {
+        printf("  %.3f ns/TA byte, %.1f ns/transform, %.1f ns/shade\n",
+               cm->ns_per_ta_byte, cm->ns_per_transform, cm->ns_per_shade);
+    }
+    for (size_t f = 0; f < model->fans.len; f++) {
+        const fan_candidates_t* c = &plan->candidates[f];
+        printf("Fan %zu, center %ld, %zu blades, flatness %.4f, "
+               "parallelogram error %.4f\n",
+               f, (long)model->fans.data[f].center.vertex,
+               model->fans.data[f].num_blades, c->flatness, c->parallelogram);
+        for (encoding_e e = 0; e < NUM_ENCODINGS; e++) {
+            printf("  %c %-10s ", plan->per_fan[f] == e ? '*' : ' ',
+                   encoding_names[e]);
+            print_cost(cm, c->cost[e]);
+            printf("%s\n", c->valid[e] ? "" : "  (over tolerance)");
+        }
+    }
+    prim_cost_t tris = {0}, sprites = {0}, strips = {0};
+    cost_add(&tris, TRI_COST, model->tris.len);
+    cost_add(&sprites, QUAD_SPRITE_COST, model->quads.len - plan->split_quads);
+    cost_add(&strips, QUAD_STRIP_COST, plan->split_quads);
+    printf("Triangles  %6zu ", model->tris.len);
+    print_cost(cm, tris);
+    printf("\nSprites    %6zu ", model->quads.len - plan->split_quads);
+    print_cost(cm, sprites);
+    printf("\nSplit quads%6zu ", plan->split_quads);
+    print_cost(cm, strips);
+    printf("\nPer frame         ");
+    print_cost(cm, plan->total);
+    printf("\n");
+    if (model->fans.len > 0) {
+        printf("Build the part with #define FAN_ENCODING %s\n",
+               encoding_names[plan->runtime]);
+    }
+}
+
+/**
+ * @brief Apply a plan, shedding quads off every fan that is not kept and
+ * converting it to triangles. Fans are shed in order and converted from the
+ * last to the first, so every index stays valid.
+ * @return int 1 on success, 0 on failure
+ */
+static int apply_plan(model_t* model, const encoding_plan_t* plan,
+                      double cut) {
+    size_t num_fans = model->fans.len;
+    for (size_t f = 0; f < num_fans; f++) {
+        if (plan->per_fan[f] == ENC_SHED_QUADS &&
+            !fan_shed_quads(model, f, cut)) {
+            return 0;
+        }
+    }
+    for (size_t f = num_fans; f-- > 0;) {
+        if (plan->per_fan[f] == ENC_SHED_QUADS && !fan2triangles(model, f)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* ---- STL ---------------------------------------------------------------- */
+
+typedef struct {
+    const model_t* model;
+    uint8_t* tri_records;
+    uint8_t* quad_records;
+} stl_ctx_t;
+
+static inline uint8_t* put_stl_tri(uint8_t* dst, const model_t* model,
+                                   vec3d_t normal, vert_idx_t a, vert_idx_t b,
+                                   vert_idx_t c) {
+    dst = put_vec3(dst, normal);
+    dst = put_vec3(dst, model->vertices.data[a.vertex]);
+    dst = put_vec3(dst, model->vertices.data[b.vertex]);
+    dst = put_vec3(dst, model->vertices.data[c.vertex]);
+    dst[0] = dst[1] = 0;  // attribute byte count
+    return dst + 2;
+}
+
+static void stl_tris(void* ctx, size_t begin, size_t end) {
+    stl_ctx_t* stl = ctx;
+    uint8_t* dst = stl->tri_records + begin * STL_RECORD_SIZE;
+    for (size_t t = begin; t < end; t++) {
+        const tri_idx_t* tri = &stl->model->tris.data[t];
+        vec3d_t normal =
+            face_normal(stl->model, tri->v[0], tri->v[1], tri->v[2]);
+        dst = put_stl_tri(dst, stl->model, normal, tri->v[0], tri->v[1],
+                          tri->v[2]);
+    }
+}
+
+static void stl_quads(void* ctx, size_t begin, size_t end) {
+    stl_ctx_t* stl = ctx;
+    uint8_t* dst = stl->quad_records + begin * 2 * STL_RECORD_SIZE;
+    for (size_t q = begin; q < end; q++) {
+        const quad_idx_t* quad = &stl->model->quads.data[q];
+        vec3d_t normal = quad_normal(stl->model, quad);
+        dst = put_stl_tri(dst, stl->model, normal, quad->v[0], quad->v[1],
+                          quad->v[2]);
+        dst = put_stl_tri(dst, stl->model, normal, quad->v[0], quad->v[2],
+                          quad->v[3]);
+    }
+}
+
+static int write_stl(const model_t* model, const char* filepath) {
+    size_t num_triangles = model->tris.len + model->quads.len * 2;
+    for (size_t f = 0; f < model->fans.len; f++) {
+        num_triangles += model->fans.data[f].num_blades + 1;
+    }
+    size_t size = STL_HEADER_SIZE + num_triangles * STL_RECORD_SIZE;
+    uint8_t* data = calloc(size, 1);
+    if (!data) {
+        printf("Error allocating %zu bytes for %s\n", size, filepath);
+        return 0;
+    }
+    put_u32(data + 80, num_triangles);
+
+    stl_ctx_t stl = {model, data + STL_HEADER_SIZE, NULL};
+    parallel_for(model->tris.len, stl_tris, &stl);
+
+    // fans are closed by repeating the first blade
+    uint8_t* dst = stl.tri_records + model->tris.len * STL_RECORD_SIZE;
+    for (size_t f = 0; f < model->fans.len; f++) {
+        const fan_t* fan = &model->fans.data[f];
+        vert_idx_t prev_v = fan->blades[fan->num_blades - 1];
+        for (size_t i = 0; i < fan->num_blades + 1; i++) {
+            vert_idx_t next_v = fan->blades[i % fan->num_blades];
+            vec3d_t normal = face_normal(model, fan->center, prev_v, next_v);
+            dst = put_stl_tri(dst, model, normal, fan->center, prev_v, next_v);
+            prev_v = next_v;
+        }
+    }
+    stl.quad_records = dst;
+    parallel_for(model->quads.len, stl_quads, &stl);
+
+    int success = write_file(filepath, data, size);
+    free(data);
+    return success;
+}
+
+/* ---- shzmdl ------------------------------------------------------------- */
+
+typedef struct {
+    const model_t* model;
+    uint8_t* tri_records;
+    uint8_t* quad_records;
+    int soa;
+} shzmdl_ctx_t;
+
+/** Streams of the SoA layout start on 32 byte boundaries */
+static inline size_t stream_size(size_t bytes) { return (bytes + 31) & ~(size_t)31; }
+
+static size_t shzmdl_tri_block_size(size_t num_tris, int soa) {
+    if (!soa) {
+        return num_tris * SHZMDL_TRI_SIZE;
+    }
+    return stream_size(num_tris * 3 * SHZMDL_VEC3_SIZE) +
+           stream_size(num_tris * SHZMDL_VEC3_SIZE);
+}
+
+static size_t shzmdl_quad_block_size(size_t num_quads, int soa) {
+    if (!soa) {
+        return num_quads * SHZMDL_QUAD_SIZE;
+    }
+    return stream_size(num_quads * 4 * SHZMDL_VEC3_SIZE) +
+           stream_size(num_quads * SHZMDL_VEC3_SIZE) +
+           stream_size(num_quads * 4);
+}
+
+static void shzmdl_tris_soa(const shzmdl_ctx_t* mdl, size_t begin, size_t end) {
+    size_t num_tris = mdl->model->tris.len;
+    uint8_t* positions = mdl->tri_records + begin * 3 * SHZMDL_VEC3_SIZE;
+    uint8_t* normals = mdl->tri_records +
+                       stream_size(num_tris * 3 * SHZMDL_VEC3_SIZE) +
+                       begin * SHZMDL_VEC3_SIZE;
+    for (size_t t = begin; t < end; t++) {
+        const tri_idx_t* tri = &mdl->model->tris.data[t];
+        normals = put_vec3(normals, face_normal(mdl->model, tri->v[0],
+                                                tri->v[1], tri->v[2]));
+        for (int i = 0; i < 3; i++) {
+            positions =
+                put_vec3(positions, mdl->model->vertices.data[tri->v[i].vertex]);
+        }
+    }
+}
+
+static void shzmdl_quads_soa(const shzmdl_ctx_t* mdl, size_t begin,
+                             size_t end) {
+    size_t num_quads = mdl->model->quads.len;
+    size_t positions_size = stream_size(num_quads * 4 * SHZMDL_VEC3_SIZE);
+    size_t normals_size = stream_size(num_quads * SHZMDL_VEC3_SIZE);
+    uint8_t* positions = mdl->quad_records + begin * 4 * SHZMDL_VEC3_SIZE;
+    uint8_t* normals =
+        mdl->quad_records + positions_size + begin * SHZMDL_VEC3_SIZE;
+    uint8_t* flags =
+        mdl->quad_records + positions_size + normals_size + begin * 4;
+    for (size_t q = begin; q < end; q++) {
+        const quad_idx_t* quad = &mdl->model->quads.data[q];
+        vec3d_t corners[4];
+        nudge_quad(mdl->model, quad, corners);
+        normals = put_vec3(normals, quad_normal(mdl->model, quad));
+        for (int i = 0; i < 4; i++) {
+            positions = put_vec3(positions, corners[i]);
+        }
+        flags = put_u32(flags, quad->flags & QUAD_FILE_FLAGS);
+    }
+}
+
+static void shzmdl_tris(void* ctx, size_t begin, size_t end) {
+    shzmdl_ctx_t* mdl = ctx;
+    if (mdl->soa) {
+        shzmdl_tris_soa(mdl, begin, end);
+        return;
+    }
+    uint8_t* dst = mdl->tri_records + begin * SHZMDL_TRI_SIZE;
+    for (size_t t = begin; t < end; t++) {
+        const tri_idx_t* tri = &mdl->model->tris.data[t];
+        dst = put_vec3(dst,
+                       face_normal(mdl->model, tri->v[0], tri->v[1], tri->v[2]));
+        for (int i = 0; i < 3; i++) {
+            dst = put_vec3(dst, mdl->model->vertices.data[tri->v[i].vertex]);
+        }
+    }
+}
+
+static void shzmdl_quads(void* ctx, size_t begin, size_t end) {
+    shzmdl_ctx_t* mdl = ctx;
+    if (mdl->soa) {
+        shzmdl_quads_soa(mdl, begin, end);
+        return;
+    }
+    uint8_t* dst = mdl->quad_records + begin * SHZMDL_QUAD_SIZE;
+    for (size_t q = begin; q < end; q++) {
+        const quad_idx_t* quad = &mdl->model->quads.data[q];
+        vec3d_t corners[4];
+        nudge_quad(mdl->model, quad, corners);
+        dst = put_vec3(dst, quad_normal(mdl->model, quad));
+        for (int i = 0; i < 4; i++) {
+            dst = put_vec3(dst, corners[i]);
+        }
+        // pads the quad to 64 bytes
+        dst = put_u32(dst, quad->flags & QUAD_FILE_FLAGS);
+    }
+}
+
+static inline size_t max_size(size_t a, size_t b) { return a > b ? a : b; }
+
+/**
+ * @brief Write the model as shzmdl, with soa the faces are stored as separate
+ * position, normal and flag streams and SHZMDL_FLAG_SOA is set
+ * @return int 1 on success, 0 on failure
+ */
+static int write_shzmdl(const model_t* model, const char* filepath, int soa) {
+    size_t num_tris = model->tris.len;
+    size_t num_quads = model->quads.len;
+    size_t num_fans = model->fans.len;
+    size_t num_strips = 0;
+
+    // offsets are in 32 byte units from the start of the file
+    uint32_t offset_triangles = 1;  // follows right after model header
+    size_t triangle_data_size = shzmdl_tri_block_size(num_tris, soa);
+    size_t quad_data_size = shzmdl_quad_block_size(num_quads, soa);
+    uint32_t offset_quads = offset_triangles + (triangle_data_size >> 5) +
+                            (triangle_data_size % 32 > 0 ? 1 : 0);
+    uint32_t offset_fans = offset_quads + (quad_data_size >> 5);
+    size_t fan_verts = 0;
+    for (size_t f = 0; f < num_fans; f++) {
+        size_t f_verts = SHZMDL_FAN_HEADER_SIZE +
+                         model->fans.data[f].num_blades * SHZMDL_BLADE_SIZE;
+        if (f_verts % 32 != 0) {
+            f_verts += 32;
+        }
+        fan_verts += f_verts >> 5;
+    }
+    uint32_t offset_strips = offset_fans + 1 + fan_verts;
+
+    if (num_tris == 0) {
+        offset_quads = offset_triangles;
+        offset_triangles = 0;
+    }
+    if (num_quads == 0) {
+        offset_fans = offset_quads;
+        offset_quads = 0;
+    }
+    if (num_fans == 0) {
+        offset_strips = offset_fans;
+        offset_fans = 0;
+    }
+    if (num_strips == 0) {
+        offset_strips = 0;
+    }
+
+    // the file ends at the furthest write, gaps are zero filled
+    size_t size = SHZMDL_HEADER_SIZE;
+    if (num_tris > 0) {
+        size = max_size(size,
+                        ((size_t)offset_triangles << 5) + triangle_data_size);
+    }
+    if (num_quads > 0) {
+        size = max_size(size, ((size_t)offset_quads << 5) + quad_data_size);
+    }
+    size_t next_fan = offset_fans;
+    for (size_t f = 0; f < num_fans; f++) {
+        size_t fan_size = SHZMDL_FAN_HEADER_SIZE +
+                          model->fans.data[f].num_blades * SHZMDL_BLADE_SIZE;
+        size = max_size(size, (next_fan << 5) + fan_size);
+        next_fan += fan_size >> 5;
+    }
+
+    uint8_t* data = calloc(size, 1);
+    if (!data) {
+        printf("Error allocating %zu bytes for %s\n", size, filepath);
+        return 0;
+    }
+    uint8_t* dst = data;
+    *dst++ = 0;  // early version
+    *dst++ = model->quads_classified ? 2 : 1;
+    *dst++ = 0;
+    *dst++ = soa ? SHZMDL_FLAG_SOA : 0;
+    dst = put_u32(dst, offset_triangles);
+    dst = put_u32(dst, offset_quads);
+    dst = put_u32(dst, offset_fans);
+    dst = put_u32(dst, offset_strips);
+    dst = put_u32(dst, num_tris);
+    dst = put_u32(dst, num_quads);
+    *dst = 4;  // type: face normals no textures
+
+    shzmdl_ctx_t mdl = {model, data + ((size_t)offset_triangles << 5),
+                        data + ((size_t)offset_quads << 5), soa};
+    parallel_for(num_tris, shzmdl_tris, &mdl);
+    parallel_for(num_quads, shzmdl_quads, &mdl);
+
+    // fans are written in order, a header may overlap the previous fan's
+    // last blade when its size is not a multiple of 32 bytes
+    next_fan = offset_fans;
+    for (size_t f = 0; f < num_fans; f++) {
+        const fan_t* fan = &model->fans.data[f];
+        dst = data + (next_fan << 5);
+        dst = put_u32(dst, fan->num_blades);  // num vertices in fan
+        dst = put_vec3(dst, model->vertices.data[fan->center.vertex]);
+        dst = put_vec3(dst, (vec3d_t){0.0, 0.0, 0.0});  // dummy center normal
+        if (f + 1 < num_fans) {
+            next_fan += (SHZMDL_FAN_HEADER_SIZE +
+                         fan->num_blades * SHZMDL_BLADE_SIZE) >> 5;
+            dst = put_u32(dst, next_fan);
+        } else {
+            dst = put_u32(dst, 0);  // null for last fan
+        }
+        vert_idx_t prev_v = fan->blades[fan->num_blades - 1];
+        for (size_t b = 0; b < fan->num_blades; b++) {
+            vert_idx_t cur_v = fan->blades[b];
+            dst = put_vec3(dst, model->vertices.data[cur_v.vertex]);
+            dst = put_vec3(dst, face_normal(model, fan->center, prev_v, cur_v));
+            prev_v = cur_v;
+        }
+    }
+
+    int success = write_file(filepath, data, size);
+    free(data);
+    return success;
+}
+
+/* ---- OBJ writing -------------------------------------------------------- */
+
+/**
+ * @brief Format a double like python's repr(): the shortest digits that read
+ * back to the same value, in positional notation for exponents from -5 to 15
+ */
+static int format_double(char* out, double x) {
+    if (isnan(x)) {
+        return sprintf(out, "nan");
+    }
+    if (isinf(x)) {
+        return sprintf(out, x < 0 ? "-inf" : "inf");
+    }
+    char sci[40];
+    for (int prec = 0; prec <= 16; prec++) {
+        snprintf(sci, sizeof(sci), "%.*e", prec, x);
+        if (strtod(sci, NULL) == x) {
+            break;
+        }
+    }
+    const char* p = sci;
+    char* o = out;
+    if (*p == '-') {
+        *o++ = *p++;
+    }
+    char digits[24];
+    int num_digits = 0;
+    for (; *p != 'e'; p++) {
+        if (*p != '.') {
+            digits[num_digits++] = *p;
+        }
+    }
+    int exponent = atoi(p + 1);
+    while (num_digits > 1 && digits[num_digits - 1] == '0') {
+        num_digits--;
+    }
+    int decpt = exponent + 1;
+    if (decpt <= -4 || decpt > 16) {
+        *o++ = digits[0];
+        if (num_digits > 1) {
+            *o++ = '.';
+            memcpy(o, digits + 1, num_digits - 1);
+            o += num_digits - 1;
+        }
+        o += sprintf(o, "e%c%02d", exponent < 0 ? '-' : '+', abs(exponent));
+    } else if (decpt <= 0) {
+        *o++ = '0';
+        *o++ = '.';
+        for (int i = 0; i < -decpt; i++) {
+            *o++ = '0';
+        }
+        memcpy(o, digits, num_digits);
+        o += num_digits;
+    } else if (decpt < num_digits) {
+        memcpy(o, digits, decpt);
+        o += decpt;
+        *o++ = '.';
+        memcpy(o, digits + decpt, num_digits - decpt);
+        o += num_digits - decpt;
+    } else {
+        memcpy(o, digits, num_digits);
+        o += num_digits;
+        for (int i = num_digits; i < decpt; i++) {
+            *o++ = '0';
+        }
+        *o++ = '.';
+        *o++ = '0';
+    }
+    *o = '\0';
+    return o - out;
+}
+
+static inline char* format_face_vertex(char* o, vert_idx_t vi) {
+    return o + sprintf(o, " %ld/%ld/%ld", (long)vi.vertex + 1,
+                       (long)vi.texcoord + 1, (long)vi.normal + 1);
+}
+
+typedef struct {
+    const model_t* model;
+    size_t num_lines;
+    size_t num_parts;
+    char_array_t text[MAX_THREADS];  // one part of the file per thread
+    int error;
+} obj_out_ctx_t;
+
+/* lines are numbered over vertices, normals, texcoords, triangles, quads */
+static int format_obj_line(char* o, const model_t* model, size_t i) {
+    char* start = o;
+    if (i < model->vertices.len) {
+        const vec3d_t* v = &model->vertices.data[i];
+        o += sprintf(o, "v ");
+        o += format_double(o, v->x);
+        *o++ = ' ';
+        o += format_double(o, v->y);
+        *o++ = ' ';
+        o += format_double(o, v->z);
+    } else if ((i -= model->vertices.len) < model->normals.len) {
+        const vec3d_t* vn = &model->normals.data[i];
+        o += sprintf(o, "vn ");
+        o += format_double(o, vn->x);
+        *o++ = ' ';
+        o += format_double(o, vn->y);
+        *o++ = ' ';
+        o += format_double(o, vn->z);
+    } else if ((i -= model->normals.len) < model->texcoords.len) {
+        const texcoord_t* vt = &model->texcoords.data[i];
+        o += sprintf(o, "vt ");
+        o += format_double(o, vt->u);
+        *o++ = ' ';
+        o += format_double(o, vt->v);
+    } else if ((i -= model->texcoords.len) < model->tris.len) {
+        *o++ = 'f';
+        for (int c = 0; c < 3; c++) {
+            o = format_face_vertex(o, model->tris.data[i].v[c]);
+        }
+    } else {
+        i -= model->tris.len;
+        *o++ = 'f';
+        for (int c = 0; c < 4; c++) {
+            o = format_face_vertex(o, model->quads.data[i].v[c]);
+        }
+    }
+    *o++ = '\n';
+    return o - start;
+}
+
+static void obj_parts(void* ctx, size_t begin, size_t end) {
+    obj_out_ctx_t* out = ctx;
+    char line[256];
+    for (size_t p = begin; p < end; p++) {
+        char_array_t* text = &out->text[p];
+        size_t first = out->num_lines * p / out->num_parts;
+        size_t last = out->num_lines * (p + 1) / out->num_parts;
+        for (size_t l = first; l < last; l++) {
+            size_t len = format_obj_line(line, out->model, l);
+            if (!ARRAY_RESERVE(*text, text->len + len)) {
+                out->error = 1;
+                return;
+            }
+            memcpy(text->data + text->len, line, len);
+            text->len += len;
+        }
+    }
+}
+
+/* fans are not part of the OBJ output, like in the reference */
+static int write_obj(const model_t* model, const char* filepath) {
+    obj_out_ctx_t* out = calloc(1, sizeof(obj_out_ctx_t));
+    if (!out) {
+        printf("Error allocating memory for %s\n", filepath);
+        return 0;
+    }
+    out->model = model;
+    out->num_lines = model->vertices.len + model->normals.len +
+                     model->texcoords.len + model->tris.len +
+                     model->quads.len;
+    out->num_parts = num_threads;
+    parallel_for(out->num_parts, obj_parts, out);
+
+    int success = !out->error;
+    FILE* file = success ? fopen(filepath, "wb") : NULL;
+    if (success && !file) {
+        printf("Error opening %s for writing: %s\n", filepath,
+               strerror(errno));
+        success = 0;
+    }
+    for (size_t p = 0; file && success && p < out->num_parts; p++) {
+        success = fwrite(out->text[p].data, 1, out->text[p].len, file) ==
+                  out->text[p].len;
+    }
+    if (file && fclose(file) != 0) {
+        success = 0;
+    }
+    if (file && !success) {
+        printf("Error writing %s\n", filepath);
+    }
+    for (size_t p = 0; p < out->num_parts; p++) {
+        free(out->text[p].data);
+    }
+    free(out);
+    return success;
+}
+
+/* ---- command line ------------------------------------------------------- */
+
+static void usage(const char* prog) {
+    printf(
+        "Usage: %s [options] model.obj\n"
+        "Converts a triangle and quad OBJ model to shzmdl.\n"
+        "\n"
+        "  -m, --shzmdl FILE      write the model in shzmdl format\n"
+        "  -s, --stl FILE         write the model as binary STL\n"
+        "  -o, --obj FILE         write the model as OBJ, without fans\n"
+        "  -f, --fan-min N        vertices shared by more than N triangles\n"
+        "                         become fans (default %d)\n"
+        "  -n, --no-fans          skip fan detection\n"
+        "  -q, --shed-quads I:C   cut a ring of quads off fan I, moving its\n"
+        "                         blades to C times their distance from the\n"
+        "                         center\n"
+        "  -t, --fan2tris I       replace fan I with triangles\n"
+        "  -a, --auto             after the fan operations, pick the cheapest\n"
+        "                         encoding for every remaining fan and apply\n"
+        "                         it, prints the per frame cost report\n"
+        "  -r, --report           print the per frame cost report only\n"
+        "  -c, --calibrate FILE   cost model from a bench_kernels run, without\n"
+        "                         it encodings are ranked by TA bytes\n"
+        "  -k, --auto-cut C       cut used when --auto sheds quads (default %.1f)\n"
+        "  -e, --tolerance T      largest geometric error of a lossy encoding,\n"
+        "                         relative to the fan radius (default %.2f)\n"
+        "  -p, --classify-quads[=T]\n"
+        "                         tag quads further than T from a\n"
+        "                         parallelogram to be drawn as strips instead\n"
+        "                         of sprites (default %.2f, relative to the\n"
+        "                         longer diagonal)\n"
+        "  -g, --nudge-quads T    with -p, move the corners of quads up to T\n"
+        "                         from a parallelogram to make them sprites\n"
+        "  -l, --soa              store shzmdl faces as separate position,\n"
+        "                         normal and flag streams\n"
+        "  -j, --threads N        worker threads (default: online CPUs)\n"
+        "  -v, --verbose          print the blades of every fan\n"
+        "  -h, --help             show this help\n"
+        "\n"
+        "Fan operations are applied in the order given, fan indices refer to\n"
+        "the fans left after the previous operations, e.g. for the teapot:\n"
+        "  %s -q 0:0.2 -q 1:0.2 -t 1 -t 0 -m teapot.shzmdl teapot2.obj\n",
+        prog, DEFAULT_FAN_MIN_TRIS, DEFAULT_AUTO_CUT, DEFAULT_TOLERANCE,
+        DEFAULT_SPRITE_TOLERANCE, prog);
+}
+
+static int parse_size(const char* arg, size_t* out) {
+    char* endp;
+    errno = 0;
+    unsigned long long value = strtoull(arg, &endp, 10);
+    if (*arg == '\0' || *arg == '-' || *endp != '\0' || errno != 0) {
+        return 0;
+    }
+    *out = value;
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    const char* stl_path = NULL;
+    const char* shzmdl_path = NULL;
+    const char* obj_path = NULL;
+    size_t fan_min_tris = DEFAULT_FAN_MIN_TRIS;
+    int find_fans_pass = 1;
+    fan_op_t ops[MAX_FAN_OPS];
+    size_t num_ops = 0;
+    int auto_encode = 0;
+    int report = 0;
+    double auto_cut = DEFAULT_AUTO_CUT;
+    double tolerance = DEFAULT_TOLERANCE;
+    cost_model_t cost_model = {1.0, 0.0, 0.0, 0};
+    quad_options_t quad_opts = {-1.0, 0.0};
+    int soa = 0;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = cpus > 0 ? (size_t)cpus : 1;
+
+    static const struct option long_options[] = {
+        {"shzmdl", required_argument, NULL, 'm'},
+        {"stl", required_argument, NULL, 's'},
+        {"obj", required_argument, NULL, 'o'},
+        {"fan-min", required_argument, NULL, 'f'},
+        {"no-fans", no_argument, NULL, 'n'},
+        {"shed-quads", required_argument, NULL, 'q'},
+        {"fan2tris", required_argument, NULL, 't'},
+        {"auto", no_argument, NULL, 'a'},
+        {"report", no_argument, NULL, 'r'},
+        {"calibrate", required_argument, NULL, 'c'},
+        {"auto-cut", required_argument, NULL, 'k'},
+        {"tolerance", required_argument, NULL, 'e'},
+        {"classify-quads", optional_argument, NULL, 'p'},
+        {"nudge-quads", required_argument, NULL, 'g'},
+        {"soa", no_argument, NULL, 'l'},
+        {"threads", required_argument, NULL, 'j'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:s:o:f:nq:t:arc:k:e:p::g:lj:vh", long_options,
+                              NULL)) != -1) {
+        switch (opt) {
+            case 'm':
+                shzmdl_path = optarg;
+                break;
+            case 's':
+                stl_path = optarg;
+                break;
+            case 'o':
+                obj_path = optarg;
+                break;
+            case 'f':
+                if (!parse_size(optarg, &fan_min_tris)) {
+                    printf("Error: invalid fan minimum \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'n':
+                find_fans_pass = 0;
+                break;
+            case 'q':
+            case 't': {
+                if (num_ops == MAX_FAN_OPS) {
+                    printf("Error: more than %d fan operations\n", MAX_FAN_OPS);
+                    return 1;
+                }
+                fan_op_t* op = &ops[num_ops++];
+                op->op = opt == 'q' ? OP_SHED_QUADS : OP_FAN2TRIS;
+                op->cut = 0.0;
+                char index[32];
+                const char* colon = strchr(optarg, ':');
+                size_t index_len = colon ? (size_t)(colon - optarg)
+                                         : strlen(optarg);
+                int valid = index_len < sizeof(index) &&
+                            (opt == 'q') == (colon != NULL);
+                if (valid) {
+                    memcpy(index, optarg, index_len);
+                    index[index_len] = '\0';
+                    valid = parse_size(index, &op->fan);
+                }
+                if (valid && colon) {
+                    char* endp;
+                    op->cut = strtod(colon + 1, &endp);
+                    valid = colon[1] != '\0' && *endp == '\0';
+                }
+                if (!valid) {
+                    printf("Error: invalid fan operation \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'a':
+                auto_encode = 1;
+                break;
+            case 'r':
+                report = 1;
+                break;
+            case 'c':
+                if (!load_cost_model(&cost_model, optarg)) {
+                    return 1;
+                }
+                break;
+            case 'p':
+            case 'g':
+                if (opt == 'p' && optarg == NULL) {
+                    quad_opts.sprite_tolerance = DEFAULT_SPRITE_TOLERANCE;
+                    break;
+                }
+                [[fallthrough]];
+            case 'k':
+            case 'e': {
+                char* endp;
+                double value = strtod(optarg, &endp);
+                if (*optarg == '\0' || *endp != '\0' || !(value >= 0.0)) {
+                    printf("Error: invalid value \"%s\"\n", optarg);
+                    return 1;
+                }
+                switch (opt) {
+                    case 'p':
+                        quad_opts.sprite_tolerance = value;
+                        break;
+                    case 'g':
+                        quad_opts.nudge_tolerance = value;
+                        break;
+                    case 'k':
+                        auto_cut = value;
+                        break;
+                    default:
+                        tolerance = value;
+                        break;
+                }
+                break;
+            }
+            case 'l':
+                soa = 1;
+                break;
+            case 'j':
+                if (!parse_size(optarg, &num_threads) || num_threads == 0) {
+                    printf("Error: invalid thread count \"%s\"\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (num_threads > MAX_THREADS) {
+        num_threads = MAX_THREADS;
+    }
+
+    model_t model = {0};
+    if (!load_obj(&model, argv[optind])) {
+        model_free(&model);
+        return 1;
+    }
+    if (find_fans_pass && !find_fans(&model, fan_min_tris)) {
+        model_free(&model);
+        return 1;
+    }
+    for (size_t o = 0; o < num_ops; o++) {
+        if (ops[o].fan >= model.fans.len) {
+            printf("Error: fan %zu does not exist, the model has %zu fans\n",
+                   ops[o].fan, model.fans.len);
+            model_free(&model);
+            return 1;
+        }
+        int success = ops[o].op == OP_SHED_QUADS
+                          ? fan_shed_quads(&model, ops[o].fan, ops[o].cut)
+                          : fan2triangles(&model, ops[o].fan);
+        if (!success) {
+            model_free(&model);
+            return 1;
+        }
+    }
+
+    if (auto_encode || report) {
+        encoding_plan_t plan = {0};
+        int success = plan_encodings(&model, &cost_model, auto_cut, tolerance,
+                                     &quad_opts, &plan);
+        if (success) {
+            print_plan(&model, &cost_model, &plan);
+        }
+        if (success && auto_encode) {
+            success = apply_plan(&model, &plan, auto_cut);
+        }
+        plan_free(&plan);
+        if (!success) {
+            model_free(&model);
+            return 1;
+        }
+    }
+
+    if (quad_opts.sprite_tolerance >= 0.0 &&
+        !classify_quads(&model, &quad_opts)) {
+        model_free(&model);
+        return 1;
+    }
+
+    int success = (!stl_path || write_stl(&model, stl_path)) &&
+                  (!shzmdl_path || write_shzmdl(&model, shzmdl_path, soa)) &&
+                  (!obj_path || write_obj(&model, obj_path));
+
+    printf("Model(vertices=%zu, normals=%zu, texcoords=%zu, triangles=%zu, "
+           "quads=%zu, fans=[",
+           model.vertices.len, model.normals.len, model.texcoords.len,
+           model.tris.len, model.quads.len);
+    for (size_t f = 0; f < model.fans.len; f++) {
+        printf(f ? ", %zu" : "%zu", model.fans.data[f].num_blades);
+    }
+    printf("])\n");
+    model_free(&model);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+import math, os, os.path, struct, sys, zlib
+
+
+"""
+highlight_brewer.py
+
+Bakes the highlight map of light_env_set_highlight() in render_kernels.h,
+the specular term of a sphere seen along the half vector. A texel at u, v
+is a normal n with n.u = 2u - 1 and n.v = 2v - 1 across the half vector h,
+its value SPECULAR_STRENGTH * (n.h)^exponent, clamped to 1. Only the
+standard library is needed, the PNG is written by hand.
+
+Usage: python3 highlight_brewer.py [size] [exponent]
+"""
+
+
+pwd = os.path.dirname(os.path.realpath(__file__))
+
+SPECULAR_STRENGTH = 1.5  # render_kernels.h
+SPEC_EXPONENT_BLINN = 128.0
+
+
+def highlight(size: int, exponent: float) -> list[bytes]:
+    rows = []
+    for y in range(size):
+        row = bytearray([0])  # filter type of the PNG scanline
+        for x in range(size):
+            u = (x + 0.5) * 2.0 / size - 1.0
+            v = (y + 0.5) * 2.0 / size - 1.0
+            across = u * u + v * v
+            level = 0.0
+            if across < 1.0:
+                level = SPECULAR_STRENGTH * math.sqrt(1.0 - across) ** exponent
+            grey = round(min(level, 1.0) * 255.0)
+            row += bytes((grey, grey, grey))
+        rows.append(bytes(row))
+    return rows
+
+
+def write_png(path: str, size: int, rows: list[bytes]) -> None:
+    def chunk(kind: bytes, data: bytes) -> bytes:
+        return (struct.pack(">I", len(data)) + kind + data +
+                struct.pack(">I", zlib.crc32(kind + data)))
+
+    header = struct.pack(">IIBBBBB", size, size, 8, 2, 0, 0, 0)  # 8 bit RGB
+    with open(path, "wb") as png:
+        png.write(b"\x89PNG\r\n\x1a\n")
+        png.write(chunk(b"IHDR", header))
+        png.write(chunk(b"IDAT", zlib.compress(b"".join(rows), 9)))
+        png.write(chunk(b"IEND", b""))
+
+
+if __name__ == "__main__":
+    size = int(sys.argv[1]) if len(sys.argv) > 1 else 128
+    exponent = float(sys.argv[2]) if len(sys.argv) > 2 else SPEC_EXPONENT_BLINN
+    path = os.path.join(pwd, "rgb565_vq_tw", f"highlight{size}.png")
+    write_png(path, size, highlight(size, exponent))
+    print(f"wrote {path}")
@@ -0,0 +1,707 @@
+/** Microbenchmarks for the render hot paths. Runs every kernel in isolation
+ * over fixed, seeded inputs and reports time per vertex or primitive next to
+ * the number of TA bytes the kernel emits. Builds for the Dreamcast as
+ * bench_kernels.elf from the top level Makefile and for the host with
+ * bench/Makefile.
+ *
+ * Usage: bench_kernels [kernel filter] [model.shzmdl], the model is mapped
+ * with shz_mdl_load_file() and adds the mdl_file case. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _arch_dreamcast
+#include <kos.h>
+#endif
+
+#include <dc/pvr.h>
+#include <sh4zam/shz_sh4zam.h>
+
+/* The TA stream goes to RAM instead of the store queues. Targets alternate
+ * between two 32 byte slots the same way the SQs do, so the "2nd half" trick
+ * used for sprites writes into the slot after the first half. The last slot
+ * has room for a whole 64 byte sprite, which is how the compiler sees it. */
+static alignas(32) uint8_t bench_ta_slots[128];
+static uint64_t bench_ta_bytes = 0;
+
+static inline void* bench_ta_target(pvr_dr_state_t* dr_state) {
+    *dr_state ^= 32;
+    return bench_ta_slots + 32 + *dr_state;
+}
+
+#define RK_TA_TARGET(dr_state) bench_ta_target(dr_state)
+#define RK_TA_COMMIT(dr_state, addr) (bench_ta_bytes += 32, (void)(addr))
+
+#define XSCALE 2.0f
+#include <sh4zamsprites/perf_timer.h>
+#include <sh4zamsprites/render_kernels.h>
+
+#define BENCH_SEED 0x5eed1234u
+#define BENCH_VERTS 4096
+#define BENCH_FAN_BLADES 40
+#define BENCH_FANS 32
+#define BENCH_PASSES 32
+#define BENCH_MDL_FACES 2048  // AoS or SoA, either way larger than the 16KB cache
+#define BENCH_SCENE_LIGHTS 16  // two of them reach the faces
+#define SCREEN_WIDTH (640.0f * XSCALE)
+#define SCREEN_HEIGHT 480.0f
+
+static uint32_t rng_state = BENCH_SEED;
+
+static inline uint32_t rng_next(void) {
+    /* xorshift32 */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static inline float rng_float(float min, float max) {
+    return min + (max - min) * (float)(rng_next() >> 8) * (1.0f / 16777216.0f);
+}
+
+static alignas(32) shz_vec3_t verts[BENCH_VERTS];
+static alignas(32) shz_vec3_t normals[BENCH_VERTS];
+static alignas(32) shz_vec4_t projected[BENCH_VERTS];
+static alignas(32) shz_mat4x4_t model_view;
+static alignas(32) shz_mat4x4_t inverse_transpose;
+static alignas(32) shz_mat4x4_t mvp;
+static light_env_t env;
+static pvr_sprite_hdr_t spr_hdr;
+
+#define FAN_STRIDE \
+    ((sizeof(shz_mdl_fan_t) + BENCH_FAN_BLADES * sizeof(shz_mdl_vert_normal_t) + 31) & ~31)
+static alignas(32) uint8_t fans[BENCH_FANS * FAN_STRIDE];
+
+/* the same synthetic faces in both shzmdl layouts */
+static alignas(32) shz_mdl_tri_face_t mdl_tris[BENCH_MDL_FACES];
+static alignas(32) shz_mdl_quad_face_t mdl_quads[BENCH_MDL_FACES];
+static alignas(32) shz_vec3_t mdl_tri_positions[BENCH_MDL_FACES * 3];
+static alignas(32) shz_vec3_t mdl_tri_normals[BENCH_MDL_FACES];
+static alignas(32) shz_vec3_t mdl_quad_positions[BENCH_MDL_FACES * 4];
+static alignas(32) shz_vec3_t mdl_quad_normals[BENCH_MDL_FACES];
+static alignas(32) uint32_t mdl_quad_flags[BENCH_MDL_FACES];
+static pvr_poly_hdr_t poly_hdr;
+static shz_mdl_t mdl_file;
+
+/* the synthetic vertices lie within this sphere */
+static const shz_vec3_t bench_center = {.e = {0.0f, 0.0f, 0.0f}};
+static const float bench_radius = 8.0f * 1.7320508f;
+static light_t near_lights[LIGHTS_MAX];  // all reach the faces
+static light_t scene_lights[BENCH_SCENE_LIGHTS];
+static light_t assigned_lights[LIGHTS_MAX];
+static spec_lut_t phong_lut;
+static spec_lut_t blinn_lut;
+static alignas(32) float intensities[BENCH_VERTS];
+static pvr_poly_hdr_t intensity_hdr;
+static pvr_poly_hdr_t highlight_hdr;
+
+static volatile float float_sink;
+
+static void setup_inputs(void) {
+    rng_state = BENCH_SEED;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        verts[i] = shz_vec3_init(rng_float(-8.0f, 8.0f), rng_float(-8.0f, 8.0f),
+                                 rng_float(-8.0f, 8.0f));
+        normals[i] = shz_vec3_normalize(shz_vec3_init(
+            rng_float(-1.0f, 1.0f), rng_float(-1.0f, 1.0f),
+            rng_float(-1.0f, 1.0f)));
+    }
+    for (int f = 0; f < BENCH_FANS; f++) {
+        shz_mdl_fan_t* fan = (shz_mdl_fan_t*)(fans + f * FAN_STRIDE);
+        shz_mdl_vert_normal_t* blades = fan_blades(fan);
+        fan->num_verts = BENCH_FAN_BLADES;
+        fan->center = verts[f];
+        fan->center_normal = normals[f];
+        fan->next_fan_offset = 0;
+        const float radius = rng_float(0.5f, 2.0f);
+        for (int b = 0; b < BENCH_FAN_BLADES; b++) {
+            shz_sincos_t sc =
+                shz_sincosu16((uint16_t)(b * (65536 / BENCH_FAN_BLADES)));
+            blades[b].vert = shz_vec3_add(
+                fan->center, shz_vec3_init(sc.cos * radius, sc.sin * radius,
+                                           rng_float(-0.1f, 0.1f)));
+            blades[b].normal = normals[(f * BENCH_FAN_BLADES + b) % BENCH_VERTS];
+        }
+    }
+
+    for (int f = 0; f < BENCH_MDL_FACES; f++) {
+        shz_mdl_tri_face_t* tri = &mdl_tris[f];
+        shz_mdl_quad_face_t* quad = &mdl_quads[f];
+        tri->normal = quad->normal = normals[f % BENCH_VERTS];
+        tri->v1 = quad->v1 = verts[(f * 4) % BENCH_VERTS];
+        tri->v2 = quad->v2 = verts[(f * 4 + 1) % BENCH_VERTS];
+        tri->v3 = quad->v3 = verts[(f * 4 + 2) % BENCH_VERTS];
+        quad->v4 = verts[(f * 4 + 3) % BENCH_VERTS];
+        /* split quads first, like tea_brewer --classify-quads stores them */
+        quad->flags = f < BENCH_MDL_FACES / 4 ? SHZ_MDL_QUAD_SPLIT : 0;
+
+        mdl_tri_positions[f * 3] = tri->v1;
+        mdl_tri_positions[f * 3 + 1] = tri->v2;
+        mdl_tri_positions[f * 3 + 2] = tri->v3;
+        mdl_tri_normals[f] = tri->normal;
+        mdl_quad_positions[f * 4] = quad->v1;
+        mdl_quad_positions[f * 4 + 1] = quad->v2;
+        mdl_quad_positions[f * 4 + 2] = quad->v3;
+        mdl_quad_positions[f * 4 + 3] = quad->v4;
+        mdl_quad_normals[f] = quad->normal;
+        mdl_quad_flags[f] = quad->flags;
+    }
+
+    /* roughly the teapot's model view, without the lookAt from perspective.h
+     * which needs the KOS matrix headers */
+    shz_vec3_t eye = shz_vec3_init(0.0f, -0.00001f, 30.0f);
+    shz_xmtrx_init_identity();
+    shz_xmtrx_translate(0.0f, -10.0f, -28.0f);
+    shz_xmtrx_apply_rotation_x(SHZ_F_PI * 0.75f - 0.1f);
+    shz_xmtrx_apply_rotation_y(SHZ_F_PI * 0.25f);
+    shz_xmtrx_store_4x4(&model_view);
+    shz_mat4x4_inverse(&model_view, &inverse_transpose);
+    shz_mat4x4_transpose(&inverse_transpose, &inverse_transpose);
+
+    shz_xmtrx_init_identity();
+    shz_xmtrx_apply_permutation_wxyz();
+    shz_xmtrx_apply_screen(SCREEN_WIDTH, SCREEN_HEIGHT);
+    shz_xmtrx_apply_perspective(75.0f * SHZ_F_PI / 180.0f,
+                                shz_divf(SCREEN_WIDTH, SCREEN_HEIGHT * XSCALE),
+                                0.0f);
+    shz_xmtrx_apply_4x4(&model_view);
+    shz_xmtrx_store_4x4(&mvp);
+
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        projected[i] = (shz_vec4_t){.xyz = project_vert(&verts[i]), .w = 1.0f};
+    }
+
+    shz_vec3_t light_pos = shz_vec3_init(10.0f, 5.0f, 20.0f);
+    env = (light_env_t){
+        .light_pos = light_pos,
+        .spec_light_pos = shz_mat4x4_trans_vec3(&model_view, light_pos),
+        .spec_view_pos = shz_mat4x4_trans_vec3(&model_view, eye),
+        .light_color = shz_vec3_init(0.9f, 0.8f, 0.7f),
+        .model_view = &model_view,
+        .inverse_transpose = &inverse_transpose,
+        .shade_model = SHADE_PHONG,  // with shz_powf(), the reference
+    };
+    light_env_set_distant(&env, bench_center, eye);
+    spec_lut_init(&phong_lut, SPEC_EXPONENT_PHONG);
+    spec_lut_init(&blinn_lut, SPEC_EXPONENT_BLINN);
+    memset(&spr_hdr, 0, sizeof(spr_hdr));
+    /* the parts' headers, compiled the same way */
+    pvr_poly_cxt_t cxt;
+    pvr_poly_cxt_col(&cxt, PVR_LIST_OP_POLY);
+    pvr_poly_compile(&poly_hdr, &cxt);
+    cxt.fmt.color = PVR_CLRFMT_INTENSITY;
+    pvr_poly_compile(&intensity_hdr, &cxt);
+    /* the 128x128 highlight map, the TA only sees its address */
+    pvr_poly_cxt_txr(&cxt, PVR_LIST_OP_POLY,
+                     PVR_TXRFMT_RGB565 | PVR_TXRFMT_VQ_ENABLE, 128, 128, NULL,
+                     PVR_FILTER_BILINEAR);
+    cxt.gen.specular = PVR_SPECULAR_ENABLE;  // the offset color
+    cxt.txr.env = PVR_TXRENV_MODULATE;
+    pvr_poly_compile(&highlight_hdr, &cxt);
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        intensities[i] = shade_intensity(&env, &verts[i], &normals[i]);
+    }
+
+    for (int i = 0; i < LIGHTS_MAX; i++) {
+        const shz_sincos_t sc =
+            shz_sincosu16((uint16_t)(i * (65536 / LIGHTS_MAX)));
+        near_lights[i] = (light_t){
+            .pos = shz_vec3_init(sc.cos * 15.0f, sc.sin * 15.0f, 10.0f),
+            .color = shz_vec3_init(0.3f, 0.3f, 0.3f),
+            .range = 40.0f,
+            .type = LIGHT_POINT};
+    }
+    for (int i = 0; i < BENCH_SCENE_LIGHTS; i++) {
+        scene_lights[i] = near_lights[i % LIGHTS_MAX];
+        if (i >= 2) {
+            /* far off to the side, out of reach */
+            scene_lights[i].pos.x += 200.0f;
+        }
+    }
+}
+
+/** Each case runs one pass over its inputs and returns the number of units */
+static uint32_t bench_calc_light(void) {
+    float acc = 0.0f;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        acc += calc_light(&verts[i], &normals[i], &env.light_pos,
+                          &env.spec_light_pos, &env.spec_view_pos,
+                          env.model_view, env.inverse_transpose);
+    }
+    float_sink = acc;
+    return BENCH_VERTS;
+}
+
+static uint32_t bench_shade_argb(void) {
+    uint32_t acc = 0;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        acc ^= shade_argb(&env, &verts[i], &normals[i]);
+    }
+    float_sink = (float)acc;
+    return BENCH_VERTS;
+}
+
+/** env in one of the lighting models, with its lookup table */
+static light_env_t shade_env(shade_model_e model) {
+    light_env_t model_env = env;
+    model_env.shade_model = model;
+    model_env.spec_lut = model == SHADE_BLINN ? &blinn_lut : &phong_lut;
+    return model_env;
+}
+
+static uint32_t bench_shade_phong_lut(void) {
+    light_env_t model_env = shade_env(SHADE_PHONG);
+    float acc = 0.0f;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        acc += calc_phong(&model_env, &verts[i], &normals[i]);
+    }
+    float_sink = acc;
+    return BENCH_VERTS;
+}
+
+static uint32_t bench_shade_blinn(void) {
+    light_env_t model_env = shade_env(SHADE_BLINN);
+    float acc = 0.0f;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        acc += calc_blinn(&model_env, &verts[i], &normals[i]);
+    }
+    float_sink = acc;
+    return BENCH_VERTS;
+}
+
+static uint32_t bench_shade_diffuse(void) {
+    float acc = 0.0f;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        acc += calc_diffuse(&verts[i], &normals[i], &env.light_pos);
+    }
+    float_sink = acc;
+    return BENCH_VERTS;
+}
+
+/* the UV on the highlight map and the diffuse offset color, in place of
+ * shade_argb() */
+static uint32_t bench_shade_highlight(void) {
+    light_env_t highlight_env = env;
+    light_env_set_highlight(&highlight_env, &highlight_hdr);
+    const uint32_t flat_argb = pack_argb(env.light_color);
+    float acc = 0.0f;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        const highlight_face_t face =
+            shade_highlight(&highlight_env, &verts[i], &normals[i], flat_argb);
+        acc += face.u + face.v + (float)face.oargb;
+    }
+    float_sink = acc;
+    return BENCH_VERTS;
+}
+
+/* the color of a face from its intensity, packed or as is */
+static uint32_t bench_light_argb(void) {
+    uint32_t acc = 0;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        acc ^= light_argb(&env, intensities[i]);
+    }
+    float_sink = (float)acc;
+    return BENCH_VERTS;
+}
+
+static uint32_t bench_light_intensity(void) {
+    light_env_t intensity_env = env;
+    light_env_set_intensity(&intensity_env, &intensity_hdr);
+    uint32_t acc = 0;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        acc ^= light_intensity_word(&intensity_env, intensities[i]);
+    }
+    float_sink = (float)acc;
+    return BENCH_VERTS;
+}
+
+static uint32_t bench_perspective_n_swizzle(void) {
+    float acc = 0.0f;
+    shz_xmtrx_load_4x4(&mvp);
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        acc += project_vert(&verts[i]).z;
+    }
+    float_sink = acc;
+    return BENCH_VERTS;
+}
+
+static uint32_t bench_draw_sprite_line(void) {
+    pvr_dr_state_t dr_state = 0;
+    for (int i = 0; i < BENCH_VERTS - 1; i += 2) {
+        draw_sprite_line(&projected[i], &projected[i + 1], 0.0f, &dr_state);
+    }
+    return BENCH_VERTS / 2;
+}
+
+static uint32_t bench_triangles(void) {
+    pvr_dr_state_t dr_state = 0;
+    shz_xmtrx_load_4x4(&mvp);
+    for (int i = 0; i < BENCH_VERTS - 2; i += 3) {
+        uint32_t argb = shade_argb(&env, &verts[i], &normals[i]);
+        shz_vec3_t v1 = project_vert(&verts[i]);
+        shz_vec3_t v2 = project_vert(&verts[i + 1]);
+        shz_vec3_t v3 = project_vert(&verts[i + 2]);
+        emit_triangle(&v1, &v2, &v3, argb, &dr_state);
+    }
+    return BENCH_VERTS / 3;
+}
+
+static uint32_t bench_quad_sprites(void) {
+    pvr_dr_state_t dr_state = 0;
+    shz_xmtrx_load_4x4(&mvp);
+    for (int i = 0; i < BENCH_VERTS - 3; i += 4) {
+        uint32_t argb = shade_argb(&env, &verts[i], &normals[i]);
+        shz_vec3_t v1 = project_vert(&verts[i]);
+        shz_vec3_t v2 = project_vert(&verts[i + 1]);
+        shz_vec3_t v3 = project_vert(&verts[i + 2]);
+        shz_vec3_t v4 = project_vert(&verts[i + 3]);
+        emit_quad_sprite(&spr_hdr, argb, &v1, &v2, &v3, &v4, &dr_state);
+    }
+    return BENCH_VERTS / 4;
+}
+
+static uint32_t bench_quad_strips(void) {
+    pvr_dr_state_t dr_state = 0;
+    shz_xmtrx_load_4x4(&mvp);
+    for (int i = 0; i < BENCH_VERTS - 3; i += 4) {
+        uint32_t argb = shade_argb(&env, &verts[i], &normals[i]);
+        shz_vec3_t v1 = project_vert(&verts[i]);
+        shz_vec3_t v2 = project_vert(&verts[i + 1]);
+        shz_vec3_t v3 = project_vert(&verts[i + 2]);
+        shz_vec3_t v4 = project_vert(&verts[i + 3]);
+        emit_quad_strip(&v1, &v2, &v3, &v4, argb, &dr_state);
+    }
+    return BENCH_VERTS / 4;
+}
+
+static inline uint32_t bench_fans(fan_encoding_e encoding) {
+    pvr_dr_state_t dr_state = 0;
+    shz_xmtrx_load_4x4(&mvp);
+    for (int f = 0; f < BENCH_FANS; f++) {
+        render_fan(encoding, (shz_mdl_fan_t*)(fans + f * FAN_STRIDE), &env,
+                   &spr_hdr, &dr_state);
+    }
+    /* one unit per fan blade, i.e. per triangle of the original fan */
+    return BENCH_FANS * BENCH_FAN_BLADES;
+}
+
+static uint32_t bench_fanstrips(void) { return bench_fans(FANSTRIPS); }
+static uint32_t bench_fan2tris(void) { return bench_fans(FAN2TRIS); }
+static uint32_t bench_fan2quads(void) { return bench_fans(FAN2QUADS); }
+
+static uint32_t bench_mdl_tris_aos(void) {
+    pvr_dr_state_t dr_state = 0;
+    shz_xmtrx_load_4x4(&mvp);
+    render_tris_aos(mdl_tris, BENCH_MDL_FACES, &env, &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_mdl_tris_soa(void) {
+    pvr_dr_state_t dr_state = 0;
+    shz_xmtrx_load_4x4(&mvp);
+    render_tris_soa(mdl_tri_positions, mdl_tri_normals, BENCH_MDL_FACES, &env,
+                    &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_mdl_quads_aos(void) {
+    pvr_dr_state_t dr_state = 0;
+    shz_xmtrx_load_4x4(&mvp);
+    render_quads_aos(mdl_quads, BENCH_MDL_FACES, &env, &spr_hdr, &poly_hdr,
+                     &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_mdl_quads_soa(void) {
+    pvr_dr_state_t dr_state = 0;
+    shz_xmtrx_load_4x4(&mvp);
+    render_quads_soa(mdl_quad_positions, mdl_quad_normals, mdl_quad_flags,
+                     BENCH_MDL_FACES, &env, &spr_hdr, &poly_hdr, &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_mdl_tris_phong(void) {
+    pvr_dr_state_t dr_state = 0;
+    light_env_t model_env = shade_env(SHADE_PHONG);
+    shz_xmtrx_load_4x4(&mvp);
+    render_phong_tris_aos(mdl_tris, BENCH_MDL_FACES, &model_env, &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_mdl_tris_blinn(void) {
+    pvr_dr_state_t dr_state = 0;
+    light_env_t model_env = shade_env(SHADE_BLINN);
+    shz_xmtrx_load_4x4(&mvp);
+    render_blinn_tris_aos(mdl_tris, BENCH_MDL_FACES, &model_env, &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_mdl_tris_diffuse(void) {
+    pvr_dr_state_t dr_state = 0;
+    light_env_t model_env = shade_env(SHADE_DIFFUSE);
+    shz_xmtrx_load_4x4(&mvp);
+    render_diffuse_tris_aos(mdl_tris, BENCH_MDL_FACES, &model_env, &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+/* mdl_tris_phong and mdl_quads_phong with the highlight map */
+static uint32_t bench_mdl_tris_highlight(void) {
+    pvr_dr_state_t dr_state = 0;
+    light_env_t model_env = env;
+    light_env_set_highlight(&model_env, &highlight_hdr);
+    shz_xmtrx_load_4x4(&mvp);
+    render_highlight_tris_aos(mdl_tris, BENCH_MDL_FACES, &model_env,
+                              &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_mdl_quads_highlight(void) {
+    pvr_dr_state_t dr_state = 0;
+    light_env_t model_env = env;
+    light_env_set_highlight(&model_env, &highlight_hdr);
+    shz_xmtrx_load_4x4(&mvp);
+    render_highlight_quads_soa(mdl_quad_positions, mdl_quad_normals,
+                               mdl_quad_flags, BENCH_MDL_FACES, &model_env,
+                               &spr_hdr, &highlight_hdr, &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+/* mdl_tris_phong and mdl_quads_soa shaded by intensity, the quads as
+ * strips since sprites can not be */
+static uint32_t bench_mdl_tris_intensity(void) {
+    pvr_dr_state_t dr_state = 0;
+    light_env_t model_env = shade_env(SHADE_PHONG);
+    light_env_set_intensity(&model_env, &intensity_hdr);
+    shz_xmtrx_load_4x4(&mvp);
+    render_intensity_phong_tris_aos(mdl_tris, BENCH_MDL_FACES, &model_env,
+                                    &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_mdl_quads_intensity(void) {
+    pvr_dr_state_t dr_state = 0;
+    light_env_t model_env = shade_env(SHADE_PHONG);
+    light_env_set_intensity(&model_env, &intensity_hdr);
+    shz_xmtrx_load_4x4(&mvp);
+    render_intensity_phong_quads_soa(mdl_quad_positions, mdl_quad_normals,
+                                     mdl_quad_flags, BENCH_MDL_FACES,
+                                     &model_env, &spr_hdr, &intensity_hdr,
+                                     &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_mdl_quads_phong(void) {
+    pvr_dr_state_t dr_state = 0;
+    light_env_t model_env = shade_env(SHADE_PHONG);
+    shz_xmtrx_load_4x4(&mvp);
+    render_phong_quads_soa(mdl_quad_positions, mdl_quad_normals,
+                           mdl_quad_flags, BENCH_MDL_FACES, &model_env,
+                           &spr_hdr, &poly_hdr, &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+/**
+ * Lit by the lights of a scene that reach the faces, the cost per face
+ * follows the lights assigned rather than the lights in the scene
+ */
+static inline uint32_t bench_mdl_tris_lights(const light_t* lights,
+                                             uint32_t count) {
+    pvr_dr_state_t dr_state = 0;
+    light_env_t lit_env = env;
+    lit_env.num_lights =
+        lights_assign(lights, count, &bench_center, bench_radius, &model_view,
+                      assigned_lights, NULL);
+    lit_env.lights = assigned_lights;
+    shz_xmtrx_load_4x4(&mvp);
+    render_tris_aos(mdl_tris, BENCH_MDL_FACES, &lit_env, &dr_state);
+    return BENCH_MDL_FACES;
+}
+
+static uint32_t bench_lights_1(void) {
+    return bench_mdl_tris_lights(near_lights, 1);
+}
+static uint32_t bench_lights_2(void) {
+    return bench_mdl_tris_lights(near_lights, 2);
+}
+static uint32_t bench_lights_4(void) {
+    return bench_mdl_tris_lights(near_lights, 4);
+}
+static uint32_t bench_lights_8(void) {
+    return bench_mdl_tris_lights(near_lights, 8);
+}
+static uint32_t bench_lights_2_of_16(void) {
+    return bench_mdl_tris_lights(scene_lights, BENCH_SCENE_LIGHTS);
+}
+
+static uint32_t bench_lights_assign(void) {
+    uint32_t acc = 0;
+    for (int i = 0; i < BENCH_VERTS; i++) {
+        acc += lights_assign(scene_lights, BENCH_SCENE_LIGHTS, &verts[i], 1.0f,
+                             &model_view, assigned_lights, NULL);
+    }
+    float_sink = (float)acc;
+    return BENCH_VERTS * BENCH_SCENE_LIGHTS;
+}
+
+static uint32_t bench_mdl_file(void) {
+    pvr_dr_state_t dr_state = 0;
+    const shzmdl_hdr_t* hdr = mdl_file.hdr;
+    shz_xmtrx_load_4x4(&mvp);
+    if (hdr->version.flags & SHZ_MDL_FLAG_SOA) {
+        render_tris_soa(shz_mdl_tri_positions(hdr), shz_mdl_tri_normals(hdr),
+                        hdr->num.tri_faces, &env, &dr_state);
+        render_quads_soa(shz_mdl_quad_positions(hdr), shz_mdl_quad_normals(hdr),
+                         shz_mdl_quad_flags(hdr), hdr->num.quad_faces, &env,
+                         &spr_hdr, &poly_hdr, &dr_state);
+    } else {
+        render_tris_aos(shz_mdl_tris(&mdl_file), hdr->num.tri_faces, &env,
+                        &dr_state);
+        render_quads_aos(shz_mdl_quads(&mdl_file), hdr->num.quad_faces, &env,
+                         &spr_hdr, &poly_hdr, &dr_state);
+    }
+    return hdr->num.tri_faces + hdr->num.quad_faces;
+}
+
+typedef struct {
+    const char* name;
+    const char* unit;
+    uint32_t (*run)(void);
+} bench_case_t;
+
+static const bench_case_t bench_cases[] = {
+    {"calc_light", "vertex", bench_calc_light},
+    {"shade_argb", "vertex", bench_shade_argb},
+    {"shade_phong_lut", "vertex", bench_shade_phong_lut},
+    {"shade_blinn", "vertex", bench_shade_blinn},
+    {"shade_diffuse", "vertex", bench_shade_diffuse},
+    {"shade_highlight", "vertex", bench_shade_highlight},
+    {"light_argb", "vertex", bench_light_argb},
+    {"light_intensity", "vertex", bench_light_intensity},
+    {"perspective_n_swizzle", "vertex", bench_perspective_n_swizzle},
+    {"draw_sprite_line", "line", bench_draw_sprite_line},
+    {"triangles", "tri", bench_triangles},
+    {"quad_sprites", "quad", bench_quad_sprites},
+    {"quad_strips", "quad", bench_quad_strips},
+    {"fan_FANSTRIPS", "blade", bench_fanstrips},
+    {"fan_FAN2TRIS", "blade", bench_fan2tris},
+    {"fan_FAN2QUADS", "blade", bench_fan2quads},
+    {"mdl_tris_aos", "tri", bench_mdl_tris_aos},
+    {"mdl_tris_soa", "tri", bench_mdl_tris_soa},
+    {"mdl_quads_aos", "quad", bench_mdl_quads_aos},
+    {"mdl_quads_soa", "quad", bench_mdl_quads_soa},
+    {"mdl_tris_phong", "tri", bench_mdl_tris_phong},
+    {"mdl_tris_blinn", "tri", bench_mdl_tris_blinn},
+    {"mdl_tris_diffuse", "tri", bench_mdl_tris_diffuse},
+    {"mdl_tris_intensity", "tri", bench_mdl_tris_intensity},
+    {"mdl_quads_phong", "quad", bench_mdl_quads_phong},
+    {"mdl_quads_intensity", "quad", bench_mdl_quads_intensity},
+    {"mdl_tris_highlight", "tri", bench_mdl_tris_highlight},
+    {"mdl_quads_highlight", "quad", bench_mdl_quads_highlight},
+    {"mdl_file", "face", bench_mdl_file},
+    {"lights_1", "tri", bench_lights_1},
+    {"lights_2", "tri", bench_lights_2},
+    {"lights_4", "tri", bench_lights_4},
+    {"lights_8", "tri", bench_lights_8},
+    {"lights_2_of_16", "tri", bench_lights_2_of_16},
+    {"lights_assign", "light", bench_lights_assign},
+};
+
+static void run_case(const bench_case_t* bc) {
+    uint64_t units = 0;
+    bench_ta_bytes = 0;
+
+    bc->run(); /* warm up caches */
+    bench_ta_bytes = 0;
+
+    perf_cycles_start(PMCR_ELAPSED_TIME_MODE);
+    const uint64_t start_cycles = perf_cycles();
+    const uint64_t start_ns = perf_now_ns();
+    for (int p = 0; p < BENCH_PASSES; p++) {
+        units += bc->run();
+    }
+    const uint64_t ns = perf_now_ns() - start_ns;
+    const uint64_t cycles = perf_cycles() - start_cycles;
+    perf_cycles_stop();
+    const uint64_t ta_bytes = bench_ta_bytes;
+
+    /* the counter only does one event at a time, so the operand cache misses
+     * come from a second round of passes */
+    perf_cycles_start(PMCR_OPERAND_CACHE_READ_MISS_MODE);
+    const uint64_t start_misses = perf_cycles();
+    for (int p = 0; p < BENCH_PASSES; p++) {
+        bc->run();
+    }
+    const uint64_t misses = perf_cycles() - start_misses;
+    perf_cycles_stop();
+
+    printf("%-24s %8llu %-6s %10.2f ns %10.2f cyc %8.2f TA B %8.3f miss\n",
+           bc->name, (unsigned long long)(units / BENCH_PASSES), bc->unit,
+           (double)ns / (double)units,
+           PERF_HAS_CYCLES ? (double)cycles / (double)units : 0.0,
+           (double)ta_bytes / (double)units,
+           PERF_HAS_CYCLES ? (double)misses / (double)units : 0.0);
+}
+
+/**
+ * What the cheaper lighting models cost in quality, the 8 bit color steps
+ * they are off from Phong with shz_powf() over the same vertices
+ */
+static void print_shade_errors(void) {
+    static const char* names[] = {"diffuse", "blinn", "phong_lut"};
+    printf("%-24s %13s %14s\n", "shading error", "mean steps", "max steps");
+    for (int model = SHADE_DIFFUSE; model <= SHADE_PHONG; model++) {
+        light_env_t model_env = shade_env((shade_model_e)model);
+        uint64_t sum = 0;
+        int max = 0;
+        for (int i = 0; i < BENCH_VERTS; i++) {
+            const uint32_t ref = shade_argb(&env, &verts[i], &normals[i]);
+            const uint32_t argb =
+                shade_argb(&model_env, &verts[i], &normals[i]);
+            for (int shift = 0; shift < 24; shift += 8) {
+                const int step = abs((int)((ref >> shift) & 0xFF) -
+                                     (int)((argb >> shift) & 0xFF));
+                sum += step;
+                max = step > max ? step : max;
+            }
+        }
+        printf("%-24s %13.3f %14d\n", names[model],
+               (double)sum / (BENCH_VERTS * 3.0), max);
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 && argv[1][0] != '\0' ? argv[1] : NULL;
+    if (argc > 2) {
+        const uint64_t start_ns = perf_now_ns();
+        if (!shz_mdl_load_file(&mdl_file, argv[2])) {
+            return 1;
+        }
+        printf("mapped %s, %lu bytes in %.3f ms\n", argv[2],
+               (unsigned long)mdl_file.size,
+               (double)(perf_now_ns() - start_ns) / 1e6);
+    }
+
+    /** ensure that no NaNs or inf values persist in the xmtrx */
+    shz_xmtrx_init_identity_safe();
+    setup_inputs();
+
+    printf("%-24s %8s %-6s %13s %14s %13s %13s\n", "kernel", "units", "",
+           "time/unit", "cycles/unit", "TA bytes/unit", "misses/unit");
+    for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+        if (filter != NULL && strstr(bench_cases[i].name, filter) == NULL) {
+            continue;
+        }
+        if (bench_cases[i].run == bench_mdl_file && mdl_file.hdr == NULL) {
+            continue;
+        }
+        run_case(&bench_cases[i]);
+    }
+    if (filter == NULL || strstr(filter, "shade") != NULL) {
+        print_shade_errors();
+    }
+    shz_mdl_free(&mdl_file);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/** PVR render time of a translucent list left to autosort, against the same
+ * list sorted on the CPU by tr_sort.h and rendered with autosort off, as the
+ * number of translucent sprites grows. Dreamcast only, builds as
+ * bench_tr_sort.elf from the top level Makefile.
+ *
+ * Every frame draws the same seeded, overlapping 64x64 sprites at random
+ * depths. Render time is the PVR's own rnd_last_time from pvr_get_stats(),
+ * sort time the CPU time of tr_batch_sort(). */
+
+#include <kos.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <dc/pvr.h>
+#include <sh4zamsprites/arena.h>
+#include <sh4zamsprites/perf_timer.h>
+#include <sh4zamsprites/tr_sort.h>
+
+#define BENCH_SEED 0x5eed1234u
+#define BENCH_FRAMES 32
+#define BENCH_MAX_SPRITES 4096
+#define SPRITE_SIZE 64.0f
+#define SPRITE_SLOTS 3  // header and the two halves of the sprite
+#define FRAME_ARENA_SIZE \
+    (BENCH_MAX_SPRITES * (SPRITE_SLOTS * 32 + 2 * sizeof(tr_prim_t)) + 1024)
+
+static const uint32_t sprite_counts[] = {64, 256, 1024, 2048, BENCH_MAX_SPRITES};
+
+static uint32_t rng_state = BENCH_SEED;
+
+static inline uint32_t rng_next(void) {
+    /* xorshift32 */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static inline float rng_float(float min, float max) {
+    return min + (max - min) * (float)(rng_next() >> 8) * (1.0f / 16777216.0f);
+}
+
+static void init_pvr(int autosort_disabled) {
+    pvr_init_params_t params = {
+        {PVR_BINSIZE_0, PVR_BINSIZE_0, PVR_BINSIZE_32, PVR_BINSIZE_0,
+         PVR_BINSIZE_0},
+        3 << 19,  // Vertex buffer size, 1.5MB
+        0,        // No DMA
+        0,        // No FSAA
+        autosort_disabled,
+        3,  // Extra OPBs
+        0,  // vbuf_doublebuf_disabled
+    };
+    pvr_init(&params);
+    pvr_set_bg_color(0.0f, 0.0f, 0.0f);
+}
+
+/** The same sprites every frame, in the order they were generated */
+static void fill_batch(tr_batch_t* batch, const pvr_sprite_hdr_t* hdr,
+                       uint32_t sprites) {
+    rng_state = BENCH_SEED;
+    for (uint32_t i = 0; i < sprites; i++) {
+        const float x = rng_float(0.0f, 640.0f - SPRITE_SIZE);
+        const float y = rng_float(0.0f, 480.0f - SPRITE_SIZE);
+        const float z = rng_float(0.01f, 1.0f);
+        pvr_sprite_hdr_t* h = tr_batch_add(batch, z, SPRITE_SLOTS);
+        *h = *hdr;
+        h->argb = 0x40000000 | (rng_next() & 0x00FFFFFF);
+        pvr_sprite_col_t* quad = (pvr_sprite_col_t*)(h + 1);
+        quad->flags = PVR_CMD_VERTEX_EOL;
+        quad->ax = x;
+        quad->ay = y + SPRITE_SIZE;
+        quad->az = z;
+        quad->bx = x;
+        quad->by = y;
+        quad->bz = z;
+        quad->cx = x + SPRITE_SIZE;
+        quad->cy = y;
+        quad->cz = z;
+        quad->dx = x + SPRITE_SIZE;
+        quad->dy = y + SPRITE_SIZE;
+    }
+}
+
+static void run(int presort, uint32_t sprites) {
+    pvr_sprite_cxt_t cxt;
+    pvr_sprite_cxt_col(&cxt, PVR_LIST_TR_POLY);
+    cxt.gen.culling = PVR_CULLING_NONE;
+    pvr_sprite_hdr_t hdr;
+    pvr_sprite_compile(&hdr, &cxt);
+
+    uint64_t sort_ns = 0;
+    uint64_t render_ns = 0;
+    for (int frame = 0; frame <= BENCH_FRAMES; frame++) {
+        pvr_wait_ready();
+        /* the render time of the frame before, the first one is a warm up */
+        pvr_stats_t stats;
+        pvr_get_stats(&stats);
+        if (frame > 1) {
+            render_ns += stats.rnd_last_time;
+        }
+        arena_reset(&frame_arena);
+
+        tr_batch_t batch;
+        if (!tr_batch_init(&batch, &frame_arena, sprites,
+                           sprites * SPRITE_SLOTS)) {
+            return;
+        }
+        fill_batch(&batch, &hdr, sprites);
+        if (presort) {
+            const uint64_t start_ns = perf_now_ns();
+            tr_batch_sort(&batch);
+            if (frame > 0) {
+                sort_ns += perf_now_ns() - start_ns;
+            }
+        }
+
+        pvr_scene_begin();
+        pvr_list_begin(PVR_LIST_TR_POLY);
+        pvr_dr_state_t dr_state;
+        pvr_dr_init(&dr_state);
+        tr_batch_submit(&batch, &dr_state);
+        pvr_dr_finish();
+        pvr_list_finish();
+        pvr_scene_finish();
+    }
+    pvr_wait_ready();
+    pvr_stats_t stats;
+    pvr_get_stats(&stats);
+    render_ns += stats.rnd_last_time;
+
+    printf("%-9s %6lu %12.3f ms %12.3f ms %12.3f ms\n",
+           presort ? "presort" : "autosort", (unsigned long)sprites,
+           (double)render_ns / BENCH_FRAMES / 1e6,
+           (double)sort_ns / BENCH_FRAMES / 1e6,
+           (double)(render_ns + sort_ns) / BENCH_FRAMES / 1e6);
+}
+
+int main(void) {
+    vid_set_mode(DM_640x480, PM_RGB565);
+    if (!arena_init(&frame_arena, "frame", FRAME_ARENA_SIZE)) {
+        return 1;
+    }
+    printf("%-9s %6s %15s %15s %15s\n", "mode", "sprites", "render/frame",
+           "sort/frame", "total/frame");
+    for (int presort = 0; presort <= 1; presort++) {
+        init_pvr(presort);
+        for (size_t i = 0; i < sizeof(sprite_counts) / sizeof(sprite_counts[0]);
+             i++) {
+            run(presort, sprite_counts[i]);
+        }
+        pvr_shutdown();
+    }
+    arena_print_stats(&frame_arena);
+    arena_destroy(&frame_arena);
+    return 0;
+}
@@ -0,0 +1,170 @@
+#ifndef BENCH_HOST_DC_PVR_H
+#define BENCH_HOST_DC_PVR_H
+
+/**
+ * Host stand-in for the parts of KallistiOS' <dc/pvr.h> the render kernels
+ * touch. Layouts match the real TA structures so byte counts are the same as
+ * on the Dreamcast, the TA stream itself is redirected into RAM by the
+ * benchmark through RK_TA_TARGET/RK_TA_COMMIT.
+ */
+
+#include <stdint.h>
+
+#define PVR_CMD_POLYHDR 0x80840000
+#define PVR_CMD_VERTEX 0xe0000000
+#define PVR_CMD_VERTEX_EOL 0xf0000000
+
+#define PVR_LIST_OP_POLY 0
+
+#define PVR_CLRFMT_ARGBPACKED 0
+#define PVR_CLRFMT_4FLOATS 1
+#define PVR_CLRFMT_INTENSITY 2
+#define PVR_CLRFMT_INTENSITY_PREV 3
+
+#define PVR_SPECULAR_DISABLE 0
+#define PVR_SPECULAR_ENABLE 1
+
+#define PVR_FILTER_NONE 0
+#define PVR_FILTER_BILINEAR 2
+
+#define PVR_TXRENV_REPLACE 0
+#define PVR_TXRENV_MODULATE 1
+
+#define PVR_TXRFMT_RGB565 (1 << 27)
+#define PVR_TXRFMT_TWIDDLED (0 << 26)
+#define PVR_TXRFMT_VQ_ENABLE (1 << 30)
+
+#define PVR_TA_CMD_TYPE_SHIFT 24
+#define PVR_TA_CMD_CLRFMT_SHIFT 4
+#define PVR_TA_CMD_SPECULAR_SHIFT 2
+#define PVR_TA_CMD_TXRENABLE_SHIFT 3
+#define PVR_TA_PM2_FILTER_SHIFT 13
+#define PVR_TA_PM2_TXRENV_SHIFT 6
+#define PVR_TA_PM2_USIZE_SHIFT 3
+#define PVR_TA_PM2_VSIZE_SHIFT 0
+
+typedef void* pvr_ptr_t;
+
+typedef uint32_t pvr_dr_state_t;
+
+typedef struct pvr_vertex {
+    uint32_t flags;
+    float x, y, z;
+    float u, v;
+    uint32_t argb;
+    uint32_t oargb;
+} pvr_vertex_t;
+
+typedef struct pvr_poly_hdr {
+    uint32_t cmd;
+    uint32_t mode1;
+    uint32_t mode2;
+    uint32_t mode3;
+    uint32_t d1, d2, d3, d4;
+} pvr_poly_hdr_t;
+
+/* a header compiled with PVR_CLRFMT_INTENSITY carries the face color */
+typedef struct pvr_poly_ic_hdr {
+    uint32_t cmd;
+    uint32_t mode1;
+    uint32_t mode2;
+    uint32_t mode3;
+    float a, r, g, b;
+} pvr_poly_ic_hdr_t;
+
+/* only the state the benchmark sets, everything else compiles to 0 */
+typedef struct {
+    int list_type;
+    struct {
+        int specular;
+    } gen;
+    struct {
+        int color;
+    } fmt;
+    struct {
+        int enable;
+        int filter;
+        int env;
+        int width;
+        int height;
+        int format;
+        pvr_ptr_t base;
+    } txr;
+} pvr_poly_cxt_t;
+
+static inline void pvr_poly_cxt_col(pvr_poly_cxt_t* dst, int list_type) {
+    *dst = (pvr_poly_cxt_t){.list_type = list_type};
+}
+
+static inline void pvr_poly_cxt_txr(pvr_poly_cxt_t* dst, int list_type,
+                                    int textureformat, int tw, int th,
+                                    pvr_ptr_t textureaddr, int filtering) {
+    *dst = (pvr_poly_cxt_t){
+        .list_type = list_type,
+        .txr = {.enable = 1,
+                .filter = filtering,
+                .env = PVR_TXRENV_REPLACE,
+                .width = tw,
+                .height = th,
+                .format = textureformat,
+                .base = textureaddr},
+    };
+}
+
+/** Texture sizes are powers of two from 8 to 1024, stored as log2 - 3 */
+static inline uint32_t pvr_txr_size_bits(int size) {
+    return (uint32_t)__builtin_ctz((unsigned)size) - 3;
+}
+
+static inline void pvr_poly_compile(pvr_poly_hdr_t* dst,
+                                    const pvr_poly_cxt_t* src) {
+    *dst = (pvr_poly_hdr_t){
+        .cmd = PVR_CMD_POLYHDR |
+               ((uint32_t)src->list_type << PVR_TA_CMD_TYPE_SHIFT) |
+               ((uint32_t)src->fmt.color << PVR_TA_CMD_CLRFMT_SHIFT) |
+               ((uint32_t)src->gen.specular << PVR_TA_CMD_SPECULAR_SHIFT) |
+               ((uint32_t)src->txr.enable << PVR_TA_CMD_TXRENABLE_SHIFT),
+    };
+    if (src->txr.enable) {
+        dst->mode2 =
+            ((uint32_t)src->txr.filter << PVR_TA_PM2_FILTER_SHIFT) |
+            ((uint32_t)src->txr.env << PVR_TA_PM2_TXRENV_SHIFT) |
+            (pvr_txr_size_bits(src->txr.width) << PVR_TA_PM2_USIZE_SHIFT) |
+            (pvr_txr_size_bits(src->txr.height) << PVR_TA_PM2_VSIZE_SHIFT);
+        dst->mode3 = (uint32_t)src->txr.format |
+                     (((uint32_t)(uintptr_t)src->txr.base & 0xffffff) >> 3);
+    }
+}
+
+typedef struct pvr_sprite_hdr {
+    uint32_t cmd;
+    uint32_t mode1;
+    uint32_t mode2;
+    uint32_t mode3;
+    uint32_t argb;
+    uint32_t oargb;
+    uint32_t d1, d2;
+} pvr_sprite_hdr_t;
+
+typedef struct pvr_sprite_col {
+    uint32_t flags;
+    float ax, ay, az;
+    float bx, by, bz;
+    float cx, cy, cz;
+    float dx, dy;
+    uint32_t d1, d2, d3, d4;
+} pvr_sprite_col_t;
+
+typedef struct pvr_sprite_txr {
+    uint32_t flags;
+    float ax, ay, az;
+    float bx, by, bz;
+    float cx, cy, cz;
+    float dx, dy;
+    uint32_t dummy;
+    uint32_t auv;
+    uint32_t buv;
+    uint32_t cuv;
+} pvr_sprite_txr_t;
+
+#endif  // BENCH_HOST_DC_PVR_H
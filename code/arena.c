@@ -0,0 +1,55 @@
+#include <sh4zamsprites/arena.h>
+#include <stdio.h>
+#include <string.h>
+
+arena_t frame_arena = {.name = "frame"};
+arena_t level_arena = {.name = "level"};
+
+int arena_init(arena_t* arena, const char* name, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    uint8_t* base = memalign(ARENA_ALIGN, size);
+    if (base == NULL) {
+        printf("Error allocating the %lu byte %s arena\n", (unsigned long)size,
+               name);
+        return 0;
+    }
+    *arena = (arena_t){.base = base, .size = size, .name = name};
+    return 1;
+}
+
+void arena_destroy(arena_t* arena) {
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size > arena->size - arena->used) {
+        /* only the first miss is printed, a frame arena would repeat it
+         * every frame */
+        if (arena->failures++ == 0) {
+            printf("Error: %s arena full, %lu of %lu bytes used, %lu more "
+                   "requested\n",
+                   arena->name, (unsigned long)arena->used,
+                   (unsigned long)arena->size, (unsigned long)size);
+        }
+        return NULL;
+    }
+    void* ptr = arena->base + arena->used;
+    arena->used += size;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+    }
+    return ptr;
+}
+
+void arena_print_stats(const arena_t* arena) {
+    printf("%s arena: %lu of %lu KB used, high-water %lu KB, %lu failed "
+           "allocations\n",
+           arena->name, (unsigned long)(arena->used + 1023) / 1024,
+           (unsigned long)arena->size / 1024,
+           (unsigned long)(arena->high_water + 1023) / 1024,
+           (unsigned long)arena->failures);
+}
@@ -0,0 +1,102 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sh4zamsprites/arena.h>
+#include <sh4zamsprites/asset_map.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _arch_dreamcast
+#include <kos/fs.h>
+
+int asset_map_open(asset_map_t* map, const char* filename) {
+    memset(map, 0, sizeof(asset_map_t));
+    file_t fd = fs_open(filename, O_RDONLY);
+    if (fd == FILEHND_INVALID) {
+        printf("Error opening file %s: %s\n", filename, strerror(errno));
+        return 0;
+    }
+    const size_t size = fs_total(fd);
+    if (size == 0 || size == (size_t)-1) {
+        printf("Error reading the size of file %s\n", filename);
+        fs_close(fd);
+        return 0;
+    }
+    /* the romdisk maps files in place, the mapping lives until fs_close */
+    void* mapped = fs_mmap(fd);
+    if (mapped != NULL && ((uintptr_t)mapped & 31) == 0) {
+        *map = (asset_map_t){mapped, size, ASSET_MAPPED, fd};
+        return 1;
+    }
+    if (mapped != NULL) {
+        printf("Warning: %s is mapped at an unaligned address, reading it\n",
+               filename);
+    }
+
+    const size_t mark = arena_mark(&level_arena);
+    void* buffer = level_alloc(size);
+    if (!buffer) {
+        printf("Error allocating %lu bytes for file %s\n", (unsigned long)size,
+               filename);
+        fs_close(fd);
+        return 0;
+    }
+    if (fs_read(fd, buffer, size) != (ssize_t)size) {
+        printf("Error reading file %s\n", filename);
+        level_free(buffer);
+        arena_release(&level_arena, mark);
+        fs_close(fd);
+        return 0;
+    }
+    fs_close(fd);
+    *map = (asset_map_t){buffer, size, ASSET_READ, -1};
+    return 1;
+}
+
+void asset_map_close(asset_map_t* map) {
+    if (map->kind == ASSET_MAPPED) {
+        fs_close(map->fd);
+    } else if (map->kind == ASSET_READ) {
+        level_free((void*)map->data);
+    }
+    memset(map, 0, sizeof(asset_map_t));
+}
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int asset_map_open(asset_map_t* map, const char* filename) {
+    memset(map, 0, sizeof(asset_map_t));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("Error opening file %s: %s\n", filename, strerror(errno));
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        printf("Error reading the size of file %s\n", filename);
+        close(fd);
+        return 0;
+    }
+    /* page aligned, so the 32 byte alignment of the sections holds */
+    void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        printf("Error mapping file %s: %s\n", filename, strerror(errno));
+        return 0;
+    }
+    *map = (asset_map_t){mapped, st.st_size, ASSET_MAPPED, -1};
+    return 1;
+}
+
+void asset_map_close(asset_map_t* map) {
+    if (map->kind == ASSET_MAPPED) {
+        munmap((void*)map->data, map->size);
+    } else if (map->kind == ASSET_READ) {
+        level_free((void*)map->data);  // e.g. a decompressed model
+    }
+    memset(map, 0, sizeof(asset_map_t));
+}
+#endif
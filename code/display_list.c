@@ -0,0 +1,114 @@
+#include <sh4zamsprites/arena.h>
+#include <sh4zamsprites/display_list.h>
+#include <stdio.h>
+#include <string.h>
+
+int dl_init(display_list_t* dl, size_t capacity) {
+    memset(dl, 0, sizeof(display_list_t));
+    capacity &= ~(size_t)31;
+    dl->data = level_alloc(capacity);
+    if (dl->data == NULL) {
+        printf("Error allocating a %lu byte display list\n",
+               (unsigned long)capacity);
+        return 0;
+    }
+    dl->capacity = capacity;
+    return 1;
+}
+
+void dl_free(display_list_t* dl) {
+    level_free(dl->data);
+    memset(dl, 0, sizeof(display_list_t));
+}
+
+void dl_invalidate(display_list_t* dl) {
+    dl->valid = 0;
+    dl->overflowed = 0;
+    dl->key_size = 0;  // matches no key, the next frame draws directly
+}
+
+dl_action_e dl_begin(display_list_t* dl, const void* key, size_t key_size) {
+    if (key_size > DL_MAX_KEY_SIZE) {
+        printf("Error: display list key of %lu bytes\n",
+               (unsigned long)key_size);
+        return DL_DRAW;
+    }
+    if (key_size != dl->key_size || memcmp(dl->key, key, key_size) != 0) {
+        memcpy(dl->key, key, key_size);
+        dl->key_size = key_size;
+        dl->valid = 0;
+        dl->overflowed = 0;
+        dl->stats.misses++;
+        return DL_DRAW;
+    }
+    if (dl->valid) {
+        dl->stats.hits++;
+        return DL_REPLAY;
+    }
+    dl->stats.misses++;
+    if (dl->overflowed || dl->data == NULL) {
+        return DL_DRAW;
+    }
+    dl->size = 0;
+    dl->recording = 1;
+    return DL_RECORD;
+}
+
+void dl_reset(display_list_t* dl) {
+    dl->valid = 0;
+    dl->overflowed = 0;
+    dl->key_size = 0;
+    dl->size = 0;
+    dl->recording = 1;
+}
+
+int dl_end_record(display_list_t* dl) {
+    dl->recording = 0;
+    if (dl->overflowed) {
+        if (dl->stats.overflows++ == 0) {
+            printf("Warning: display list of %lu bytes overflowed, drawing "
+                   "directly\n",
+                   (unsigned long)dl->capacity);
+        }
+        dl->size = 0;
+        return 0;
+    }
+    dl->valid = 1;
+    dl->stats.records++;
+    return 1;
+}
+
+int dl_end_record_from(display_list_t* dl, size_t size) {
+    if (dl_end_record(dl)) {
+        return 1;
+    }
+    dl->size = size;  // written before the overflow, none of it spilled
+    return 0;
+}
+
+void dl_replay(const display_list_t* dl, pvr_dr_state_t* dr_state) {
+    const uint32_t* src = (const uint32_t*)dl->data;
+    const uint32_t* const end = (const uint32_t*)(dl->data + dl->size);
+    for (; src < end; src += 8) {
+        __builtin_prefetch(src + 16);
+        uint32_t* dst = (uint32_t*)pvr_dr_target(*dr_state);
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = src[3];
+        dst[4] = src[4];
+        dst[5] = src[5];
+        dst[6] = src[6];
+        dst[7] = src[7];
+        pvr_dr_commit(dst);
+    }
+}
+
+void dl_print_stats(const display_list_t* dl, const char* label) {
+    printf("%s: %lu hits, %lu misses, %lu recordings, %lu overflows, %.1f of "
+           "%.1f KB\n",
+           label, (unsigned long)dl->stats.hits,
+           (unsigned long)dl->stats.misses, (unsigned long)dl->stats.records,
+           (unsigned long)dl->stats.overflows, dl->size / 1024.0,
+           dl->capacity / 1024.0);
+}
@@ -0,0 +1,47 @@
+#include <sh4zamsprites/frame_sched.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* const phase_names[FRAME_PHASES] = {"other", "prepare",
+                                                      "stall", "submit"};
+
+void frame_sched_init(frame_sched_t* sched) {
+    memset(sched, 0, sizeof(frame_sched_t));
+    sched->phase = FRAME_PHASE_OTHER;
+    sched->phase_start_ns = perf_now_ns();
+}
+
+void frame_sched_end_frame(frame_sched_t* sched) {
+    frame_sched_phase(sched, FRAME_PHASE_OTHER);
+    for (int i = 0; i < FRAME_PHASES; i++) {
+        sched->total_ns[i] += sched->frame_ns[i];
+        if (sched->frame_ns[i] > sched->max_ns[i]) {
+            sched->max_ns[i] = sched->frame_ns[i];
+        }
+        sched->frame_ns[i] = 0;
+    }
+    sched->frames++;
+}
+
+void frame_sched_print_stats(const frame_sched_t* sched, const char* label) {
+    if (sched->frames == 0) {
+        return;
+    }
+    uint64_t frame_ns = 0;
+    for (int i = 0; i < FRAME_PHASES; i++) {
+        frame_ns += sched->total_ns[i];
+    }
+    printf("%s over %lu frames, %.3f ms per frame:\n", label,
+           (unsigned long)sched->frames,
+           (double)frame_ns / sched->frames / 1e6);
+    for (int i = 0; i < FRAME_PHASES; i++) {
+        printf("  %-8s %8.3f ms mean %8.3f ms max %5.1f%%\n", phase_names[i],
+               (double)sched->total_ns[i] / sched->frames / 1e6,
+               (double)sched->max_ns[i] / 1e6,
+               frame_ns ? 100.0 * sched->total_ns[i] / frame_ns : 0.0);
+    }
+    const uint64_t work_ns = frame_ns - sched->total_ns[FRAME_PHASE_STALL];
+    printf("  CPU busy %.3f ms, stalled %.3f ms per frame\n",
+           (double)work_ns / sched->frames / 1e6,
+           (double)sched->total_ns[FRAME_PHASE_STALL] / sched->frames / 1e6);
+}
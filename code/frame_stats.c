@@ -0,0 +1,61 @@
+#include <sh4zamsprites/frame_stats.h>
+#include <sh4zamsprites/perf_timer.h>
+#include <stdio.h>
+#include <string.h>
+
+void frame_stats_reset(frame_stats_t* stats) {
+    memset(stats, 0, sizeof(frame_stats_t));
+    stats->min_ns = UINT64_MAX;
+}
+
+void frame_stats_add(frame_stats_t* stats, uint64_t ns) {
+    if (ns < stats->min_ns) {
+        stats->min_ns = ns;
+    }
+    if (ns > stats->max_ns) {
+        stats->max_ns = ns;
+    }
+    stats->total_ns += ns;
+    stats->frames++;
+    uint64_t bucket = ns / FRAME_STATS_BUCKET_NS;
+    if (bucket >= FRAME_STATS_BUCKETS) {
+        bucket = FRAME_STATS_BUCKETS - 1;
+    }
+    stats->histogram[bucket]++;
+}
+
+void frame_stats_tick(frame_stats_t* stats) {
+    uint64_t now = perf_now_ns();
+    if (stats->last_tick_ns != 0) {
+        frame_stats_add(stats, now - stats->last_tick_ns);
+    }
+    stats->last_tick_ns = now;
+}
+
+uint64_t frame_stats_percentile(const frame_stats_t* stats, float percentile) {
+    if (stats->frames == 0) {
+        return 0;
+    }
+    uint32_t threshold =
+        (uint32_t)((float)stats->frames * percentile / 100.0f + 0.5f);
+    uint32_t seen = 0;
+    for (uint32_t b = 0; b < FRAME_STATS_BUCKETS; b++) {
+        seen += stats->histogram[b];
+        if (seen >= threshold) {
+            return (uint64_t)(b + 1) * FRAME_STATS_BUCKET_NS;
+        }
+    }
+    return stats->max_ns;
+}
+
+void frame_stats_print(const frame_stats_t* stats, const char* label) {
+    if (stats->frames == 0) {
+        printf("%s: no frames\n", label);
+        return;
+    }
+    printf("%s: %lu frames, min %.2f ms, avg %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           label, (unsigned long)stats->frames, stats->min_ns / 1000000.0,
+           (double)stats->total_ns / stats->frames / 1000000.0,
+           frame_stats_percentile(stats, 99.0f) / 1000000.0,
+           stats->max_ns / 1000000.0);
+}
@@ -0,0 +1,291 @@
+#include <dc/pvr.h>
+#include <errno.h>
+#include <malloc.h>
+#include <sh4zamsprites/input_replay.h>
+#include <sh4zamsprites/perf_timer.h>
+#include <sh4zamsprites/stringify.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT_REC_VERSION 1
+#define INPUT_REC_INITIAL_FRAMES (60 * 60)  // grows by doubling
+
+/* render target of the unlocked replay, as big as a texture gets, the
+ * frame has to fit so there is no room for horizontal FSAA at 640 wide */
+#define OFFSCREEN_WIDTH 1024
+#define OFFSCREEN_HEIGHT 512
+
+#ifdef BASEPATH
+#define INPUT_REC_DIR EXPAND_STRINGIFY(BASEPATH)
+#else
+#define INPUT_REC_DIR "/pc/"
+#endif
+
+static struct {
+    input_replay_mode_e mode;
+    char filename[256];
+    input_frame_t* frames;
+    uint32_t num_frames;
+    uint32_t capacity;
+    uint32_t cur_frame;
+    input_frame_t live;
+    input_frame_t* current;
+    pvr_ptr_t offscreen;
+    uint64_t sample_ns;  // when the current frame's state was read
+    frame_stats_t stats;
+    frame_stats_t latency;  // from sample_ns to pvr_scene_finish()
+} replay = {0};
+
+static int load_recording(void) {
+    FILE* file = fopen(replay.filename, "rb");
+    if (!file) {
+        printf("Error opening input recording %s: %s\n", replay.filename,
+               strerror(errno));
+        return 0;
+    }
+    input_rec_hdr_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+        memcmp(hdr.fourcc, "SHZI", 4) != 0 ||
+        hdr.version != INPUT_REC_VERSION ||
+        hdr.frame_size != sizeof(input_frame_t)) {
+        printf("Error: %s is not a compatible input recording\n",
+               replay.filename);
+        fclose(file);
+        return 0;
+    }
+    replay.frames = memalign(32, hdr.num_frames * sizeof(input_frame_t));
+    if (!replay.frames) {
+        printf("Error allocating memory for %lu recorded frames\n",
+               (unsigned long)hdr.num_frames);
+        fclose(file);
+        return 0;
+    }
+    if (fread(replay.frames, sizeof(input_frame_t), hdr.num_frames, file) !=
+        hdr.num_frames) {
+        printf("Error reading recorded frames from %s\n", replay.filename);
+        free(replay.frames);
+        replay.frames = NULL;
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    replay.num_frames = hdr.num_frames;
+    replay.capacity = hdr.num_frames;
+    printf("Replaying %lu frames from %s\n", (unsigned long)replay.num_frames,
+           replay.filename);
+    return 1;
+}
+
+static int save_recording(void) {
+    FILE* file = fopen(replay.filename, "wb");
+    if (!file) {
+        printf("Error opening %s for writing: %s\n", replay.filename,
+               strerror(errno));
+        return 0;
+    }
+    input_rec_hdr_t hdr = {
+        .fourcc = {'S', 'H', 'Z', 'I'},
+        .version = INPUT_REC_VERSION,
+        .frame_size = sizeof(input_frame_t),
+        .num_frames = replay.num_frames,
+    };
+    int success =
+        fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+        fwrite(replay.frames, sizeof(input_frame_t), replay.num_frames, file) ==
+            replay.num_frames;
+    fclose(file);
+    if (!success) {
+        printf("Error writing input recording %s\n", replay.filename);
+        return 0;
+    }
+    printf("Recorded %lu frames to %s\n", (unsigned long)replay.num_frames,
+           replay.filename);
+    return 1;
+}
+
+static void read_controllers(input_frame_t* frame) {
+    frame->port_mask = 0;
+    for (int i = 0; i < INPUT_MAX_PORTS; i++) {
+        maple_device_t* cont = maple_enum_type(i, MAPLE_FUNC_CONTROLLER);
+        if (cont) {
+            frame->port_mask |= 1 << i;
+            frame->ports[i] = *(cont_state_t*)maple_dev_status(cont);
+        }
+    }
+}
+
+/** Whether the frame params render fits the unlocked replay's texture */
+static int offscreen_fits(const pvr_init_params_t* params) {
+    const uint32_t width = vid_mode->width * (params->fsaa_enabled ? 2 : 1);
+    return width <= OFFSCREEN_WIDTH && vid_mode->height <= OFFSCREEN_HEIGHT;
+}
+
+int input_replay_init(input_replay_mode_e mode, const char* name,
+                      const pvr_init_params_t* params) {
+    frame_stats_reset(&replay.stats);
+    frame_stats_reset(&replay.latency);
+    replay.mode = INPUT_LIVE;
+    replay.current = &replay.live;
+    snprintf(replay.filename, sizeof(replay.filename), "%s%s.inputs",
+             INPUT_REC_DIR, name);
+
+    if (mode == INPUT_REPLAY_UNLOCKED && !offscreen_fits(params)) {
+        printf("Error: a %lux%lu%s frame does not fit the %dx%d offscreen "
+               "target, replaying vblank locked\n",
+               (unsigned long)vid_mode->width, (unsigned long)vid_mode->height,
+               params->fsaa_enabled ? " FSAA" : "", OFFSCREEN_WIDTH,
+               OFFSCREEN_HEIGHT);
+        mode = INPUT_REPLAY;
+    }
+    switch (mode) {
+        case INPUT_LIVE:
+            return 1;
+        case INPUT_RECORD:
+            replay.capacity = INPUT_REC_INITIAL_FRAMES;
+            replay.frames = malloc(replay.capacity * sizeof(input_frame_t));
+            if (!replay.frames) {
+                printf("Error allocating memory for input recording\n");
+                return 0;
+            }
+            break;
+        case INPUT_REPLAY_UNLOCKED:
+            replay.offscreen =
+                pvr_mem_malloc(OFFSCREEN_WIDTH * OFFSCREEN_HEIGHT * 2);
+            if (replay.offscreen == NULL) {
+                printf("Error: pvr_mem_malloc failed for offscreen target\n");
+                return 0;
+            }
+            [[fallthrough]];
+        case INPUT_REPLAY:
+            if (!load_recording()) {
+                if (replay.offscreen != NULL) {
+                    pvr_mem_free(replay.offscreen);
+                    replay.offscreen = NULL;
+                }
+                return 0;
+            }
+            break;
+    }
+    replay.mode = mode;
+    return 1;
+}
+
+void input_replay_begin_frame(void) {
+    frame_stats_tick(&replay.stats);
+    replay.sample_ns = perf_now_ns();
+    switch (replay.mode) {
+        case INPUT_LIVE:
+            read_controllers(&replay.live);
+            break;
+        case INPUT_RECORD:
+            if (replay.num_frames == replay.capacity) {
+                input_frame_t* grown = realloc(
+                    replay.frames, 2 * replay.capacity * sizeof(input_frame_t));
+                if (!grown) {
+                    printf("Error growing input recording, stopped at %lu "
+                           "frames\n",
+                           (unsigned long)replay.num_frames);
+                    read_controllers(&replay.live);
+                    replay.current = &replay.live;
+                    return;
+                }
+                replay.frames = grown;
+                replay.capacity *= 2;
+            }
+            replay.current = &replay.frames[replay.num_frames++];
+            read_controllers(replay.current);
+            break;
+        case INPUT_REPLAY:
+        case INPUT_REPLAY_UNLOCKED:
+            if (replay.cur_frame < replay.num_frames) {
+                replay.current = &replay.frames[replay.cur_frame];
+            }
+            replay.cur_frame++;
+            break;
+    }
+}
+
+void input_replay_latch(void) {
+    if (replay.mode != INPUT_LIVE && replay.mode != INPUT_RECORD) {
+        return;  // a replayed frame is whatever was recorded
+    }
+    input_frame_t late;
+    read_controllers(&late);
+    replay.sample_ns = perf_now_ns();
+    /* buttons keep their early state, the frame has already acted on them,
+     * and recording the merged frame keeps replays deterministic */
+    for (int i = 0; i < INPUT_MAX_PORTS; i++) {
+        if (replay.current->port_mask & late.port_mask & (1 << i)) {
+            cont_state_t* state = &replay.current->ports[i];
+            state->joyx = late.ports[i].joyx;
+            state->joyy = late.ports[i].joyy;
+            state->joy2x = late.ports[i].joy2x;
+            state->joy2y = late.ports[i].joy2y;
+            state->ltrig = late.ports[i].ltrig;
+            state->rtrig = late.ports[i].rtrig;
+        }
+    }
+}
+
+cont_state_t* input_replay_state(int port) {
+    if ((replay.current->port_mask & (1 << port)) == 0) {
+        return NULL;
+    }
+    return &replay.current->ports[port];
+}
+
+int input_replay_finished(void) {
+    return (replay.mode == INPUT_REPLAY ||
+            replay.mode == INPUT_REPLAY_UNLOCKED) &&
+           replay.cur_frame > replay.num_frames;
+}
+
+void input_replay_scene_begin(void) {
+    if (replay.mode == INPUT_REPLAY_UNLOCKED) {
+        uint32_t width = OFFSCREEN_WIDTH;
+        uint32_t height = OFFSCREEN_HEIGHT;
+        pvr_scene_begin_txr(replay.offscreen, &width, &height);
+    } else {
+        pvr_scene_begin();
+    }
+}
+
+void input_replay_scene_finish(void) {
+    pvr_scene_finish();
+    frame_stats_add(&replay.latency, perf_now_ns() - replay.sample_ns);
+}
+
+const frame_stats_t* input_replay_stats(void) { return &replay.stats; }
+
+const frame_stats_t* input_replay_latency(void) { return &replay.latency; }
+
+void input_replay_shutdown(void) {
+    switch (replay.mode) {
+        case INPUT_RECORD:
+            save_recording();
+            break;
+        case INPUT_REPLAY:
+            frame_stats_print(&replay.stats, "replay (vblank locked)");
+            break;
+        case INPUT_REPLAY_UNLOCKED:
+            frame_stats_print(&replay.stats, "replay (unlocked)");
+            break;
+        default:
+            break;
+    }
+    if (replay.latency.frames > 0) {
+        frame_stats_print(&replay.latency, "input to scene finish");
+    }
+    if (replay.frames != NULL) {
+        free(replay.frames);
+        replay.frames = NULL;
+    }
+    if (replay.offscreen != NULL) {
+        pvr_mem_free(replay.offscreen);
+        replay.offscreen = NULL;
+    }
+    replay.num_frames = replay.capacity = replay.cur_frame = 0;
+    replay.current = &replay.live;
+    replay.mode = INPUT_LIVE;
+}
@@ -0,0 +1,111 @@
+#include <math.h>
+#include <sh4zamsprites/arena.h>
+#include <sh4zamsprites/light_cache.h>
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t num_faces(const shz_mdl_t* mdl) {
+    return mdl->hdr->num.tri_faces + mdl->hdr->num.quad_faces;
+}
+
+static int vec3_differs(shz_vec3_t a, shz_vec3_t b) {
+    return fabsf(a.x - b.x) > LIGHT_CACHE_EPSILON ||
+           fabsf(a.y - b.y) > LIGHT_CACHE_EPSILON ||
+           fabsf(a.z - b.z) > LIGHT_CACHE_EPSILON;
+}
+
+static int mat4x4_differs(const shz_mat4x4_t* a, const shz_mat4x4_t* b) {
+    for (int i = 0; i < 16; i++) {
+        if (fabsf(a->elem[i] - b->elem[i]) > LIGHT_CACHE_EPSILON) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int light_cache_init(light_cache_t* cache, const shz_mdl_t* mdl) {
+    memset(cache, 0, sizeof(light_cache_t));
+    const uint32_t count = num_faces(mdl);
+    cache->entries = level_alloc(count * sizeof(light_cache_entry_t));
+    if (cache->entries == NULL) {
+        printf("Error allocating a light cache of %lu faces\n",
+               (unsigned long)count);
+        return 0;
+    }
+    cache->count = count;
+    return 1;
+}
+
+void light_cache_free(light_cache_t* cache) {
+    level_free(cache->entries);
+    memset(cache, 0, sizeof(light_cache_t));
+}
+
+int light_cache_begin(light_cache_t* cache, const shz_mdl_t* mdl,
+                      const light_env_t* env) {
+    /* the entries keep one intensity, lit by the one light of env */
+    if (cache->entries == NULL || cache->count != num_faces(mdl) ||
+        env->lights != NULL) {
+        return 0;
+    }
+    cache->cursor = 0;
+    cache->frame = (light_cache_counts_t){0};
+    cache->repack = 0;
+
+    if (!cache->valid || mat4x4_differs(env->model_view, &cache->model_view) ||
+        vec3_differs(env->spec_view_pos, cache->spec_view_pos) ||
+        env->shade_model != cache->shade_model ||
+        env->spec_lut != cache->spec_lut ||
+        (env->intensity_hdr != NULL) != cache->intensity) {
+        cache->mode = LIGHT_CACHE_FULL;
+        cache->valid = 1;
+        cache->intensity = env->intensity_hdr != NULL;
+        cache->shade_model = env->shade_model;
+        cache->spec_lut = env->spec_lut;
+        cache->model_view = *env->model_view;
+        cache->spec_view_pos = env->spec_view_pos;
+        cache->light_pos = env->light_pos;
+        cache->light_color = env->light_color;
+    } else {
+        /* compared with what the entries were lit with rather than the last
+         * frame, so changes below the epsilon can not add up unnoticed */
+        const float moved = shz_vec3_magnitude(
+            shz_vec3_sub(env->light_pos, cache->light_pos));
+        if (moved > LIGHT_CACHE_EPSILON) {
+            cache->mode = LIGHT_CACHE_LIGHT_MOVED;
+            cache->moved = moved;
+            cache->light_pos = env->light_pos;
+        } else {
+            cache->mode = LIGHT_CACHE_CLEAN;
+        }
+        if (vec3_differs(env->light_color, cache->light_color)) {
+            cache->repack = 1;
+            cache->light_color = env->light_color;
+        }
+    }
+
+    const float max_color =
+        SHZ_MAX(SHZ_MAX(env->light_color.x, env->light_color.y),
+                env->light_color.z);
+    cache->drift_limit =
+        max_color > 0.0f ? 1.0f / (255.0f * light_cache_slope(env) * max_color)
+                         : INFINITY;
+    return 1;
+}
+
+void light_cache_end(light_cache_t* cache) {
+    cache->frame.reused = cache->cursor - cache->frame.recomputed;
+    cache->total.recomputed += cache->frame.recomputed;
+    cache->total.reused += cache->frame.reused;
+    cache->frames++;
+}
+
+void light_cache_print_stats(const light_cache_t* cache, const char* label) {
+    const uint32_t frames = cache->frames ? cache->frames : 1;
+    printf("%s: last frame %lu recomputed, %lu reused; per frame %.1f "
+           "recomputed, %.1f reused over %lu frames\n",
+           label, (unsigned long)cache->frame.recomputed,
+           (unsigned long)cache->frame.reused,
+           (double)cache->total.recomputed / frames,
+           (double)cache->total.reused / frames, (unsigned long)cache->frames);
+}
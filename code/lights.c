@@ -0,0 +1,60 @@
+#include <sh4zamsprites/lights.h>
+#include <stdio.h>
+
+static inline int reaches(const light_t* light, const shz_vec3_t* center,
+                          float radius) {
+    if (light->type == LIGHT_DIRECTIONAL) {
+        return 1;
+    }
+    const shz_vec3_t offset = shz_vec3_sub(light->pos, *center);
+    const float reach = light->range + radius;
+    return shz_vec3_dot(offset, offset) < reach * reach;
+}
+
+uint8_t lights_assign(const light_t* lights, uint32_t count,
+                      const shz_vec3_t* center, float radius,
+                      const shz_mat4x4_t* model_view, light_t* out,
+                      light_stats_t* stats) {
+    /* directions only turn, the translation of the model view drops out */
+    const shz_vec3_t view_origin =
+        shz_mat4x4_trans_vec3(model_view, shz_vec3_init(0.0f, 0.0f, 0.0f));
+    uint8_t assigned = 0;
+    for (uint32_t i = 0; i < count && assigned < LIGHTS_MAX; i++) {
+        const light_t* light = &lights[i];
+        if (!reaches(light, center, radius)) {
+            continue;
+        }
+        light_t* lit = &out[assigned++];
+        *lit = *light;
+        lit->spec_pos = shz_mat4x4_trans_vec3(model_view, light->pos);
+        if (light->type == LIGHT_DIRECTIONAL) {
+            lit->spec_pos = shz_vec3_sub(lit->spec_pos, view_origin);
+            lit->inv_range_sq = 0.0f;
+        } else {
+            lit->inv_range_sq = shz_divf(1.0f, light->range * light->range);
+        }
+    }
+    if (stats) {
+        stats->objects++;
+        stats->total += count;
+        stats->assigned += assigned;
+        stats->histogram[assigned]++;
+    }
+    return assigned;
+}
+
+void lights_print_stats(const light_stats_t* stats, const char* label) {
+    if (stats->objects == 0) {
+        return;
+    }
+    printf("%s: %.2f of %.2f lights per object over %lu objects\n", label,
+           (double)stats->assigned / stats->objects,
+           (double)stats->total / stats->objects,
+           (unsigned long)stats->objects);
+    for (int i = 0; i <= LIGHTS_MAX; i++) {
+        if (stats->histogram[i] != 0) {
+            printf("  %d lights %8lu objects\n", i,
+                   (unsigned long)stats->histogram[i]);
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#include <sh4zamsprites/arena.h>
+#include <sh4zamsprites/lz4_stream.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ4_MAGIC 0x184D2204u
+#define LZ4_MIN_MATCH 4
+
+/* frame descriptor FLG bits */
+#define LZ4_FLG_VERSION_MASK 0xC0
+#define LZ4_FLG_VERSION 0x40
+#define LZ4_FLG_BLOCK_INDEPENDENT 0x20
+#define LZ4_FLG_BLOCK_CHECKSUM 0x10
+#define LZ4_FLG_CONTENT_SIZE 0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_DICT_ID 0x01
+
+#define LZ4_BLOCK_UNCOMPRESSED 0x80000000u
+
+typedef struct {
+    uint8_t flags;
+    size_t block_max;
+    uint64_t content_size;
+    size_t header_size;
+} lz4_frame_t;
+
+static inline uint32_t read_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static int parse_frame(const uint8_t* src, size_t size, lz4_frame_t* frame) {
+    if (size < 7 || read_le32(src) != LZ4_MAGIC) {
+        printf("Error: not an LZ4 frame\n");
+        return 0;
+    }
+    frame->flags = src[4];
+    const uint8_t block_size_id = (src[5] >> 4) & 7;
+    if ((frame->flags & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION ||
+        (frame->flags & LZ4_FLG_DICT_ID) || block_size_id < 4) {
+        printf("Error: unsupported LZ4 frame descriptor %02x %02x\n", src[4],
+               src[5]);
+        return 0;
+    }
+    if (!(frame->flags & LZ4_FLG_BLOCK_INDEPENDENT)) {
+        printf("Error: LZ4 frame with linked blocks, compress with -BI\n");
+        return 0;
+    }
+    /* 4: 64KB, 5: 256KB, 6: 1MB, 7: 4MB */
+    frame->block_max = (size_t)1 << (8 + 2 * block_size_id);
+    frame->header_size = 7;
+    frame->content_size = 0;
+    if (frame->flags & LZ4_FLG_CONTENT_SIZE) {
+        if (size < 15) {
+            printf("Error: truncated LZ4 frame header\n");
+            return 0;
+        }
+        frame->content_size =
+            read_le32(src + 6) | (uint64_t)read_le32(src + 10) << 32;
+        frame->header_size = 15;
+    }
+    return 1;
+}
+
+/** Decode one block, returns the decoded size or 0 on malformed input */
+static size_t decode_block(const uint8_t* ip, size_t in_size, uint8_t* out,
+                           size_t out_size) {
+    const uint8_t* const iend = ip + in_size;
+    uint8_t* op = out;
+    uint8_t* const oend = out + out_size;
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+        size_t length = token >> 4;
+        if (length == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) {
+                    return 0;
+                }
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        if (length > (size_t)(iend - ip) || length > (size_t)(oend - op)) {
+            return 0;
+        }
+        memcpy(op, ip, length);
+        ip += length;
+        op += length;
+        if (ip == iend) {
+            break;  // the last sequence only has literals
+        }
+
+        if (iend - ip < 2) {
+            return 0;
+        }
+        const size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out)) {
+            return 0;
+        }
+        length = token & 15;
+        if (length == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) {
+                    return 0;
+                }
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        length += LZ4_MIN_MATCH;
+        if (length > (size_t)(oend - op)) {
+            return 0;
+        }
+        const uint8_t* match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            /* overlapping match, repeats the last offset bytes */
+            while (length--) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op - out;
+}
+
+int lz4_frame_content_size(const void* src, size_t size,
+                           uint64_t* content_size) {
+    lz4_frame_t frame;
+    if (!parse_frame(src, size, &frame)) {
+        return 0;
+    }
+    if (!(frame.flags & LZ4_FLG_CONTENT_SIZE)) {
+        printf("Error: LZ4 frame without content size, compress with "
+               "--content-size\n");
+        return 0;
+    }
+    *content_size = frame.content_size;
+    return 1;
+}
+
+int lz4_frame_decode(const void* src, size_t size, lz4_sink_t sink,
+                     void* ctx) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = ip + size;
+    lz4_frame_t frame;
+    if (!parse_frame(ip, size, &frame)) {
+        return 0;
+    }
+    ip += frame.header_size;
+
+    /* scratch for this call only, rolled back before returning */
+    const size_t mark = arena_mark(&level_arena);
+    uint8_t* staging = level_alloc(frame.block_max);
+    if (!staging) {
+        printf("Error allocating the %lu byte LZ4 staging buffer\n",
+               (unsigned long)frame.block_max);
+        return 0;
+    }
+    const size_t checksum_size =
+        frame.flags & LZ4_FLG_BLOCK_CHECKSUM ? 4 : 0;
+    uint64_t decoded = 0;
+    int success = 0;
+    for (;;) {
+        if (iend - ip < 4) {
+            printf("Error: truncated LZ4 frame\n");
+            break;
+        }
+        const uint32_t block = read_le32(ip);
+        ip += 4;
+        if (block == 0) {
+            success = 1;  // end mark, a content checksum may follow
+            break;
+        }
+        const size_t block_size = block & ~LZ4_BLOCK_UNCOMPRESSED;
+        if (block_size > frame.block_max ||
+            block_size + checksum_size > (size_t)(iend - ip)) {
+            printf("Error: LZ4 block of %lu bytes is out of bounds\n",
+                   (unsigned long)block_size);
+            break;
+        }
+        size_t out_size = block_size;
+        if (block & LZ4_BLOCK_UNCOMPRESSED) {
+            memcpy(staging, ip, block_size);
+        } else {
+            out_size = decode_block(ip, block_size, staging, frame.block_max);
+            if (out_size == 0) {
+                printf("Error: corrupt LZ4 block at %lu\n",
+                       (unsigned long)(ip - (const uint8_t*)src));
+                break;
+            }
+        }
+        ip += block_size + checksum_size;
+        decoded += out_size;
+        if (!sink(ctx, staging, out_size)) {
+            break;
+        }
+    }
+    level_free(staging);
+    arena_release(&level_arena, mark);
+    if (success && (frame.flags & LZ4_FLG_CONTENT_SIZE) &&
+        decoded != frame.content_size) {
+        printf("Error: LZ4 frame decoded to %lu bytes, not %lu\n",
+               (unsigned long)decoded, (unsigned long)frame.content_size);
+        success = 0;
+    }
+    return success;
+}
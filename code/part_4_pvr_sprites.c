@@ -26,7 +26,15 @@
 #include <sh4zam/shz_sh4zam.h>
 #include <sh4zamsprites/cube.h> /* Cube vertices and side strips layout */
 #include <sh4zamsprites/perspective.h> /* Perspective projection matrix functions */
+#include <sh4zamsprites/input_replay.h> /* controller recording and replay */
 #include <sh4zamsprites/tex_loader.h> /* texture management */
+#include <sh4zamsprites/asset_map.h>  /* asset files instead of #embed */
+#include <sh4zamsprites/perf_timer.h> /* asset load timing */
+#include <sh4zamsprites/arena.h>      /* loader memory */
+#include <sh4zamsprites/tr_sort.h>    /* back to front translucent list */
+#include <sh4zamsprites/ta_usage.h>   /* vertex buffer and OPB telemetry */
+#include <sh4zamsprites/quality_governor.h> /* hold 60 fps */
+#include <sh4zamsprites/near_clip.h> /* cubes behind the eye */
 
 #define DEFAULT_FOV 75.0f  // Field of view, adjust with dpad up/down
 #define ZOOM_SPEED 0.3f
@@ -34,9 +42,20 @@
 #define MIN_ZOOM -10.0f
 #define MAX_ZOOM 15.0f
 #define LINE_WIDTH 1.0f
+#define LEVEL_ARENA_SIZE (192 * 1024)  // staging for uploads, LZ4 and reads
+#define FRAME_ARENA_SIZE (4 * 1024)    // the translucent batch
+#define TR_PRESORT 1  // sort the TR list on the CPU and turn autosort off
 #define WIREFRAME_MIN_GRID_LINES 0
 #define WIREFRAME_MAX_GRID_LINES 10
 #define WIREFRAME_GRID_LINES_STEP 5
+#define CUBES_MAX_PER_SIDE (17 - SUPERSAMPLING)  // CUBES_CUBE_MAX at best
+#define CUBES_MIN_PER_SIDE 8
+
+/* Set to 0 to always render at full quality, see quality_governor.h. Replays
+ * are never governed, so builds can be compared on the same frames */
+#ifndef QUALITY_GOVERNOR
+#define QUALITY_GOVERNOR 1
+#endif
 typedef enum : uint8_t {
     TEXTURED_TR = 0,   // Textured transparent cube
     CUBES_CUBE_MIN,    // Cube of cubes, 7x7x7 cubes, in 6 different color
@@ -48,9 +67,38 @@ typedef enum : uint8_t {
 } render_mode_e;
 
 static render_mode_e render_mode = TEXTURED_TR;
+
+/** Quality knobs, cheapest to lose first */
+typedef enum : uint8_t {
+    KNOB_GRID = 0,
+    KNOB_CUBES,
+    KNOBS,
+} knob_e;
+
+static qg_knob_t knobs[KNOBS] = {
+    [KNOB_GRID] = {"grid lines", WIREFRAME_MAX_GRID_LINES,
+                   WIREFRAME_MIN_GRID_LINES, WIREFRAME_MAX_GRID_LINES,
+                   QG_COST_BOTH, 0},
+    [KNOB_CUBES] = {"cubes per side", CUBES_MAX_PER_SIDE, CUBES_MIN_PER_SIDE,
+                    CUBES_MAX_PER_SIDE, QG_COST_BOTH, 0},
+};
 static float fovy = DEFAULT_FOV;
 static uint32_t dpad_right_down = 0;
 
+#if ASSETFILES == 0 && ASSETLZ4 == 1
+static const alignas(32) uint8_t texture256_lz4[] = {
+#embed "../build/pvrtex/rgb565_vq_tw/sh4zam256.dt.lz4"
+};
+static const alignas(32) uint8_t texture128_lz4[] = {
+#embed "../build/pvrtex/argb1555_vq_tw/sh4zam128_t.dt.lz4"
+};
+static const alignas(32) uint8_t texture32_lz4[] = {
+#embed "../build/pvrtex/pal4/sh4zam32_w.dt.lz4"
+};
+static const alignas(32) uint8_t palette32_raw[] = {
+#embed "../build/pvrtex/pal4/sh4zam32_w.dt.pal"
+};
+#elif ASSETFILES == 0
 static const alignas(32) uint8_t texture256_raw[] = {
 #embed "../build/pvrtex/rgb565_vq_tw/sh4zam256.dt"
 };
@@ -64,11 +112,38 @@ static const alignas(32) uint8_t texture32_raw[] = {
 static const alignas(32) uint8_t palette32_raw[] = {
 #embed "../build/pvrtex/pal4/sh4zam32_w.dt.pal"
 };
+#endif
 
 static alignas(32) dttex_info_t texture256x256;
 static alignas(32) dttex_info_t texture128x128;
 static alignas(32) dttex_info_t texture32x32;
 
+/* the embedded textures upload in the background, a fence stays 0 when its
+ * texture was loaded before the main loop */
+static tex_upload_queue_t uploads;
+static tex_upload_fence_t texture256_fence;
+static tex_upload_fence_t texture128_fence;
+static tex_upload_fence_t texture32_fence;
+
+/** Whether the texture the render mode samples is in VRAM yet */
+static inline int render_mode_ready(void) {
+    tex_upload_fence_t fence = 0;
+    switch (render_mode) {
+        case TEXTURED_TR:
+            fence = texture256_fence;
+            break;
+        case CUBES_CUBE_MIN:
+            fence = texture128_fence;
+            break;
+        case CUBES_CUBE_MAX:
+            fence = texture32_fence;
+            break;
+        default:
+            break;
+    }
+    return fence == 0 || tex_upload_done(&uploads, fence);
+}
+
 static inline void set_cube_transform(float scale) {
     alignas(32) shz_mat4x4_t wmat = {0};
     shz_xmtrx_init_translation(cube_state.pos.x, cube_state.pos.y,
@@ -116,6 +191,33 @@ static inline void draw_textured_sprite(shz_vec4_t* tverts, uint32_t side,
     pvr_dr_commit(quad);
 }
 
+/** draw_textured_sprite() into memory, where the two halves are contiguous */
+static inline void store_textured_sprite(pvr_sprite_txr_t* quad,
+                                         shz_vec4_t* tverts, uint32_t side) {
+    shz_vec4_t* ac = tverts + cube_side_strips[side][0];
+    shz_vec4_t* bc = tverts + cube_side_strips[side][2];
+    shz_vec4_t* cc = tverts + cube_side_strips[side][3];
+    shz_vec4_t* dc = tverts + cube_side_strips[side][1];
+    quad->flags = PVR_CMD_VERTEX_EOL;
+    quad->ax = ac->x;
+    quad->ay = ac->y;
+    quad->az = ac->z;
+    quad->bx = bc->x;
+    quad->by = bc->y;
+    quad->bz = bc->z;
+    quad->cx = cc->x;
+    quad->cy = cc->y;
+    quad->cz = cc->z;
+    quad->dx = dc->x;
+    quad->dy = dc->y;
+    quad->auv =
+        PVR_PACK_16BIT_UV(cube_tex_coords[0][0], cube_tex_coords[0][1]);
+    quad->cuv =
+        PVR_PACK_16BIT_UV(cube_tex_coords[3][0], cube_tex_coords[3][1]);
+    quad->buv =
+        PVR_PACK_16BIT_UV(cube_tex_coords[2][0], cube_tex_coords[2][1]);
+}
+
 void render_txr_tr_cube(void) {
     set_cube_transform(1.0f);
     alignas(32) shz_vec4_t tverts[8] = {0};
@@ -138,6 +240,26 @@ void render_txr_tr_cube(void) {
     pvr_sprite_hdr_t hdr;
     pvr_sprite_compile(&hdr, &cxt);
     hdr.argb = 0x7FFFFFFF;
+#if TR_PRESORT == 1
+    /* header and sprite per side, sorted by the mean depth of its corners */
+    tr_batch_t batch;
+    if (!tr_batch_init(&batch, &frame_arena, 6, 6 * 3)) {
+        return;
+    }
+    for (int i = 0; i < 6; i++) {
+        const float depth = (tverts[cube_side_strips[i][0]].z +
+                             tverts[cube_side_strips[i][1]].z +
+                             tverts[cube_side_strips[i][2]].z +
+                             tverts[cube_side_strips[i][3]].z) *
+                            0.25f;
+        pvr_sprite_hdr_t* hdrpntr = tr_batch_add(&batch, depth, 3);
+        *hdrpntr = hdr;
+        hdrpntr->oargb = cube_side_colors[i];
+        store_textured_sprite((pvr_sprite_txr_t*)(hdrpntr + 1), tverts, i);
+    }
+    tr_batch_sort(&batch);
+    tr_batch_submit(&batch, &dr_state);
+#else
     for (int i = 0; i < 6; i++) {
         pvr_sprite_hdr_t* hdrpntr = (pvr_sprite_hdr_t*)pvr_dr_target(dr_state);
         *hdrpntr = hdr;
@@ -145,9 +267,23 @@ void render_txr_tr_cube(void) {
         pvr_dr_commit(hdrpntr);
         draw_textured_sprite(tverts, i, &dr_state);
     }
+#endif
     pvr_dr_finish();
 }
 
+/**
+ * A textured sprite cannot be cut, the PVR derives its fourth corner and UV
+ * from the other three, so a cube that reaches behind the near plane is left
+ * out rather than drawn with corners projected through the eye.
+ */
+static inline int cube_crosses_near(const shz_vec4_t* tverts) {
+    int crosses = 0;
+    for (int i = 0; i < 8; i++) {
+        crosses |= tverts[i].w < NEAR_CLIP_W;
+    }
+    return crosses;
+}
+
 void render_cubes_cube() {
     set_cube_transform(1.0f);
 
@@ -158,7 +294,7 @@ void render_cubes_cube() {
     pvr_sprite_cxt_col(&cxt, list_type);
     uint32_t cuberoot_cubes = 3;
     if (render_mode == CUBES_CUBE_MAX) {
-        cuberoot_cubes = 17 - (SUPERSAMPLING * 1);
+        cuberoot_cubes = knobs[KNOB_CUBES].value;
         // 15x15x15 cubes, 6 faces per cube, 2 triangles per face @60 fps ==
         // 2430000 triangles pr. second 17*17*16 cubes, or 3329280 triangles pr.
         // second, works with FSAA disabled, set #define SUPERSAMPLING 0
@@ -198,6 +334,14 @@ void render_cubes_cube() {
         cuberoot_cubes -
         (SUPERSAMPLING == 0 && render_mode == CUBES_CUBE_MAX ? 1 : 0);
 
+    /* every cube lies within the corners of the grid, while all of those are
+     * in front of the near plane no cube needs looking at on its own */
+    int grid_crosses_near = 0;
+    for (int i = 0; i < 8; i++) {
+        grid_crosses_near |=
+            shz_xmtrx_transform_vec4(cube_vertices[i]).w < NEAR_CLIP_W;
+    }
+
     for (int cx = 0; cx < xiterations; cx++) {
         for (uint32_t cy = 0; cy < cuberoot_cubes; cy++) {
             for (uint32_t cz = 0; cz < cuberoot_cubes; cz++) {
@@ -253,6 +397,9 @@ void render_cubes_cube() {
                                      .y = cube_pos.y + cube_size.y,
                                      .z = cube_pos.z,
                                      .w = 1.0f})};
+                if (grid_crosses_near && cube_crosses_near(tverts)) {
+                    continue;
+                }
                 for (int i = 0; i < 8; i++) {
                     tverts[i].z = shz_invf_fsrra(tverts[i].w);  // 1/w
                     tverts[i].x *= tverts[i].z;
@@ -396,50 +543,53 @@ void render_wire_cube(void) {
         draw_sprite_line(dc, cc, centerz, &dr_state);
         draw_sprite_line(ac, bc, centerz, &dr_state);
     }
+    /* the quality governor may leave out some of the grid lines */
+    const uint32_t grid_size =
+        SHZ_MIN(cube_state.grid_size, (uint32_t)knobs[KNOB_GRID].value);
     shz_vec4_t wiredir1 = (shz_vec4_t){.e = {1.0f, 0.0f, 0.0f, 1.0f}};
     shz_vec4_t wiredir2 = (shz_vec4_t){.e = {0.0f, 1.0f, 0.0f, 0.0f}};
     render_wire_grid(cube_vertices + 0, cube_vertices + 3, &wiredir1, &wiredir2,
-                     cube_state.grid_size, cube_side_colors[0], &dr_state);
+                     grid_size, cube_side_colors[0], &dr_state);
     if (render_mode == WIREFRAME_FILLED) {
-        for (uint32_t i = 1; i < cube_state.grid_size + 1; i++) {
+        for (uint32_t i = 1; i < grid_size + 1; i++) {
             shz_vec4_t inner_from = *(cube_vertices + 0);
             shz_vec4_t inner_to = *(cube_vertices + 3);
             float z_offset = shz_divf_fsrra(i * ((inner_from.x - inner_to.x)),
-                                            (cube_state.grid_size + 1));
+                                            (grid_size + 1));
             inner_from.z += z_offset;
             inner_to.z += z_offset;
             render_wire_grid(&inner_from, &inner_to, &wiredir1, &wiredir2,
-                             cube_state.grid_size, 0x55FFFFFF, &dr_state);
+                             grid_size, 0x55FFFFFF, &dr_state);
         }
     }
     render_wire_grid(cube_vertices + 4, cube_vertices + 7, &wiredir1, &wiredir2,
-                     cube_state.grid_size, cube_side_colors[1], &dr_state);
+                     grid_size, cube_side_colors[1], &dr_state);
     wiredir2.y = 0;
     wiredir2.z = 1;
     render_wire_grid(cube_vertices + 0, cube_vertices + 4, &wiredir1, &wiredir2,
-                     cube_state.grid_size, cube_side_colors[5], &dr_state);
+                     grid_size, cube_side_colors[5], &dr_state);
     if (render_mode == WIREFRAME_FILLED) {
-        for (uint32_t i = 1; i < cube_state.grid_size + 1; i++) {
+        for (uint32_t i = 1; i < grid_size + 1; i++) {
             shz_vec4_t inner_from = *(cube_vertices + 0);
             shz_vec4_t inner_to = *(cube_vertices + 4);
             float y_offset = shz_divf_fsrra(i * ((inner_to.x - inner_from.x)),
-                                            cube_state.grid_size + 1);
+                                            grid_size + 1);
             inner_from.y += y_offset;
             inner_to.y += y_offset;
             render_wire_grid(&inner_from, &inner_to, &wiredir1, &wiredir2,
-                             cube_state.grid_size, 0x55FFFFFF, &dr_state);
+                             grid_size, 0x55FFFFFF, &dr_state);
         }
     }
     render_wire_grid(cube_vertices + 1, cube_vertices + 5, &wiredir1, &wiredir2,
-                     cube_state.grid_size, cube_side_colors[4], &dr_state);
+                     grid_size, cube_side_colors[4], &dr_state);
     wiredir1.x = 0;
     wiredir1.z = 1;
     wiredir2.z = 0;
     wiredir2.y = 1;
     render_wire_grid(cube_vertices + 4, cube_vertices + 3, &wiredir1, &wiredir2,
-                     cube_state.grid_size, cube_side_colors[3], &dr_state);
+                     grid_size, cube_side_colors[3], &dr_state);
     render_wire_grid(cube_vertices + 6, cube_vertices + 1, &wiredir1, &wiredir2,
-                     cube_state.grid_size, cube_side_colors[2], &dr_state);
+                     grid_size, cube_side_colors[2], &dr_state);
     pvr_dr_finish();
 }
 
@@ -457,10 +607,13 @@ static inline void cube_reset_state() {
 }
 
 static inline int update_state() {
-    for (int i = 0; i < 4; i++) {
-        maple_device_t* cont = maple_enum_type(i, MAPLE_FUNC_CONTROLLER);
-        if (cont) {
-            cont_state_t* state = (cont_state_t*)maple_dev_status(cont);
+    input_replay_begin_frame();
+    if (input_replay_finished()) {
+        return 0;
+    }
+    for (int i = 0; i < INPUT_MAX_PORTS; i++) {
+        cont_state_t* state = input_replay_state(i);
+        if (state) {
             if (state->buttons & CONT_START) {
                 return 0;
             }
@@ -542,55 +695,107 @@ int main(void) {
         3 << 19,        // Vertex buffer size, 1.5MB
         0,              // No DMA15
         SUPERSAMPLING,  // Set horisontal FSAA
-        0,              // Translucent Autosort enabled.
+        TR_PRESORT,     // Translucent Autosort disabled when presorted
         3,              // Extra OPBs
         0,              // vbuf_doublebuf_disabled
     };
     vid_set_mode(DM_640x480, PM_RGB888P);
     pvr_set_bg_color(0, 0, 0);
+    ta_usage_init(TAUSAGE, "part_4_pvr_sprites", &params);
     pvr_init(&params);
     PVR_SET(PVR_OBJECT_CLIP, 0.00001f);
+    input_replay_init(INPUTREPLAY, "part_4_pvr_sprites", &params);
 
-    if (!pvrtex_load_blob(&texture256_raw, &texture256x256)) return -1;
-    if (!pvrtex_load_blob(&texture128_raw, &texture128x128)) return -1;
+    if (!arena_init(&level_arena, "level", LEVEL_ARENA_SIZE) ||
+        !arena_init(&frame_arena, "frame", FRAME_ARENA_SIZE))
+        return -1;
+    const uint64_t assets_start_ns = perf_now_ns();
+#if ASSETFILES == 1
+    if (!pvrtex_load_file(ASSET_DIR "pvrtex/rgb565_vq_tw/sh4zam256.dt",
+                          &texture256x256))
+        return -1;
+    if (!pvrtex_load_file(ASSET_DIR "pvrtex/argb1555_vq_tw/sh4zam128_t.dt",
+                          &texture128x128))
+        return -1;
+    if (!pvrtex_load_file(ASSET_DIR "pvrtex/pal4/sh4zam32_w.dt",
+                          &texture32x32))
+        return -1;
+    if (!pvrtex_load_palette_file(ASSET_DIR "pvrtex/pal4/sh4zam32_w.dt.pal",
+                                  PVR_PAL_RGB565, 256))
+        return -1;
+#elif ASSETLZ4 == 1
+    if (!pvrtex_load_lz4(texture256_lz4, sizeof(texture256_lz4),
+                         &texture256x256))
+        return -1;
+    if (!pvrtex_load_lz4(texture128_lz4, sizeof(texture128_lz4),
+                         &texture128x128))
+        return -1;
+    if (!pvrtex_load_lz4(texture32_lz4, sizeof(texture32_lz4), &texture32x32))
+        return -1;
+    if (!pvrtex_load_palette_blob(palette32_raw, PVR_PAL_RGB565, 256))
+        return -1;
+#else
+    if (!tex_upload_init(&uploads)) return -1;
+    texture256_fence =
+        pvrtex_load_async(&uploads, &texture256_raw, &texture256x256);
+    texture128_fence =
+        pvrtex_load_async(&uploads, &texture128_raw, &texture128x128);
     // if (!pvrtex_load_palette_blob(palette64_raw, PVR_PAL_ARGB1555, 0))
     //   return -1;
-    if (!pvrtex_load_blob(&texture32_raw, &texture32x32)) return -1;
+    texture32_fence = pvrtex_load_async(&uploads, &texture32_raw, &texture32x32);
+    if (!texture256_fence || !texture128_fence || !texture32_fence) return -1;
     if (!pvrtex_load_palette_blob(palette32_raw, PVR_PAL_RGB565, 256))
         return -1;
+#endif
+    printf("Assets loaded in %.2f ms\n",
+           (double)(perf_now_ns() - assets_start_ns) / 1e6);
 
     cube_reset_state();
 
+    quality_governor_t governor;
+    qg_init(&governor, knobs, KNOBS, QG_BUDGET_NS);
+    governor.enabled = QUALITY_GOVERNOR == 1 && INPUTREPLAY < INPUT_REPLAY;
     while (update_state()) {
+        /* only the knobs of the mode on screen are stepped */
+        knobs[KNOB_GRID].idle =
+            render_mode != WIREFRAME_EMPTY && render_mode != WIREFRAME_FILLED;
+        knobs[KNOB_CUBES].idle = render_mode != CUBES_CUBE_MAX;
 #if SHOWFRAMETIMES == 1
         vid_border_color(255, 0, 0);
 #endif
-        pvr_wait_ready();
+        qg_wait_ready(&governor);
+        arena_reset(&frame_arena);
 #if SHOWFRAMETIMES == 1
         vid_border_color(0, 255, 0);
 #endif
-        pvr_scene_begin();
-        switch (render_mode) {
+        input_replay_scene_begin();
+        ta_usage_scene_begin();
+        /* an empty scene until the mode's texture has landed */
+        switch (render_mode_ready() ? render_mode : MAX_RENDERMODE) {
             case TEXTURED_TR:
                 pvr_list_begin(PVR_LIST_TR_POLY);
                 render_txr_tr_cube();
                 pvr_list_finish();
+                ta_usage_list_finish(PVR_LIST_TR_POLY);
                 break;
             case WIREFRAME_FILLED:
             case WIREFRAME_EMPTY:
                 pvr_list_begin(PVR_LIST_OP_POLY);
                 render_wire_cube();
                 pvr_list_finish();
+                ta_usage_list_finish(PVR_LIST_OP_POLY);
                 break;
             case CUBES_CUBE_MAX:
                 pvr_list_begin(PVR_LIST_OP_POLY);
                 render_cubes_cube();
                 pvr_list_finish();
+                ta_usage_list_finish(PVR_LIST_OP_POLY);
                 break;
             case CUBES_CUBE_MIN:
                 pvr_list_begin(PVR_LIST_PT_POLY);
                 render_cubes_cube();
                 pvr_list_finish();
+                ta_usage_list_finish(PVR_LIST_PT_POLY);
                 break;
             default:
                 break;
@@ -598,12 +803,24 @@ int main(void) {
 #if SHOWFRAMETIMES == 1
         vid_border_color(0, 0, 255);
 #endif
-        pvr_scene_finish();
+        ta_usage_scene_finish();
+        input_replay_scene_finish();
     }
     printf("Cleaning up\n");
+    input_replay_shutdown();
+    ta_usage_shutdown();
+    qg_print_stats(&governor, "Quality governor");
+#if ASSETFILES == 0 && ASSETLZ4 == 0
+    tex_upload_shutdown(&uploads);
+    tex_upload_print_stats(&uploads, "Texture uploads");
+#endif
     pvrtex_unload(&texture256x256);
     pvrtex_unload(&texture128x128);
     pvrtex_unload(&texture32x32);
+    arena_print_stats(&frame_arena);
+    arena_destroy(&frame_arena);
+    arena_print_stats(&level_arena);
+    arena_destroy(&level_arena);
     pvr_shutdown();  // Clean up PVR resources
     vid_shutdown();  // This function reinitializes the video system to what
                      // dcload and friends expect it to be Run the main
@@ -26,13 +26,17 @@
 #include <sh4zam/shz_sh4zam.h>
 #include <sh4zamsprites/cube.h> /* Cube vertices and side strips layout */
 #include <sh4zamsprites/perspective.h> /* Perspective projection matrix functions */
-#include <sh4zamsprites/shz_mdl.h>     /* sh4zam model loading and rendering */
+#include <sh4zamsprites/input_replay.h> /* controller recording and replay */
+#include <sh4zamsprites/stl_mesh.h>    /* welded meshes from STL files */
+#include <sh4zamsprites/arena.h>       /* per frame scratch memory */
+#include <sh4zamsprites/ta_usage.h>    /* vertex buffer and OPB telemetry */
 
 #define DEFAULT_FOV 75.0f  // Field of view, adjust with dpad up/down
 #define ZOOM_SPEED 0.3f
 #define MIN_ZOOM -20.0f
 #define MAX_ZOOM 15.0f
 #define LINE_WIDTH 1.0f
+#define FRAME_ARENA_SIZE (64 * 1024)  // the teapot projects 3319 vertices
 
 static float fovy = DEFAULT_FOV;
 
@@ -99,10 +103,16 @@ static inline void draw_sprite_line(shz_vec4_t* from, shz_vec4_t* to,
     pvr_dr_commit(quad);
 }
 
-typedef struct __attribute__((packed)) {
-    struct shz_mdl_tri_face_t;
-    uint16_t attrbytecount;
-} stl_poly_t;
+/* The STL is welded into an indexed mesh once at startup, the packed and
+ * unaligned records are only read there. Each frame projects the shared
+ * vertices once into the frame arena and the faces pick them up by index. */
+static stl_mesh_t teapot;
+static camera_t camera;
+
+static int load_teapot(void) {
+    return stl_mesh_load(&teapot, teapot_stl, sizeof(teapot_stl),
+                         STL_MESH_WELD_EPSILON);
+}
 
 static uint16_t light_rotation = 13337;
 static uint16_t light_height = 4999;
@@ -113,6 +123,11 @@ static inline shz_vec3_t perspective(shz_vec4_t v) {
 }
 
 void render_teapot(void) {
+    shz_vec3_t* projected =
+        arena_alloc(&frame_arena, teapot.num_verts * sizeof(shz_vec3_t));
+    if (projected == NULL) {
+        return;
+    }
     const float screen_width = vid_mode->width * XSCALE;
     const float screen_height = vid_mode->height;
     const float near_z = 0.0f;
@@ -120,30 +135,28 @@ void render_teapot(void) {
     const float aspect = shz_divf_fsrra(screen_width, (screen_height * XSCALE));
 
     shz_vec3_t eye = shz_vec3_init(0.0f, -0.00001f, 30.0f);
-    shz_xmtrx_init_identity();
-    kos_lookAt(eye, (shz_vec3_t){.e = {0.0f, 0.0f, 0.0f}},
-               (shz_vec3_t){.e = {0.0f, 0.0f, 1.0f}});
-
-    shz_xmtrx_translate(cube_state.pos.x, cube_state.pos.y - 10.0f,
-                        cube_state.pos.z - 10.0f);
+    camera_set_screen(&camera, screen_width, screen_height);
+    camera_set_perspective(&camera, fov, aspect, near_z);
+    camera_look_at(&camera, eye, (shz_vec3_t){.e = {0.0f, 0.0f, 0.0f}},
+                   (shz_vec3_t){.e = {0.0f, 0.0f, 1.0f}});
+
+    alignas(32) shz_mat4x4_t model;
+    shz_xmtrx_init_translation(cube_state.pos.x, cube_state.pos.y - 10.0f,
+                               cube_state.pos.z - 10.0f);
     shz_xmtrx_apply_rotation_x(cube_state.rot.x + SHZ_F_PI * 0.75f - 0.1f);
     shz_xmtrx_apply_rotation_y(cube_state.rot.y + SHZ_F_PI * 0.25f);
+    shz_xmtrx_store_4x4(&model);
+    camera_set_model(&camera, &model);
 
-    shz_mat4x4_t model_view = {0};
-    shz_mat4x4_t inverse_transpose = {0};
-    shz_xmtrx_store_4x4(&model_view);
-    shz_mat4x4_inverse(&model_view, &inverse_transpose);
-    shz_mat4x4_transpose(&inverse_transpose, &inverse_transpose);
-
-    shz_xmtrx_init_identity();
-    shz_xmtrx_apply_screen(screen_width, screen_height);
-    shz_xmtrx_apply_perspective(fov, aspect, near_z);
-    shz_xmtrx_apply_4x4(&model_view);
+    /* leaves the MVP in the XMTRX */
+    camera_update(&camera);
+    shz_mat4x4_t* model_view = &camera.model_view;
+    shz_mat4x4_t* inverse_transpose = &camera.normal;
 
     if (light_rotation == 13337) {
         print_xmtrx("MVP Matrix");
-        print_mat4x4("ModelView Matrix", &model_view);
-        print_mat4x4("Inverse Transpose Matrix", &inverse_transpose);
+        print_mat4x4("ModelView Matrix", model_view);
+        print_mat4x4("Inverse Transpose Matrix", inverse_transpose);
     }
 
     pvr_dr_state_t dr_state;
@@ -217,9 +230,6 @@ void render_teapot(void) {
     light2ndhalf->dy = light_quad[3].y;
     pvr_dr_commit(light);
 
-    uint32_t num_polys = *((uint32_t*)(teapot_stl + 80));
-    stl_poly_t* polys = (stl_poly_t*)(teapot_stl + 84);
-
     pvr_poly_cxt_t cxt;
     pvr_poly_cxt_col(&cxt, PVR_LIST_OP_POLY);
     cxt.gen.culling = PVR_CULLING_CW;
@@ -228,17 +238,26 @@ void render_teapot(void) {
     pvr_poly_compile(hdrpntr, &cxt);
     pvr_dr_commit(hdrpntr);
 
-    shz_vec3_t spec_light_pos = shz_mat4x4_trans_vec3(&model_view, light_pos);
-    shz_vec3_t spec_view_pos = shz_mat4x4_trans_vec3(&model_view, eye);
+    shz_vec3_t spec_light_pos = shz_mat4x4_trans_vec3(model_view, light_pos);
+    shz_vec3_t spec_view_pos = shz_mat4x4_trans_vec3(model_view, eye);
 
-    for (uint32_t p = 0; p < num_polys; p++) {
+    for (uint32_t v = 0; v < teapot.num_verts; v++) {
+        __builtin_prefetch(&teapot.positions[v] + 8);
+        projected[v] = perspective(shz_xmtrx_transform_vec4(
+            (shz_vec4_t){.xyz = teapot.positions[v], .w = 1.0f}));
+    }
+
+    for (uint32_t p = 0; p < teapot.num_faces; p++) {
+        const uint32_t* face = &teapot.indices[p * 3];
+        const shz_vec3_t* normal = &teapot.face_normals[p];
+        const shz_vec3_t* v1 = &teapot.positions[face[0]];
         /* ambient light */
         shz_vec3_t final_light = (shz_vec3_t){.x = 0.1f, .y = 0.1f, .z = 0.1f};
 
         /* diffuse light */
-        shz_vec3_t face_normal = shz_vec3_normalize(polys[p].normal);
+        shz_vec3_t face_normal = *normal;
         shz_vec3_t light_dir =
-            shz_vec3_normalize(shz_vec3_sub(light_pos, polys[p].v1));
+            shz_vec3_normalize(shz_vec3_sub(light_pos, *v1));
 
         float light_intensity =
             SHZ_MAX(shz_vec3_dot(face_normal, light_dir), 0.0f);
@@ -246,9 +265,9 @@ void render_teapot(void) {
         if (light_intensity > 0.0f) {
             /* specular light */
             shz_vec3_t spec_normal = shz_vec3_normalize(
-                shz_mat4x4_trans_vec3(&inverse_transpose, polys[p].normal));
+                shz_mat4x4_trans_vec3(inverse_transpose, *normal));
             shz_vec3_t spec_vert_pos =
-                shz_mat4x4_trans_vec3(&model_view, polys[p].v1);
+                shz_mat4x4_trans_vec3(model_view, *v1);
             shz_vec3_t spec_light_dir =
                 shz_vec3_normalize(shz_vec3_sub(spec_light_pos, spec_vert_pos));
 
@@ -267,15 +286,9 @@ void render_teapot(void) {
                                             light_intensity * light_color.y,
                                             light_intensity * light_color.z}});
         final_light = shz_vec3_clamp(final_light, 0.0f, 1.0f);
-        stl_poly_t* poly = &polys[p];
-        alignas(32) shz_vec3_t v1 = perspective(
-            shz_xmtrx_transform_vec4((shz_vec4_t){.xyz = poly->v1, .w = 1.0f}));
-
-        alignas(32) shz_vec3_t v2 = perspective(
-            shz_xmtrx_transform_vec4((shz_vec4_t){.xyz = poly->v2, .w = 1.0f}));
-
-        alignas(32) shz_vec3_t v3 = perspective(
-            shz_xmtrx_transform_vec4((shz_vec4_t){.xyz = poly->v3, .w = 1.0f}));
+        const shz_vec3_t* p1 = &projected[face[0]];
+        const shz_vec3_t* p2 = &projected[face[1]];
+        const shz_vec3_t* p3 = &projected[face[2]];
 
         const uint32_t vertex_color = ((uint32_t)(final_light.x * 255.0f) << 16) |
                     ((uint32_t)(final_light.y * 255.0f) << 8) |
@@ -283,24 +296,24 @@ void render_teapot(void) {
 
         pvr_vertex_t* tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
         tri->flags = PVR_CMD_VERTEX;
-        tri->x = v1.x;
-        tri->y = v1.y;
-        tri->z = v1.z;
+        tri->x = p1->x;
+        tri->y = p1->y;
+        tri->z = p1->z;
         tri->argb = vertex_color;
         pvr_dr_commit(tri);
         tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
         tri->flags = PVR_CMD_VERTEX;
-        tri->x = v2.x;
-        tri->y = v2.y;
-        tri->z = v2.z;
+        tri->x = p2->x;
+        tri->y = p2->y;
+        tri->z = p2->z;
         tri->argb = vertex_color;
 
         pvr_dr_commit(tri);
         tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
         tri->flags = PVR_CMD_VERTEX_EOL;
-        tri->x = v3.x;
-        tri->y = v3.y;
-        tri->z = v3.z;
+        tri->x = p3->x;
+        tri->y = p3->y;
+        tri->z = p3->z;
         pvr_dr_commit(tri);
     }
     pvr_dr_finish();
@@ -318,10 +331,13 @@ static inline void cube_reset_state() {
 }
 
 static inline int update_state() {
-    for (int i = 0; i < 4; i++) {
-        maple_device_t* cont = maple_enum_type(i, MAPLE_FUNC_CONTROLLER);
-        if (cont) {
-            cont_state_t* state = (cont_state_t*)maple_dev_status(cont);
+    input_replay_begin_frame();
+    if (input_replay_finished()) {
+        return 0;
+    }
+    for (int i = 0; i < INPUT_MAX_PORTS; i++) {
+        cont_state_t* state = input_replay_state(i);
+        if (state) {
             if (state->buttons & CONT_START) {
                 return 0;
             }
@@ -385,11 +401,18 @@ int main(void) {
     };
     vid_set_mode(DM_640x480, PM_RGB888P);
     pvr_set_bg_color(0, 0, 0);
+    ta_usage_init(TAUSAGE, "part_5_diffuse_lighting", &params);
     pvr_init(&params);
     PVR_SET(PVR_OBJECT_CLIP, 0.00001f);
+    input_replay_init(INPUTREPLAY, "part_5_diffuse_lighting", &params);
     /** ensure that no NaNs or inf values persist in the xmtrx */
     shz_xmtrx_init_identity_safe();
+    camera_init(&camera, 0);
 
+    if (!arena_init(&frame_arena, "frame", FRAME_ARENA_SIZE) ||
+        !load_teapot()) {
+        return 1;
+    }
     cube_reset_state();
 
     while (update_state()) {
@@ -400,16 +423,25 @@ int main(void) {
 #if SHOWFRAMETIMES == 1
         vid_border_color(0, 255, 0);
 #endif
-        pvr_scene_begin();
+        arena_reset(&frame_arena);
+        input_replay_scene_begin();
+        ta_usage_scene_begin();
         pvr_list_begin(PVR_LIST_OP_POLY);
         render_teapot();
         pvr_list_finish();
+        ta_usage_list_finish(PVR_LIST_OP_POLY);
 #if SHOWFRAMETIMES == 1
         vid_border_color(0, 0, 255);
 #endif
-        pvr_scene_finish();
+        ta_usage_scene_finish();
+        input_replay_scene_finish();
     }
     printf("Cleaning up\n");
+    input_replay_shutdown();
+    ta_usage_shutdown();
+    stl_mesh_free(&teapot);
+    arena_print_stats(&frame_arena);
+    arena_destroy(&frame_arena);
     pvr_shutdown();  // Clean up PVR resources
     vid_shutdown();  // This function reinitializes the video system to what
                      // dcload and friends expect it to be Run the main
@@ -6,6 +6,7 @@
 #include <kos.h> /* Includes necessary KallistiOS (KOS) headers for Dreamcast development */
 #include <stdio.h> /* Standard I/O library headers for input and output functions */
 #include <stdlib.h> /* Standard library headers for general-purpose functions, including abs() */
+#include <string.h> /* memcmp() of the teapot pose */
 
 // #define DEBUG
 #ifdef DEBUG
@@ -13,110 +14,266 @@
 #endif
 
 #define SUPERSAMPLING 1  // Set to 1 to enable horizontal FSAA, 0 to disable
-#if SUPERSAMPLING == 1
-#define XSCALE 2
-#else
-#define XSCALE 1
-#endif
+/* the quality governor turns FSAA off and on at runtime */
+static float xscale = SUPERSAMPLING == 1 ? 2.0f : 1.0f;
+#define XSCALE xscale
 
 #ifndef SHOWFRAMETIMES
 #define SHOWFRAMETIMES 0
 #endif
 
+/* Set to 0 to prepare each frame after pvr_wait_ready() instead of before,
+ * for comparing the stall times frame_sched.h reports */
+#ifndef FRAME_PIPELINE
+#define FRAME_PIPELINE 1
+#endif
+
+/* Set to 1 to read the sticks and triggers again after pvr_wait_ready() and
+ * move the teapot with those, a frame prepared before the wait is prepared
+ * again if that moved it */
+#ifndef LATE_LATCH
+#define LATE_LATCH 0
+#endif
+
+/* Set to 0 to always render at full quality, see quality_governor.h. Replays
+ * are never governed, so builds can be compared on the same frames */
+#ifndef QUALITY_GOVERNOR
+#define QUALITY_GOVERNOR 1
+#endif
+
+/* Lights around the teapot, 1 lights it with the single light kernels and
+ * the light cache. More add a directional fill light and small point lights
+ * circling the teapot, up to LIGHTS_MAX, see lights.h */
+#ifndef LIGHTS
+#define LIGHTS 1
+#endif
+
+/* Lighting model of the teapot at full quality, SHADE_PHONG, SHADE_BLINN or
+ * SHADE_DIFFUSE, see render_kernels.h. The governor steps down from it one
+ * model at a time */
+#ifndef SHADE_MODEL
+#define SHADE_MODEL SHADE_PHONG
+#endif
+
+/* Set to 1 to shade the teapot in the intensity color mode of the PVR, see
+ * light_env_set_intensity(). The orbiting light turns grey so it looks the
+ * same as with ARGB */
+#ifndef INTENSITY_MODE
+#define INTENSITY_MODE 0
+#endif
+
+/* Set to 1 to texture the teapot with a highlight map instead of working out
+ * the specular term per face, see light_env_set_highlight() */
+#ifndef HIGHLIGHT_MAP
+#define HIGHLIGHT_MAP 0
+#endif
+
+#include <sh4zamsprites/display_list.h> /* recorded teapot frames */
+
+/* The frame is prepared into RAM while the PVR is still busy with the one
+ * before, the kernels included below write there instead of the store
+ * queues and submit_frame() copies it to the TA */
+static display_list_t frame_stream;
+#define RK_TA_TARGET(dr_state) \
+    ((void)(dr_state), dl_record_target(&frame_stream))
+#define RK_TA_COMMIT(dr_state, addr) ((void)(addr))
+
 #include <sh4zam/shz_sh4zam.h>
 #include <sh4zamsprites/cube.h> /* Cube vertices and side strips layout */
 #include <sh4zamsprites/perspective.h> /* Perspective projection matrix functions */
-#include <sh4zamsprites/shz_mdl.h>     /* sh4zam model loading and rendering */
+#include <sh4zamsprites/input_replay.h> /* controller recording and replay */
+#include <sh4zamsprites/shz_mdl.h>     /* sh4zam model loading */
+#include <sh4zamsprites/shz_mdl_render.h> /* lighting and TA emission */
+#include <sh4zamsprites/perf_timer.h> /* asset load timing */
+#include <sh4zamsprites/arena.h>      /* loader memory */
+#include <sh4zamsprites/light_cache.h>  /* face colors kept across frames */
+#include <sh4zamsprites/ta_usage.h>    /* vertex buffer and OPB telemetry */
+#include <sh4zamsprites/frame_sched.h> /* stall and work time per frame */
+#include <sh4zamsprites/quality_governor.h> /* hold 60 fps */
+#include <sh4zamsprites/tex_loader.h>  /* the highlight map */
+#include <sh4zamsprites/lights.h>      /* more than one light */
 
 #define DEFAULT_FOV 75.0f  // Field of view, adjust with dpad up/down
 #define ZOOM_SPEED 0.3f
 #define MIN_ZOOM -20.0f
 #define MAX_ZOOM 15.0f
 #define LINE_WIDTH 1.0f
+#define FAN_ENCODING FAN2QUADS  // FANSTRIPS, FAN2TRIS or FAN2QUADS
+#define FRAME_HEADERS_SIZE (4 * 1024)  // light and headers before the teapot
+#define LEVEL_ARENA_SIZE (1152 * 1024)  // teapot, LZ4 staging, lists, caches
 
 static float fovy = DEFAULT_FOV;
 
+#if ASSETFILES == 0 && ASSETLZ4 == 1
+static const alignas(32) uint8_t teapot_shzmdl_lz4[] = {
+#embed "../build/models/teapot.shzmdl.lz4"
+};
+#elif ASSETFILES == 0
 static const alignas(32) uint8_t teapot_shzmdl[] = {
 // #embed "../assets/models/teapot.stl"
 // #embed "../assets/models/Utah_teapot_(solid).stl"
 #embed "../assets/models/teapot.shzmdl"
 };
+#endif
 
-static inline void draw_sprite_line(shz_vec4_t* from, shz_vec4_t* to,
-                                    float centerz, pvr_dr_state_t* dr_state) {
-    pvr_sprite_col_t* quad = (pvr_sprite_col_t*)pvr_dr_target(*dr_state);
-    quad->flags = PVR_CMD_VERTEX_EOL;
-    if (from->x > to->x) {
-        shz_vec4_t* tmp = from;
-        from = to;
-        to = tmp;
-    }
-    shz_vec3_t direction = shz_vec3_normalize(
-        (shz_vec3_t){.e = {to->x - from->x, to->y - from->y, to->z - from->z}});
-    quad->ax = from->x;
-    quad->ay = from->y;
-    quad->az = from->z + centerz * 0.1;
-    quad->bx = to->x;
-    quad->by = to->y;
-    quad->bz = to->z + centerz * 0.1;
-    quad->cx = to->x + LINE_WIDTH * XSCALE * direction.y;
-    pvr_dr_commit(quad);
-    quad = (pvr_sprite_col_t*)pvr_dr_target(*dr_state);
-    pvr_sprite_col_t* quad2ndhalf = (pvr_sprite_col_t*)((int)quad - 32);
-    quad2ndhalf->cy = to->y - LINE_WIDTH * direction.x;
-    quad2ndhalf->cz = to->z + centerz * 0.1;
-    quad2ndhalf->dx = from->x + LINE_WIDTH * XSCALE * direction.y;
-    quad2ndhalf->dy = from->y - LINE_WIDTH * direction.x;
-    pvr_dr_commit(quad);
-}
+#if HIGHLIGHT_MAP == 1 && ASSETFILES == 0 && ASSETLZ4 == 1
+static const alignas(32) uint8_t highlight_lz4[] = {
+#embed "../build/pvrtex/rgb565_vq_tw/highlight128.dt.lz4"
+};
+#elif HIGHLIGHT_MAP == 1 && ASSETFILES == 0
+static const alignas(32) uint8_t highlight_raw[] = {
+#embed "../build/pvrtex/rgb565_vq_tw/highlight128.dt"
+};
+#endif
 
 typedef struct __attribute__((packed)) {
     struct shz_mdl_tri_face_t;
     uint16_t attrbytecount;
 } stl_poly_t;
 
+static shz_mdl_t teapot;
+static camera_t camera;
+static display_list_t teapot_list;
+static light_cache_t teapot_light;
+static spec_lut_t phong_lut;
+static spec_lut_t blinn_lut;
+#if HIGHLIGHT_MAP == 1
+static alignas(32) dttex_info_t highlight_map;
+static pvr_poly_hdr_t highlight_hdr;
+#endif
+
 static uint16_t light_rotation = 13337;
 static uint16_t light_height = 4999;
+static int light_paused = 0;  // toggle with dpad right
+static uint32_t dpad_right_down = 0;
 
-static inline shz_vec3_t perspective_n_swizzle(shz_vec4_t v) {
-    const float inv_w = shz_invf_fsrra(v.x);
-    return shz_vec3_init(v.y * inv_w, v.z * inv_w, inv_w);
+#if LIGHTS < 1 || LIGHTS > LIGHTS_MAX
+#error "LIGHTS must be 1 to LIGHTS_MAX"
+#endif
+#if (INTENSITY_MODE == 1 || HIGHLIGHT_MAP == 1) && LIGHTS > 1
+#error "INTENSITY_MODE and HIGHLIGHT_MAP shade by the one light of light_env_t"
+#endif
+static light_t scene_lights[LIGHTS];
+static light_stats_t teapot_lights;
+
+#define MAIN_LIGHT_RANGE 80.0f  // reaches all of the teapot from its orbit
+#define SMALL_LIGHT_RANGE 12.0f
+#define SMALL_LIGHT_ORBIT 22.0f  // in and out of reach as they circle
+
+/**
+ * @brief Place the lights of the scene, the main light from the orbit of the
+ * single light, a fill light from above and small colored lights circling the
+ * teapot at their own speeds
+ * @param main_pos Position of the main light, model space
+ * @param main_color Its color
+ */
+static void place_lights(shz_vec3_t main_pos, shz_vec3_t main_color) {
+    scene_lights[0] = (light_t){.pos = main_pos,
+                                .color = main_color,
+                                .range = MAIN_LIGHT_RANGE,
+                                .type = LIGHT_POINT};
+#if LIGHTS > 1
+    scene_lights[1] = (light_t){
+        .pos = shz_vec3_normalize(shz_vec3_init(0.3f, -0.2f, 1.0f)),
+        .color = shz_vec3_init(0.15f, 0.2f, 0.35f),
+        .type = LIGHT_DIRECTIONAL};
+#endif
+    for (int i = 2; i < LIGHTS; i++) {
+        const shz_sincos_t orbit =
+            shz_sincosu16((uint16_t)(light_rotation * (i + 1) + i * 9973));
+        const float hue = (float)i / LIGHTS_MAX;
+        scene_lights[i] = (light_t){
+            .pos = shz_vec3_init(orbit.cos * SMALL_LIGHT_ORBIT,
+                                 orbit.sin * SMALL_LIGHT_ORBIT,
+                                 orbit.sin * 6.0f),
+            .color = shz_vec3_init(1.0f - hue, 0.4f + hue * 0.5f, hue),
+            .range = SMALL_LIGHT_RANGE,
+            .type = LIGHT_POINT};
+    }
 }
 
-static inline float calc_light(shz_vec3_t* model_vert, shz_vec3_t* face_normal,
-                               shz_vec3_t* light_pos,
-                               shz_vec3_t* spec_light_pos,
-                               shz_vec3_t* spec_view_pos,
-                               shz_mat4x4_t* model_view,
-                               shz_mat4x4_t* inverse_transpose) {
-    shz_vec3_t diff_normal = shz_vec3_normalize(*face_normal);
-    shz_vec3_t light_dir =
-        shz_vec3_normalize(shz_vec3_sub(*light_pos, *model_vert));
-
-    float light_intensity = SHZ_MAX(shz_vec3_dot(diff_normal, light_dir), 0.0f);
-
-    if (light_intensity > 0.0f) {
-        /* specular light */
-        shz_vec3_t spec_normal = shz_vec3_normalize(
-            shz_mat4x4_trans_vec3(inverse_transpose, *face_normal));
-        shz_vec3_t spec_vert_pos =
-            shz_mat4x4_trans_vec3(model_view, *model_vert);
-        shz_vec3_t spec_light_dir =
-            shz_vec3_normalize(shz_vec3_sub(*spec_light_pos, spec_vert_pos));
-        const float specular_strength = 1.5f;
-        shz_vec3_t spec_view_dir =
-            shz_vec3_normalize(shz_vec3_sub(*spec_view_pos, spec_vert_pos));
-        shz_vec3_t reflect_dir =
-            shz_vec3_reflect(shz_vec3_neg(spec_light_dir), spec_normal);
-        const float dot_spec =
-            SHZ_MAX(shz_vec3_dot(spec_view_dir, reflect_dir), 0.0f);
-        light_intensity +=
-            specular_strength * light_intensity * shz_powf(dot_spec, 32.0f);
+/** Quality knobs, cheapest to lose first */
+typedef enum : uint8_t {
+    KNOB_SHADING = 0,
+    KNOB_FSAA,
+    KNOBS,
+} knob_e;
+
+static qg_knob_t knobs[KNOBS] = {
+    [KNOB_SHADING] = {"shading", SHADE_MODEL, 0, SHADE_MODEL, QG_COST_CPU, 0},
+    [KNOB_FSAA] = {"FSAA", SUPERSAMPLING, 0, SUPERSAMPLING, QG_COST_PVR, 0},
+};
+
+/** Everything the teapot stream depends on that can change between frames,
+ * projection and eye are fixed */
+typedef struct {
+    shz_mat4x4_t model_view;
+    shz_vec3_t light_pos;
+    shz_vec3_t light_color;
+    float xscale;
+    uint32_t shade_model;
+    uint32_t num_lights;
+    light_t lights[LIGHTS];  // the ones that reach the teapot
+} teapot_key_t;
+
+/** Where submit_frame() finds the teapot of the prepared frame */
+typedef enum : uint8_t {
+    TEAPOT_IN_FRAME = 0,  // recorded into frame_stream
+    TEAPOT_REPLAY,        // replayed from teapot_list after frame_stream
+    TEAPOT_DIRECT,        // fit in neither, drawn by submit_frame()
+} teapot_source_e;
+
+/** What prepare_teapot() lit the teapot with, kept for TEAPOT_DIRECT */
+static struct {
+    light_env_t env;
+    light_t reaching[LIGHTS_MAX];
+    pvr_poly_hdr_t intensity_hdr;
+    pvr_sprite_hdr_t spr_hdr;
+    pvr_sprite_hdr_t quad_spr_hdr;
+    pvr_poly_hdr_t poly_hdr;
+} teapot_draw;
+
+#if HIGHLIGHT_MAP == 1
+/**
+ * @brief Load the highlight map and compile the header the teapot is drawn
+ * with in its place
+ * @return int 1 on success, 0 on failure
+ */
+static int load_highlight_map(void) {
+#if ASSETFILES == 1
+    if (!pvrtex_load_file(ASSET_DIR "pvrtex/rgb565_vq_tw/highlight128.dt",
+                          &highlight_map)) {
+        return 0;
+    }
+#elif ASSETLZ4 == 1
+    if (!pvrtex_load_lz4(highlight_lz4, sizeof(highlight_lz4),
+                         &highlight_map)) {
+        return 0;
+    }
+#else
+    if (!pvrtex_load_blob(highlight_raw, &highlight_map)) {
+        return 0;
     }
-    return SHZ_MAX(light_intensity, 0.0f);
+#endif
+    pvr_poly_cxt_t cxt;
+    pvr_poly_cxt_txr(&cxt, PVR_LIST_OP_POLY, highlight_map.pvrformat,
+                     highlight_map.width, highlight_map.height,
+                     highlight_map.ptr, PVR_FILTER_BILINEAR);
+    cxt.gen.shading = PVR_SHADE_FLAT;
+    cxt.gen.culling = PVR_CULLING_CW;
+    cxt.gen.specular = PVR_SPECULAR_ENABLE;  // the offset color
+    cxt.txr.env = PVR_TXRENV_MODULATE;
+    pvr_poly_compile(&highlight_hdr, &cxt);
+    return 1;
 }
+#endif
 
-void render_teapot(void) {
+/**
+ * @brief Transform, light and encode the next frame into frame_stream, touches
+ * neither the PVR nor the store queues so it can run before pvr_wait_ready()
+ * @return teapot_source_e Where submit_frame() finds the teapot
+ */
+static teapot_source_e prepare_teapot(void) {
     const float screen_width = vid_mode->width * XSCALE;
     const float screen_height = vid_mode->height;
     const float near_z = 0.0f;
@@ -124,32 +281,27 @@ void render_teapot(void) {
     const float aspect = shz_divf_fsrra(screen_width, (screen_height * XSCALE));
 
     shz_vec3_t eye = shz_vec3_init(0.0f, -0.00001f, 30.0f);
-    shz_xmtrx_init_identity();
-    kos_lookAt(eye, (shz_vec3_t){.e = {0.0f, 0.0f, 0.0f}},
-               (shz_vec3_t){.e = {0.0f, 0.0f, 1.0f}});
-
-    shz_xmtrx_translate(cube_state.pos.x, cube_state.pos.y - 10.0f,
-                        cube_state.pos.z - 10.0f);
+    camera_set_screen(&camera, screen_width, screen_height);
+    camera_set_perspective(&camera, fov, aspect, near_z);
+    camera_look_at(&camera, eye, (shz_vec3_t){.e = {0.0f, 0.0f, 0.0f}},
+                   (shz_vec3_t){.e = {0.0f, 0.0f, 1.0f}});
+
+    alignas(32) shz_mat4x4_t model;
+    shz_xmtrx_init_translation(cube_state.pos.x, cube_state.pos.y - 10.0f,
+                               cube_state.pos.z - 10.0f);
     shz_xmtrx_apply_rotation_x(cube_state.rot.x + SHZ_F_PI * 0.75f - 0.1f);
     shz_xmtrx_apply_rotation_y(cube_state.rot.y + SHZ_F_PI * 0.25f);
+    shz_xmtrx_store_4x4(&model);
+    camera_set_model(&camera, &model);
 
-    shz_mat4x4_t model_view = {0};
-    shz_mat4x4_t inverse_transpose = {0};
-    shz_xmtrx_store_4x4(&model_view);
-    shz_mat4x4_inverse(&model_view, &inverse_transpose);
-    shz_mat4x4_transpose(&inverse_transpose, &inverse_transpose);
+    /* leaves the MVP in the XMTRX */
+    camera_update(&camera);
+    shz_mat4x4_t* model_view = &camera.model_view;
+    shz_mat4x4_t* inverse_transpose = &camera.normal;
 
-    shz_xmtrx_init_identity();
-    shz_xmtrx_apply_permutation_wxyz();
-    shz_xmtrx_apply_screen(screen_width, screen_height);
-    shz_xmtrx_apply_perspective(fov, aspect, near_z);
-    shz_xmtrx_apply_4x4(&model_view);
+    pvr_dr_state_t dr_state = 0;  // unused while recording
+    dl_reset(&frame_stream);
 
-    pvr_dr_state_t dr_state;
-    pvr_dr_init(&dr_state);
-
-    light_rotation += 223;
-    light_height += 127;
     const shz_sincos_t xy_rotation = shz_sincosu16(light_rotation);
     const shz_sincos_t height_variantion = shz_sincosu16(light_height);
 
@@ -159,6 +311,11 @@ void render_teapot(void) {
         shz_vec3_init(0.5f + (xy_rotation.cos + height_variantion.cos) * 0.25f,
                       0.5f + (xy_rotation.sin + height_variantion.sin) * 0.25f,
                       0.5f + (height_variantion.cos + xy_rotation.sin) * 0.25f);
+#if INTENSITY_MODE == 1
+    const float light_level =
+        (light_color.x + light_color.y + light_color.z) * (1.0f / 3.0f);
+    light_color = shz_vec3_init(light_level, light_level, light_level);
+#endif
 
     float high_attack_angle_x = SHZ_MAX(height_variantion.sin  * light_radius * 0.75f, 0.0f);
     float high_attack_angle_y = SHZ_MAX(height_variantion.cos  * light_radius * 0.75f, 0.0f);
@@ -192,17 +349,16 @@ void render_teapot(void) {
     spr_cxt.gen.culling = PVR_CULLING_NONE;
     pvr_sprite_hdr_t spr_hdr, *spr_hdr_pntr;
     pvr_sprite_compile(&spr_hdr, &spr_cxt);
-    spr_hdr.argb = (uint32_t)(light_color.x * 255) << 16 |
-                   (uint32_t)(light_color.y * 255) << 8 |
-                   (uint32_t)(light_color.z * 255) | 0xFF000000;
-
-    spr_hdr_pntr = (pvr_sprite_hdr_t*)pvr_dr_target(dr_state);
+    spr_hdr_pntr = (pvr_sprite_hdr_t*)RK_TA_TARGET(&dr_state);
     *spr_hdr_pntr = spr_hdr;
-    pvr_dr_commit(spr_hdr_pntr);
+    spr_hdr_pntr->argb = (uint32_t)(light_color.x * 255) << 16 |
+                         (uint32_t)(light_color.y * 255) << 8 |
+                         (uint32_t)(light_color.z * 255) | 0xFF000000;
+    RK_TA_COMMIT(&dr_state, spr_hdr_pntr);
     draw_sprite_line(&((shz_vec4_t){.xyz = light_quad[4].xyz, .w = 1.0f}),
                      &scene_center, 0.0f, &dr_state);
 
-    pvr_sprite_col_t* light = (pvr_sprite_col_t*)pvr_dr_target(dr_state);
+    pvr_sprite_col_t* light = (pvr_sprite_col_t*)RK_TA_TARGET(&dr_state);
     light->flags = PVR_CMD_VERTEX_EOL;
     light->ax = light_quad[0].x;
     light->ay = light_quad[0].y;
@@ -211,30 +367,22 @@ void render_teapot(void) {
     light->by = light_quad[1].y;
     light->bz = light_quad[1].z;
     light->cx = light_quad[2].x;
-    pvr_dr_commit(light);
-    light = (pvr_sprite_col_t*)pvr_dr_target(dr_state);
+    RK_TA_COMMIT(&dr_state, light);
+    light = (pvr_sprite_col_t*)RK_TA_TARGET(&dr_state);
     pvr_sprite_col_t* light2ndhalf = (pvr_sprite_col_t*)((int)light - 32);
     light2ndhalf->cy = light_quad[3].y;
     light2ndhalf->cz = light_quad[3].z;
     light2ndhalf->dx = light_quad[3].x;
     light2ndhalf->dy = light_quad[3].y;
-    pvr_dr_commit(light);
-
-    shzmdl_hdr_t* shzmdl_hdr = (shzmdl_hdr_t*)(teapot_shzmdl);
-
-    shz_mdl_tri_face_t* tris =
-        (shz_mdl_tri_face_t*)((uint8_t*)teapot_shzmdl +
-                               (shzmdl_hdr->offset.tri_faces << 5));
-    shz_mdl_quad_face_t* quads =
-        (shz_mdl_quad_face_t*)((uint8_t*)teapot_shzmdl +
-                               (shzmdl_hdr->offset.quad_faces << 5));
+    RK_TA_COMMIT(&dr_state, light);
 
     pvr_poly_cxt_t cxt;
     pvr_poly_cxt_col(&cxt, PVR_LIST_OP_POLY);
     cxt.gen.shading = PVR_SHADE_FLAT;
     cxt.gen.culling = PVR_CULLING_NONE;
 
-    pvr_poly_hdr_t* hdrpntr = (pvr_poly_hdr_t*)pvr_dr_target(dr_state);
+    pvr_poly_hdr_t poly_hdr;
+    pvr_poly_hdr_t* hdrpntr = (pvr_poly_hdr_t*)RK_TA_TARGET(&dr_state);
     // hdrpntr->cmd = PVR_CMD_USERCLIP;
     // hdrpntr->mode1 = 0;
     // hdrpntr->mode2 = 0;
@@ -247,337 +395,130 @@ void render_teapot(void) {
     // pvr_dr_commit(hdrpntr);
 
     // hdrpntr = (pvr_poly_hdr_t*)pvr_dr_target(dr_state);
-    pvr_poly_compile(hdrpntr, &cxt);
-    // hdrpntr->m0.clip_mode = PVR_USERCLIP_INSIDE;
-    // hdrpntr->m0.gouraud = PVR_SHADE_FLAT;
-    pvr_dr_commit(hdrpntr);
-
-    shz_vec3_t spec_light_pos = shz_mat4x4_trans_vec3(&model_view, light_pos);
-    shz_vec3_t spec_view_pos = shz_mat4x4_trans_vec3(&model_view, eye);
-
-    uint32_t fan_offset = shzmdl_hdr->offset.fans << 5;
-    while (fan_offset) {
-        shz_mdl_fan_t* cur_fan =
-            (shz_mdl_fan_t*)((uint8_t*)&teapot_shzmdl + fan_offset);
-
-        shz_mdl_vert_normal_t* fan_blades =
-            (shz_mdl_vert_normal_t*)((uint8_t*)cur_fan + sizeof(shz_mdl_fan_t));
-
-        shz_vec3_t fan_center = perspective_n_swizzle(shz_xmtrx_transform_vec4(
-            (shz_vec4_t){.xyz = cur_fan->center, .w = 1.0f}));
-        shz_vec3_t prev_left = perspective_n_swizzle(shz_xmtrx_transform_vec4(
-            (shz_vec4_t){.xyz = (fan_blades + cur_fan->num_verts - 1)->vert,
-                         .w = 1.0f}));
-
-// #define FANSTRIPS
-// #define FAN2TRIS
-#define FAN2QUADS
-
-        pvr_vertex_t* tri ;
-#ifdef FANSTRIPS
-        tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
-        tri->flags = PVR_CMD_VERTEX;
-        tri->x = prev_left.x;
-        tri->y = prev_left.y;
-        tri->z = prev_left.z;
-        pvr_dr_commit(tri);
-        for (uint32_t f = 0; f < cur_fan->num_verts; f++) {
-            /* ambient light */
-            shz_vec3_t final_light =
-                (shz_vec3_t){.x = 0.1f, .y = 0.1f, .z = 0.1f};
-
-            /* diffuse and specular light */
-            float light_intensity =
-                calc_light(&(fan_blades + f)->vert, &(fan_blades + f)->normal,
-                           &light_pos, &spec_light_pos, &spec_view_pos,
-                           &model_view, &inverse_transpose);
-
-            final_light = shz_vec3_add(
-                final_light,
-                (shz_vec3_t){.e = {light_intensity * light_color.x,
-                                   light_intensity * light_color.y,
-                                   light_intensity * light_color.z}});
-            final_light = shz_vec3_clamp(final_light, 0.0f, 1.0f);
-            uint32_t argb = (uint32_t)(final_light.x * 255) << 16 |
-                            (uint32_t)(final_light.y * 255) << 8 |
-                            (uint32_t)(final_light.z * 255) | 0xFF000000;
-
-            shz_vec3_t cur_right =
-                perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                    (shz_vec4_t){.xyz = (fan_blades + f)->vert, .w = 1.0f}));
-
-            tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
-            tri->flags = PVR_CMD_VERTEX;
-            tri->x = fan_center.x;
-            tri->y = fan_center.y;
-            tri->z = fan_center.z;
-            pvr_dr_commit(tri);
-            tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
-            tri->flags = PVR_CMD_VERTEX;
-            tri->x = cur_right.x;
-            tri->y = cur_right.y;
-            tri->z = cur_right.z;
-            tri->argb = argb;
-            pvr_dr_commit(tri);
-        }
-                // finish the fan
-        tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
-        tri->flags = PVR_CMD_VERTEX;
-        tri->x = fan_center.x;
-        tri->y = fan_center.y;
-        tri->z = fan_center.z;
-        pvr_dr_commit(tri);
-
-        shz_vec3_t final_light = (shz_vec3_t){.x = 0.1f, .y = 0.1f, .z = 0.1f};
-
-        /* diffuse and specular light */
-        float light_intensity = calc_light(
-            &fan_blades->vert, &fan_blades->normal, &light_pos, &spec_light_pos,
-            &spec_view_pos, &model_view, &inverse_transpose);
-
-        final_light = shz_vec3_add(
-            final_light, (shz_vec3_t){.e = {light_intensity * light_color.x,
-                                            light_intensity * light_color.y,
-                                            light_intensity * light_color.z}});
-        final_light = shz_vec3_clamp(final_light, 0.0f, 1.0f);
-        uint32_t argb = (uint32_t)(final_light.x * 255) << 16 |
-                        (uint32_t)(final_light.y * 255) << 8 |
-                        (uint32_t)(final_light.z * 255) | 0xFF000000;
-
-        shz_vec3_t cur_right = perspective_n_swizzle(shz_xmtrx_transform_vec4(
-            (shz_vec4_t){.xyz = fan_blades->vert, .w = 1.0f}));
-
-        tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
-        tri->flags = PVR_CMD_VERTEX_EOL;
-        tri->x = cur_right.x;
-        tri->y = cur_right.y;
-        tri->z = cur_right.z;
-        pvr_dr_commit(tri);
-#endif
-#ifdef FAN2TRIS
-        for (uint32_t f = 0; f < cur_fan->num_verts; f++) {
-            /* ambient light */
-            shz_vec3_t final_light =
-                (shz_vec3_t){.x = 0.1f, .y = 0.1f, .z = 0.1f};
-
-            /* diffuse and specular light */
-            float light_intensity =
-                calc_light(&(fan_blades + f)->vert, &(fan_blades + f)->normal,
-                           &light_pos, &spec_light_pos, &spec_view_pos,
-                           &model_view, &inverse_transpose);
-
-            final_light = shz_vec3_add(
-                final_light,
-                (shz_vec3_t){.e = {light_intensity * light_color.x,
-                                   light_intensity * light_color.y,
-                                   light_intensity * light_color.z}});
-            final_light = shz_vec3_clamp(final_light, 0.0f, 1.0f);
-            uint32_t argb = (uint32_t)(final_light.x * 255) << 16 |
-                            (uint32_t)(final_light.y * 255) << 8 |
-                            (uint32_t)(final_light.z * 255) | 0xFF000000;
-
-            shz_vec3_t cur_right =
-                perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                    (shz_vec4_t){.xyz = (fan_blades + f)->vert, .w = 1.0f}));
-
-            tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
-            tri->flags = PVR_CMD_VERTEX;
-            tri->x = fan_center.x;
-            tri->y = fan_center.y;
-            tri->z = fan_center.z;
-            tri->argb = argb;
-            pvr_dr_commit(tri);
-            tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
-            tri->flags = PVR_CMD_VERTEX;
-            tri->x = prev_left.x;
-            tri->y = prev_left.y;
-            tri->z = prev_left.z;
-            tri->argb = argb;
-            pvr_dr_commit(tri);
-            tri = (pvr_vertex_t*)pvr_dr_target(dr_state);
-            tri->flags = PVR_CMD_VERTEX_EOL;
-            tri->x = cur_right.x;
-            tri->y = cur_right.y;
-            tri->z = cur_right.z;
-            tri->argb = argb;
-            pvr_dr_commit(tri);
-            prev_left = cur_right;
-        }
+    pvr_poly_compile(&poly_hdr, &cxt);
+    // poly_hdr.m0.clip_mode = PVR_USERCLIP_INSIDE;
+    // poly_hdr.m0.gouraud = PVR_SHADE_FLAT;
+    *hdrpntr = poly_hdr;
+    RK_TA_COMMIT(&dr_state, hdrpntr);
+
+    light_t* reaching = teapot_draw.reaching;
+    light_env_t env = {
+        .light_pos = light_pos,
+        .spec_light_pos = shz_mat4x4_trans_vec3(model_view, light_pos),
+        .spec_view_pos = shz_mat4x4_trans_vec3(model_view, eye),
+        .light_color = light_color,
+        .model_view = model_view,
+        .inverse_transpose = inverse_transpose,
+        .cache = &teapot_light,
+        .shade_model = knobs[KNOB_SHADING].value,
+        .spec_lut = knobs[KNOB_SHADING].value == SHADE_BLINN ? &blinn_lut
+                                                              : &phong_lut,
+    };
+    light_env_set_distant(&env, teapot.center, eye);
+#if HIGHLIGHT_MAP == 1
+    light_env_set_highlight(&env, &highlight_hdr);
 #endif
-
-#ifdef FAN2QUADS
-        for (uint32_t f = 0; f < cur_fan->num_verts; f+=2) {
-            /* ambient light */
-            shz_vec3_t final_light =
-                (shz_vec3_t){.x = 0.1f, .y = 0.1f, .z = 0.1f};
-
-            /* diffuse and specular light */
-            float light_intensity =
-                calc_light(&(fan_blades + f + 1)->vert, &(fan_blades + f)->normal,
-                           &light_pos, &spec_light_pos, &spec_view_pos,
-                           &model_view, &inverse_transpose);
-
-            final_light = shz_vec3_add(
-                final_light,
-                (shz_vec3_t){.e = {light_intensity * light_color.x,
-                                   light_intensity * light_color.y,
-                                   light_intensity * light_color.z}});
-            final_light = shz_vec3_clamp(final_light, 0.0f, 1.0f);
-
-            spr_hdr.argb =  (uint32_t)(final_light.x * 255) << 16 |
-                            (uint32_t)(final_light.y * 255) << 8 |
-                            (uint32_t)(final_light.z * 255) | 0xFF000000;
-            spr_hdr_pntr = (pvr_sprite_hdr_t*)pvr_dr_target(dr_state);
-            *spr_hdr_pntr = spr_hdr;
-            pvr_dr_commit(spr_hdr_pntr);
-
-            shz_vec3_t cur_center =
-                perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                    (shz_vec4_t){.xyz = (fan_blades + f)->vert, .w = 1.0f}));
-
-            shz_vec3_t cur_right =
-                perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                    (shz_vec4_t){.xyz = (fan_blades + f +1)->vert, .w = 1.0f}));
-            pvr_sprite_col_t* fq = (pvr_sprite_col_t*)pvr_dr_target(dr_state);
-            fq->flags = PVR_CMD_VERTEX_EOL;
-            fq->ax = fan_center.x;
-            fq->ay = fan_center.y;
-            fq->az = fan_center.z;
-            fq->bx = prev_left.x;
-            fq->by = prev_left.y;
-            fq->bz = prev_left.z;
-            fq->cx = cur_center.x;
-            pvr_dr_commit(fq);
-            fq = (pvr_sprite_col_t*)pvr_dr_target(dr_state);
-            pvr_sprite_col_t* fq2ndhalf = (pvr_sprite_col_t*)((int)fq - 32);
-            fq2ndhalf->cy = cur_center.y;
-            fq2ndhalf->cz = cur_center.z;
-            fq2ndhalf->dx = cur_right.x;
-            fq2ndhalf->dy = cur_right.y;
-            pvr_dr_commit(fq);
-            prev_left = cur_right;
-        }
+#if INTENSITY_MODE == 1
+    pvr_poly_hdr_t* intensity_hdr = &teapot_draw.intensity_hdr;
+    cxt.fmt.color = PVR_CLRFMT_INTENSITY;
+    pvr_poly_compile(intensity_hdr, &cxt);
+    light_env_set_intensity(&env, intensity_hdr);
 #endif
-
-        fan_offset = cur_fan->next_fan_offset << 5;
+    if (LIGHTS > 1) {
+        place_lights(light_pos, light_color);
+        env.num_lights =
+            lights_assign(scene_lights, LIGHTS, &teapot.center, teapot.radius,
+                          model_view, reaching, &teapot_lights);
+        env.lights = reaching;
     }
 
-    
-    for (int vidx = 0; vidx < shzmdl_hdr->num.tri_faces; vidx++) {
-        shz_mdl_tri_face_t* triface = &tris[vidx];
-
-        /* ambient light */
-        shz_vec3_t final_light = (shz_vec3_t){.x = 0.1f, .y = 0.1f, .z = 0.1f};
-
-        /* diffuse and specular light */
-        float light_intensity = calc_light(
-            &(triface->v1), &triface->normal, &light_pos, &spec_light_pos,
-            &spec_view_pos, &model_view, &inverse_transpose);
-
-        final_light = shz_vec3_add(
-            final_light, (shz_vec3_t){.e = {light_intensity * light_color.x,
-                                            light_intensity * light_color.y,
-                                            light_intensity * light_color.z}});
-        final_light = shz_vec3_clamp(final_light, 0.0f, 1.0f);
-
-        uint32_t color = (uint32_t)(final_light.x * 255) << 16 |
-                         (uint32_t)(final_light.y * 255) << 8 |
-                         (uint32_t)(final_light.z * 255) | 0xFF000000;        
-        
-        alignas(32) shz_vec3_t v1 =
-            perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                (shz_vec4_t){.xyz = triface->v1, .w = 1.0f}));
-        alignas(32) shz_vec3_t v2 =
-            perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                (shz_vec4_t){.xyz = triface->v2, .w = 1.0f}));
-        alignas(32) shz_vec3_t v3 =
-            perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                (shz_vec4_t){.xyz = triface->v3, .w = 1.0f}));
-        // if (color != 0){
-        //     continue; 
-        // }
-        pvr_vertex_t* v = (pvr_vertex_t*)pvr_dr_target(dr_state);
-        v->flags = PVR_CMD_VERTEX;
-        v->x = v1.x;
-        v->y = v1.y;
-        v->z = v1.z;
-        pvr_dr_commit(v);
-        v = (pvr_vertex_t*)pvr_dr_target(dr_state);
-        v->flags = PVR_CMD_VERTEX;
-        v->x = v2.x;
-        v->y = v2.y;
-        v->z = v2.z;
-        pvr_dr_commit(v);
-        v = (pvr_vertex_t*)pvr_dr_target(dr_state);
-        v->flags = PVR_CMD_VERTEX_EOL;
-        v->x = v3.x;
-        v->y = v3.y;
-        v->z = v3.z;
-        v->argb = color;
-        pvr_dr_commit(v);
+    pvr_sprite_hdr_t quad_spr_hdr = spr_hdr;
+    quad_spr_hdr.m1.culling = PVR_CULLING_CW;
+    // quad_spr_hdr.m0.clip_mode = PVR_USERCLIP_INSIDE;
+    teapot_key_t key = {
+        .model_view = *model_view,
+        .light_pos = light_pos,
+        .light_color = light_color,
+        .xscale = XSCALE,
+        .shade_model = env.shade_model,
+        .num_lights = env.num_lights,
+    };
+    memcpy(key.lights, reaching, env.num_lights * sizeof(light_t));
+    const size_t frame_size = frame_stream.size;  // the light and headers
+    teapot_source_e teapot_source = TEAPOT_IN_FRAME;
+    switch (dl_begin(&teapot_list, &key, sizeof(key))) {
+        case DL_RECORD:
+            shz_mdl_record(&teapot_list, &teapot, FAN_ENCODING, &env, &spr_hdr,
+                           &quad_spr_hdr, &poly_hdr);
+            if (dl_end_record(&teapot_list)) {
+                teapot_source = TEAPOT_REPLAY;
+                break;
+            }
+            [[fallthrough]];
+        case DL_DRAW:
+            /* appended to the light and headers already in frame_stream */
+            shz_mdl_record(&frame_stream, &teapot, FAN_ENCODING, &env,
+                           &spr_hdr, &quad_spr_hdr, &poly_hdr);
+            break;
+        case DL_REPLAY:
+            teapot_source = TEAPOT_REPLAY;
+            break;
     }
+    if (!dl_end_record_from(&frame_stream, frame_size)) {
+        /* the env points at statics only, so it outlives this call */
+        teapot_draw.env = env;
+        teapot_draw.spr_hdr = spr_hdr;
+        teapot_draw.quad_spr_hdr = quad_spr_hdr;
+        teapot_draw.poly_hdr = poly_hdr;
+        teapot_source = TEAPOT_DIRECT;
+    }
+    return teapot_source;
+}
 
-    for (int q = 0; q < shzmdl_hdr->num.quad_faces; q++) {
-        shz_mdl_quad_face_t* quadface = &quads[q];
-
-        /* ambient light */
-        shz_vec3_t final_light = (shz_vec3_t){.x = 0.1f, .y = 0.1f, .z = 0.1f};
-
-        /* diffuse and specular light */
-        float light_intensity = calc_light(
-            &(quadface->v1), &quadface->normal, &light_pos, &spec_light_pos,
-            &spec_view_pos, &model_view, &inverse_transpose);
-
-        final_light = shz_vec3_add(
-            final_light, (shz_vec3_t){.e = {light_intensity * light_color.x,
-                                            light_intensity * light_color.y,
-                                            light_intensity * light_color.z}});
-        final_light = shz_vec3_clamp(final_light, 0.0f, 1.0f);
-
-        spr_hdr.m1.culling = PVR_CULLING_CW;
-        spr_hdr.argb = (uint32_t)(final_light.x * 255) << 16 |
-                       (uint32_t)(final_light.y * 255) << 8 |
-                       (uint32_t)(final_light.z * 255) | 0xFF000000;
-        // spr_hdr.m0.clip_mode = PVR_USERCLIP_INSIDE;
-
-        spr_hdr_pntr = (pvr_sprite_hdr_t*)pvr_dr_target(dr_state);
-        *spr_hdr_pntr = spr_hdr;
-        pvr_dr_commit(spr_hdr_pntr);
-
-        alignas(32) shz_vec3_t v1 =
-            perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                (shz_vec4_t){.xyz = quadface->v1, .w = 1.0f}));
-        alignas(32) shz_vec3_t v2 =
-            perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                (shz_vec4_t){.xyz = quadface->v2, .w = 1.0f}));
-        alignas(32) shz_vec3_t v3 =
-            perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                (shz_vec4_t){.xyz = quadface->v3, .w = 1.0f}));
-        alignas(32) shz_vec3_t v4 =
-            perspective_n_swizzle(shz_xmtrx_transform_vec4(
-                (shz_vec4_t){.xyz = quadface->v4, .w = 1.0f}));
-
-        pvr_sprite_col_t* qface = (pvr_sprite_col_t*)pvr_dr_target(dr_state);
-        qface->flags = PVR_CMD_VERTEX_EOL;
-        qface->ax = v1.x;
-        qface->ay = v1.y;
-        qface->az = v1.z;
-        qface->bx = v2.x;
-        qface->by = v2.y;
-        qface->bz = v2.z;
-        qface->cx = v3.x;
-        pvr_dr_commit(qface);
-        qface = (pvr_sprite_col_t*)pvr_dr_target(dr_state);
-        pvr_sprite_col_t* qface2ndhalf = (pvr_sprite_col_t*)((int)qface - 32);
-        qface2ndhalf->cy = v3.y;
-        qface2ndhalf->cz = v3.z;
-        qface2ndhalf->dx = v4.x;
-        qface2ndhalf->dy = v4.y;
-        pvr_dr_commit(qface);
+/**
+ * @brief Copy the prepared frame to the TA, after pvr_list_begin()
+ * @param teapot_source What prepare_teapot() returned for the frame
+ */
+static void submit_frame(teapot_source_e teapot_source) {
+    pvr_dr_state_t dr_state;
+    pvr_dr_init(&dr_state);
+    dl_replay(&frame_stream, &dr_state);
+    switch (teapot_source) {
+        case TEAPOT_REPLAY:
+            dl_replay(&teapot_list, &dr_state);
+            break;
+        case TEAPOT_DIRECT:
+            /* frame_stream ends on the polygon header the teapot expects */
+            shz_xmtrx_load_4x4(&camera.mvp);
+            shz_mdl_render(&teapot, FAN_ENCODING, &teapot_draw.env,
+                           &teapot_draw.spr_hdr, &teapot_draw.quad_spr_hdr,
+                           &teapot_draw.poly_hdr, &dr_state);
+            break;
+        case TEAPOT_IN_FRAME:
+            break;
     }
     pvr_dr_finish();
 }
 
+/**
+ * @brief Initialize the PVR again with FSAA on or off, and update everything
+ * that depends on the horizontal scale
+ * @param params What the PVR was initialized with, updated
+ * @param fsaa 1 to turn FSAA on
+ */
+static void set_fsaa(pvr_init_params_t* params, int fsaa) {
+    if (params->fsaa_enabled == fsaa) {
+        return;
+    }
+    pvr_shutdown();
+    params->fsaa_enabled = fsaa;
+    pvr_init(params);
+    PVR_SET(PVR_OBJECT_CLIP, 0.00001f);
+    pvr_set_bg_color(0, 0, 0);
+    xscale = fsaa ? 2.0f : 1.0f;
+    update_projection_view(fovy);
+}
+
 static inline void cube_reset_state() {
     uint32_t grid_size = cube_state.grid_size;
     cube_state = (struct cube){0};
@@ -589,14 +530,11 @@ static inline void cube_reset_state() {
     update_projection_view(fovy);
 }
 
-static inline int update_state() {
-    for (int i = 0; i < 4; i++) {
-        maple_device_t* cont = maple_enum_type(i, MAPLE_FUNC_CONTROLLER);
-        if (cont) {
-            cont_state_t* state = (cont_state_t*)maple_dev_status(cont);
-            if (state->buttons & CONT_START) {
-                return 0;
-            }
+/** Sticks and triggers move and zoom the teapot, applied once per frame */
+static inline void apply_motion(void) {
+    for (int i = 0; i < INPUT_MAX_PORTS; i++) {
+        cont_state_t* state = input_replay_state(i);
+        if (state) {
             if (abs(state->joyx) > 16)
                 cube_state.pos.x +=
                     (state->joyx / 32768.0f) * 20.5f;  // Increased sensitivity
@@ -612,6 +550,30 @@ static inline int update_state() {
                 cube_state.pos.z = MIN_ZOOM;  // Farther away
             if (cube_state.pos.z > MAX_ZOOM)
                 cube_state.pos.z = MAX_ZOOM;  // Closer to the screen
+        }
+    }
+    cube_state.rot.x += cube_state.speed.x;
+    cube_state.rot.y += cube_state.speed.y;
+    cube_state.speed.x *= 0.99f;
+    cube_state.speed.y *= 0.99f;
+}
+
+static inline int same_pose(const struct cube* a, const struct cube* b) {
+    return memcmp(&a->pos, &b->pos, sizeof(a->pos)) == 0 &&
+           memcmp(&a->rot, &b->rot, sizeof(a->rot)) == 0;
+}
+
+static inline int update_state() {
+    input_replay_begin_frame();
+    if (input_replay_finished()) {
+        return 0;
+    }
+    for (int i = 0; i < INPUT_MAX_PORTS; i++) {
+        cont_state_t* state = input_replay_state(i);
+        if (state) {
+            if (state->buttons & CONT_START) {
+                return 0;
+            }
             if (state->buttons & CONT_X) cube_state.speed.y += 0.001f;
             if (state->buttons & CONT_B) cube_state.speed.y -= 0.001f;
             if (state->buttons & CONT_A) cube_state.speed.x += 0.001f;
@@ -628,12 +590,23 @@ static inline int update_state() {
                 fovy += 1.0f;
                 update_projection_view(fovy);
             }
+            if (state->buttons & CONT_DPAD_RIGHT) {
+                if ((dpad_right_down & (1 << i)) == 0) {
+                    dpad_right_down |= (1 << i);
+                    light_paused = !light_paused;
+                }
+            } else {
+                dpad_right_down &= ~(1 << i);
+            }
         }
     }
-    cube_state.rot.x += cube_state.speed.x;
-    cube_state.rot.y += cube_state.speed.y;
-    cube_state.speed.x *= 0.99f;
-    cube_state.speed.y *= 0.99f;
+    if (!light_paused) {
+        light_rotation += 223;
+        light_height += 127;
+    }
+#if LATE_LATCH == 0
+    apply_motion();
+#endif
     return 1;
 }
 
@@ -648,7 +621,7 @@ int main(void) {
     pvr_init_params_t params = {
         {PVR_BINSIZE_16, PVR_BINSIZE_0, PVR_BINSIZE_16, PVR_BINSIZE_0,
          PVR_BINSIZE_8},
-        3 << 18,        // Vertex buffer size, 1.5MB
+        3 << 18,        // Vertex buffer size, 768KB
         0,              // No DMA15
         SUPERSAMPLING,  // Set horisontal FSAA
         0,              // Translucent Autosort enabled.
@@ -657,31 +630,138 @@ int main(void) {
     };
     vid_set_mode(DM_640x480, PM_RGB888P);
     pvr_set_bg_color(0, 0, 0);
+    ta_usage_init(TAUSAGE, "part_6_specular_lighting", &params);
     pvr_init(&params);
     PVR_SET(PVR_OBJECT_CLIP, 0.00001f);
+    input_replay_init(INPUTREPLAY, "part_6_specular_lighting", &params);
     /** ensure that no NaNs or inf values persist in the xmtrx */
     shz_xmtrx_init_identity_safe();
+    camera_init(&camera, 1);
 
+    if (!arena_init(&level_arena, "level", LEVEL_ARENA_SIZE)) {
+        return 1;
+    }
+    const uint64_t assets_start_ns = perf_now_ns();
+#if ASSETFILES == 1
+    if (!shz_mdl_load_file(&teapot, ASSET_DIR "models/teapot.shzmdl")) {
+        return 1;
+    }
+#elif ASSETLZ4 == 1
+    if (!shz_mdl_load_lz4(&teapot, teapot_shzmdl_lz4,
+                          sizeof(teapot_shzmdl_lz4))) {
+        return 1;
+    }
+#else
+    if (!shz_mdl_load_blob(&teapot, teapot_shzmdl, sizeof(teapot_shzmdl))) {
+        return 1;
+    }
+#endif
+#if HIGHLIGHT_MAP == 1
+    if (!load_highlight_map()) {
+        return 1;
+    }
+#endif
+    printf("Assets loaded in %.2f ms\n",
+           (double)(perf_now_ns() - assets_start_ns) / 1e6);
+    /* up to 407KB for the teapot when its quads are all strips */
+    const size_t teapot_size = shz_mdl_ta_bytes(
+        &teapot, FAN_ENCODING, INTENSITY_MODE == 1 || HIGHLIGHT_MAP == 1);
+    if (!dl_init(&teapot_list, teapot_size) ||
+        !dl_init(&frame_stream, teapot_size + FRAME_HEADERS_SIZE) ||
+        !light_cache_init(&teapot_light, &teapot)) {
+        return 1;
+    }
+    spec_lut_init(&phong_lut, SPEC_EXPONENT_PHONG);
+    spec_lut_init(&blinn_lut, SPEC_EXPONENT_BLINN);
     cube_reset_state();
 
+#if SHOWFRAMETIMES == 1
+    uint32_t frame = 0;
+#endif
+    frame_sched_t sched;
+    frame_sched_init(&sched);
+    quality_governor_t governor;
+    qg_init(&governor, knobs, KNOBS, QG_BUDGET_NS);
+    /* the highlight map takes the place of every lighting model, and
+     * set_fsaa() would drop it from VRAM with the rest of the PVR */
+    knobs[KNOB_SHADING].idle = HIGHLIGHT_MAP == 1;
+    knobs[KNOB_FSAA].idle = HIGHLIGHT_MAP == 1;
+    governor.enabled = QUALITY_GOVERNOR == 1 && INPUTREPLAY < INPUT_REPLAY;
     while (update_state()) {
+        teapot_source_e teapot_source = TEAPOT_IN_FRAME;
+        int prepared = 0;
+#if FRAME_PIPELINE == 1
+        [[maybe_unused]] const struct cube prepared_pose = cube_state;
+        frame_sched_phase(&sched, FRAME_PHASE_PREPARE);
+        teapot_source = prepare_teapot();
+        prepared = 1;
+#endif
 #if SHOWFRAMETIMES == 1
         vid_border_color(255, 0, 0);
 #endif
-        pvr_wait_ready();
+        frame_sched_phase(&sched, FRAME_PHASE_STALL);
+        if (qg_wait_ready(&governor)) {
+            set_fsaa(&params, knobs[KNOB_FSAA].value);
+            prepared = 0;  // with the knobs from before
+        }
 #if SHOWFRAMETIMES == 1
         vid_border_color(0, 255, 0);
 #endif
-        pvr_scene_begin();
+#if LATE_LATCH == 1
+        frame_sched_phase(&sched, FRAME_PHASE_PREPARE);
+        input_replay_latch();
+        apply_motion();
+#if FRAME_PIPELINE == 1
+        /* prepared from the pose before the latch */
+        prepared = prepared && same_pose(&prepared_pose, &cube_state);
+#endif
+#endif
+        if (!prepared) {
+            frame_sched_phase(&sched, FRAME_PHASE_PREPARE);
+            teapot_source = prepare_teapot();
+        }
+        frame_sched_phase(&sched, FRAME_PHASE_SUBMIT);
+        input_replay_scene_begin();
+        ta_usage_scene_begin();
         pvr_list_begin(PVR_LIST_OP_POLY);
-        render_teapot();
+        submit_frame(teapot_source);
         pvr_list_finish();
+        ta_usage_list_finish(PVR_LIST_OP_POLY);
 #if SHOWFRAMETIMES == 1
         vid_border_color(0, 0, 255);
 #endif
-        pvr_scene_finish();
+        ta_usage_scene_finish();
+        input_replay_scene_finish();
+        frame_sched_end_frame(&sched);
+#if SHOWFRAMETIMES == 1
+        if (++frame % 60 == 0) {
+            light_cache_print_stats(&teapot_light, "Teapot light cache");
+            frame_sched_print_stats(&sched, "Frame schedule");
+            frame_stats_print(input_replay_latency(), "input to scene finish");
+            if (LIGHTS > 1) {
+                lights_print_stats(&teapot_lights, "Teapot lights");
+            }
+        }
+#endif
     }
     printf("Cleaning up\n");
+    input_replay_shutdown();
+    ta_usage_shutdown();
+    dl_print_stats(&teapot_list, "Teapot display list");
+    dl_free(&teapot_list);
+    dl_print_stats(&frame_stream, "Frame stream");
+    dl_free(&frame_stream);
+    frame_sched_print_stats(&sched, "Frame schedule");
+    qg_print_stats(&governor, "Quality governor");
+    light_cache_print_stats(&teapot_light, "Teapot light cache");
+    light_cache_free(&teapot_light);
+    lights_print_stats(&teapot_lights, "Teapot lights");
+    shz_mdl_free(&teapot);
+#if HIGHLIGHT_MAP == 1
+    pvrtex_unload(&highlight_map);
+#endif
+    arena_print_stats(&level_arena);
+    arena_destroy(&level_arena);
     pvr_shutdown();  // Clean up PVR resources
     vid_shutdown();  // This function reinitializes the video system to what
                      // dcload and friends expect it to be Run the main
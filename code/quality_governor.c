@@ -0,0 +1,133 @@
+#include <dc/pvr.h>
+#include <sh4zamsprites/perf_timer.h>
+#include <sh4zamsprites/quality_governor.h>
+#include <stdio.h>
+
+void qg_init(quality_governor_t* qg, qg_knob_t* knobs, uint8_t count,
+             uint64_t budget_ns) {
+    *qg = (quality_governor_t){
+        .knobs = knobs,
+        .count = count,
+        .enabled = 1,
+        .last_up = -1,
+        .budget_ns = budget_ns,
+        .up_frames = QG_UP_FRAMES,
+    };
+}
+
+static void stepped(quality_governor_t* qg, const qg_knob_t* knob,
+                    const char* direction) {
+    printf("Quality: %s %s to %d, CPU %.2f ms, PVR %.2f ms\n", knob->name,
+           direction, knob->value, (double)qg->cpu_ns / 1e6,
+           (double)qg->pvr_ns / 1e6);
+    qg->over = 0;
+    qg->under = 0;
+    qg->settle = QG_SETTLE_FRAMES;
+}
+
+static int step_down(quality_governor_t* qg) {
+    const qg_cost_e bottleneck =
+        qg->cpu_ns >= qg->pvr_ns ? QG_COST_CPU : QG_COST_PVR;
+    int pick = -1;
+    for (int i = 0; i < qg->count && pick < 0; i++) {
+        const qg_knob_t* knob = &qg->knobs[i];
+        if (!knob->idle && knob->value > knob->min &&
+            (knob->cost & bottleneck)) {
+            pick = i;
+        }
+    }
+    /* nothing left that costs what is over, anything helps a little */
+    for (int i = 0; i < qg->count && pick < 0; i++) {
+        const qg_knob_t* knob = &qg->knobs[i];
+        if (!knob->idle && knob->value > knob->min) {
+            pick = i;
+        }
+    }
+    if (pick < 0) {
+        return 0;
+    }
+    if (pick == qg->last_up) {
+        /* the last step up did not hold, wait longer before the next */
+        qg->up_frames *= 2;
+        if (qg->up_frames > QG_MAX_UP_FRAMES) {
+            qg->up_frames = QG_MAX_UP_FRAMES;
+        }
+        qg->last_up = -1;
+    }
+    qg->knobs[pick].value--;
+    qg->steps_down++;
+    stepped(qg, &qg->knobs[pick], "down");
+    return 1;
+}
+
+static int step_up(quality_governor_t* qg) {
+    for (int i = qg->count - 1; i >= 0; i--) {
+        qg_knob_t* knob = &qg->knobs[i];
+        if (!knob->idle && knob->value < knob->max) {
+            knob->value++;
+            qg->last_up = i;
+            qg->last_up_frame = qg->frames;
+            qg->steps_up++;
+            stepped(qg, knob, "up");
+            return 1;
+        }
+    }
+    qg->under = 0;
+    return 0;
+}
+
+static int govern(quality_governor_t* qg) {
+    qg->frames++;
+    const uint64_t load = qg->cpu_ns > qg->pvr_ns ? qg->cpu_ns : qg->pvr_ns;
+    const int over = load * 100 > qg->budget_ns * QG_HIGH_PERCENT;
+    qg->frames_over += over;
+    if (qg->last_up >= 0 && qg->frames - qg->last_up_frame > qg->up_frames) {
+        qg->last_up = -1;  // held long enough
+    }
+    if (!qg->enabled) {
+        return 0;
+    }
+    if (qg->settle > 0) {
+        qg->settle--;
+        return 0;
+    }
+    if (over) {
+        qg->under = 0;
+        return ++qg->over >= QG_DOWN_FRAMES && step_down(qg);
+    }
+    qg->over = 0;
+    if (load * 100 < qg->budget_ns * QG_LOW_PERCENT) {
+        return ++qg->under >= qg->up_frames && step_up(qg);
+    }
+    qg->under = 0;
+    return 0;
+}
+
+int qg_wait_ready(quality_governor_t* qg) {
+    const uint64_t wait_ns = perf_now_ns();
+    pvr_wait_ready();
+    const uint64_t ready_ns = perf_now_ns();
+    int changed = 0;
+    if (qg->ready_ns != 0) {
+        /* rendering of the frame before has finished by now */
+        pvr_stats_t stats;
+        pvr_get_stats(&stats);
+        qg->cpu_ns = wait_ns - qg->ready_ns;
+        qg->pvr_ns = stats.rnd_last_time;
+        changed = govern(qg);
+    }
+    qg->ready_ns = ready_ns;
+    return changed;
+}
+
+void qg_print_stats(const quality_governor_t* qg, const char* label) {
+    printf("%s: %lu of %lu frames over %.2f ms, %lu steps down, %lu up\n",
+           label, (unsigned long)qg->frames_over, (unsigned long)qg->frames,
+           (double)qg->budget_ns / 1e6, (unsigned long)qg->steps_down,
+           (unsigned long)qg->steps_up);
+    for (int i = 0; i < qg->count; i++) {
+        const qg_knob_t* knob = &qg->knobs[i];
+        printf("  %-16s %d of %d..%d\n", knob->name, knob->value, knob->min,
+               knob->max);
+    }
+}
@@ -0,0 +1,241 @@
+#include <sh4zamsprites/arena.h>
+#include <sh4zamsprites/lz4_stream.h>
+#include <sh4zamsprites/shz_mdl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** A section of count records or streams starting at offset 32 byte units */
+static int section_fits(const char* name, uint32_t offset, uint32_t count,
+                        uint64_t bytes, size_t size) {
+    if (count == 0) {
+        return 1;
+    }
+    if (offset == 0 || ((uint64_t)offset << 5) + bytes > size) {
+        printf("Error: shzmdl %s section (%lu bytes at %lu) exceeds the %lu "
+               "byte model\n",
+               name, (unsigned long)bytes, (unsigned long)offset << 5,
+               (unsigned long)size);
+        return 0;
+    }
+    return 1;
+}
+
+static inline uint64_t stream_size(uint64_t bytes) {
+    return (bytes + 31) & ~(uint64_t)31;
+}
+
+static int fans_fit(const shzmdl_hdr_t* hdr, size_t size) {
+    uint32_t prev = 0;
+    for (uint32_t offset = hdr->offset.fans; offset != 0;) {
+        /* strictly increasing offsets also rule out cycles */
+        if (offset <= prev ||
+            ((uint64_t)offset << 5) + sizeof(shz_mdl_fan_t) > size) {
+            printf("Error: shzmdl fan at %lu is out of order or bounds\n",
+                   (unsigned long)offset << 5);
+            return 0;
+        }
+        const shz_mdl_fan_t* fan =
+            (const shz_mdl_fan_t*)((const uint8_t*)hdr + (offset << 5));
+        const uint64_t end = ((uint64_t)offset << 5) + sizeof(shz_mdl_fan_t) +
+                             (uint64_t)fan->num_verts *
+                                 sizeof(shz_mdl_vert_normal_t);
+        if (fan->num_verts < 2 || end > size) {
+            printf("Error: shzmdl fan at %lu has %lu blades\n",
+                   (unsigned long)offset << 5, (unsigned long)fan->num_verts);
+            return 0;
+        }
+        prev = offset;
+        offset = fan->next_fan_offset;
+    }
+    return 1;
+}
+
+typedef void (*vert_visitor_t)(void* ctx, shz_vec3_t v);
+
+/** Call visit with every vertex of the faces and fans of a validated model */
+static void visit_verts(const shz_mdl_t* mdl, vert_visitor_t visit,
+                        void* ctx) {
+    const shzmdl_hdr_t* hdr = mdl->hdr;
+    if (hdr->version.flags & SHZ_MDL_FLAG_SOA) {
+        const shz_vec3_t* tris = shz_mdl_tri_positions(hdr);
+        for (uint32_t i = 0; i < hdr->num.tri_faces * 3; i++) {
+            visit(ctx, tris[i]);
+        }
+        const shz_vec3_t* quads = shz_mdl_quad_positions(hdr);
+        for (uint32_t i = 0; i < hdr->num.quad_faces * 4; i++) {
+            visit(ctx, quads[i]);
+        }
+    } else {
+        const shz_mdl_tri_face_t* tris = shz_mdl_tris(mdl);
+        for (uint32_t i = 0; i < hdr->num.tri_faces; i++) {
+            visit(ctx, tris[i].v1);
+            visit(ctx, tris[i].v2);
+            visit(ctx, tris[i].v3);
+        }
+        const shz_mdl_quad_face_t* quads = shz_mdl_quads(mdl);
+        for (uint32_t i = 0; i < hdr->num.quad_faces; i++) {
+            visit(ctx, quads[i].v1);
+            visit(ctx, quads[i].v2);
+            visit(ctx, quads[i].v3);
+            visit(ctx, quads[i].v4);
+        }
+    }
+    SHZ_MDL_FOREACH_FAN(mdl, fan) {
+        visit(ctx, fan->center);
+        const shz_mdl_vert_normal_t* blades =
+            (const shz_mdl_vert_normal_t*)((const uint8_t*)fan +
+                                           sizeof(shz_mdl_fan_t));
+        for (uint32_t i = 0; i < fan->num_verts; i++) {
+            visit(ctx, blades[i].vert);
+        }
+    }
+}
+
+typedef struct {
+    shz_vec3_t min;
+    shz_vec3_t max;
+    shz_vec3_t center;
+    float radius;
+    uint32_t count;
+} bounds_t;
+
+static void grow_box(void* ctx, shz_vec3_t v) {
+    bounds_t* bounds = ctx;
+    if (bounds->count++ == 0) {
+        bounds->min = v;
+        bounds->max = v;
+        return;
+    }
+    for (int i = 0; i < 3; i++) {
+        bounds->min.e[i] = SHZ_MIN(bounds->min.e[i], v.e[i]);
+        bounds->max.e[i] = SHZ_MAX(bounds->max.e[i], v.e[i]);
+    }
+}
+
+static void grow_radius(void* ctx, shz_vec3_t v) {
+    bounds_t* bounds = ctx;
+    bounds->radius = SHZ_MAX(
+        bounds->radius, shz_vec3_magnitude(shz_vec3_sub(v, bounds->center)));
+}
+
+/** A sphere around the box of the vertices, loose but cheap to test */
+static void measure_bounds(shz_mdl_t* mdl) {
+    bounds_t bounds = {0};
+    visit_verts(mdl, grow_box, &bounds);
+    bounds.center = shz_vec3_scale(shz_vec3_add(bounds.min, bounds.max), 0.5f);
+    visit_verts(mdl, grow_radius, &bounds);
+    mdl->center = bounds.center;
+    mdl->radius = bounds.radius;
+}
+
+int shz_mdl_load_blob(shz_mdl_t* mdl, const void* data, size_t size) {
+    memset(mdl, 0, sizeof(shz_mdl_t));
+    if (size < sizeof(shzmdl_hdr_t)) {
+        printf("Error: shzmdl data too short for a header\n");
+        return 0;
+    }
+    const shzmdl_hdr_t* hdr = data;
+    if (hdr->version.major != SHZ_MDL_VERSION_MAJOR ||
+        hdr->version.minor > SHZ_MDL_VERSION_MINOR ||
+        (hdr->version.flags & ~SHZ_MDL_FLAG_SOA) != 0) {
+        printf("Error: unsupported shzmdl version %u.%u.%u flags 0x%02x\n",
+               hdr->version.major, hdr->version.minor, hdr->version.patch,
+               hdr->version.flags);
+        return 0;
+    }
+    /* only the untextured types share the face records below */
+    if (hdr->type != shzmdl_UNTEXTURED && hdr->type != shzmdl_FACE_NORMALS) {
+        printf("Error: unsupported shzmdl type %u\n", hdr->type);
+        return 0;
+    }
+
+    const uint64_t num_tris = hdr->num.tri_faces;
+    const uint64_t num_quads = hdr->num.quad_faces;
+    uint64_t tri_bytes = num_tris * sizeof(shz_mdl_tri_face_t);
+    uint64_t quad_bytes = num_quads * sizeof(shz_mdl_quad_face_t);
+    if (hdr->version.flags & SHZ_MDL_FLAG_SOA) {
+        if ((uintptr_t)data & 31) {
+            printf("Error: shzmdl streams need 32 byte aligned data\n");
+            return 0;
+        }
+        tri_bytes = stream_size(num_tris * 3 * sizeof(shz_vec3_t)) +
+                    stream_size(num_tris * sizeof(shz_vec3_t));
+        quad_bytes = stream_size(num_quads * 4 * sizeof(shz_vec3_t)) +
+                     stream_size(num_quads * sizeof(shz_vec3_t)) +
+                     stream_size(num_quads * sizeof(uint32_t));
+    }
+    if (!section_fits("triangle", hdr->offset.tri_faces, num_tris, tri_bytes,
+                      size) ||
+        !section_fits("quad", hdr->offset.quad_faces, num_quads, quad_bytes,
+                      size) ||
+        !fans_fit(hdr, size)) {
+        return 0;
+    }
+    mdl->hdr = hdr;
+    mdl->size = size;
+    measure_bounds(mdl);
+    return 1;
+}
+
+int shz_mdl_load_file(shz_mdl_t* mdl, const char* filename) {
+    asset_map_t map;
+    if (!asset_map_open(&map, filename)) {
+        memset(mdl, 0, sizeof(shz_mdl_t));
+        return 0;
+    }
+    if (!shz_mdl_load_blob(mdl, map.data, map.size)) {
+        printf("Error: %s is not a valid shzmdl file\n", filename);
+        asset_map_close(&map);
+        return 0;
+    }
+    mdl->map = map;
+    return 1;
+}
+
+typedef struct {
+    uint8_t* dst;
+    size_t size;  // left to fill, the frame must decode to exactly its size
+} lz4_model_t;
+
+static int lz4_model_sink(void* ctx, const uint8_t* data, size_t size) {
+    lz4_model_t* model = ctx;
+    if (size > model->size) {
+        return 0;
+    }
+    memcpy(model->dst, data, size);
+    model->dst += size;
+    model->size -= size;
+    return 1;
+}
+
+int shz_mdl_load_lz4(shz_mdl_t* mdl, const void* data, size_t size) {
+    memset(mdl, 0, sizeof(shz_mdl_t));
+    uint64_t content_size;
+    if (!lz4_frame_content_size(data, size, &content_size)) {
+        return 0;
+    }
+    const size_t mark = arena_mark(&level_arena);
+    uint8_t* buffer = level_alloc(content_size);
+    if (!buffer) {
+        printf("Error allocating %lu bytes for a compressed model\n",
+               (unsigned long)content_size);
+        return 0;
+    }
+    lz4_model_t model = {buffer, content_size};
+    /* the buffer only holds a model once the sink has filled all of it */
+    if (!lz4_frame_decode(data, size, lz4_model_sink, &model) ||
+        model.size != 0 || !shz_mdl_load_blob(mdl, buffer, content_size)) {
+        level_free(buffer);
+        arena_release(&level_arena, mark);
+        return 0;
+    }
+    /* owned like a file that was read, shz_mdl_free() releases it */
+    mdl->map = (asset_map_t){buffer, content_size, ASSET_READ, -1};
+    return 1;
+}
+
+void shz_mdl_free(shz_mdl_t* mdl) {
+    asset_map_close(&mdl->map);
+    memset(mdl, 0, sizeof(shz_mdl_t));
+}
@@ -0,0 +1,30 @@
+#include <sh4zamsprites/display_list.h>
+
+/* the kernels write into the list being recorded instead of the store
+ * queues, the dr_state they pass around is a dummy */
+static display_list_t* recording;
+#define RK_TA_TARGET(dr_state) ((void)(dr_state), dl_record_target(recording))
+#define RK_TA_COMMIT(dr_state, addr) ((void)(addr))
+
+#include <sh4zamsprites/shz_mdl_render.h>
+
+static int record_model(const shz_mdl_t* mdl, fan_encoding_e fan_encoding,
+                        light_env_t* env, const pvr_sprite_hdr_t* fan_spr_hdr,
+                        const pvr_sprite_hdr_t* quad_spr_hdr,
+                        const pvr_poly_hdr_t* poly_hdr,
+                        pvr_dr_state_t* dr_state);
+
+SHZ_MDL_DEFINE_RENDER(record_model)
+
+int shz_mdl_record(display_list_t* dl, const shz_mdl_t* mdl,
+                   fan_encoding_e fan_encoding, light_env_t* env,
+                   const pvr_sprite_hdr_t* fan_spr_hdr,
+                   const pvr_sprite_hdr_t* quad_spr_hdr,
+                   const pvr_poly_hdr_t* poly_hdr) {
+    pvr_dr_state_t unused = 0;
+    recording = dl;
+    const int sprite_mode = record_model(mdl, fan_encoding, env, fan_spr_hdr,
+                                         quad_spr_hdr, poly_hdr, &unused);
+    recording = NULL;
+    return sprite_mode;
+}
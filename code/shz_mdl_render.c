@@ -0,0 +1,49 @@
+#include <sh4zamsprites/shz_mdl_render.h>
+
+SHZ_MDL_DEFINE_RENDER(shz_mdl_render)
+
+/* in 32 byte slots, a vertex, a header or half a sprite each */
+size_t shz_mdl_ta_bytes(const shz_mdl_t* mdl, fan_encoding_e fan_encoding,
+                        int quad_strips) {
+    const shzmdl_hdr_t* hdr = mdl->hdr;
+    size_t slots = 0;
+    SHZ_MDL_FOREACH_FAN(mdl, fan) {
+        switch (fan_encoding) {
+            case FANSTRIPS:
+                slots += 2 * fan->num_verts + 3;
+                break;
+            case FAN2TRIS:
+                slots += 3 * fan->num_verts;
+                break;
+            case FAN2QUADS:
+                /* an odd last blade is a sprite of its own */
+                slots += 3 * ((fan->num_verts + 1) / 2);
+                break;
+        }
+    }
+    if (fan_encoding == FAN2QUADS && hdr->offset.fans) {
+        slots++;  // the polygon header after the fan sprites
+    }
+    slots += 3 * hdr->num.tri_faces;
+
+    if (quad_strips && hdr->type != shzmdl_UNTEXTURED) {
+        /* the header of the mode, then every quad as a strip */
+        return (slots + 1 + 4 * hdr->num.quad_faces) * 32;
+    }
+    const uint32_t* soa_flags = hdr->version.flags & SHZ_MDL_FLAG_SOA
+                                    ? shz_mdl_quad_flags(hdr)
+                                    : NULL;
+    int sprite_mode = 0;
+    for (uint32_t q = 0; q < hdr->num.quad_faces; q++) {
+        const uint32_t flags =
+            soa_flags ? soa_flags[q] : shz_mdl_quads(mdl)[q].flags;
+        if (flags & SHZ_MDL_QUAD_SPLIT) {
+            slots += 4 + sprite_mode;  // leave_sprite_mode()
+            sprite_mode = 0;
+        } else {
+            slots += 3;  // the sprite header and two halves
+            sprite_mode = 1;
+        }
+    }
+    return slots * 32;
+}
@@ -0,0 +1,11 @@
+#include <math.h>
+#include <sh4zamsprites/spec_lut.h>
+
+void spec_lut_init(spec_lut_t* lut, float exponent) {
+    lut->exponent = exponent;
+    lut->start = powf(SPEC_LUT_CUTOFF, 1.0f / exponent);
+    lut->scale = SPEC_LUT_SIZE / (1.0f - lut->start);
+    for (int i = 0; i <= SPEC_LUT_SIZE; i++) {
+        lut->table[i] = powf(lut->start + (float)i / lut->scale, exponent);
+    }
+}
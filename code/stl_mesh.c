@@ -0,0 +1,200 @@
+#include <malloc.h>
+#include <math.h>
+#include <sh4zamsprites/stl_mesh.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STL_HEADER_SIZE 84
+#define STL_RECORD_SIZE 50
+#define WELD_NONE UINT32_MAX
+
+/** Temporary state of the weld, freed once the final block is built */
+typedef struct {
+    shz_vec3_t* positions;  // unique vertices, at most 3 per face
+    uint32_t* next;         // chains vertices that share a hash bucket
+    uint32_t* buckets;
+    uint32_t mask;
+    uint32_t num_verts;
+    float cell;
+    float epsilon_sq;
+} weld_t;
+
+static inline int32_t weld_cell(float x, float cell) {
+    return (int32_t)floorf(x / cell);
+}
+
+static inline uint32_t weld_hash(int32_t x, int32_t y, int32_t z,
+                                 uint32_t mask) {
+    return ((uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^
+            (uint32_t)z * 83492791u) &
+           mask;
+}
+
+/**
+ * Index of the vertex within epsilon of v, adding it if there is none. With
+ * the cells as large as epsilon a match is at most one cell away on each axis.
+ */
+static uint32_t weld_vertex(weld_t* weld, shz_vec3_t v) {
+    const int32_t cx = weld_cell(v.x, weld->cell);
+    const int32_t cy = weld_cell(v.y, weld->cell);
+    const int32_t cz = weld_cell(v.z, weld->cell);
+    for (int32_t dz = -1; dz <= 1; dz++) {
+        for (int32_t dy = -1; dy <= 1; dy++) {
+            for (int32_t dx = -1; dx <= 1; dx++) {
+                uint32_t i = weld->buckets[weld_hash(cx + dx, cy + dy, cz + dz,
+                                                     weld->mask)];
+                for (; i != WELD_NONE; i = weld->next[i]) {
+                    shz_vec3_t d = shz_vec3_sub(weld->positions[i], v);
+                    if (d.x * d.x + d.y * d.y + d.z * d.z <=
+                        weld->epsilon_sq) {
+                        return i;
+                    }
+                }
+            }
+        }
+    }
+    const uint32_t index = weld->num_verts++;
+    const uint32_t bucket = weld_hash(cx, cy, cz, weld->mask);
+    weld->positions[index] = v;
+    weld->next[index] = weld->buckets[bucket];
+    weld->buckets[bucket] = index;
+    return index;
+}
+
+static inline shz_vec3_t normalize_or_zero(shz_vec3_t v) {
+    return shz_vec3_dot(v, v) > 0.0f ? shz_vec3_normalize(v) : v;
+}
+
+static inline size_t cache_lines(size_t bytes) { return (bytes + 31) & ~31u; }
+
+int stl_mesh_load(stl_mesh_t* mesh, const uint8_t* data, size_t size,
+                  float weld_epsilon) {
+    memset(mesh, 0, sizeof(stl_mesh_t));
+    if (size < STL_HEADER_SIZE) {
+        printf("Error: STL data too short for a header\n");
+        return 0;
+    }
+    uint32_t num_records;
+    memcpy(&num_records, data + 80, sizeof(uint32_t));
+    if (num_records == 0 ||
+        num_records > (size - STL_HEADER_SIZE) / STL_RECORD_SIZE) {
+        printf("Error: STL data holds %lu bytes, not %lu triangles\n",
+               (unsigned long)size, (unsigned long)num_records);
+        return 0;
+    }
+
+    const size_t max_verts = (size_t)num_records * 3;
+    uint32_t num_buckets = 1;
+    while (num_buckets < max_verts * 2) {
+        num_buckets <<= 1;
+    }
+    weld_t weld = {
+        .positions = malloc(max_verts * sizeof(shz_vec3_t)),
+        .next = malloc(max_verts * sizeof(uint32_t)),
+        .buckets = malloc(num_buckets * sizeof(uint32_t)),
+        .mask = num_buckets - 1,
+        .num_verts = 0,
+        .cell = weld_epsilon > 0.0f ? weld_epsilon : 1.0f,
+        .epsilon_sq = weld_epsilon > 0.0f ? weld_epsilon * weld_epsilon : 0.0f,
+    };
+    uint32_t* indices = malloc(max_verts * sizeof(uint32_t));
+    int success = weld.positions && weld.next && weld.buckets && indices;
+    if (!success) {
+        printf("Error: out of memory welding %lu triangles\n",
+               (unsigned long)num_records);
+    } else {
+        memset(weld.buckets, 0xFF, num_buckets * sizeof(uint32_t));
+    }
+
+    uint32_t num_faces = 0;
+    const uint8_t* record = data + STL_HEADER_SIZE;
+    for (uint32_t r = 0; success && r < num_records;
+         r++, record += STL_RECORD_SIZE) {
+        uint32_t* face = indices + num_faces * 3;
+        for (int c = 0; c < 3; c++) {
+            shz_vec3_t v;
+            /* skip the stored normal, the records are not aligned */
+            memcpy(&v, record + 12 + c * 12, sizeof(shz_vec3_t));
+            if (!isfinite(v.x) || !isfinite(v.y) || !isfinite(v.z)) {
+                printf("Error: STL triangle %lu has a non-finite vertex\n",
+                       (unsigned long)r);
+                success = 0;
+                break;
+            }
+            face[c] = weld_vertex(&weld, v);
+        }
+        if (success && face[0] != face[1] && face[1] != face[2] &&
+            face[2] != face[0]) {
+            num_faces++;
+        }
+    }
+    if (success && num_faces == 0) {
+        printf("Error: every STL triangle collapsed when welding\n");
+        success = 0;
+    }
+
+    if (success) {
+        const size_t positions_size =
+            cache_lines(weld.num_verts * sizeof(shz_vec3_t));
+        const size_t face_normals_size =
+            cache_lines(num_faces * sizeof(shz_vec3_t));
+        const size_t indices_size =
+            cache_lines(num_faces * 3 * sizeof(uint32_t));
+        uint8_t* block = memalign(32, positions_size * 2 + face_normals_size +
+                                          indices_size);
+        if (block == NULL) {
+            printf("Error: out of memory for a mesh of %lu vertices\n",
+                   (unsigned long)weld.num_verts);
+            success = 0;
+        } else {
+            mesh->block = block;
+            mesh->positions = (shz_vec3_t*)block;
+            mesh->vertex_normals = (shz_vec3_t*)(block + positions_size);
+            mesh->face_normals = (shz_vec3_t*)(block + positions_size * 2);
+            mesh->indices = (uint32_t*)(block + positions_size * 2 +
+                                        face_normals_size);
+            mesh->num_verts = weld.num_verts;
+            mesh->num_faces = num_faces;
+        }
+    }
+
+    if (success) {
+        memcpy(mesh->positions, weld.positions,
+               mesh->num_verts * sizeof(shz_vec3_t));
+        memcpy(mesh->indices, indices, num_faces * 3 * sizeof(uint32_t));
+        memset(mesh->vertex_normals, 0, mesh->num_verts * sizeof(shz_vec3_t));
+        for (uint32_t f = 0; f < num_faces; f++) {
+            const uint32_t* face = mesh->indices + f * 3;
+            const shz_vec3_t v1 = mesh->positions[face[0]];
+            /* the cross product's length is twice the face area, which
+             * weights the vertex normals */
+            const shz_vec3_t n =
+                shz_vec3_cross(shz_vec3_sub(mesh->positions[face[1]], v1),
+                               shz_vec3_sub(mesh->positions[face[2]], v1));
+            mesh->face_normals[f] = normalize_or_zero(n);
+            for (int c = 0; c < 3; c++) {
+                mesh->vertex_normals[face[c]] =
+                    shz_vec3_add(mesh->vertex_normals[face[c]], n);
+            }
+        }
+        for (uint32_t v = 0; v < mesh->num_verts; v++) {
+            mesh->vertex_normals[v] =
+                normalize_or_zero(mesh->vertex_normals[v]);
+        }
+        printf("STL mesh: %lu triangles welded to %lu vertices and %lu faces\n",
+               (unsigned long)num_records, (unsigned long)mesh->num_verts,
+               (unsigned long)num_faces);
+    }
+
+    free(weld.positions);
+    free(weld.next);
+    free(weld.buckets);
+    free(indices);
+    return success;
+}
+
+void stl_mesh_free(stl_mesh_t* mesh) {
+    free(mesh->block);
+    memset(mesh, 0, sizeof(stl_mesh_t));
+}
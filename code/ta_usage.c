@@ -0,0 +1,264 @@
+#include <dc/pvr.h>
+#include <dc/video.h>
+#include <errno.h>
+#include <sh4zamsprites/stringify.h>
+#include <sh4zamsprites/ta_usage.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TA_USAGE_VERTEX_ALIGN (32 * 1024)
+#define TA_USAGE_TILE 32  // pixels, the PVR bins per 32x32 tile
+
+#ifdef BASEPATH
+#define TA_USAGE_DIR EXPAND_STRINGIFY(BASEPATH)
+#else
+#define TA_USAGE_DIR "/pc/"
+#endif
+
+static const char* const list_names[TA_USAGE_LISTS] = {
+    "OP poly", "OP mod", "TR poly", "TR mod", "PT poly"};
+
+static struct {
+    ta_usage_mode_e mode;
+    char filename[256];
+    pvr_init_params_t params;  // what the PVR was initialized with
+    uint32_t vertex_capacity;
+    uint32_t opb_capacity;  // overflow OPBs
+    uint32_t vertex_start;
+    uint32_t opb_start;
+    uint32_t vertex_mark;  // where the last list ended
+    uint32_t opb_mark;
+    ta_usage_t frame;
+    ta_usage_t peak;
+    uint32_t frames;
+    uint32_t warnings;
+} usage = {0};
+
+static inline uint32_t distance(uint32_t a, uint32_t b) {
+    return a > b ? a - b : b - a;
+}
+
+/** Bytes of the per tile OPBs all lists together get from their bin sizes */
+static uint32_t static_opb_bytes(const pvr_init_params_t* params) {
+    const uint32_t tiles =
+        (vid_mode->width * (params->fsaa_enabled ? 2 : 1) / TA_USAGE_TILE) *
+        (vid_mode->height / TA_USAGE_TILE);
+    uint32_t words = 0;
+    for (int i = 0; i < TA_USAGE_LISTS; i++) {
+        words += params->opb_sizes[i];
+    }
+    return words * 4 * tiles;
+}
+
+static int valid_binsize(int size) {
+    return size == PVR_BINSIZE_0 || size == PVR_BINSIZE_8 ||
+           size == PVR_BINSIZE_16 || size == PVR_BINSIZE_32;
+}
+
+static int load_profile(pvr_init_params_t* params) {
+    FILE* file = fopen(usage.filename, "r");
+    if (!file) {
+        printf("Error opening TA usage profile %s: %s\n", usage.filename,
+               strerror(errno));
+        return 0;
+    }
+    pvr_init_params_t loaded = *params;
+    int ok =
+        fscanf(file, " vertex_buf_size %d", &loaded.vertex_buf_size) == 1 &&
+        fscanf(file, " opb_sizes %d %d %d %d %d", &loaded.opb_sizes[0],
+               &loaded.opb_sizes[1], &loaded.opb_sizes[2],
+               &loaded.opb_sizes[3], &loaded.opb_sizes[4]) == 5 &&
+        fscanf(file, " opb_overflow_count %d", &loaded.opb_overflow_count) ==
+            1;
+    fclose(file);
+    for (int i = 0; ok && i < TA_USAGE_LISTS; i++) {
+        ok = valid_binsize(loaded.opb_sizes[i]);
+    }
+    if (!ok || loaded.vertex_buf_size < TA_USAGE_VERTEX_ALIGN ||
+        loaded.opb_overflow_count < 0) {
+        printf("Error: %s is not a TA usage profile\n", usage.filename);
+        return 0;
+    }
+    printf("Sized from %s: vertex buffer %d KB (was %d KB), "
+           "%d overflow OPBs (was %d)\n",
+           usage.filename, loaded.vertex_buf_size / 1024,
+           params->vertex_buf_size / 1024, loaded.opb_overflow_count,
+           params->opb_overflow_count);
+    *params = loaded;
+    return 1;
+}
+
+int ta_usage_init(ta_usage_mode_e mode, const char* name,
+                  pvr_init_params_t* params) {
+    usage.mode = mode;
+    snprintf(usage.filename, sizeof(usage.filename), "%s%s.tausage",
+             TA_USAGE_DIR, name);
+    int success = 1;
+    if (mode == TA_USAGE_PROFILE) {
+        success = load_profile(params);
+    }
+    usage.params = *params;
+    return success;
+}
+
+void ta_usage_scene_begin(void) {
+    if (usage.mode == TA_USAGE_OFF) {
+        return;
+    }
+    if (usage.vertex_capacity == 0) {
+        /* the video mode is set by now */
+        usage.vertex_capacity = usage.params.vertex_buf_size;
+        usage.opb_capacity =
+            usage.params.opb_overflow_count * static_opb_bytes(&usage.params);
+    }
+    usage.vertex_start = PVR_GET(PVR_TA_VERTBUF_START);
+    usage.opb_start = PVR_GET(PVR_TA_OPB_INIT);
+    usage.vertex_mark = usage.vertex_start;
+    usage.opb_mark = usage.opb_start;
+    memset(&usage.frame, 0, sizeof(ta_usage_t));
+}
+
+void ta_usage_list_finish(pvr_list_t list) {
+    if (usage.mode == TA_USAGE_OFF || list >= TA_USAGE_LISTS) {
+        return;
+    }
+    const uint32_t vertex_pos = PVR_GET(PVR_TA_VERTBUF_POS);
+    const uint32_t opb_pos = PVR_GET(PVR_TA_OPB_POS);
+    /* the OPBs grow up or down depending on the TA's OPB config */
+    usage.frame.vertex_bytes[list] += distance(vertex_pos, usage.vertex_mark);
+    usage.frame.opb_bytes[list] += distance(opb_pos, usage.opb_mark);
+    usage.vertex_mark = vertex_pos;
+    usage.opb_mark = opb_pos;
+}
+
+void ta_usage_scene_finish(void) {
+    if (usage.mode == TA_USAGE_OFF) {
+        return;
+    }
+    ta_usage_t* frame = &usage.frame;
+    ta_usage_t* peak = &usage.peak;
+    frame->vertex_total = distance(usage.vertex_mark, usage.vertex_start);
+    frame->opb_total = distance(usage.opb_mark, usage.opb_start);
+    for (int i = 0; i < TA_USAGE_LISTS; i++) {
+        if (frame->vertex_bytes[i] > peak->vertex_bytes[i]) {
+            peak->vertex_bytes[i] = frame->vertex_bytes[i];
+        }
+        if (frame->opb_bytes[i] > peak->opb_bytes[i]) {
+            peak->opb_bytes[i] = frame->opb_bytes[i];
+        }
+    }
+    if (frame->vertex_total > peak->vertex_total) {
+        peak->vertex_total = frame->vertex_total;
+    }
+    if (frame->opb_total > peak->opb_total) {
+        peak->opb_total = frame->opb_total;
+    }
+    usage.frames++;
+
+    const int vertex_full =
+        frame->vertex_total > 0 &&
+        (uint64_t)frame->vertex_total * 100 >=
+            (uint64_t)usage.vertex_capacity * TA_USAGE_WARN_PERCENT;
+    const int opb_full =
+        frame->opb_total > 0 &&
+        (uint64_t)frame->opb_total * 100 >=
+            (uint64_t)usage.opb_capacity * TA_USAGE_WARN_PERCENT;
+    if (vertex_full || opb_full) {
+        /* only the first one is printed, it would repeat every frame */
+        if (usage.warnings++ == 0) {
+            printf("Warning: frame %lu used %lu of %lu KB vertex buffer and "
+                   "%lu of %lu KB overflow OPBs\n",
+                   (unsigned long)usage.frames,
+                   (unsigned long)frame->vertex_total / 1024,
+                   (unsigned long)usage.vertex_capacity / 1024,
+                   (unsigned long)frame->opb_total / 1024,
+                   (unsigned long)usage.opb_capacity / 1024);
+        }
+    }
+}
+
+/** The smallest buffers that hold the peaks with TA_USAGE_HEADROOM to spare */
+static pvr_init_params_t recommend(void) {
+    pvr_init_params_t params = usage.params;
+    const ta_usage_t* peak = &usage.peak;
+
+    uint32_t vertex =
+        peak->vertex_total + peak->vertex_total / TA_USAGE_HEADROOM;
+    vertex =
+        (vertex + TA_USAGE_VERTEX_ALIGN - 1) & ~(TA_USAGE_VERTEX_ALIGN - 1);
+    params.vertex_buf_size =
+        vertex > TA_USAGE_VERTEX_ALIGN ? vertex : TA_USAGE_VERTEX_ALIGN;
+
+    /* bins of lists that never got a vertex are left out */
+    for (int i = 0; i < TA_USAGE_LISTS; i++) {
+        if (peak->vertex_bytes[i] == 0) {
+            params.opb_sizes[i] = PVR_BINSIZE_0;
+        }
+    }
+
+    /* overflow OPBs come in units of the per tile OPB area, keep one so a
+     * full bin does not drop geometry */
+    const uint32_t unit = static_opb_bytes(&params);
+    const uint32_t opb = peak->opb_total + peak->opb_total / TA_USAGE_HEADROOM;
+    params.opb_overflow_count = unit ? (opb + unit - 1) / unit : 0;
+    if (params.opb_overflow_count < 1) {
+        params.opb_overflow_count = 1;
+    }
+    return params;
+}
+
+static int save_profile(const pvr_init_params_t* params) {
+    FILE* file = fopen(usage.filename, "w");
+    if (!file) {
+        printf("Error opening %s for writing: %s\n", usage.filename,
+               strerror(errno));
+        return 0;
+    }
+    const int success =
+        fprintf(file,
+                "vertex_buf_size %d\nopb_sizes %d %d %d %d %d\n"
+                "opb_overflow_count %d\n",
+                params->vertex_buf_size, params->opb_sizes[0],
+                params->opb_sizes[1], params->opb_sizes[2],
+                params->opb_sizes[3], params->opb_sizes[4],
+                params->opb_overflow_count) > 0;
+    fclose(file);
+    if (!success) {
+        printf("Error writing TA usage profile %s\n", usage.filename);
+        return 0;
+    }
+    printf("Wrote TA usage profile %s\n", usage.filename);
+    return 1;
+}
+
+void ta_usage_shutdown(void) {
+    if (usage.mode == TA_USAGE_OFF || usage.frames == 0) {
+        return;
+    }
+    const ta_usage_t* peak = &usage.peak;
+    printf("TA usage over %lu frames, %lu near full:\n",
+           (unsigned long)usage.frames, (unsigned long)usage.warnings);
+    for (int i = 0; i < TA_USAGE_LISTS; i++) {
+        printf("  %-8s vertices %7.1f KB, overflow OPBs %7.1f KB\n",
+               list_names[i], peak->vertex_bytes[i] / 1024.0,
+               peak->opb_bytes[i] / 1024.0);
+    }
+    printf("  %-8s vertices %7.1f of %lu KB, overflow OPBs %7.1f of %lu KB\n",
+           "frame", peak->vertex_total / 1024.0,
+           (unsigned long)usage.vertex_capacity / 1024,
+           peak->opb_total / 1024.0, (unsigned long)usage.opb_capacity / 1024);
+
+    const pvr_init_params_t params = recommend();
+    printf("Recommended pvr_init_params_t:\n"
+           "    {%d, %d, %d, %d, %d},  // bin sizes\n"
+           "    %d << 10,  // Vertex buffer size, was %d KB\n"
+           "    ...\n"
+           "    %d,  // Extra OPBs, was %d\n",
+           params.opb_sizes[0], params.opb_sizes[1], params.opb_sizes[2],
+           params.opb_sizes[3], params.opb_sizes[4],
+           params.vertex_buf_size / 1024, usage.params.vertex_buf_size / 1024,
+           params.opb_overflow_count, usage.params.opb_overflow_count);
+    if (usage.mode == TA_USAGE_RECORD) {
+        save_profile(&params);
+    }
+}
@@ -1,4 +1,7 @@
 #include <errno.h>
+#include <sh4zamsprites/arena.h>
+#include <sh4zamsprites/asset_map.h>
+#include <sh4zamsprites/lz4_stream.h>
 #include <sh4zamsprites/tex_loader.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,8 +11,8 @@
 #include <malloc.h>
 
 
-int pvrtex_load_blob(const void* data, dttex_info_t* texinfo) {
-    memcpy(&texinfo->hdr, data, sizeof(dt_header_t));
+/** Fill texinfo from its header and allocate VRAM, returns the texel bytes */
+static size_t pvrtex_setup(dttex_info_t* texinfo) {
     if (texinfo->hdr.fourcc[0] != 'D' || texinfo->hdr.fourcc[1] != 'c' ||
         texinfo->hdr.fourcc[2] != 'T' || texinfo->hdr.fourcc[3] != 'x') {
         printf("Error: not valid DcTx data\n");
@@ -43,50 +46,104 @@ int pvrtex_load_blob(const void* data, dttex_info_t* texinfo) {
         printf("Error: pvr_mem_malloc failed\n");
         return 0;
     }
-    pvr_txr_load(data + sizeof(dt_header_t), texinfo->ptr, tdatasize);
-    return 1;
+    return tdatasize;
 }
 
-int pvrtex_load_file(const char* filename, dttex_info_t* texinfo) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        printf("Error opening file %s: %s\n", filename, strerror(errno));
+int pvrtex_load_blob(const void* data, dttex_info_t* texinfo) {
+    memcpy(&texinfo->hdr, data, sizeof(dt_header_t));
+    size_t tdatasize = pvrtex_setup(texinfo);
+    if (tdatasize == 0) {
         return 0;
     }
+    pvr_txr_load(data + sizeof(dt_header_t), texinfo->ptr, tdatasize);
+    return 1;
+}
 
-    if (fread(texinfo, sizeof(dt_header_t), 1, file) != 1) {
-        printf("Error reading header from file %s\n", filename);
-        fclose(file);
+tex_upload_fence_t pvrtex_load_async(tex_upload_queue_t* queue,
+                                     const void* data, dttex_info_t* texinfo) {
+    memcpy(&texinfo->hdr, data, sizeof(dt_header_t));
+    size_t tdatasize = pvrtex_setup(texinfo);
+    if (tdatasize == 0) {
         return 0;
     }
+    tex_upload_fence_t fence = tex_upload_submit(
+        queue, (const uint8_t*)data + sizeof(dt_header_t), texinfo->ptr,
+        tdatasize);
+    if (fence == 0) {
+        pvrtex_unload(texinfo);
+    }
+    return fence;
+}
 
-    if (texinfo->hdr.fourcc[0] != 'D' || texinfo->hdr.fourcc[1] != 'c' ||
-        texinfo->hdr.fourcc[2] != 'T' || texinfo->hdr.fourcc[3] != 'x') {
-        printf("Error: not valid DcTx data in file %s\n", filename);
-        fclose(file);
-        return 0;
+typedef struct {
+    dttex_info_t* texinfo;
+    size_t header_bytes;  // of the header gathered so far
+    size_t tdatasize;
+    size_t loaded;
+} lz4_texture_t;
+
+/* the header arrives in the first block, everything after it goes to VRAM
+ * in block sized pieces */
+static int lz4_texture_sink(void* ctx, const uint8_t* data, size_t size) {
+    lz4_texture_t* tex = ctx;
+    if (tex->header_bytes < sizeof(dt_header_t)) {
+        size_t n = MIN(size, sizeof(dt_header_t) - tex->header_bytes);
+        memcpy((uint8_t*)&tex->texinfo->hdr + tex->header_bytes, data, n);
+        tex->header_bytes += n;
+        data += n;
+        size -= n;
+        if (tex->header_bytes == sizeof(dt_header_t)) {
+            tex->tdatasize = pvrtex_setup(tex->texinfo);
+            if (tex->tdatasize == 0) {
+                return 0;
+            }
+        }
+    }
+    size = MIN(size, tex->tdatasize - tex->loaded);
+    if (size > 0) {
+        /* the staging buffer is padded, so rounding up to whole store queue
+         * bursts stays within it and within the 32 byte VRAM allocation */
+        pvr_txr_load(data, (uint8_t*)tex->texinfo->ptr + tex->loaded,
+                     (size + 31) & ~31);
+        tex->loaded += size;
     }
+    return 1;
+}
 
-    size_t tdatasize =
-        texinfo->hdr.chunk_size - ((1 + texinfo->hdr.header_size) << 5);
+int pvrtex_load_lz4(const void* data, size_t size, dttex_info_t* texinfo) {
+    lz4_texture_t tex = {texinfo, 0, 0, 0};
+    texinfo->ptr = NULL;
+    int success = lz4_frame_decode(data, size, lz4_texture_sink, &tex);
+    if (success && (tex.tdatasize == 0 || tex.loaded != tex.tdatasize)) {
+        printf("Error: LZ4 texture ends after %lu of %lu bytes\n",
+               (unsigned long)tex.loaded, (unsigned long)tex.tdatasize);
+        success = 0;
+    }
+    if (!success && texinfo->ptr != NULL) {
+        pvrtex_unload(texinfo);
+    }
+    return success;
+}
 
-    void* buffer = memalign(32, tdatasize + sizeof(dt_header_t));
-    if (!buffer) {
-        printf("Error allocating memory for texture data from file %s\n",
-               filename);
-        fclose(file);
+int pvrtex_load_file(const char* filename, dttex_info_t* texinfo) {
+    /* a file that has to be read only lives until its texels are in VRAM */
+    const size_t mark = arena_mark(&level_arena);
+    asset_map_t map;
+    if (!asset_map_open(&map, filename)) {
         return 0;
     }
-    memcpy(buffer, texinfo, sizeof(dt_header_t));
-    if (fread(buffer + sizeof(dt_header_t), tdatasize , 1, file) != 1) {
-        printf("Error reading texture data from file %s\n", filename);
-        free(buffer);
-        fclose(file);
+    /* the header is checked in place, the texels go from the mapped file
+     * straight to VRAM */
+    const dt_header_t* hdr = map.data;
+    if (map.size < sizeof(dt_header_t) || hdr->chunk_size > map.size) {
+        printf("Error: %s is too short for a DcTx texture\n", filename);
+        asset_map_close(&map);
+        arena_release(&level_arena, mark);
         return 0;
     }
-    fclose(file);
-    int result = pvrtex_load_blob(buffer, texinfo);
-    free(buffer);
+    int result = pvrtex_load_blob(map.data, texinfo);
+    asset_map_close(&map);
+    arena_release(&level_arena, mark);
     return result;
 }
 
@@ -128,50 +185,28 @@ int pvrtex_load_palette_blob(const void* raw_data, int fmt, size_t offset) {
 }
 
 int pvrtex_load_palette_file(const char* filename, int fmt, size_t offset) {
-    int success = 1;
-    FILE* file = NULL;
-    void* raw_data = NULL;
-    do {
-        file = fopen(filename, "rb");
-        if (!file) {
-            printf("Error opening palette file %s: %s\n", filename,
-                   strerror(errno));
-            success = 0;
-            break;
-        }
-        struct {
-            char fourcc[4];
-            size_t colors;
-        } palette_hdr;
-        if (fread(&palette_hdr, sizeof(palette_hdr), 1, file) != 1) {
-            printf("Error reading palette header from file %s\n", filename);
-            success = 0;
-            break;
-        }
-        void* raw_data =
-            memalign(32, palette_hdr.colors * sizeof(uint32_t) + sizeof(palette_hdr));
-        if (!raw_data) {
-            printf("Error allocating memory for palette colors from file %s\n",
-                   filename);
-            success = 0;
-            break;
-        }
-        memcpy(raw_data, &palette_hdr, sizeof(palette_hdr));
-        if (fread((char*)raw_data + sizeof(palette_hdr),
-                  palette_hdr.colors * sizeof(uint32_t), 1, file) != 1) {
-            printf("Error reading palette colors from file %s\n", filename);
-            free(raw_data);
-        }
-        fclose(file);
-        success = pvrtex_load_palette_blob(raw_data, fmt, offset);
-    } while (0);
-
-    if (file != NULL) {
-        fclose(file);
+    const size_t mark = arena_mark(&level_arena);
+    asset_map_t map;
+    if (!asset_map_open(&map, filename)) {
+        return 0;
     }
-    if (raw_data != NULL) {
-        free(raw_data);
+    struct {
+        char fourcc[4];
+        size_t colors;
+    } palette_hdr;
+    int success = map.size >= sizeof(palette_hdr);
+    if (success) {
+        memcpy(&palette_hdr, map.data, sizeof(palette_hdr));
+        success = palette_hdr.colors <=
+                  (map.size - sizeof(palette_hdr)) / sizeof(uint32_t);
+    }
+    if (!success) {
+        printf("Error: %s is too short for its palette\n", filename);
+    } else {
+        success = pvrtex_load_palette_blob(map.data, fmt, offset);
     }
+    asset_map_close(&map);
+    arena_release(&level_arena, mark);
     return success;
 }
 
@@ -0,0 +1,218 @@
+#include <sh4zamsprites/arena.h>
+#include <sh4zamsprites/perf_timer.h>
+#include <sh4zamsprites/tex_upload.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _arch_dreamcast
+#include <arch/cache.h>
+#include <arch/irq.h>
+#include <dc/pvr.h>
+
+/* with a single core, masking interrupts keeps out both the DMA completion
+ * and a switch to the worker */
+#define UPLOAD_LOCK(queue) const int upload_irq = irq_disable()
+#define UPLOAD_UNLOCK(queue) irq_restore(upload_irq)
+
+static inline void upload_sem_init(tex_upload_sem_t* sem, int count) {
+    sem_init(sem, count);
+}
+static inline void upload_sem_post(tex_upload_sem_t* sem) { sem_signal(sem); }
+static inline void upload_yield(void) { thd_pass(); }
+#else
+#include <sched.h>
+
+#define UPLOAD_LOCK(queue) pthread_mutex_lock(&(queue)->lock)
+#define UPLOAD_UNLOCK(queue) pthread_mutex_unlock(&(queue)->lock)
+
+static inline void upload_sem_init(tex_upload_sem_t* sem, int count) {
+    sem_init(sem, 0, count);
+}
+static inline void upload_sem_post(tex_upload_sem_t* sem) { sem_post(sem); }
+static inline void upload_yield(void) { sched_yield(); }
+#endif
+
+/** Retire the chunk in flight, called with the queue locked or from the DMA
+ * interrupt */
+static void upload_complete(tex_upload_queue_t* queue) {
+    queue->stats.bytes += queue->in_flight.size;
+    if (queue->in_flight.fence != 0) {
+        atomic_store_explicit(&queue->last_completed, queue->in_flight.fence,
+                              memory_order_release);
+        queue->stats.completed++;
+        if (queue->in_flight.fence == queue->last_submitted &&
+            queue->busy_since_ns != 0) {
+            queue->stats.busy_ns += perf_now_ns() - queue->busy_since_ns;
+            queue->busy_since_ns = 0;
+        }
+    }
+    upload_sem_post(&queue->dma_idle);
+}
+
+#ifdef _arch_dreamcast
+static void upload_dma_done(void* data) { upload_complete(data); }
+
+static void upload_transfer(tex_upload_queue_t* queue, const uint8_t* staging,
+                            uint8_t* dst) {
+    /* the staging buffers are whole bursts, the DMA moves multiples of 32 */
+    const size_t bytes = (queue->in_flight.size + 31) & ~31;
+    dcache_flush_range((uintptr_t)staging, bytes);
+    if (pvr_txr_load_dma(staging, dst, bytes, 0, upload_dma_done, queue) !=
+        0) {
+        printf("Error starting a texture DMA, copying %lu bytes instead\n",
+               (unsigned long)bytes);
+        pvr_txr_load(staging, dst, bytes);
+        UPLOAD_LOCK(queue);
+        upload_complete(queue);
+        UPLOAD_UNLOCK(queue);
+    }
+}
+#else
+static void upload_transfer(tex_upload_queue_t* queue, const uint8_t* staging,
+                            uint8_t* dst) {
+    memcpy(dst, staging, queue->in_flight.size);
+    UPLOAD_LOCK(queue);
+    upload_complete(queue);
+    UPLOAD_UNLOCK(queue);
+}
+#endif
+
+static void* upload_worker(void* param) {
+    tex_upload_queue_t* queue = param;
+    int buffer = 0;
+    for (;;) {
+        sem_wait(&queue->pending);
+        UPLOAD_LOCK(queue);
+        const int stop = queue->tail == queue->head;
+        tex_upload_job_t job = queue->jobs[queue->tail % TEX_UPLOAD_MAX_JOBS];
+        if (!stop) {
+            queue->tail++;
+        }
+        UPLOAD_UNLOCK(queue);
+        if (stop) {
+            break;  // posted by tex_upload_shutdown() once the ring is empty
+        }
+
+        for (size_t offset = 0; offset < job.size;
+             offset += TEX_UPLOAD_CHUNK_SIZE) {
+            const size_t size = job.size - offset < TEX_UPLOAD_CHUNK_SIZE
+                                    ? job.size - offset
+                                    : TEX_UPLOAD_CHUNK_SIZE;
+            /* this buffer was sent two chunks ago, which finished before the
+             * previous chunk could start, so the copy overlaps only the DMA
+             * of the other buffer */
+            memcpy(queue->staging[buffer], job.src + offset, size);
+            sem_wait(&queue->dma_idle);
+            queue->in_flight.size = size;
+            queue->in_flight.fence =
+                offset + size == job.size ? job.fence : 0;
+            upload_transfer(queue, queue->staging[buffer], job.dst + offset);
+            buffer ^= 1;
+        }
+    }
+    return NULL;
+}
+
+int tex_upload_init(tex_upload_queue_t* queue) {
+    memset(queue, 0, sizeof(tex_upload_queue_t));
+    queue->staging[0] = level_alloc(TEX_UPLOAD_CHUNK_SIZE);
+    queue->staging[1] = level_alloc(TEX_UPLOAD_CHUNK_SIZE);
+    if (!queue->staging[0] || !queue->staging[1]) {
+        printf("Error allocating the texture upload staging buffers\n");
+        level_free(queue->staging[0]);
+        level_free(queue->staging[1]);
+        return 0;
+    }
+    upload_sem_init(&queue->pending, 0);
+    upload_sem_init(&queue->dma_idle, 1);
+#ifdef _arch_dreamcast
+    queue->worker = thd_create(0, upload_worker, queue);
+    const int started = queue->worker != NULL;
+#else
+    pthread_mutex_init(&queue->lock, NULL);
+    const int started =
+        pthread_create(&queue->worker, NULL, upload_worker, queue) == 0;
+#endif
+    if (!started) {
+        printf("Error starting the texture upload thread\n");
+        sem_destroy(&queue->pending);
+        sem_destroy(&queue->dma_idle);
+        level_free(queue->staging[0]);
+        level_free(queue->staging[1]);
+        return 0;
+    }
+    return 1;
+}
+
+void tex_upload_shutdown(tex_upload_queue_t* queue) {
+    if (queue->staging[0] == NULL) {
+        return;
+    }
+    /* the worker only sees this with the ring empty, after every job */
+    upload_sem_post(&queue->pending);
+#ifdef _arch_dreamcast
+    thd_join(queue->worker, NULL);
+#else
+    pthread_join(queue->worker, NULL);
+    pthread_mutex_destroy(&queue->lock);
+#endif
+    sem_wait(&queue->dma_idle);  // the last chunk
+    sem_destroy(&queue->pending);
+    sem_destroy(&queue->dma_idle);
+    level_free(queue->staging[0]);
+    level_free(queue->staging[1]);
+    queue->staging[0] = queue->staging[1] = NULL;
+}
+
+tex_upload_fence_t tex_upload_submit(tex_upload_queue_t* queue, const void* src,
+                                     void* dst, size_t size) {
+    if (size == 0 || ((uintptr_t)dst & 31)) {
+        printf("Error: texture upload of %lu bytes to %p\n",
+               (unsigned long)size, dst);
+        return 0;
+    }
+    UPLOAD_LOCK(queue);
+    if (queue->head - queue->tail == TEX_UPLOAD_MAX_JOBS) {
+        UPLOAD_UNLOCK(queue);
+        printf("Error: texture upload queue is full\n");
+        return 0;
+    }
+    tex_upload_fence_t fence = queue->last_submitted + 1;
+    if (fence == 0) {
+        fence++;
+    }
+    queue->jobs[queue->head % TEX_UPLOAD_MAX_JOBS] =
+        (tex_upload_job_t){src, dst, size, fence};
+    queue->head++;
+    queue->last_submitted = fence;
+    if (queue->busy_since_ns == 0) {
+        queue->busy_since_ns = perf_now_ns();
+    }
+    queue->stats.submitted++;
+    const uint32_t depth = tex_upload_depth(queue);
+    if (depth > queue->stats.max_depth) {
+        queue->stats.max_depth = depth;
+    }
+    UPLOAD_UNLOCK(queue);
+    upload_sem_post(&queue->pending);
+    return fence;
+}
+
+void tex_upload_wait(tex_upload_queue_t* queue, tex_upload_fence_t fence) {
+    while (!tex_upload_done(queue, fence)) {
+        upload_yield();
+    }
+}
+
+void tex_upload_print_stats(const tex_upload_queue_t* queue,
+                            const char* label) {
+    const tex_upload_stats_t* stats = &queue->stats;
+    printf("%s: %lu of %lu jobs, %.1f KB, depth %lu, max depth %lu, "
+           "%.2f MB/s\n",
+           label, (unsigned long)stats->completed,
+           (unsigned long)stats->submitted, stats->bytes / 1024.0,
+           (unsigned long)tex_upload_depth(queue),
+           (unsigned long)stats->max_depth,
+           stats->busy_ns ? stats->bytes * 1000.0 / stats->busy_ns : 0.0);
+}
@@ -0,0 +1,92 @@
+#include <sh4zamsprites/tr_sort.h>
+#include <stdio.h>
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (32 / RADIX_BITS)
+
+int tr_batch_init(tr_batch_t* batch, arena_t* arena, uint32_t max_prims,
+                  uint32_t max_slots) {
+    memset(batch, 0, sizeof(tr_batch_t));
+    if (max_slots > 65536) {
+        printf("Error: translucent batch of %lu slots, at most 65536\n",
+               (unsigned long)max_slots);
+        return 0;
+    }
+    batch->data = arena_alloc(arena, max_slots * 32);
+    batch->prims = arena_alloc(arena, max_prims * sizeof(tr_prim_t));
+    batch->scratch = arena_alloc(arena, max_prims * sizeof(tr_prim_t));
+    if (batch->data == NULL || batch->prims == NULL ||
+        batch->scratch == NULL) {
+        return 0;  // arena_alloc() has said so
+    }
+    batch->max_prims = max_prims;
+    batch->max_slots = max_slots;
+    return 1;
+}
+
+void tr_batch_sort(tr_batch_t* batch) {
+    const uint32_t count = batch->count;
+    if (count < 2) {
+        return;
+    }
+    /* all four histograms in one sweep over the keys */
+    uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS] = {0};
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t key = batch->prims[i].key;
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+            histograms[pass][(key >> (pass * RADIX_BITS)) & 0xFF]++;
+        }
+    }
+
+    tr_prim_t* src = batch->prims;
+    tr_prim_t* dst = batch->scratch;
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        uint32_t* histogram = histograms[pass];
+        const uint32_t shift = pass * RADIX_BITS;
+        /* every key has the same digit, this pass would not move anything */
+        if (histogram[(src[0].key >> shift) & 0xFF] == count) {
+            continue;
+        }
+        uint32_t offset = 0;
+        for (int bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            const uint32_t n = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += n;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+        }
+        tr_prim_t* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    /* keep the sorted order in prims, scratch stays scratch */
+    if (src != batch->prims) {
+        batch->scratch = batch->prims;
+        batch->prims = src;
+    }
+}
+
+void tr_batch_submit(const tr_batch_t* batch, pvr_dr_state_t* dr_state) {
+    for (uint32_t p = 0; p < batch->count; p++) {
+        const tr_prim_t* prim = &batch->prims[p];
+        const uint32_t* src =
+            (const uint32_t*)(batch->data + (uint32_t)prim->slot * 32);
+        if (p + 1 < batch->count) {
+            __builtin_prefetch(batch->data + batch->prims[p + 1].slot * 32);
+        }
+        for (uint32_t s = 0; s < prim->slots; s++, src += 8) {
+            uint32_t* dst = (uint32_t*)pvr_dr_target(*dr_state);
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = src[3];
+            dst[4] = src[4];
+            dst[5] = src[5];
+            dst[6] = src[6];
+            dst[7] = src[7];
+            pvr_dr_commit(dst);
+        }
+    }
+}
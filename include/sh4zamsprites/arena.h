@@ -0,0 +1,100 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <malloc.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Bump pointer arenas, one block allocated up front and handed out in 32 byte
+ * aligned pieces, so the store queues and DMA can use anything that comes out
+ * of them. Nothing is freed on its own: an arena is reset as a whole, or
+ * rolled back to a mark taken earlier.
+ *
+ * frame_arena is the renderer's scratch and is reset at the start of every
+ * frame. level_arena holds what the loaders produce for as long as the level
+ * lives. Both track the most they ever held, print it with arena_print_stats()
+ * next to the malloc stats to size them.
+ */
+
+#define ARENA_ALIGN 32
+
+typedef struct {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    size_t high_water;
+    uint32_t failures;  // allocations that did not fit
+    const char* name;
+} arena_t;
+
+/** Renderer scratch, reset every frame */
+extern arena_t frame_arena;
+/** Loader output, lives until the level is unloaded */
+extern arena_t level_arena;
+
+/**
+ * @brief Allocate the block behind an arena
+ * @param arena The arena to set up, release it with arena_destroy()
+ * @param name Printed by arena_print_stats()
+ * @param size Capacity in bytes
+ * @return int 1 on success, 0 on failure
+ */
+int arena_init(arena_t* arena, const char* name, size_t size);
+
+/**
+ * @brief Free the block behind an arena, everything allocated from it is gone
+ * @param arena The arena to release
+ */
+void arena_destroy(arena_t* arena);
+
+/**
+ * @brief Allocate size bytes, rounded up to whole cache lines
+ * @param arena The arena to allocate from
+ * @param size Number of bytes
+ * @return void* 32 byte aligned memory, NULL if the arena is full
+ */
+void* arena_alloc(arena_t* arena, size_t size);
+
+/** Drop every allocation, the start of a frame or a level */
+static inline void arena_reset(arena_t* arena) { arena->used = 0; }
+
+/** Position to roll back to with arena_release() */
+static inline size_t arena_mark(const arena_t* arena) { return arena->used; }
+
+/** Drop every allocation made since the mark was taken */
+static inline void arena_release(arena_t* arena, size_t mark) {
+    if (mark < arena->used) {
+        arena->used = mark;
+    }
+}
+
+static inline int arena_ready(const arena_t* arena) {
+    return arena->base != NULL;
+}
+
+/**
+ * For the loaders: memory from level_arena once a part has set it up, from
+ * the heap otherwise. Either way it is 32 byte aligned.
+ */
+static inline void* level_alloc(size_t size) {
+    return arena_ready(&level_arena) ? arena_alloc(&level_arena, size)
+                                     : memalign(ARENA_ALIGN, size);
+}
+
+/** Release memory from level_alloc(), a no-op when it came from the arena */
+static inline void level_free(void* ptr) {
+    if (!arena_ready(&level_arena)) {
+        free(ptr);
+    }
+}
+
+/**
+ * @brief Print the capacity, current use, high-water mark and failed
+ * allocations
+ * @param arena The arena to report on
+ */
+void arena_print_stats(const arena_t* arena);
+
+#endif  // ARENA_H
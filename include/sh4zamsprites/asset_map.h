@@ -0,0 +1,65 @@
+#ifndef ASSET_MAP_H
+#define ASSET_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sh4zamsprites/stringify.h>
+
+/**
+ * Read-only views of asset files, so models and textures can come from the
+ * romdisk or dcload instead of being baked into the ELF with #embed.
+ *
+ * On the Dreamcast a file system that supports fs_mmap(), like the romdisk,
+ * hands out a pointer into its image and nothing is copied. Anything else,
+ * e.g. /pc over dcload, is read once straight into a 32 byte aligned buffer.
+ * On the host the file is mmap()ed.
+ */
+
+/** Where the parts look for asset files, BASEPATH when building with it */
+#ifndef ASSET_DIR
+#ifdef BASEPATH
+#define ASSET_DIR EXPAND_STRINGIFY(BASEPATH)
+#else
+#define ASSET_DIR "/rd/"
+#endif
+#endif
+
+/** Build with ASSETFILES=1 to load the parts' assets from ASSET_DIR */
+#ifndef ASSETFILES
+#define ASSETFILES 0
+#endif
+
+/** Build with ASSETLZ4=1 to #embed the LZ4 compressed assets instead */
+#ifndef ASSETLZ4
+#define ASSETLZ4 0
+#endif
+
+typedef enum : uint8_t {
+    ASSET_UNMAPPED = 0,
+    ASSET_MAPPED,  // points into the file system, zero copy
+    ASSET_READ,    // read into memory from level_alloc()
+} asset_map_kind_e;
+
+typedef struct {
+    const void* data;  // 32 byte aligned unless the file system says otherwise
+    size_t size;
+    asset_map_kind_e kind;
+    int fd;
+} asset_map_t;
+
+/**
+ * @brief Map a file read-only
+ * @param map The map to fill, close it with asset_map_close()
+ * @param filename The name of the file to map
+ * @return int 1 on success, 0 on failure
+ */
+int asset_map_open(asset_map_t* map, const char* filename);
+
+/**
+ * @brief Release a mapped file, pointers into it become invalid
+ * @param map The map to close
+ */
+void asset_map_close(asset_map_t* map);
+
+#endif  // ASSET_MAP_H
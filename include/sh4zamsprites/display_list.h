@@ -0,0 +1,139 @@
+#ifndef DISPLAY_LIST_H
+#define DISPLAY_LIST_H
+
+#include <dc/pvr.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Recorded TA streams for geometry whose inputs hold still. A list is tagged
+ * with a key, the bytes of whatever state produced the stream: transforms,
+ * lights, encodings. dl_begin() compares the key of the frame with the one
+ * the list was recorded for and tells the caller to draw, record or replay.
+ *
+ * Recording only starts once the same key comes back a second frame in a
+ * row, so animated geometry keeps drawing straight to the TA and never pays
+ * for the copy into RAM.
+ *
+ * A recording is written with the RK_TA_TARGET of render_kernels.h pointed at
+ * dl_record_target(), e.g. by shz_mdl_record(), and replayed 32 bytes at a
+ * time through the store queues.
+ */
+
+/** Largest key a list compares */
+#define DL_MAX_KEY_SIZE 192
+
+typedef enum : uint8_t {
+    DL_DRAW = 0,  // inputs changed, draw directly
+    DL_RECORD,    // inputs held still, record into the list and replay it
+    DL_REPLAY,    // the list holds the stream for these inputs
+} dl_action_e;
+
+typedef struct {
+    uint32_t hits;       // frames replayed
+    uint32_t misses;     // frames drawn or recorded
+    uint32_t records;    // recordings that fit
+    uint32_t overflows;  // recordings larger than the list
+} dl_stats_t;
+
+typedef struct {
+    uint8_t* data;  // 32 byte aligned
+    size_t capacity;
+    size_t size;
+    uint8_t valid;        // data holds the stream for key
+    uint8_t overflowed;   // too large to record for this key
+    uint8_t recording;
+    uint8_t key_size;
+    alignas(32) uint8_t spill[64];  // writes past the capacity land here
+    uint8_t key[DL_MAX_KEY_SIZE];
+    dl_stats_t stats;
+} display_list_t;
+
+/**
+ * @brief Allocate the buffer of a list from level_alloc()
+ * @param dl The list to set up
+ * @param capacity Largest stream in bytes the list can record
+ * @return int 1 on success, 0 on failure
+ */
+int dl_init(display_list_t* dl, size_t capacity);
+
+/**
+ * @brief Release the buffer of a list
+ * @param dl The list to free
+ */
+void dl_free(display_list_t* dl);
+
+/**
+ * @brief Drop the recording, e.g. when something the key does not cover has
+ * changed. The next frame draws directly.
+ * @param dl The list to invalidate
+ */
+void dl_invalidate(display_list_t* dl);
+
+/**
+ * @brief Decide what to do with this frame's inputs. DL_RECORD starts a
+ * recording that has to be finished with dl_end_record().
+ * @param dl The list
+ * @param key The inputs of the stream, compared byte for byte
+ * @param key_size Size of the key, at most DL_MAX_KEY_SIZE
+ * @return dl_action_e What the caller should do
+ */
+dl_action_e dl_begin(display_list_t* dl, const void* key, size_t key_size);
+
+/**
+ * @brief Start a recording that is not keyed, e.g. a whole frame prepared
+ * ahead of its submission. Finish it with dl_end_record().
+ * @param dl The list to record into
+ */
+void dl_reset(display_list_t* dl);
+
+/**
+ * @brief Finish a recording
+ * @param dl The list
+ * @return int 1 if the stream fit and can be replayed, 0 if the caller has to
+ * draw directly, which it will keep doing until the key changes
+ */
+int dl_end_record(display_list_t* dl);
+
+/**
+ * @brief Finish a recording whose last part may not fit, e.g. geometry
+ * appended to the rest of a frame. On overflow the stream is cut back to
+ * what came before that part, which still replays.
+ * @param dl The list
+ * @param size dl->size before the part that may not fit
+ * @return int 1 if all of it fit, 0 if the caller has to draw the part
+ * directly after replaying the rest
+ */
+int dl_end_record_from(display_list_t* dl, size_t size);
+
+/**
+ * @brief Send the recorded stream to the TA
+ * @param dl A list dl_begin() returned DL_REPLAY for, or that was just
+ * recorded
+ * @param dr_state The direct render state
+ */
+void dl_replay(const display_list_t* dl, pvr_dr_state_t* dr_state);
+
+/**
+ * @brief Print hits, misses, recordings and the size of the stream
+ * @param dl The list to report on
+ * @param label Printed in front of the numbers
+ */
+void dl_print_stats(const display_list_t* dl, const char* label);
+
+/**
+ * Next 32 bytes of the stream being recorded, the RK_TA_TARGET of a recording
+ * renderer. Sprites write their second half through the slot before the one
+ * returned, which in a linear buffer is the one returned.
+ */
+static inline void* dl_record_target(display_list_t* dl) {
+    if (__builtin_expect(dl->size + 32 > dl->capacity, 0)) {
+        dl->overflowed = 1;
+        return dl->spill + 32;
+    }
+    void* slot = dl->data + dl->size;
+    dl->size += 32;
+    return slot;
+}
+
+#endif  // DISPLAY_LIST_H
@@ -0,0 +1,80 @@
+#ifndef FRAME_SCHED_H
+#define FRAME_SCHED_H
+
+#include <stdint.h>
+
+#include <sh4zamsprites/perf_timer.h>
+
+/**
+ * Where the CPU time of a frame loop goes. A pipelined loop prepares frame
+ * N+1 (transforms, lighting, the TA stream into RAM) while the PVR is still
+ * busy with frame N, and after pvr_wait_ready() only copies the prepared
+ * stream to the TA:
+ *
+ *     while (update_state()) {
+ *         frame_sched_phase(&sched, FRAME_PHASE_PREPARE);
+ *         prepare_frame();
+ *         frame_sched_phase(&sched, FRAME_PHASE_STALL);
+ *         pvr_wait_ready();
+ *         frame_sched_phase(&sched, FRAME_PHASE_SUBMIT);
+ *         ... pvr_scene_begin() to pvr_scene_finish() ...
+ *         frame_sched_end_frame(&sched);
+ *     }
+ *
+ * Work done before the wait shrinks the stall, the time the CPU sits idle
+ * in pvr_wait_ready(), by as much as the PVR had left of the frame before.
+ */
+
+typedef enum : uint8_t {
+    FRAME_PHASE_OTHER = 0,  // input and the rest of the loop
+    FRAME_PHASE_PREPARE,    // transform and lighting of the next frame
+    FRAME_PHASE_STALL,      // waiting for the PVR in pvr_wait_ready()
+    FRAME_PHASE_SUBMIT,     // from pvr_wait_ready() to pvr_scene_finish()
+    FRAME_PHASES,
+} frame_phase_e;
+
+typedef struct {
+    frame_phase_e phase;
+    uint64_t phase_start_ns;
+    uint64_t frame_ns[FRAME_PHASES];  // the frame in progress
+    uint64_t total_ns[FRAME_PHASES];
+    uint64_t max_ns[FRAME_PHASES];  // longest of a single frame
+    uint32_t frames;
+} frame_sched_t;
+
+/**
+ * @brief Start timing, in FRAME_PHASE_OTHER
+ * @param sched The scheduler to set up
+ */
+void frame_sched_init(frame_sched_t* sched);
+
+/**
+ * @brief Account the time since the last call to the phase the scheduler was
+ * in and switch to another one
+ * @param sched The scheduler
+ * @param phase The phase the loop enters
+ */
+static inline void frame_sched_phase(frame_sched_t* sched,
+                                     frame_phase_e phase) {
+    const uint64_t now_ns = perf_now_ns();
+    sched->frame_ns[sched->phase] += now_ns - sched->phase_start_ns;
+    sched->phase_start_ns = now_ns;
+    sched->phase = phase;
+}
+
+/**
+ * @brief Close the frame, its phases go into the totals and the loop is back
+ * in FRAME_PHASE_OTHER
+ * @param sched The scheduler
+ */
+void frame_sched_end_frame(frame_sched_t* sched);
+
+/**
+ * @brief Print the mean and longest time per frame of every phase, and how
+ * much of the frame the CPU spent stalled
+ * @param sched The scheduler to report on
+ * @param label Printed in front of the numbers
+ */
+void frame_sched_print_stats(const frame_sched_t* sched, const char* label);
+
+#endif  // FRAME_SCHED_H
@@ -0,0 +1,56 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stdint.h>
+
+/** Histogram resolution and range, frames longer than the range are counted
+ * in the last bucket */
+#define FRAME_STATS_BUCKET_NS 100000u  // 0.1 ms
+#define FRAME_STATS_BUCKETS 1000       // up to 100 ms
+
+typedef struct {
+    uint64_t last_tick_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t total_ns;
+    uint32_t frames;
+    uint32_t histogram[FRAME_STATS_BUCKETS];
+} frame_stats_t;
+
+/**
+ * @brief Clear all samples
+ * @param stats The statistics to reset
+ */
+void frame_stats_reset(frame_stats_t* stats);
+
+/**
+ * @brief Add a single frame time sample
+ * @param stats The statistics to update
+ * @param ns The frame time in nanoseconds
+ */
+void frame_stats_add(frame_stats_t* stats, uint64_t ns);
+
+/**
+ * @brief Mark the start of a frame, adds the time since the previous tick as a
+ * sample. The first tick after a reset only starts the clock.
+ * @param stats The statistics to update
+ */
+void frame_stats_tick(frame_stats_t* stats);
+
+/**
+ * @brief Frame time below which the given share of the frames fall
+ * @param stats The statistics to query
+ * @param percentile In the range 0 to 100, e.g. 99 for p99
+ * @return uint64_t The frame time in nanoseconds, rounded up to the histogram
+ * resolution
+ */
+uint64_t frame_stats_percentile(const frame_stats_t* stats, float percentile);
+
+/**
+ * @brief Print frames, min, avg, p99 and max frame times
+ * @param stats The statistics to print
+ * @param label Printed in front of the numbers
+ */
+void frame_stats_print(const frame_stats_t* stats, const char* label);
+
+#endif  // FRAME_STATS_H
@@ -0,0 +1,118 @@
+#ifndef INPUT_REPLAY_H
+#define INPUT_REPLAY_H
+
+#include <dc/maple.h>
+#include <dc/maple/controller.h>
+#include <dc/pvr.h>
+#include <stdint.h>
+
+#include <sh4zamsprites/frame_stats.h>
+
+/**
+ * Controller input recording and replay, so benchmark runs of different builds
+ * cover the exact same camera path, rotation speeds and zoom levels.
+ *
+ * Select the mode at build time with INPUTREPLAY, e.g.
+ * `INPUTREPLAY=1 BASEPATH=/pc make part_6_specular_lighting.elf` records every
+ * frame of controller state until START is pressed, and writes it to
+ * BASEPATH/<name>.inputs on exit. Building with INPUTREPLAY=2 plays the file
+ * back instead of reading the controllers, and prints frame time statistics
+ * when the recording runs out.
+ */
+typedef enum : uint8_t {
+    INPUT_LIVE = 0,             // read the controllers, no recording
+    INPUT_RECORD = 1,           // read the controllers and record every frame
+    INPUT_REPLAY = 2,           // replay, one recorded frame per vblank
+    INPUT_REPLAY_UNLOCKED = 3,  // replay, rendered offscreen as fast as possible
+                                // into a 1024x512 texture, so not with FSAA
+} input_replay_mode_e;
+
+#ifndef INPUTREPLAY
+#define INPUTREPLAY INPUT_LIVE
+#endif
+
+#define INPUT_MAX_PORTS 4
+
+typedef struct {
+    char fourcc[4];  // "SHZI"
+    uint32_t version;
+    uint32_t frame_size;  // sizeof(input_frame_t), guards against layout changes
+    uint32_t num_frames;
+} input_rec_hdr_t;
+
+typedef struct {
+    uint32_t port_mask;  // bit n set if a controller was present in port n
+    cont_state_t ports[INPUT_MAX_PORTS];
+} input_frame_t;
+
+/**
+ * @brief Set up input for the given mode, must be called after pvr_init()
+ * @param mode One of input_replay_mode_e, usually INPUTREPLAY. A frame wider
+ * than 1024 or taller than 512, like 640x480 with horizontal FSAA, does not
+ * fit the INPUT_REPLAY_UNLOCKED texture and is replayed as INPUT_REPLAY
+ * @param name The recording is stored as BASEPATH/<name>.inputs
+ * @param params The parameters the PVR was initialized with
+ * @return int 1 on success, 0 on failure, in which case input stays live
+ */
+int input_replay_init(input_replay_mode_e mode, const char* name,
+                      const pvr_init_params_t* params);
+
+/**
+ * @brief Latch this frame's controller state, call once at the start of every
+ * frame before input_replay_state()
+ */
+void input_replay_begin_frame(void);
+
+/**
+ * @brief Read the analog sticks and triggers again just before they are
+ * used, so the camera and model matrices built from them are as fresh as
+ * possible. Buttons keep the state input_replay_begin_frame() read. Does
+ * nothing while replaying.
+ */
+void input_replay_latch(void);
+
+/**
+ * @brief Controller state of a port for the current frame
+ * @param port The maple port, 0 to 3
+ * @return cont_state_t* The state, or NULL if there is no controller
+ */
+cont_state_t* input_replay_state(int port);
+
+/**
+ * @brief Whether a replay has run out of recorded frames
+ * @return int 1 when the replay is done, always 0 in the other modes
+ */
+int input_replay_finished(void);
+
+/**
+ * @brief Begin a scene, in INPUT_REPLAY_UNLOCKED mode the scene is rendered
+ * into an offscreen texture so frames are not held back by vblank
+ */
+void input_replay_scene_begin(void);
+
+/**
+ * @brief Finish a scene, and account the time since the controllers were
+ * last read as input latency
+ */
+void input_replay_scene_finish(void);
+
+/**
+ * @brief Frame time statistics collected by input_replay_begin_frame()
+ * @return const frame_stats_t* The statistics
+ */
+const frame_stats_t* input_replay_stats(void);
+
+/**
+ * @brief Input to scene finish latency collected by
+ * input_replay_scene_finish()
+ * @return const frame_stats_t* The statistics
+ */
+const frame_stats_t* input_replay_latency(void);
+
+/**
+ * @brief Write the recording, print replay and latency statistics and free
+ * all buffers
+ */
+void input_replay_shutdown(void);
+
+#endif  // INPUT_REPLAY_H
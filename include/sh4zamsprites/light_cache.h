@@ -0,0 +1,191 @@
+#ifndef LIGHT_CACHE_H
+#define LIGHT_CACHE_H
+
+#include <stdint.h>
+
+#include <sh4zamsprites/render_kernels.h>
+#include <sh4zamsprites/shz_mdl.h>
+
+/**
+ * Face colors of a model kept from one frame to the next. A lit face only
+ * depends on the light, the eye and the model transform, so while those hold
+ * still the colors from the last frame are reused as they are.
+ *
+ * A change of the model view, eye, lighting model or color mode relights
+ * every face. When only the light moves, each entry adds up how far the
+ * light has turned as seen from the face, and is relit once that angle could
+ * have moved its color by a full 8 bit step. A new light color repacks the
+ * kept intensities without relighting.
+ *
+ * Hook a cache into light_env_t::cache and shz_mdl_render() shades the faces
+ * through it, with the loops of the lighting model and color mode picked once
+ * per model. Fans are lit every frame.
+ */
+
+/** Changes below this are treated as no change */
+#define LIGHT_CACHE_EPSILON 1e-5f
+
+/**
+ * Upper bound on how fast a lighting model changes with the angle of the
+ * light: 1 for the diffuse term and 1.5 * (1 + exponent) for the specular
+ * one. The half vector of SHADE_BLINN only turns half as far as the light.
+ */
+static inline float light_cache_slope(const light_env_t* env) {
+    const float exponent = env->spec_lut ? env->spec_lut->exponent
+                                         : SPEC_EXPONENT_PHONG;
+    switch (env->shade_model) {
+        case SHADE_DIFFUSE:
+            return 1.0f;
+        case SHADE_BLINN:
+            return 1.0f + SPECULAR_STRENGTH * (1.0f + 0.5f * exponent);
+        default:
+            return 1.0f + SPECULAR_STRENGTH * (1.0f + exponent);
+    }
+}
+
+typedef enum : uint8_t {
+    LIGHT_CACHE_FULL = 0,     // relight every face
+    LIGHT_CACHE_LIGHT_MOVED,  // relight the faces that drifted too far
+    LIGHT_CACHE_CLEAN,        // reuse every face
+} light_cache_mode_e;
+
+typedef struct {
+    uint32_t argb;    // or the word of light_intensity_word()
+    float intensity;  // calc_light() the color was packed from
+    float drift;      // radians the light turned since the face was lit
+} light_cache_entry_t;
+
+typedef struct {
+    uint32_t recomputed;
+    uint32_t reused;
+} light_cache_counts_t;
+
+typedef struct light_cache {
+    light_cache_entry_t* entries;  // tris, then quads
+    uint32_t count;
+    uint32_t cursor;
+    light_cache_mode_e mode;
+    uint8_t valid;
+    uint8_t repack;        // the light color changed
+    shade_model_e shade_model;  // the light_env_t the entries were lit with
+    const spec_lut_t* spec_lut;
+    uint8_t intensity;     // packed for light_env_set_intensity()
+    float moved;           // distance the light moved this frame
+    float drift_limit;     // drift at which a face is a full step off
+    shz_vec3_t light_pos;  // what the entries were lit with
+    shz_vec3_t light_color;
+    shz_vec3_t spec_view_pos;
+    shz_mat4x4_t model_view;
+    light_cache_counts_t frame;  // the last frame shaded
+    light_cache_counts_t total;
+    uint32_t frames;
+} light_cache_t;
+
+/**
+ * @brief Allocate one entry per face of a model from level_alloc()
+ * @param cache The cache to set up
+ * @param mdl The model it will shade
+ * @return int 1 on success, 0 on failure
+ */
+int light_cache_init(light_cache_t* cache, const shz_mdl_t* mdl);
+
+/**
+ * @brief Release the entries of a cache
+ * @param cache The cache to free
+ */
+void light_cache_free(light_cache_t* cache);
+
+/**
+ * @brief Compare env with what the entries were lit with and pick the mode
+ * of the frame, called by shz_mdl_render()
+ * @param cache The cache
+ * @param mdl The model about to be shaded
+ * @param env The lighting of the frame
+ * @return int 1 if the faces should be shaded through the cache, 0 if it
+ * does not fit the model or env is lit by env->lights
+ */
+int light_cache_begin(light_cache_t* cache, const shz_mdl_t* mdl,
+                      const light_env_t* env);
+
+/**
+ * @brief Finish the counts of the frame
+ * @param cache The cache
+ */
+void light_cache_end(light_cache_t* cache);
+
+/**
+ * @brief Print the counts of the last frame and the averages per frame
+ * @param cache The cache to report on
+ * @param label Printed in front of the numbers
+ */
+void light_cache_print_stats(const light_cache_t* cache, const char* label);
+
+/** Whether the entry of the next face has to be relit this frame */
+static inline int light_cache_stale(light_cache_t* cache,
+                                    light_cache_entry_t* entry,
+                                    const light_env_t* env,
+                                    const shz_vec3_t* vert) {
+    if (cache->mode != LIGHT_CACHE_LIGHT_MOVED) {
+        return cache->mode == LIGHT_CACHE_FULL;
+    }
+    const float dist = shz_vec3_magnitude(shz_vec3_sub(env->light_pos, *vert));
+    /* the light turned by at most this much as seen from the face */
+    entry->drift += dist > cache->moved ? cache->moved / (dist - cache->moved)
+                                        : cache->drift_limit;
+    return entry->drift >= cache->drift_limit;
+}
+
+/**
+ * Defines NAME, a shading function for RK_DEFINE_FACE_LOOPS that colors the
+ * next face through env->cache. A stale face is relit with INTENSITY(env,
+ * vert, normal), the entries are packed with PACK(env, intensity). One per
+ * lighting model and color mode, so relighting carries no branch on either.
+ */
+#define LIGHT_CACHE_DEFINE_SHADE(NAME, INTENSITY, PACK)                        \
+    static inline uint32_t NAME(light_env_t* env, const shz_vec3_t* vert,      \
+                                const shz_vec3_t* normal,                      \
+                                uint32_t flat_argb) {                          \
+        (void)flat_argb;                                                       \
+        light_cache_t* cache = env->cache;                                     \
+        light_cache_entry_t* entry = &cache->entries[cache->cursor++];         \
+        if (light_cache_stale(cache, entry, env, vert)) {                      \
+            entry->intensity =                                                 \
+                INTENSITY(env, (shz_vec3_t*)vert, (shz_vec3_t*)normal);        \
+            entry->argb = PACK(env, entry->intensity);                         \
+            entry->drift = 0.0f;                                               \
+            cache->frame.recomputed++;                                         \
+        } else if (cache->repack) {                                            \
+            entry->argb = PACK(env, entry->intensity);                         \
+        }                                                                      \
+        return entry->argb;                                                    \
+    }
+
+/** calc_diffuse() with the arguments of calc_phong() */
+#define LIGHT_CACHE_DIFFUSE(env, vert, normal) \
+    calc_diffuse((vert), (normal), &(env)->light_pos)
+
+LIGHT_CACHE_DEFINE_SHADE(light_cache_phong, calc_phong, light_argb)
+LIGHT_CACHE_DEFINE_SHADE(light_cache_blinn, calc_blinn, light_argb)
+LIGHT_CACHE_DEFINE_SHADE(light_cache_diffuse, LIGHT_CACHE_DIFFUSE, light_argb)
+LIGHT_CACHE_DEFINE_SHADE(light_cache_intensity_phong, calc_phong,
+                         light_intensity_word)
+LIGHT_CACHE_DEFINE_SHADE(light_cache_intensity_blinn, calc_blinn,
+                         light_intensity_word)
+LIGHT_CACHE_DEFINE_SHADE(light_cache_intensity_diffuse, LIGHT_CACHE_DIFFUSE,
+                         light_intensity_word)
+
+/**
+ * Lit through a light cache, render_cached_phong_tris_aos() and friends, one
+ * set of loops per lighting model like the uncached ones
+ */
+RK_DEFINE_FACE_LOOPS(render_cached_phong, light_cache_phong)
+RK_DEFINE_FACE_LOOPS(render_cached_blinn, light_cache_blinn)
+RK_DEFINE_FACE_LOOPS(render_cached_diffuse, light_cache_diffuse)
+RK_DEFINE_INTENSITY_LOOPS(render_cached_intensity_phong,
+                          light_cache_intensity_phong)
+RK_DEFINE_INTENSITY_LOOPS(render_cached_intensity_blinn,
+                          light_cache_intensity_blinn)
+RK_DEFINE_INTENSITY_LOOPS(render_cached_intensity_diffuse,
+                          light_cache_intensity_diffuse)
+
+#endif  // LIGHT_CACHE_H
@@ -0,0 +1,74 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <stdint.h>
+
+#include <sh4zam/shz_sh4zam.h>
+
+/**
+ * Point and directional lights for models lit by more than the one light of
+ * light_env_t. A scene keeps all of its lights, and before a model is drawn
+ * lights_assign() picks the ones whose range reaches its bounding sphere, so
+ * shade_lights_argb() only iterates those for every face:
+ *
+ *     light_t reaching[LIGHTS_MAX];
+ *     env.num_lights = lights_assign(scene, count, &mdl.center, mdl.radius,
+ *                                    env.model_view, reaching, &stats);
+ *     env.lights = reaching;
+ *
+ * A point light fades to nothing at its range, (1 - d^2 / range^2)^2, so
+ * leaving it out beyond the range changes no pixel. Directional lights reach
+ * everything.
+ */
+
+#define LIGHTS_MAX 8  // most lights one model is lit by
+
+typedef enum : uint8_t {
+    LIGHT_POINT = 0,
+    LIGHT_DIRECTIONAL,
+} light_type_e;
+
+typedef struct {
+    shz_vec3_t pos;  // model space, the direction towards the light for
+                     // LIGHT_DIRECTIONAL, normalized
+    shz_vec3_t color;
+    float range;  // LIGHT_POINT only
+    light_type_e type;
+    /* filled in by lights_assign() */
+    shz_vec3_t spec_pos;  // pos in view space
+    float inv_range_sq;
+} light_t;
+
+typedef struct {
+    uint32_t objects;   // lights_assign() calls
+    uint32_t total;     // lights in the scene, summed over the calls
+    uint32_t assigned;  // lights that reached the object
+    uint32_t histogram[LIGHTS_MAX + 1];  // objects by lights assigned
+} light_stats_t;
+
+/**
+ * @brief Copy the lights that reach a bounding sphere, with their view space
+ * positions for the specular term
+ * @param lights The lights of the scene, model space
+ * @param count Number of lights
+ * @param center Center of the sphere, model space
+ * @param radius Its radius
+ * @param model_view Model to view space
+ * @param out Room for LIGHTS_MAX lights
+ * @param stats Counts the lights assigned, NULL to not count
+ * @return uint8_t Number of lights in out, at most LIGHTS_MAX
+ */
+uint8_t lights_assign(const light_t* lights, uint32_t count,
+                      const shz_vec3_t* center, float radius,
+                      const shz_mat4x4_t* model_view, light_t* out,
+                      light_stats_t* stats);
+
+/**
+ * @brief Print the lights per object on average and how many objects were
+ * lit by each number of lights
+ * @param stats The counts to report on
+ * @param label Printed in front of the numbers
+ */
+void lights_print_stats(const light_stats_t* stats, const char* label);
+
+#endif  // LIGHTS_H
@@ -0,0 +1,44 @@
+#ifndef LZ4_STREAM_H
+#define LZ4_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decoder for LZ4 frames as written by `lz4 -B4 --content-size`, one block at
+ * a time into a small aligned staging buffer, so nothing ever holds the whole
+ * decompressed asset unless the caller wants it to.
+ *
+ * Blocks must be independent (the lz4 default), block and content checksums
+ * are skipped rather than verified.
+ */
+
+/**
+ * Receives each decoded block in order. data is 32 byte aligned and the
+ * buffer behind it is padded to a multiple of 32 bytes, so it can go straight
+ * to pvr_txr_load().
+ * @return int 1 to continue, 0 to stop decoding with an error
+ */
+typedef int (*lz4_sink_t)(void* ctx, const uint8_t* data, size_t size);
+
+/**
+ * @brief Read the decompressed size from a frame header
+ * @param src The LZ4 frame
+ * @param size Size of the frame in bytes
+ * @param content_size Set to the decompressed size
+ * @return int 1 on success, 0 if the frame is invalid or has no content size
+ */
+int lz4_frame_content_size(const void* src, size_t size,
+                           uint64_t* content_size);
+
+/**
+ * @brief Decode a frame block by block into sink
+ * @param src The LZ4 frame
+ * @param size Size of the frame in bytes
+ * @param sink Called with every decoded block
+ * @param ctx Passed to sink
+ * @return int 1 on success, 0 on failure
+ */
+int lz4_frame_decode(const void* src, size_t size, lz4_sink_t sink, void* ctx);
+
+#endif  // LZ4_STREAM_H
@@ -0,0 +1,100 @@
+#ifndef NEAR_CLIP_H
+#define NEAR_CLIP_H
+
+#include <stdint.h>
+
+#include <sh4zam/shz_sh4zam.h>
+
+/**
+ * Clipping against the near plane in homogeneous space, before the divide by
+ * w. A vertex behind the eye has a negative w, dividing by it flips it to the
+ * other side of the screen and one close to 0 sends it off to infinity, so a
+ * primitive that crosses the plane is cut at w = NEAR_CLIP_W first.
+ *
+ * Vertices are in the layout of render_kernels.h, the xmtrx permuted to wxyz,
+ * so w is in .x. Clipping is the slow path, a whole object is classified
+ * once with near_classify_sphere() and only one that crosses the plane has
+ * its primitives clipped one by one:
+ *
+ *     switch (near_classify_sphere(&center, radius)) {
+ *         case NEAR_INSIDE:   draw it with the usual loops
+ *         case NEAR_CROSSING: draw it with the _clipped loops
+ *         case NEAR_OUTSIDE:  all of it is behind the eye
+ *     }
+ */
+
+#ifndef NEAR_CLIP_W
+#define NEAR_CLIP_W 0.5f  // w of the near plane, view space distance
+#endif
+
+/** Most vertices a clipped quad can have, a clipped triangle has one less */
+#define NEAR_CLIP_MAX_VERTS 5
+
+typedef enum : uint8_t {
+    NEAR_INSIDE = 0,  // all in front of the near plane
+    NEAR_CROSSING,
+    NEAR_OUTSIDE,  // all behind it
+} near_class_e;
+
+/**
+ * @brief Where a bounding sphere lies against the near plane, the xmtrx must
+ * hold the model view projection
+ * @param center The center of the sphere in model space
+ * @param radius Its radius in model space
+ * @return near_class_e NEAR_INSIDE if nothing of the sphere needs clipping
+ */
+static inline near_class_e near_classify_sphere(const shz_vec3_t* center,
+                                                float radius) {
+    const float w =
+        shz_xmtrx_transform_vec4((shz_vec4_t){.xyz = *center, .w = 1.0f}).x;
+    /* how far w changes per model unit along x, y and z, the w row of the
+     * xmtrx */
+    const shz_vec3_t w_row = shz_vec3_init(
+        shz_xmtrx_transform_vec4((shz_vec4_t){.e = {1.0f, 0.0f, 0.0f, 0.0f}}).x,
+        shz_xmtrx_transform_vec4((shz_vec4_t){.e = {0.0f, 1.0f, 0.0f, 0.0f}}).x,
+        shz_xmtrx_transform_vec4((shz_vec4_t){.e = {0.0f, 0.0f, 1.0f, 0.0f}})
+            .x);
+    const float extent = radius * shz_vec3_magnitude(w_row);
+    if (w - extent >= NEAR_CLIP_W) {
+        return NEAR_INSIDE;
+    }
+    if (w + extent < NEAR_CLIP_W) {
+        return NEAR_OUTSIDE;
+    }
+    return NEAR_CROSSING;
+}
+
+/**
+ * @brief Cut a convex polygon at the near plane, Sutherland-Hodgman against
+ * the one plane. The winding is kept.
+ * @param in The vertices, transformed but not divided by w
+ * @param count Number of vertices, at most NEAR_CLIP_MAX_VERTS - 1
+ * @param out Room for count + 1 vertices
+ * @return int Number of vertices in out, 0 if all of it is behind the plane
+ */
+static inline int near_clip_polygon(const shz_vec4_t* in, int count,
+                                    shz_vec4_t* out) {
+    int clipped = 0;
+    const shz_vec4_t* a = &in[count - 1];
+    float da = a->x - NEAR_CLIP_W;
+    for (int i = 0; i < count; i++) {
+        const shz_vec4_t* b = &in[i];
+        const float db = b->x - NEAR_CLIP_W;
+        if ((da >= 0.0f) != (db >= 0.0f)) {
+            /* the edge crosses, da - db is never 0 here */
+            const float t = shz_divf(da, da - db);
+            out[clipped++] = (shz_vec4_t){.e = {a->x + t * (b->x - a->x),
+                                                a->y + t * (b->y - a->y),
+                                                a->z + t * (b->z - a->z),
+                                                a->w + t * (b->w - a->w)}};
+        }
+        if (db >= 0.0f) {
+            out[clipped++] = *b;
+        }
+        a = b;
+        da = db;
+    }
+    return clipped;
+}
+
+#endif  // NEAR_CLIP_H
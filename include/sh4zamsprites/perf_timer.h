@@ -0,0 +1,58 @@
+#ifndef PERF_TIMER_H
+#define PERF_TIMER_H
+
+#include <stdint.h>
+
+/**
+ * Minimal timing helpers shared by the benchmarks and the frame statistics.
+ * On the Dreamcast the cycle counter is the SH4 performance counter PRFC1,
+ * PRFC0 is left alone since KallistiOS may use it for its own timer. On the
+ * host there is no portable cycle counter, so perf_cycles() returns 0 and only
+ * the nanosecond timings are meaningful.
+ */
+
+#ifdef _arch_dreamcast
+#include <arch/perfctr.h>
+#include <arch/timer.h>
+
+static inline uint64_t perf_now_ns(void) { return timer_ns_gettime64(); }
+
+/**
+ * Start counting the given event, e.g. PMCR_ELAPSED_TIME_MODE for CPU cycles
+ * or PMCR_OPERAND_CACHE_READ_MISS_MODE for data cache misses.
+ */
+static inline void perf_cycles_start(perf_cntr_event_t event) {
+    perf_cntr_stop(PRFC1);
+    perf_cntr_clear(PRFC1);
+    perf_cntr_start(PRFC1, event, PMCR_COUNT_CPU_CYCLES);
+}
+
+static inline uint64_t perf_cycles(void) { return perf_cntr_count(PRFC1); }
+
+static inline void perf_cycles_stop(void) { perf_cntr_stop(PRFC1); }
+
+#define PERF_HAS_CYCLES 1
+#else
+#include <time.h>
+
+typedef enum {
+    PMCR_ELAPSED_TIME_MODE,
+    PMCR_OPERAND_CACHE_READ_MISS_MODE,
+} perf_cntr_event_t;
+
+static inline uint64_t perf_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void perf_cycles_start(perf_cntr_event_t event) { (void)event; }
+
+static inline uint64_t perf_cycles(void) { return 0; }
+
+static inline void perf_cycles_stop(void) {}
+
+#define PERF_HAS_CYCLES 0
+#endif
+
+#endif  // PERF_TIMER_H
@@ -5,6 +5,7 @@
 #include <dc/matrix3d.h> /* Matrix3D library headers for handling 3D matrix operations */
 #include <sh4zam/shz_sh4zam.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifndef XSCALE
 #define XSCALE 1.0f
@@ -106,8 +107,18 @@ void kos_lookAt(const shz_vec3_t eye, const shz_vec3_t center,
 
 alignas(32) shz_mat4x4_t stored_projection_view = {0};
 void update_projection_view(float fovy) {
+  /* cube_reset_state() calls this every frame dpad left is held */
+  static float stored_fovy = 0.0f;
+  static float stored_width = 0.0f;
+  const float screen_width = vid_mode->width * XSCALE;
+  if (fovy == stored_fovy && screen_width == stored_width) {
+    return;
+  }
+  stored_fovy = fovy;
+  stored_width = screen_width;
+
   shz_xmtrx_init_identity_safe();
-  kos_perspective(vid_mode->width * XSCALE, vid_mode->height, fovy, 0.f, -10.0f);
+  kos_perspective(screen_width, vid_mode->height, fovy, 0.f, -10.0f);
 
   kos_lookAt((shz_vec3_t){.e = {0.f, -0.00001f, 20.0f}},
              (shz_vec3_t){.e = {0.f, 0.f, 0.f}},
@@ -119,4 +130,161 @@ void update_projection_view(float fovy) {
 
   shz_xmtrx_store_4x4(&stored_projection_view);
 }
+
+/**
+ * Inverse transpose of a rotation and translation, the matrix that takes
+ * normals along with it. Its 3x3 part is the rotation itself, so unlike a
+ * general 4x4 inverse this is a handful of dot products. Only valid without
+ * scale or shear.
+ *
+ * \param m The rigid transform.
+ * \param out The inverse transpose, can not be m.
+ */
+void rigid_inverse_transpose(const shz_mat4x4_t* m, shz_mat4x4_t* out) {
+  const shz_vec3_t t = m->pos.xyz;
+  for (int c = 0; c < 3; c++) {
+    out->col[c].xyz = m->col[c].xyz;
+    /* the inverse's translation is -R^T t, transposed into the w row */
+    out->col[c].w = -shz_vec3_dot(m->col[c].xyz, t);
+  }
+  out->pos = (shz_vec4_t){.x = 0.0f, .y = 0.0f, .z = 0.0f, .w = 1.0f};
+}
+
+/**
+ * Camera and model transforms kept from one frame to the next. The setters
+ * only mark what they changed as dirty, camera_update() rebuilds the matrices
+ * that depend on it and leaves the MVP in the XMTRX, so a camera that holds
+ * still costs a single matrix load per frame.
+ */
+typedef enum : uint8_t {
+  CAMERA_DIRTY_SCREEN = 1 << 0,
+  CAMERA_DIRTY_PROJECTION = 1 << 1,
+  CAMERA_DIRTY_VIEW = 1 << 2,
+  CAMERA_DIRTY_MODEL = 1 << 3,
+  CAMERA_DIRTY_ALL = 0x0F,
+} camera_dirty_e;
+
+typedef struct {
+  alignas(32) shz_mat4x4_t projection;  // screen * perspective
+  alignas(32) shz_mat4x4_t view;
+  alignas(32) shz_mat4x4_t model;
+  alignas(32) shz_mat4x4_t model_view;
+  alignas(32) shz_mat4x4_t normal;  // inverse transpose of model_view
+  alignas(32) shz_mat4x4_t mvp;
+  shz_vec3_t eye;
+  shz_vec3_t center;
+  shz_vec3_t up;
+  float screen_width;
+  float screen_height;
+  float fovy;  // radians
+  float aspect;
+  float near_z;
+  uint8_t wxyz;  // permute the output for perspective_n_swizzle()
+  uint8_t dirty;
+} camera_t;
+
+/**
+ * Set up a camera with nothing computed yet.
+ *
+ * \param cam The camera.
+ * \param wxyz 1 to permute the output to w, x, y, z.
+ */
+void camera_init(camera_t* cam, int wxyz) {
+  memset(cam, 0, sizeof(camera_t));
+  cam->wxyz = wxyz;
+  cam->dirty = CAMERA_DIRTY_ALL;
+  shz_xmtrx_init_identity();
+  shz_xmtrx_store_4x4(&cam->model);
+}
+
+/**
+ * Set the viewport, in pixels.
+ */
+void camera_set_screen(camera_t* cam, float screen_width,
+                       float screen_height) {
+  if (screen_width != cam->screen_width ||
+      screen_height != cam->screen_height) {
+    cam->screen_width = screen_width;
+    cam->screen_height = screen_height;
+    cam->dirty |= CAMERA_DIRTY_SCREEN;
+  }
+}
+
+/**
+ * Set the perspective projection.
+ *
+ * \param fovy The field of view in the y direction, in radians.
+ */
+void camera_set_perspective(camera_t* cam, float fovy, float aspect,
+                            float near_z) {
+  if (fovy != cam->fovy || aspect != cam->aspect || near_z != cam->near_z) {
+    cam->fovy = fovy;
+    cam->aspect = aspect;
+    cam->near_z = near_z;
+    cam->dirty |= CAMERA_DIRTY_PROJECTION;
+  }
+}
+
+/**
+ * Set the view, like kos_lookAt().
+ */
+void camera_look_at(camera_t* cam, shz_vec3_t eye, shz_vec3_t center,
+                    shz_vec3_t up) {
+  if (memcmp(&eye, &cam->eye, sizeof(eye)) != 0 ||
+      memcmp(&center, &cam->center, sizeof(center)) != 0 ||
+      memcmp(&up, &cam->up, sizeof(up)) != 0) {
+    cam->eye = eye;
+    cam->center = center;
+    cam->up = up;
+    cam->dirty |= CAMERA_DIRTY_VIEW;
+  }
+}
+
+/**
+ * Set the model transform, compared with the last one byte for byte.
+ *
+ * \param model A rotation and translation, see rigid_inverse_transpose().
+ */
+void camera_set_model(camera_t* cam, const shz_mat4x4_t* model) {
+  if (memcmp(model, &cam->model, sizeof(shz_mat4x4_t)) != 0) {
+    cam->model = *model;
+    cam->dirty |= CAMERA_DIRTY_MODEL;
+  }
+}
+
+/**
+ * Rebuild what is dirty and load the MVP into the XMTRX.
+ *
+ * \param cam The camera.
+ */
+void camera_update(camera_t* cam) {
+  if (cam->dirty == 0) {
+    shz_xmtrx_load_4x4(&cam->mvp);
+    return;
+  }
+  if (cam->dirty & (CAMERA_DIRTY_SCREEN | CAMERA_DIRTY_PROJECTION)) {
+    shz_xmtrx_init_identity();
+    if (cam->wxyz) {
+      shz_xmtrx_apply_permutation_wxyz();
+    }
+    shz_xmtrx_apply_screen(cam->screen_width, cam->screen_height);
+    shz_xmtrx_apply_perspective(cam->fovy, cam->aspect, cam->near_z);
+    shz_xmtrx_store_4x4(&cam->projection);
+  }
+  if (cam->dirty & CAMERA_DIRTY_VIEW) {
+    shz_xmtrx_init_identity();
+    kos_lookAt(cam->eye, cam->center, cam->up);
+    shz_xmtrx_store_4x4(&cam->view);
+  }
+  if (cam->dirty & (CAMERA_DIRTY_VIEW | CAMERA_DIRTY_MODEL)) {
+    shz_xmtrx_load_4x4(&cam->view);
+    shz_xmtrx_apply_4x4(&cam->model);
+    shz_xmtrx_store_4x4(&cam->model_view);
+    rigid_inverse_transpose(&cam->model_view, &cam->normal);
+  }
+  shz_xmtrx_load_4x4(&cam->projection);
+  shz_xmtrx_apply_4x4(&cam->model_view);
+  shz_xmtrx_store_4x4(&cam->mvp);
+  cam->dirty = 0;
+}
 #endif // PERSPECTIVE_H
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef QUALITY_GOVERNOR_H
+#define QUALITY_GOVERNOR_H
+
+#include <stdint.h>
+
+/**
+ * Runtime quality scaling against a frame time budget. Every frame the time
+ * the CPU was busy since the last pvr_wait_ready() and the time the PVR took
+ * to render the frame before are compared with the budget. A few frames in a
+ * row over it step a quality knob down, a long run well under it steps one
+ * back up, so a heavy scene holds 60 fps at a lower quality instead of
+ * dropping to 30.
+ *
+ * Knobs are listed cheapest to lose first. Stepping down picks the first one
+ * that costs what is over the budget, CPU or PVR time, stepping up restores
+ * the last one that is not at its best. A step up that has to be taken back
+ * soon after doubles the frames the next step up waits for, so the governor
+ * does not flip between two levels.
+ */
+
+#define QG_BUDGET_NS 16666667u  // 60 fps
+#define QG_HIGH_PERCENT 95      // of the budget, step down above it
+#define QG_LOW_PERCENT 70       // of the budget, step up below it
+#define QG_DOWN_FRAMES 4        // frames over in a row before a step down
+#define QG_UP_FRAMES 120        // frames under in a row before a step up
+#define QG_MAX_UP_FRAMES (QG_UP_FRAMES * 16)  // longest back off
+#define QG_SETTLE_FRAMES 4  // ignored after a step, frames of the old
+                            // quality are still being rendered
+
+typedef enum : uint8_t {
+    QG_COST_CPU = 1,   // transform, lighting or submission
+    QG_COST_PVR = 2,   // fill rate, sorting
+    QG_COST_BOTH = 3,
+} qg_cost_e;
+
+typedef struct {
+    const char* name;
+    int16_t value;  // the level to render at, read by the part every frame
+    int16_t min;
+    int16_t max;
+    qg_cost_e cost;
+    uint8_t idle;  // does not affect the current frame, left alone
+} qg_knob_t;
+
+typedef struct {
+    qg_knob_t* knobs;
+    uint8_t count;
+    uint8_t enabled;  // 0 keeps measuring but never steps
+    int8_t last_up;   // knob of the last step up, -1 once it has held
+    uint64_t budget_ns;
+    uint64_t ready_ns;  // when pvr_wait_ready() last returned
+    uint64_t cpu_ns;    // the last frame
+    uint64_t pvr_ns;
+    uint32_t over;  // frames in a row over the budget
+    uint32_t under;
+    uint32_t settle;
+    uint32_t up_frames;  // frames under the budget a step up waits for
+    uint32_t last_up_frame;
+    uint32_t frames;
+    uint32_t frames_over;
+    uint32_t steps_down;
+    uint32_t steps_up;
+} quality_governor_t;
+
+/**
+ * @brief Set up a governor with every knob at its current value
+ * @param qg The governor to set up
+ * @param knobs The knobs, cheapest to lose first, owned by the caller
+ * @param count Number of knobs
+ * @param budget_ns Frame time to hold, usually QG_BUDGET_NS
+ */
+void qg_init(quality_governor_t* qg, qg_knob_t* knobs, uint8_t count,
+             uint64_t budget_ns);
+
+/**
+ * @brief pvr_wait_ready() that also times the frame before it and steps a
+ * knob when the budget calls for it
+ * @param qg The governor
+ * @return int 1 if a knob changed value
+ */
+int qg_wait_ready(quality_governor_t* qg);
+
+/**
+ * @brief Print frames over the budget, the steps taken and the knob values
+ * @param qg The governor to report on
+ * @param label Printed in front of the numbers
+ */
+void qg_print_stats(const quality_governor_t* qg, const char* label);
+
+#endif  // QUALITY_GOVERNOR_H
@@ -0,0 +1,1101 @@
+#ifndef RENDER_KERNELS_H
+#define RENDER_KERNELS_H
+
+#include <dc/pvr.h>
+#include <stdint.h>
+
+#include <sh4zam/shz_sh4zam.h>
+#include <sh4zamsprites/lights.h>
+#include <sh4zamsprites/near_clip.h>
+#include <sh4zamsprites/shz_mdl.h>
+#include <sh4zamsprites/spec_lut.h>
+
+#ifndef XSCALE
+#define XSCALE 1.0f
+#endif
+
+#ifndef LINE_WIDTH
+#define LINE_WIDTH 1.0f
+#endif
+
+/**
+ * The kernels below write their output through these two macros. They default
+ * to the direct render API, define both before including this header to send
+ * the TA stream somewhere else, e.g. into RAM when benchmarking.
+ */
+#ifndef RK_TA_TARGET
+#define RK_TA_TARGET(dr_state) pvr_dr_target(*(dr_state))
+#define RK_TA_COMMIT(dr_state, addr) pvr_dr_commit(addr)
+#endif
+
+/** Fan encodings, see render_fan() */
+typedef enum : uint8_t {
+    FANSTRIPS = 0,  // one strip per fan, zig-zagging over the center vertex
+    FAN2TRIS,       // one triangle per blade
+    FAN2QUADS,      // one sprite per two blades
+} fan_encoding_e;
+
+/**
+ * Lighting models, cheapest first, a choice per material. Phong reflects the
+ * light per face in view space. Blinn-Phong treats the light and the viewer
+ * as distant for the specular term, the half vector between them is worked
+ * out once per frame and stays in model space. Each model has face loops of
+ * its own, see RK_DEFINE_FACE_LOOPS.
+ */
+typedef enum : uint8_t {
+    SHADE_DIFFUSE = 0,
+    SHADE_BLINN,  // needs light_env_set_distant() every frame
+    SHADE_PHONG,
+} shade_model_e;
+
+#define SPEC_EXPONENT_PHONG 32.0f
+/* the half vector is at half the angle of the reflection, four times the
+ * exponent gives about the same highlight */
+#define SPEC_EXPONENT_BLINN 128.0f
+
+struct light_cache;
+
+/** Everything the lighting kernels need to shade a face */
+typedef struct {
+    shz_vec3_t light_pos;       // model space
+    shz_vec3_t spec_light_pos;  // view space
+    shz_vec3_t spec_view_pos;   // view space
+    shz_vec3_t light_color;
+    shz_mat4x4_t* model_view;
+    shz_mat4x4_t* inverse_transpose;
+    struct light_cache* cache;  // reuse face colors across frames, see
+                                // light_cache.h, NULL to light every face
+    const light_t* lights;  // lights_assign() output, NULL for the one light
+                            // above
+    uint8_t num_lights;
+    shade_model_e shade_model;
+    const spec_lut_t* spec_lut;  // the specular power of the model, NULL for
+                                 // shz_powf() with SPEC_EXPONENT_PHONG
+    shz_vec3_t half_dir;  // SHADE_BLINN, model space, light_env_set_distant()
+    const pvr_poly_hdr_t* intensity_hdr;  // faces carry float intensities
+                                          // under it, NULL for ARGB, see
+                                          // light_env_set_intensity()
+    float light_level;  // brightest channel of light_color
+    const pvr_poly_hdr_t* highlight_hdr;  // textured with a highlight map,
+                                          // see light_env_set_highlight()
+    shz_vec3_t highlight_u;  // model space, across half_dir, half length
+    shz_vec3_t highlight_v;
+} light_env_t;
+
+/**
+ * Divide by w, with the xmtrx permuted to wxyz the result is already swizzled
+ * into screen x, y and 1/w.
+ */
+static inline shz_vec3_t perspective_n_swizzle(shz_vec4_t v) {
+    const float inv_w = shz_invf_fsrra(v.x);
+    return shz_vec3_init(v.y * inv_w, v.z * inv_w, inv_w);
+}
+
+/** Transform a model space vertex by the xmtrx, w is left undivided */
+static inline shz_vec4_t transform_vert(const shz_vec3_t* v) {
+    return shz_xmtrx_transform_vec4((shz_vec4_t){.xyz = *v, .w = 1.0f});
+}
+
+/** Transform a model space vertex by the xmtrx and project it to the screen */
+static inline shz_vec3_t project_vert(const shz_vec3_t* v) {
+    return perspective_n_swizzle(transform_vert(v));
+}
+
+static inline float calc_diffuse(shz_vec3_t* model_vert,
+                                 shz_vec3_t* face_normal,
+                                 shz_vec3_t* light_pos) {
+    shz_vec3_t diff_normal = shz_vec3_normalize(*face_normal);
+    shz_vec3_t light_dir =
+        shz_vec3_normalize(shz_vec3_sub(*light_pos, *model_vert));
+    return SHZ_MAX(shz_vec3_dot(diff_normal, light_dir), 0.0f);
+}
+
+#define SPECULAR_STRENGTH 1.5f
+
+/** Cosine between the view direction and the reflected light, in view space */
+static inline float phong_dot(shz_vec3_t* model_vert, shz_vec3_t* face_normal,
+                              shz_vec3_t* spec_light_pos,
+                              shz_vec3_t* spec_view_pos,
+                              shz_mat4x4_t* model_view,
+                              shz_mat4x4_t* inverse_transpose) {
+    shz_vec3_t spec_normal = shz_vec3_normalize(
+        shz_mat4x4_trans_vec3(inverse_transpose, *face_normal));
+    shz_vec3_t spec_vert_pos = shz_mat4x4_trans_vec3(model_view, *model_vert);
+    shz_vec3_t spec_light_dir =
+        shz_vec3_normalize(shz_vec3_sub(*spec_light_pos, spec_vert_pos));
+    shz_vec3_t spec_view_dir =
+        shz_vec3_normalize(shz_vec3_sub(*spec_view_pos, spec_vert_pos));
+    shz_vec3_t reflect_dir =
+        shz_vec3_reflect(shz_vec3_neg(spec_light_dir), spec_normal);
+    return SHZ_MAX(shz_vec3_dot(spec_view_dir, reflect_dir), 0.0f);
+}
+
+/** Phong with shz_powf(), the reference the other models are measured by */
+static inline float calc_light(shz_vec3_t* model_vert, shz_vec3_t* face_normal,
+                               shz_vec3_t* light_pos,
+                               shz_vec3_t* spec_light_pos,
+                               shz_vec3_t* spec_view_pos,
+                               shz_mat4x4_t* model_view,
+                               shz_mat4x4_t* inverse_transpose) {
+    float light_intensity = calc_diffuse(model_vert, face_normal, light_pos);
+
+    if (light_intensity > 0.0f) {
+        /* specular light */
+        const float dot_spec =
+            phong_dot(model_vert, face_normal, spec_light_pos, spec_view_pos,
+                      model_view, inverse_transpose);
+        light_intensity += SPECULAR_STRENGTH * light_intensity *
+                           shz_powf(dot_spec, SPEC_EXPONENT_PHONG);
+    }
+    return SHZ_MAX(light_intensity, 0.0f);
+}
+
+/** The specular power of env's model */
+static inline float spec_pow(const light_env_t* env, float x) {
+    return env->spec_lut ? spec_lut_pow(env->spec_lut, x)
+                         : shz_powf(x, SPEC_EXPONENT_PHONG);
+}
+
+/** SHADE_PHONG, calc_light() with the power from env->spec_lut */
+static inline float calc_phong(light_env_t* env, shz_vec3_t* model_vert,
+                               shz_vec3_t* face_normal) {
+    float light_intensity =
+        calc_diffuse(model_vert, face_normal, &env->light_pos);
+
+    if (light_intensity > 0.0f) {
+        /* specular light */
+        const float dot_spec =
+            phong_dot(model_vert, face_normal, &env->spec_light_pos,
+                      &env->spec_view_pos, env->model_view,
+                      env->inverse_transpose);
+        light_intensity +=
+            SPECULAR_STRENGTH * light_intensity * spec_pow(env, dot_spec);
+    }
+    return SHZ_MAX(light_intensity, 0.0f);
+}
+
+/**
+ * SHADE_BLINN, the diffuse term of calc_diffuse() and a specular one from
+ * the half vector of the frame, which stays in model space and needs no
+ * more than a dot product with the normal
+ */
+static inline float calc_blinn(light_env_t* env, shz_vec3_t* model_vert,
+                               shz_vec3_t* face_normal) {
+    const shz_vec3_t normal = shz_vec3_normalize(*face_normal);
+    const shz_vec3_t light_dir =
+        shz_vec3_normalize(shz_vec3_sub(env->light_pos, *model_vert));
+    float light_intensity = shz_vec3_dot(normal, light_dir);
+
+    if (light_intensity > 0.0f) {
+        /* specular light */
+        const float dot_half =
+            SHZ_MAX(shz_vec3_dot(normal, env->half_dir), 0.0f);
+        light_intensity +=
+            SPECULAR_STRENGTH * light_intensity * spec_pow(env, dot_half);
+    }
+    return SHZ_MAX(light_intensity, 0.0f);
+}
+
+/**
+ * Set up SHADE_BLINN for a frame, the half vector between the light and the
+ * eye as seen from the center of the model
+ * @param env Its light_pos is the light
+ * @param center Center of the model, e.g. shz_mdl_t::center
+ * @param eye The eye env->spec_view_pos was transformed from
+ */
+static inline void light_env_set_distant(light_env_t* env, shz_vec3_t center,
+                                         shz_vec3_t eye) {
+    const shz_vec3_t light_dir =
+        shz_vec3_normalize(shz_vec3_sub(env->light_pos, center));
+    const shz_vec3_t view_dir = shz_vec3_normalize(shz_vec3_sub(eye, center));
+    env->half_dir = shz_vec3_normalize(shz_vec3_add(light_dir, view_dir));
+}
+
+/** Opaque ARGB from a color with components in the range 0 to 1 */
+static inline uint32_t pack_argb(shz_vec3_t color) {
+    color = shz_vec3_clamp(color, 0.0f, 1.0f);
+    return (uint32_t)(color.x * 255) << 16 | (uint32_t)(color.y * 255) << 8 |
+           (uint32_t)(color.z * 255) | 0xFF000000;
+}
+
+/** Ambient + the light color scaled by a calc_light() intensity */
+static inline uint32_t light_argb(const light_env_t* env,
+                                  float light_intensity) {
+    /* ambient light */
+    shz_vec3_t final_light = (shz_vec3_t){.x = 0.1f, .y = 0.1f, .z = 0.1f};
+
+    final_light = shz_vec3_add(
+        final_light, (shz_vec3_t){.e = {light_intensity * env->light_color.x,
+                                        light_intensity * env->light_color.y,
+                                        light_intensity * env->light_color.z}});
+    return pack_argb(final_light);
+}
+
+/**
+ * @brief Shade faces in the intensity color mode of the PVR, the light color
+ * goes into the face color of the header and every vertex carries a single
+ * float that scales it, which saves packing an ARGB per face. Only for the
+ * one light of env.
+ *
+ * The header's face color is light_color scaled to its brightest channel, so
+ * a white or grey light looks the same as with ARGB. A colored one keeps its
+ * diffuse and specular terms but tints the ambient and can not wash out to
+ * white in the highlights. Offset colors only apply to textured polygons, the
+ * specular term stays in the base intensity.
+ * @param env Takes the header and the brightness of its light_color
+ * @param hdr Compiled with fmt.color PVR_CLRFMT_INTENSITY, gets the face
+ * color and must outlive the frame
+ */
+static inline void light_env_set_intensity(light_env_t* env,
+                                           pvr_poly_hdr_t* hdr) {
+    const shz_vec3_t color = env->light_color;
+    env->light_level = SHZ_MAX(SHZ_MAX(color.x, color.y), color.z);
+    pvr_poly_ic_hdr_t* ic_hdr = (pvr_poly_ic_hdr_t*)hdr;
+    ic_hdr->a = 1.0f;
+    if (env->light_level > 0.0f) {
+        const float scale = shz_divf(1.0f, env->light_level);
+        ic_hdr->r = color.x * scale;
+        ic_hdr->g = color.y * scale;
+        ic_hdr->b = color.z * scale;
+    } else {
+        /* only the ambient light is left */
+        ic_hdr->r = ic_hdr->g = ic_hdr->b = 1.0f;
+    }
+    env->intensity_hdr = hdr;
+}
+
+/**
+ * light_argb() for light_env_set_intensity(), the float goes where the
+ * vertex would carry its ARGB
+ */
+static inline uint32_t light_intensity_word(const light_env_t* env,
+                                            float light_intensity) {
+    /* ambient light */
+    const union {
+        float intensity;
+        uint32_t word;
+    } vert = {.intensity =
+                  SHZ_MIN(0.1f + light_intensity * env->light_level, 1.0f)};
+    return vert.word;
+}
+
+/**
+ * @brief Shade faces with a highlight map instead of the specular term. The
+ * texture holds the highlight of a sphere, SPECULAR_STRENGTH * (n.h)^128 with
+ * the half vector at its center, see assets/textures/highlight_brewer.py.
+ * A face only works out where its normal lands on it, two dot products with
+ * an orthonormal pair across env->half_dir, and the PVR looks the highlight
+ * up. The light color scales the texel and the ambient and diffuse light are
+ * added as the offset color.
+ *
+ * The map follows the light since it is centered on the half vector rather
+ * than on the view direction of a classic matcap. light_env_set_distant()
+ * must have set the half vector of the frame.
+ * @param env Takes the header and the pair across its half vector
+ * @param hdr Textured with the highlight map, PVR_TXRENV_MODULATE and the
+ * offset color enabled, must outlive the frame
+ */
+static inline void light_env_set_highlight(light_env_t* env,
+                                           const pvr_poly_hdr_t* hdr) {
+    const shz_vec3_t half_dir = env->half_dir;
+    /* any direction that is not along the half vector will do */
+    const shz_vec3_t up = SHZ_MAX(half_dir.z, -half_dir.z) < 0.9f
+                              ? shz_vec3_init(0.0f, 0.0f, 1.0f)
+                              : shz_vec3_init(1.0f, 0.0f, 0.0f);
+    const shz_vec3_t across = shz_vec3_normalize(shz_vec3_cross(half_dir, up));
+    env->highlight_u = shz_vec3_scale(across, 0.5f);
+    env->highlight_v = shz_vec3_scale(shz_vec3_cross(half_dir, across), 0.5f);
+    env->highlight_hdr = hdr;
+}
+
+/** What a face sends to the PVR for light_env_set_highlight() */
+typedef struct {
+    float u, v;      // where the normal lands on the highlight map
+    uint32_t argb;   // the light color, scales the texel
+    uint32_t oargb;  // ambient and diffuse light, added
+} highlight_face_t;
+
+static inline highlight_face_t shade_highlight(const light_env_t* env,
+                                               shz_vec3_t* model_vert,
+                                               shz_vec3_t* face_normal,
+                                               uint32_t flat_argb) {
+    const shz_vec3_t normal = shz_vec3_normalize(*face_normal);
+    const shz_vec3_t light_dir =
+        shz_vec3_normalize(shz_vec3_sub(env->light_pos, *model_vert));
+    const float diffuse = shz_vec3_dot(normal, light_dir);
+    if (diffuse <= 0.0f || shz_vec3_dot(normal, env->half_dir) <= 0.0f) {
+        /* no specular term, as in calc_blinn(). A normal turned away from
+         * the half vector would land on the highlight from the front, the
+         * corner of the map lies outside the sphere and is black */
+        return (highlight_face_t){
+            .u = 0.0f,
+            .v = 0.0f,
+            .argb = flat_argb,
+            .oargb = light_argb(env, SHZ_MAX(diffuse, 0.0f)),
+        };
+    }
+    return (highlight_face_t){
+        .u = 0.5f + shz_vec3_dot(normal, env->highlight_u),
+        .v = 0.5f + shz_vec3_dot(normal, env->highlight_v),
+        .argb = flat_argb,
+        .oargb = light_argb(env, diffuse),
+    };
+}
+
+/** Diffuse and specular intensity of a face lit by env, in its model */
+static inline float shade_intensity(light_env_t* env, shz_vec3_t* model_vert,
+                                    shz_vec3_t* normal) {
+    switch (env->shade_model) {
+        case SHADE_DIFFUSE:
+            return calc_diffuse(model_vert, normal, &env->light_pos);
+        case SHADE_BLINN:
+            return calc_blinn(env, model_vert, normal);
+        default:
+            return calc_phong(env, model_vert, normal);
+    }
+}
+
+/**
+ * Ambient + diffuse and specular of every light in env->lights, packed as
+ * opaque ARGB. The view space normal, vertex and view direction are worked
+ * out once per face, each light adds its direction, falloff and reflection.
+ */
+static inline uint32_t shade_lights_argb(light_env_t* env,
+                                         shz_vec3_t* model_vert,
+                                         shz_vec3_t* normal) {
+    /* ambient light */
+    shz_vec3_t final_light = (shz_vec3_t){.x = 0.1f, .y = 0.1f, .z = 0.1f};
+    const shz_vec3_t diff_normal = shz_vec3_normalize(*normal);
+    shz_vec3_t spec_normal, spec_vert_pos, spec_view_dir;
+    int spec_ready = 0;
+
+    for (uint8_t i = 0; i < env->num_lights; i++) {
+        const light_t* light = &env->lights[i];
+        shz_vec3_t light_dir = light->pos;
+        float falloff = 1.0f;
+        if (light->type == LIGHT_POINT) {
+            light_dir = shz_vec3_sub(light->pos, *model_vert);
+            falloff = 1.0f - shz_vec3_dot(light_dir, light_dir) *
+                                 light->inv_range_sq;
+            if (falloff <= 0.0f) {
+                continue;
+            }
+            falloff *= falloff;
+            light_dir = shz_vec3_normalize(light_dir);
+        }
+        float light_intensity = shz_vec3_dot(diff_normal, light_dir);
+        if (light_intensity <= 0.0f) {
+            continue;
+        }
+
+        if (env->shade_model != SHADE_DIFFUSE) {
+            /* specular light, Phong for every model since the lights are
+             * neither distant nor the same for every face */
+            if (!spec_ready) {
+                spec_normal = shz_vec3_normalize(
+                    shz_mat4x4_trans_vec3(env->inverse_transpose, *normal));
+                spec_vert_pos =
+                    shz_mat4x4_trans_vec3(env->model_view, *model_vert);
+                spec_view_dir = shz_vec3_normalize(
+                    shz_vec3_sub(env->spec_view_pos, spec_vert_pos));
+                spec_ready = 1;
+            }
+            const shz_vec3_t spec_light_dir =
+                light->type == LIGHT_POINT
+                    ? shz_vec3_normalize(
+                          shz_vec3_sub(light->spec_pos, spec_vert_pos))
+                    : light->spec_pos;
+            shz_vec3_t reflect_dir =
+                shz_vec3_reflect(shz_vec3_neg(spec_light_dir), spec_normal);
+            const float dot_spec =
+                SHZ_MAX(shz_vec3_dot(spec_view_dir, reflect_dir), 0.0f);
+            light_intensity += SPECULAR_STRENGTH * light_intensity *
+                               shz_powf(dot_spec, SPEC_EXPONENT_PHONG);
+        }
+        light_intensity *= falloff;
+        final_light = shz_vec3_add(
+            final_light, (shz_vec3_t){.e = {light_intensity * light->color.x,
+                                            light_intensity * light->color.y,
+                                            light_intensity * light->color.z}});
+    }
+    return pack_argb(final_light);
+}
+
+/** Ambient + diffuse + specular, packed as opaque ARGB */
+static inline uint32_t shade_argb(light_env_t* env, shz_vec3_t* model_vert,
+                                  shz_vec3_t* normal) {
+    if (env->lights) {
+        return shade_lights_argb(env, model_vert, normal);
+    }
+    return light_argb(env, shade_intensity(env, model_vert, normal));
+}
+
+static inline void draw_sprite_line(shz_vec4_t* from, shz_vec4_t* to,
+                                    float centerz, pvr_dr_state_t* dr_state) {
+    pvr_sprite_col_t* quad = (pvr_sprite_col_t*)RK_TA_TARGET(dr_state);
+    quad->flags = PVR_CMD_VERTEX_EOL;
+    if (from->x > to->x) {
+        shz_vec4_t* tmp = from;
+        from = to;
+        to = tmp;
+    }
+    shz_vec3_t direction = shz_vec3_normalize(
+        (shz_vec3_t){.e = {to->x - from->x, to->y - from->y, to->z - from->z}});
+    quad->ax = from->x;
+    quad->ay = from->y;
+    quad->az = from->z + centerz * 0.1;
+    quad->bx = to->x;
+    quad->by = to->y;
+    quad->bz = to->z + centerz * 0.1;
+    quad->cx = to->x + LINE_WIDTH * XSCALE * direction.y;
+    RK_TA_COMMIT(dr_state, quad);
+    quad = (pvr_sprite_col_t*)RK_TA_TARGET(dr_state);
+    pvr_sprite_col_t* quad2ndhalf = (pvr_sprite_col_t*)((uint8_t*)quad - 32);
+    quad2ndhalf->cy = to->y - LINE_WIDTH * direction.x;
+    quad2ndhalf->cz = to->z + centerz * 0.1;
+    quad2ndhalf->dx = from->x + LINE_WIDTH * XSCALE * direction.y;
+    quad2ndhalf->dy = from->y - LINE_WIDTH * direction.x;
+    RK_TA_COMMIT(dr_state, quad);
+}
+
+/** Flat shaded triangle, the color is taken from the last vertex */
+static inline void emit_triangle(const shz_vec3_t* v1, const shz_vec3_t* v2,
+                                 const shz_vec3_t* v3, uint32_t argb,
+                                 pvr_dr_state_t* dr_state) {
+    pvr_vertex_t* v = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    v->flags = PVR_CMD_VERTEX;
+    v->x = v1->x;
+    v->y = v1->y;
+    v->z = v1->z;
+    RK_TA_COMMIT(dr_state, v);
+    v = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    v->flags = PVR_CMD_VERTEX;
+    v->x = v2->x;
+    v->y = v2->y;
+    v->z = v2->z;
+    RK_TA_COMMIT(dr_state, v);
+    v = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    v->flags = PVR_CMD_VERTEX_EOL;
+    v->x = v3->x;
+    v->y = v3->y;
+    v->z = v3->z;
+    v->argb = argb;
+    RK_TA_COMMIT(dr_state, v);
+}
+
+/**
+ * Colored sprite with its own header, the PVR derives the position of d from
+ * a, b and c, so only v4.x and v4.y are sent.
+ */
+static inline void emit_quad_sprite(const pvr_sprite_hdr_t* spr_hdr,
+                                    uint32_t argb, const shz_vec3_t* v1,
+                                    const shz_vec3_t* v2, const shz_vec3_t* v3,
+                                    const shz_vec3_t* v4,
+                                    pvr_dr_state_t* dr_state) {
+    pvr_sprite_hdr_t* spr_hdr_pntr =
+        (pvr_sprite_hdr_t*)RK_TA_TARGET(dr_state);
+    *spr_hdr_pntr = *spr_hdr;
+    spr_hdr_pntr->argb = argb;
+    RK_TA_COMMIT(dr_state, spr_hdr_pntr);
+
+    pvr_sprite_col_t* qface = (pvr_sprite_col_t*)RK_TA_TARGET(dr_state);
+    qface->flags = PVR_CMD_VERTEX_EOL;
+    qface->ax = v1->x;
+    qface->ay = v1->y;
+    qface->az = v1->z;
+    qface->bx = v2->x;
+    qface->by = v2->y;
+    qface->bz = v2->z;
+    qface->cx = v3->x;
+    RK_TA_COMMIT(dr_state, qface);
+    qface = (pvr_sprite_col_t*)RK_TA_TARGET(dr_state);
+    pvr_sprite_col_t* qface2ndhalf = (pvr_sprite_col_t*)((uint8_t*)qface - 32);
+    qface2ndhalf->cy = v3->y;
+    qface2ndhalf->cz = v3->z;
+    qface2ndhalf->dx = v4->x;
+    qface2ndhalf->dy = v4->y;
+    RK_TA_COMMIT(dr_state, qface);
+}
+
+/**
+ * Flat shaded quad of any shape as a strip a, b, d, c, needs a polygon header.
+ * Both triangles take their color from their last vertex, 128 bytes against
+ * 192 for two triangles.
+ */
+static inline void emit_quad_strip(const shz_vec3_t* v1, const shz_vec3_t* v2,
+                                   const shz_vec3_t* v3, const shz_vec3_t* v4,
+                                   uint32_t argb, pvr_dr_state_t* dr_state) {
+    pvr_vertex_t* v = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    v->flags = PVR_CMD_VERTEX;
+    v->x = v1->x;
+    v->y = v1->y;
+    v->z = v1->z;
+    RK_TA_COMMIT(dr_state, v);
+    v = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    v->flags = PVR_CMD_VERTEX;
+    v->x = v2->x;
+    v->y = v2->y;
+    v->z = v2->z;
+    RK_TA_COMMIT(dr_state, v);
+    v = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    v->flags = PVR_CMD_VERTEX;
+    v->x = v4->x;
+    v->y = v4->y;
+    v->z = v4->z;
+    v->argb = argb;
+    RK_TA_COMMIT(dr_state, v);
+    v = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    v->flags = PVR_CMD_VERTEX_EOL;
+    v->x = v3->x;
+    v->y = v3->y;
+    v->z = v3->z;
+    v->argb = argb;
+    RK_TA_COMMIT(dr_state, v);
+}
+
+/**
+ * Flat shaded convex polygon as one strip zig-zagging between its two ends,
+ * 0, 1, n-1, 2, n-2, ..., which keeps the winding. Needs a polygon header.
+ */
+static inline void emit_polygon_strip(const shz_vec4_t* poly, int count,
+                                      uint32_t argb,
+                                      pvr_dr_state_t* dr_state) {
+    int lo = 1;
+    int hi = count - 1;
+    for (int i = 0; i < count; i++) {
+        const int index = i == 0 ? 0 : (i & 1) ? lo++ : hi--;
+        const shz_vec3_t p = perspective_n_swizzle(poly[index]);
+        pvr_vertex_t* v = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+        v->flags = i == count - 1 ? PVR_CMD_VERTEX_EOL : PVR_CMD_VERTEX;
+        v->x = p.x;
+        v->y = p.y;
+        v->z = p.z;
+        v->argb = argb;
+        RK_TA_COMMIT(dr_state, v);
+    }
+}
+
+/**
+ * Cut a transformed polygon at the near plane and send what is left in front
+ * of it as a strip, nothing if all of it is behind. Needs a polygon header.
+ */
+static inline void emit_clipped_polygon(const shz_vec4_t* poly, int count,
+                                        uint32_t argb,
+                                        pvr_dr_state_t* dr_state) {
+    shz_vec4_t clipped[NEAR_CLIP_MAX_VERTS];
+    const int clipped_count = near_clip_polygon(poly, count, clipped);
+    if (clipped_count >= 3) {
+        emit_polygon_strip(clipped, clipped_count, argb, dr_state);
+    }
+}
+
+/**
+ * emit_polygon_strip() of a transformed polygon for a textured header, every
+ * vertex carries the UV and colors of the face
+ */
+static inline void emit_highlight_strip(const shz_vec4_t* poly, int count,
+                                        const highlight_face_t* face,
+                                        pvr_dr_state_t* dr_state) {
+    int lo = 1;
+    int hi = count - 1;
+    for (int i = 0; i < count; i++) {
+        const int index = i == 0 ? 0 : (i & 1) ? lo++ : hi--;
+        const shz_vec3_t p = perspective_n_swizzle(poly[index]);
+        pvr_vertex_t* v = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+        v->flags = i == count - 1 ? PVR_CMD_VERTEX_EOL : PVR_CMD_VERTEX;
+        v->x = p.x;
+        v->y = p.y;
+        v->z = p.z;
+        v->u = face->u;
+        v->v = face->v;
+        v->argb = face->argb;
+        v->oargb = face->oargb;
+        RK_TA_COMMIT(dr_state, v);
+    }
+}
+
+/** emit_clipped_polygon() for emit_highlight_strip() */
+static inline void emit_clipped_highlight(const shz_vec4_t* poly, int count,
+                                          const highlight_face_t* face,
+                                          pvr_dr_state_t* dr_state) {
+    shz_vec4_t clipped[NEAR_CLIP_MAX_VERTS];
+    const int clipped_count = near_clip_polygon(poly, count, clipped);
+    if (clipped_count >= 3) {
+        emit_highlight_strip(clipped, clipped_count, face, dr_state);
+    }
+}
+
+/** Resubmit the polygon header if the TA was left in sprite mode */
+static inline void leave_sprite_mode(const pvr_poly_hdr_t* poly_hdr,
+                                     int* sprite_mode,
+                                     pvr_dr_state_t* dr_state) {
+    if (*sprite_mode) {
+        pvr_poly_hdr_t* hdr = (pvr_poly_hdr_t*)RK_TA_TARGET(dr_state);
+        *hdr = *poly_hdr;
+        RK_TA_COMMIT(dr_state, hdr);
+        *sprite_mode = 0;
+    }
+}
+
+static inline shz_mdl_vert_normal_t* fan_blades(const shz_mdl_fan_t* fan) {
+    return (shz_mdl_vert_normal_t*)((uint8_t*)fan + sizeof(shz_mdl_fan_t));
+}
+
+/** One strip per fan, every other vertex is the fan center */
+static inline void render_fan_strip(const shz_mdl_fan_t* fan,
+                                    light_env_t* env,
+                                    pvr_dr_state_t* dr_state) {
+    shz_mdl_vert_normal_t* blades = fan_blades(fan);
+    shz_vec3_t fan_center = project_vert(&fan->center);
+    shz_vec3_t prev_left = project_vert(&(blades + fan->num_verts - 1)->vert);
+
+    pvr_vertex_t* tri = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    tri->flags = PVR_CMD_VERTEX;
+    tri->x = prev_left.x;
+    tri->y = prev_left.y;
+    tri->z = prev_left.z;
+    RK_TA_COMMIT(dr_state, tri);
+    for (uint32_t f = 0; f < fan->num_verts; f++) {
+        uint32_t argb =
+            shade_argb(env, &(blades + f)->vert, &(blades + f)->normal);
+        shz_vec3_t cur_right = project_vert(&(blades + f)->vert);
+
+        tri = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+        tri->flags = PVR_CMD_VERTEX;
+        tri->x = fan_center.x;
+        tri->y = fan_center.y;
+        tri->z = fan_center.z;
+        RK_TA_COMMIT(dr_state, tri);
+        tri = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+        tri->flags = PVR_CMD_VERTEX;
+        tri->x = cur_right.x;
+        tri->y = cur_right.y;
+        tri->z = cur_right.z;
+        tri->argb = argb;
+        RK_TA_COMMIT(dr_state, tri);
+    }
+    // finish the fan
+    tri = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    tri->flags = PVR_CMD_VERTEX;
+    tri->x = fan_center.x;
+    tri->y = fan_center.y;
+    tri->z = fan_center.z;
+    RK_TA_COMMIT(dr_state, tri);
+
+    uint32_t argb = shade_argb(env, &blades->vert, &blades->normal);
+    shz_vec3_t cur_right = project_vert(&blades->vert);
+
+    tri = (pvr_vertex_t*)RK_TA_TARGET(dr_state);
+    tri->flags = PVR_CMD_VERTEX_EOL;
+    tri->x = cur_right.x;
+    tri->y = cur_right.y;
+    tri->z = cur_right.z;
+    tri->argb = argb;
+    RK_TA_COMMIT(dr_state, tri);
+}
+
+/** One triangle per fan blade */
+static inline void render_fan_tris(const shz_mdl_fan_t* fan, light_env_t* env,
+                                   pvr_dr_state_t* dr_state) {
+    shz_mdl_vert_normal_t* blades = fan_blades(fan);
+    shz_vec3_t fan_center = project_vert(&fan->center);
+    shz_vec3_t prev_left = project_vert(&(blades + fan->num_verts - 1)->vert);
+
+    for (uint32_t f = 0; f < fan->num_verts; f++) {
+        uint32_t argb =
+            shade_argb(env, &(blades + f)->vert, &(blades + f)->normal);
+        shz_vec3_t cur_right = project_vert(&(blades + f)->vert);
+        emit_triangle(&fan_center, &prev_left, &cur_right, argb, dr_state);
+        prev_left = cur_right;
+    }
+}
+
+/**
+ * One sprite per two fan blades, only correct where center, left, mid and
+ * right are close to a parallelogram, but a third less TA data than triangles.
+ * The last blade of an odd fan is a triangle, a sprite with its last corner
+ * on the one before.
+ */
+static inline void render_fan_quads(const shz_mdl_fan_t* fan,
+                                    light_env_t* env,
+                                    const pvr_sprite_hdr_t* spr_hdr,
+                                    pvr_dr_state_t* dr_state) {
+    shz_mdl_vert_normal_t* blades = fan_blades(fan);
+    shz_vec3_t fan_center = project_vert(&fan->center);
+    shz_vec3_t prev_left = project_vert(&(blades + fan->num_verts - 1)->vert);
+
+    for (uint32_t f = 0; f < fan->num_verts; f += 2) {
+        const uint32_t right = SHZ_MIN(f + 1, fan->num_verts - 1);
+        uint32_t argb =
+            shade_argb(env, &(blades + right)->vert, &(blades + f)->normal);
+        shz_vec3_t cur_center = project_vert(&(blades + f)->vert);
+        shz_vec3_t cur_right = project_vert(&(blades + right)->vert);
+        emit_quad_sprite(spr_hdr, argb, &fan_center, &prev_left, &cur_center,
+                         &cur_right, dr_state);
+        prev_left = cur_right;
+    }
+}
+
+/**
+ * One clipped triangle per fan blade, for fans that may cross the near plane.
+ * Takes the arguments of render_fan() but ignores the encoding and leaves the
+ * TA in polygon mode.
+ */
+static inline void render_fan_clipped(fan_encoding_e encoding,
+                                      const shz_mdl_fan_t* fan,
+                                      light_env_t* env,
+                                      const pvr_sprite_hdr_t* spr_hdr,
+                                      pvr_dr_state_t* dr_state) {
+    (void)encoding;
+    (void)spr_hdr;
+    shz_mdl_vert_normal_t* blades = fan_blades(fan);
+    shz_vec4_t blade[3] = {
+        transform_vert(&fan->center),
+        transform_vert(&(blades + fan->num_verts - 1)->vert),
+    };
+
+    for (uint32_t f = 0; f < fan->num_verts; f++) {
+        uint32_t argb =
+            shade_argb(env, &(blades + f)->vert, &(blades + f)->normal);
+        blade[2] = transform_vert(&(blades + f)->vert);
+        emit_clipped_polygon(blade, 3, argb, dr_state);
+        blade[1] = blade[2];
+    }
+}
+
+/**
+ * Render a single fan with the given encoding. The sprite header is only used
+ * by FAN2QUADS, which also leaves the TA in sprite mode, so a polygon header
+ * must be resubmitted before any following triangles.
+ */
+static inline void render_fan(fan_encoding_e encoding,
+                              const shz_mdl_fan_t* fan, light_env_t* env,
+                              const pvr_sprite_hdr_t* spr_hdr,
+                              pvr_dr_state_t* dr_state) {
+    switch (encoding) {
+        case FANSTRIPS:
+            render_fan_strip(fan, env, dr_state);
+            break;
+        case FAN2TRIS:
+            render_fan_tris(fan, env, dr_state);
+            break;
+        case FAN2QUADS:
+            render_fan_quads(fan, env, spr_hdr, dr_state);
+            break;
+    }
+}
+
+/** How far ahead of the face being drawn the model loops prefetch */
+#ifndef RK_PREFETCH_AHEAD
+#define RK_PREFETCH_AHEAD 64  // bytes, two cache lines
+#endif
+
+static inline void render_tri(const shz_vec3_t* v1, const shz_vec3_t* v2,
+                              const shz_vec3_t* v3, uint32_t argb,
+                              pvr_dr_state_t* dr_state) {
+    shz_vec3_t p1 = project_vert(v1);
+    shz_vec3_t p2 = project_vert(v2);
+    shz_vec3_t p3 = project_vert(v3);
+    emit_triangle(&p1, &p2, &p3, argb, dr_state);
+}
+
+/** render_tri() for faces that may cross the near plane */
+static inline void render_tri_clipped(const shz_vec3_t* v1,
+                                      const shz_vec3_t* v2,
+                                      const shz_vec3_t* v3, uint32_t argb,
+                                      pvr_dr_state_t* dr_state) {
+    const shz_vec4_t tri[3] = {transform_vert(v1), transform_vert(v2),
+                               transform_vert(v3)};
+    emit_clipped_polygon(tri, 3, argb, dr_state);
+}
+
+/** A projected quad as a sprite or, with SHZ_MDL_QUAD_SPLIT, as a strip */
+static inline void emit_quad(const shz_vec3_t* p1, const shz_vec3_t* p2,
+                             const shz_vec3_t* p3, const shz_vec3_t* p4,
+                             uint32_t flags, uint32_t argb,
+                             const pvr_sprite_hdr_t* spr_hdr,
+                             const pvr_poly_hdr_t* poly_hdr, int* sprite_mode,
+                             pvr_dr_state_t* dr_state) {
+    if (flags & SHZ_MDL_QUAD_SPLIT) {
+        leave_sprite_mode(poly_hdr, sprite_mode, dr_state);
+        emit_quad_strip(p1, p2, p3, p4, argb, dr_state);
+    } else {
+        emit_quad_sprite(spr_hdr, argb, p1, p2, p3, p4, dr_state);
+        *sprite_mode = 1;
+    }
+}
+
+/**
+ * A quad as a sprite or, with SHZ_MDL_QUAD_SPLIT, as a strip. sprite_mode
+ * tracks what the TA expects, the polygon header is resubmitted when a strip
+ * follows a sprite.
+ */
+static inline void render_quad(const shz_vec3_t* v1, const shz_vec3_t* v2,
+                               const shz_vec3_t* v3, const shz_vec3_t* v4,
+                               uint32_t flags, uint32_t argb,
+                               const pvr_sprite_hdr_t* spr_hdr,
+                               const pvr_poly_hdr_t* poly_hdr,
+                               int* sprite_mode, pvr_dr_state_t* dr_state) {
+    shz_vec3_t p1 = project_vert(v1);
+    shz_vec3_t p2 = project_vert(v2);
+    shz_vec3_t p3 = project_vert(v3);
+    shz_vec3_t p4 = project_vert(v4);
+    emit_quad(&p1, &p2, &p3, &p4, flags, argb, spr_hdr, poly_hdr, sprite_mode,
+              dr_state);
+}
+
+/**
+ * render_quad() for faces that may cross the near plane. A quad wholly in
+ * front of it is drawn as usual, a cut one has lost its shape and becomes a
+ * polygon strip, sprite or not.
+ */
+static inline void render_quad_clipped(const shz_vec3_t* v1,
+                                       const shz_vec3_t* v2,
+                                       const shz_vec3_t* v3,
+                                       const shz_vec3_t* v4, uint32_t flags,
+                                       uint32_t argb,
+                                       const pvr_sprite_hdr_t* spr_hdr,
+                                       const pvr_poly_hdr_t* poly_hdr,
+                                       int* sprite_mode,
+                                       pvr_dr_state_t* dr_state) {
+    const shz_vec4_t quad[4] = {transform_vert(v1), transform_vert(v2),
+                                transform_vert(v3), transform_vert(v4)};
+    if (quad[0].x >= NEAR_CLIP_W && quad[1].x >= NEAR_CLIP_W &&
+        quad[2].x >= NEAR_CLIP_W && quad[3].x >= NEAR_CLIP_W) {
+        shz_vec3_t p1 = perspective_n_swizzle(quad[0]);
+        shz_vec3_t p2 = perspective_n_swizzle(quad[1]);
+        shz_vec3_t p3 = perspective_n_swizzle(quad[2]);
+        shz_vec3_t p4 = perspective_n_swizzle(quad[3]);
+        emit_quad(&p1, &p2, &p3, &p4, flags, argb, spr_hdr, poly_hdr,
+                  sprite_mode, dr_state);
+        return;
+    }
+    leave_sprite_mode(poly_hdr, sprite_mode, dr_state);
+    emit_clipped_polygon(quad, 4, argb, dr_state);
+}
+
+/**
+ * render_quad() that never turns a quad into a sprite, sprites take their
+ * color from an ARGB in the header and can not be shaded by intensity
+ */
+static inline void render_quad_poly(const shz_vec3_t* v1, const shz_vec3_t* v2,
+                                    const shz_vec3_t* v3, const shz_vec3_t* v4,
+                                    uint32_t flags, uint32_t argb,
+                                    const pvr_sprite_hdr_t* spr_hdr,
+                                    const pvr_poly_hdr_t* poly_hdr,
+                                    int* sprite_mode,
+                                    pvr_dr_state_t* dr_state) {
+    render_quad(v1, v2, v3, v4, flags | SHZ_MDL_QUAD_SPLIT, argb, spr_hdr,
+                poly_hdr, sprite_mode, dr_state);
+}
+
+/** render_quad_clipped() that never turns a quad into a sprite */
+static inline void render_quad_poly_clipped(
+    const shz_vec3_t* v1, const shz_vec3_t* v2, const shz_vec3_t* v3,
+    const shz_vec3_t* v4, uint32_t flags, uint32_t argb,
+    const pvr_sprite_hdr_t* spr_hdr, const pvr_poly_hdr_t* poly_hdr,
+    int* sprite_mode, pvr_dr_state_t* dr_state) {
+    render_quad_clipped(v1, v2, v3, v4, flags | SHZ_MDL_QUAD_SPLIT, argb,
+                        spr_hdr, poly_hdr, sprite_mode, dr_state);
+}
+
+/**
+ * render_tri() and render_quad() for highlight_face_t faces, quads are always
+ * strips since sprites can not carry the offset color
+ */
+static inline void render_tri_highlight(const shz_vec3_t* v1,
+                                        const shz_vec3_t* v2,
+                                        const shz_vec3_t* v3,
+                                        highlight_face_t face,
+                                        pvr_dr_state_t* dr_state) {
+    const shz_vec4_t tri[3] = {transform_vert(v1), transform_vert(v2),
+                               transform_vert(v3)};
+    emit_highlight_strip(tri, 3, &face, dr_state);
+}
+
+static inline void render_tri_highlight_clipped(const shz_vec3_t* v1,
+                                                const shz_vec3_t* v2,
+                                                const shz_vec3_t* v3,
+                                                highlight_face_t face,
+                                                pvr_dr_state_t* dr_state) {
+    const shz_vec4_t tri[3] = {transform_vert(v1), transform_vert(v2),
+                               transform_vert(v3)};
+    emit_clipped_highlight(tri, 3, &face, dr_state);
+}
+
+static inline void render_quad_highlight(
+    const shz_vec3_t* v1, const shz_vec3_t* v2, const shz_vec3_t* v3,
+    const shz_vec3_t* v4, uint32_t flags, highlight_face_t face,
+    const pvr_sprite_hdr_t* spr_hdr, const pvr_poly_hdr_t* poly_hdr,
+    int* sprite_mode, pvr_dr_state_t* dr_state) {
+    (void)flags, (void)spr_hdr, (void)poly_hdr, (void)sprite_mode;
+    const shz_vec4_t quad[4] = {transform_vert(v1), transform_vert(v2),
+                                transform_vert(v3), transform_vert(v4)};
+    emit_highlight_strip(quad, 4, &face, dr_state);
+}
+
+static inline void render_quad_highlight_clipped(
+    const shz_vec3_t* v1, const shz_vec3_t* v2, const shz_vec3_t* v3,
+    const shz_vec3_t* v4, uint32_t flags, highlight_face_t face,
+    const pvr_sprite_hdr_t* spr_hdr, const pvr_poly_hdr_t* poly_hdr,
+    int* sprite_mode, pvr_dr_state_t* dr_state) {
+    (void)flags, (void)spr_hdr, (void)poly_hdr, (void)sprite_mode;
+    const shz_vec4_t quad[4] = {transform_vert(v1), transform_vert(v2),
+                                transform_vert(v3), transform_vert(v4)};
+    emit_clipped_highlight(quad, 4, &face, dr_state);
+}
+
+/**
+ * Face shading for RK_DEFINE_FACE_LOOPS, called with the environment, the
+ * first vertex, the face normal and the color packed from env->light_color
+ * once per loop.
+ */
+#define RK_SHADE_FACE(env, vert, normal, flat_argb) \
+    shade_argb((env), (shz_vec3_t*)(vert), (shz_vec3_t*)(normal))
+#define RK_SHADE_PHONG(env, vert, normal, flat_argb)         \
+    light_argb((env), calc_phong((env), (shz_vec3_t*)(vert), \
+                                 (shz_vec3_t*)(normal)))
+#define RK_SHADE_BLINN(env, vert, normal, flat_argb)         \
+    light_argb((env), calc_blinn((env), (shz_vec3_t*)(vert), \
+                                 (shz_vec3_t*)(normal)))
+#define RK_SHADE_DIFFUSE(env, vert, normal, flat_argb)                         \
+    light_argb((env), calc_diffuse((shz_vec3_t*)(vert), (shz_vec3_t*)(normal), \
+                                   &(env)->light_pos))
+#define RK_SHADE_FLAT(env, vert, normal, flat_argb) (flat_argb)
+#define RK_SHADE_HIGHLIGHT(env, vert, normal, flat_argb)              \
+    shade_highlight((env), (shz_vec3_t*)(vert), (shz_vec3_t*)(normal), \
+                    (flat_argb))
+#define RK_SHADE_INTENSITY_PHONG(env, vert, normal, flat_argb)         \
+    light_intensity_word((env), calc_phong((env), (shz_vec3_t*)(vert), \
+                                           (shz_vec3_t*)(normal)))
+#define RK_SHADE_INTENSITY_BLINN(env, vert, normal, flat_argb)         \
+    light_intensity_word((env), calc_blinn((env), (shz_vec3_t*)(vert), \
+                                           (shz_vec3_t*)(normal)))
+#define RK_SHADE_INTENSITY_DIFFUSE(env, vert, normal, flat_argb)    \
+    light_intensity_word((env), calc_diffuse((shz_vec3_t*)(vert),   \
+                                             (shz_vec3_t*)(normal), \
+                                             &(env)->light_pos))
+
+/**
+ * Generates the four face loops NAME_tris_aos, NAME_tris_soa, NAME_quads_aos
+ * and NAME_quads_soa around one shading macro, so every combination of
+ * layout and shading gets a loop without per-face branches on either.
+ * RK_DEFINE_FACE_LOOPS_WITH() takes the functions that draw a face as well,
+ * render_tri() and render_quad() or their _clipped counterparts.
+ *
+ * The aos loops walk packed shz_mdl_tri_face_t or shz_mdl_quad_face_t faces,
+ * the soa loops the streams of a SHZ_MDL_FLAG_SOA model. Quad loops expect
+ * the TA in polygon mode and return 1 if they left it in sprite mode.
+ */
+#define RK_DEFINE_FACE_LOOPS_WITH(NAME, SHADE, RENDER_TRI, RENDER_QUAD)        \
+    static inline void NAME##_tris_aos(const shz_mdl_tri_face_t* tris,         \
+                                       uint32_t num_tris, light_env_t* env,    \
+                                       pvr_dr_state_t* dr_state) {             \
+        const uint32_t flat_argb = pack_argb(env->light_color);                \
+        (void)flat_argb;                                                       \
+        for (uint32_t t = 0; t < num_tris; t++) {                              \
+            __builtin_prefetch((const uint8_t*)&tris[t] + RK_PREFETCH_AHEAD);  \
+            RENDER_TRI(&tris[t].v1, &tris[t].v2, &tris[t].v3,                  \
+                       SHADE(env, &tris[t].v1, &tris[t].normal, flat_argb),    \
+                       dr_state);                                              \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static inline void NAME##_tris_soa(                                        \
+        const shz_vec3_t* positions, const shz_vec3_t* normals,                \
+        uint32_t num_tris, light_env_t* env, pvr_dr_state_t* dr_state) {       \
+        const uint32_t flat_argb = pack_argb(env->light_color);                \
+        (void)flat_argb;                                                       \
+        for (uint32_t t = 0; t < num_tris; t++) {                              \
+            const shz_vec3_t* v = positions + 3 * t;                           \
+            __builtin_prefetch((const uint8_t*)v + RK_PREFETCH_AHEAD);         \
+            __builtin_prefetch((const uint8_t*)&normals[t] +                   \
+                               RK_PREFETCH_AHEAD);                             \
+            RENDER_TRI(&v[0], &v[1], &v[2],                                    \
+                       SHADE(env, &v[0], &normals[t], flat_argb), dr_state);   \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    static inline int NAME##_quads_aos(                                        \
+        const shz_mdl_quad_face_t* quads, uint32_t num_quads,                  \
+        light_env_t* env, const pvr_sprite_hdr_t* spr_hdr,                     \
+        const pvr_poly_hdr_t* poly_hdr, pvr_dr_state_t* dr_state) {            \
+        const uint32_t flat_argb = pack_argb(env->light_color);                \
+        (void)flat_argb;                                                       \
+        int sprite_mode = 0;                                                   \
+        for (uint32_t q = 0; q < num_quads; q++) {                             \
+            __builtin_prefetch((const uint8_t*)&quads[q] + RK_PREFETCH_AHEAD); \
+            RENDER_QUAD(&quads[q].v1, &quads[q].v2, &quads[q].v3,              \
+                        &quads[q].v4, quads[q].flags,                          \
+                        SHADE(env, &quads[q].v1, &quads[q].normal, flat_argb), \
+                        spr_hdr, poly_hdr, &sprite_mode, dr_state);            \
+        }                                                                      \
+        return sprite_mode;                                                    \
+    }                                                                          \
+                                                                               \
+    static inline int NAME##_quads_soa(                                        \
+        const shz_vec3_t* positions, const shz_vec3_t* normals,                \
+        const uint32_t* flags, uint32_t num_quads, light_env_t* env,           \
+        const pvr_sprite_hdr_t* spr_hdr, const pvr_poly_hdr_t* poly_hdr,       \
+        pvr_dr_state_t* dr_state) {                                            \
+        const uint32_t flat_argb = pack_argb(env->light_color);                \
+        (void)flat_argb;                                                       \
+        int sprite_mode = 0;                                                   \
+        for (uint32_t q = 0; q < num_quads; q++) {                             \
+            const shz_vec3_t* v = positions + 4 * q;                           \
+            __builtin_prefetch((const uint8_t*)v + RK_PREFETCH_AHEAD);         \
+            __builtin_prefetch((const uint8_t*)&normals[q] +                   \
+                               RK_PREFETCH_AHEAD);                             \
+            RENDER_QUAD(&v[0], &v[1], &v[2], &v[3], flags[q],                  \
+                        SHADE(env, &v[0], &normals[q], flat_argb), spr_hdr,    \
+                        poly_hdr, &sprite_mode, dr_state);                     \
+        }                                                                      \
+        return sprite_mode;                                                    \
+    }
+
+/**
+ * The face loops of RK_DEFINE_FACE_LOOPS_WITH() around render_tri() and
+ * render_quad(), and NAME_clipped_tris_aos() and friends that clip every face
+ * against the near plane, for models that cross it.
+ */
+#define RK_DEFINE_FACE_LOOPS(NAME, SHADE)                                      \
+    RK_DEFINE_FACE_LOOPS_WITH(NAME, SHADE, render_tri, render_quad)            \
+    RK_DEFINE_FACE_LOOPS_WITH(NAME##_clipped, SHADE, render_tri_clipped,       \
+                              render_quad_clipped)
+
+/**
+ * RK_DEFINE_FACE_LOOPS() for an intensity header, quads are always drawn as
+ * strips. The quad loops never leave the TA in sprite mode.
+ */
+#define RK_DEFINE_INTENSITY_LOOPS(NAME, SHADE)                                 \
+    RK_DEFINE_FACE_LOOPS_WITH(NAME, SHADE, render_tri, render_quad_poly)       \
+    RK_DEFINE_FACE_LOOPS_WITH(NAME##_clipped, SHADE, render_tri_clipped,       \
+                              render_quad_poly_clipped)
+
+/** Lit with shade_argb(), render_tris_aos() and friends */
+RK_DEFINE_FACE_LOOPS(render, RK_SHADE_FACE)
+
+/** One lighting model each, render_phong_tris_aos() and friends */
+RK_DEFINE_FACE_LOOPS(render_phong, RK_SHADE_PHONG)
+RK_DEFINE_FACE_LOOPS(render_blinn, RK_SHADE_BLINN)
+RK_DEFINE_FACE_LOOPS(render_diffuse, RK_SHADE_DIFFUSE)
+
+/** Shaded by intensity, render_intensity_phong_tris_aos() and friends */
+RK_DEFINE_INTENSITY_LOOPS(render_intensity_phong, RK_SHADE_INTENSITY_PHONG)
+RK_DEFINE_INTENSITY_LOOPS(render_intensity_blinn, RK_SHADE_INTENSITY_BLINN)
+RK_DEFINE_INTENSITY_LOOPS(render_intensity_diffuse, RK_SHADE_INTENSITY_DIFFUSE)
+
+/**
+ * Highlights from a texture, render_highlight_tris_aos() and friends, their
+ * faces are highlight_face_t rather than an ARGB
+ */
+RK_DEFINE_FACE_LOOPS_WITH(render_highlight, RK_SHADE_HIGHLIGHT,
+                          render_tri_highlight, render_quad_highlight)
+RK_DEFINE_FACE_LOOPS_WITH(render_highlight_clipped, RK_SHADE_HIGHLIGHT,
+                          render_tri_highlight_clipped,
+                          render_quad_highlight_clipped)
+
+/** One flat color for the whole model, render_unlit_tris_aos() and friends */
+RK_DEFINE_FACE_LOOPS(render_unlit, RK_SHADE_FLAT)
+
+#endif  // RENDER_KERNELS_H
@@ -1,8 +1,10 @@
 #ifndef shzmdl_H
 #define shzmdl_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sh4zam/shz_sh4zam.h>
+#include <sh4zamsprites/asset_map.h>
 
 typedef enum : uint8_t {
   shzmdl_UNTEXTURED = 0,
@@ -20,13 +22,16 @@ typedef struct __attribute__((packed)) shz_mdl_tri_face_t {
   shz_vec3_t v3;
 } shz_mdl_tri_face_t;
 
+/** shz_mdl_quad_face_t flags, always 0 before version 0.2 */
+#define SHZ_MDL_QUAD_SPLIT 0x1 // not a parallelogram, draw as a strip
+
 typedef struct __attribute__((packed)) shz_mdl_quad_face_t {
   shz_vec3_t normal;
   shz_vec3_t v1;
   shz_vec3_t v2;
   shz_vec3_t v3;
   shz_vec3_t v4;
-  char _padding[4];
+  uint32_t flags; // SHZ_MDL_QUAD_*, split quads come before the sprites
 } shz_mdl_quad_face_t;
 
 typedef struct __attribute__((packed)) {
@@ -61,4 +66,125 @@ typedef struct __attribute__((packed)) {
   shz_mdl_type_e type;
 } shzmdl_hdr_t;
 
+/** version.flags */
+#define SHZ_MDL_FLAG_SOA 0x1 // faces stored as streams, see below
+
+/*
+ * With SHZ_MDL_FLAG_SOA the face offsets point at separate streams instead of
+ * packed faces, so the reader gets naturally aligned vectors and only pulls in
+ * the data it uses. Every stream starts on a 32 byte cache line:
+ *   tri_faces:  shz_vec3_t positions[num.tri_faces * 3]
+ *               shz_vec3_t normals[num.tri_faces]
+ *   quad_faces: shz_vec3_t positions[num.quad_faces * 4]
+ *               shz_vec3_t normals[num.quad_faces]
+ *               uint32_t flags[num.quad_faces]
+ */
+static inline uint32_t shz_mdl_stream_size(uint32_t bytes) {
+  return (bytes + 31) & ~31u;
+}
+
+static inline shz_vec3_t* shz_mdl_tri_positions(const shzmdl_hdr_t* hdr) {
+  return (shz_vec3_t*)((uint8_t*)hdr + (hdr->offset.tri_faces << 5));
+}
+
+static inline shz_vec3_t* shz_mdl_tri_normals(const shzmdl_hdr_t* hdr) {
+  return (shz_vec3_t*)((uint8_t*)shz_mdl_tri_positions(hdr) +
+                       shz_mdl_stream_size(hdr->num.tri_faces * 3 *
+                                           sizeof(shz_vec3_t)));
+}
+
+static inline shz_vec3_t* shz_mdl_quad_positions(const shzmdl_hdr_t* hdr) {
+  return (shz_vec3_t*)((uint8_t*)hdr + (hdr->offset.quad_faces << 5));
+}
+
+static inline shz_vec3_t* shz_mdl_quad_normals(const shzmdl_hdr_t* hdr) {
+  return (shz_vec3_t*)((uint8_t*)shz_mdl_quad_positions(hdr) +
+                       shz_mdl_stream_size(hdr->num.quad_faces * 4 *
+                                           sizeof(shz_vec3_t)));
+}
+
+static inline uint32_t* shz_mdl_quad_flags(const shzmdl_hdr_t* hdr) {
+  return (uint32_t*)((uint8_t*)shz_mdl_quad_normals(hdr) +
+                     shz_mdl_stream_size(hdr->num.quad_faces *
+                                         sizeof(shz_vec3_t)));
+}
+
+/** Newest format version this tree reads */
+#define SHZ_MDL_VERSION_MAJOR 0
+#define SHZ_MDL_VERSION_MINOR 2
+
+/** A validated model, every section lies within the size of the data */
+typedef struct {
+  const shzmdl_hdr_t* hdr;
+  size_t size;
+  asset_map_t map; // the file, set by shz_mdl_load_file()
+  shz_vec3_t center; // of a sphere around every vertex, measured on load
+  float radius;
+} shz_mdl_t;
+
+/**
+ * @brief Validate a model in memory, e.g. from #embed. The data is used in
+ * place and must stay valid, it must be 32 byte aligned for SHZ_MDL_FLAG_SOA.
+ * @param mdl The model to fill
+ * @param data The shzmdl file contents
+ * @param size Size of the data in bytes
+ * @return int 1 on success, 0 on failure
+ */
+int shz_mdl_load_blob(shz_mdl_t* mdl, const void* data, size_t size);
+
+/**
+ * @brief Map and validate a model file in place, see asset_map_open()
+ * @param mdl The model to fill, free it with shz_mdl_free()
+ * @param filename The name of the file to load
+ * @return int 1 on success, 0 on failure
+ */
+int shz_mdl_load_file(shz_mdl_t* mdl, const char* filename);
+
+/**
+ * @brief Decompress and validate a model from an LZ4 frame, e.g. an #embed
+ * of a .shzmdl.lz4, see lz4_stream.h. The model is decompressed into
+ * level_alloc() memory, which stays with the level arena when it is set up.
+ * @param mdl The model to fill, free it with shz_mdl_free()
+ * @param data The LZ4 frame, with content size
+ * @param size Size of the frame in bytes
+ * @return int 1 on success, 0 on failure
+ */
+int shz_mdl_load_lz4(shz_mdl_t* mdl, const void* data, size_t size);
+
+/**
+ * @brief Release a model, unmaps the data only if it came from a file
+ * @param mdl The model to free
+ */
+void shz_mdl_free(shz_mdl_t* mdl);
+
+/** Packed triangles, only without SHZ_MDL_FLAG_SOA */
+static inline shz_mdl_tri_face_t* shz_mdl_tris(const shz_mdl_t* mdl) {
+  return (shz_mdl_tri_face_t*)shz_mdl_tri_positions(mdl->hdr);
+}
+
+/** Packed quads, only without SHZ_MDL_FLAG_SOA */
+static inline shz_mdl_quad_face_t* shz_mdl_quads(const shz_mdl_t* mdl) {
+  return (shz_mdl_quad_face_t*)shz_mdl_quad_positions(mdl->hdr);
+}
+
+static inline shz_mdl_fan_t* shz_mdl_first_fan(const shz_mdl_t* mdl) {
+  if (mdl->hdr->offset.fans == 0) {
+    return NULL;
+  }
+  return (shz_mdl_fan_t*)((uint8_t*)mdl->hdr + (mdl->hdr->offset.fans << 5));
+}
+
+static inline shz_mdl_fan_t* shz_mdl_next_fan(const shz_mdl_t* mdl,
+                                              const shz_mdl_fan_t* fan) {
+  if (fan->next_fan_offset == 0) {
+    return NULL;
+  }
+  return (shz_mdl_fan_t*)((uint8_t*)mdl->hdr + (fan->next_fan_offset << 5));
+}
+
+/** Loop over the fans of a validated model */
+#define SHZ_MDL_FOREACH_FAN(mdl, fan)                                          \
+  for (shz_mdl_fan_t* fan = shz_mdl_first_fan(mdl); fan != NULL;               \
+       fan = shz_mdl_next_fan(mdl, fan))
+
 #endif // shzmdl_H
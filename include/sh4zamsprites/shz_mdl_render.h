@@ -0,0 +1,222 @@
+#ifndef SHZ_MDL_RENDER_H
+#define SHZ_MDL_RENDER_H
+
+#include <sh4zamsprites/display_list.h>
+#include <sh4zamsprites/light_cache.h>
+#include <sh4zamsprites/render_kernels.h>
+#include <sh4zamsprites/shz_mdl.h>
+
+/**
+ * @brief Render the fans and faces of a validated model through the direct
+ * render API. The loops are picked once per model from its type and layout:
+ * shzmdl_FACE_NORMALS faces are lit by env, through env->cache when it is set,
+ * with the loops of env->shade_model otherwise, shzmdl_UNTEXTURED ones are
+ * drawn in env->light_color. Fans always carry normals and are lit either way.
+ * With env->intensity_hdr set the faces are shaded by intensity under that
+ * header, with env->highlight_hdr they are textured with a highlight map,
+ * either way lit by the one light of env. The fans stay ARGB.
+ * @param mdl The model to render
+ * @param fan_encoding How to draw the fans, see render_fan()
+ * @param env Lighting, the xmtrx must hold the model view projection
+ * @param fan_spr_hdr Sprite header for FAN2QUADS
+ * @param quad_spr_hdr Sprite header for the quads that are not split
+ * @param poly_hdr Polygon header, the TA must be in polygon mode on entry
+ * @param dr_state The direct render state
+ * @return int 1 if the TA was left in sprite mode or under another header,
+ * poly_hdr has to be sent again before more polygons
+ */
+int shz_mdl_render(const shz_mdl_t* mdl, fan_encoding_e fan_encoding,
+                   light_env_t* env, const pvr_sprite_hdr_t* fan_spr_hdr,
+                   const pvr_sprite_hdr_t* quad_spr_hdr,
+                   const pvr_poly_hdr_t* poly_hdr, pvr_dr_state_t* dr_state);
+
+/**
+ * @brief Bytes shz_mdl_render() sends to the TA for a model wholly in front
+ * of the near plane, to size the display lists it is recorded into. Clipped
+ * faces can take more, a list they overflow falls back to direct drawing.
+ * @param mdl The model
+ * @param fan_encoding How its fans are drawn
+ * @param quad_strips 1 if its faces are drawn under env->intensity_hdr or
+ * env->highlight_hdr, where every quad is a strip
+ * @return size_t Upper bound in bytes, headers included
+ */
+size_t shz_mdl_ta_bytes(const shz_mdl_t* mdl, fan_encoding_e fan_encoding,
+                        int quad_strips);
+
+/**
+ * @brief Record what shz_mdl_render() would send to the TA into a display
+ * list, after dl_begin() returned DL_RECORD. Finish with dl_end_record().
+ * @param dl The list being recorded
+ * @return int 1 if the stream leaves the TA in sprite mode
+ */
+int shz_mdl_record(display_list_t* dl, const shz_mdl_t* mdl,
+                   fan_encoding_e fan_encoding, light_env_t* env,
+                   const pvr_sprite_hdr_t* fan_spr_hdr,
+                   const pvr_sprite_hdr_t* quad_spr_hdr,
+                   const pvr_poly_hdr_t* poly_hdr);
+
+/**
+ * One face renderer per model type, LOOPS names a set of face loops from
+ * RK_DEFINE_FACE_LOOPS. The layout is checked once, the loops themselves
+ * carry no per-face branches on type or layout.
+ */
+#define SHZ_MDL_DEFINE_FACES(NAME, LOOPS)                                      \
+    static int NAME(const shz_mdl_t* mdl, light_env_t* env,                    \
+                    const pvr_sprite_hdr_t* spr_hdr,                           \
+                    const pvr_poly_hdr_t* poly_hdr,                            \
+                    pvr_dr_state_t* dr_state) {                                \
+        const shzmdl_hdr_t* hdr = mdl->hdr;                                    \
+        if (hdr->version.flags & SHZ_MDL_FLAG_SOA) {                           \
+            LOOPS##_tris_soa(shz_mdl_tri_positions(hdr),                       \
+                             shz_mdl_tri_normals(hdr), hdr->num.tri_faces,     \
+                             env, dr_state);                                   \
+            return LOOPS##_quads_soa(                                          \
+                shz_mdl_quad_positions(hdr), shz_mdl_quad_normals(hdr),        \
+                shz_mdl_quad_flags(hdr), hdr->num.quad_faces, env, spr_hdr,    \
+                poly_hdr, dr_state);                                           \
+        }                                                                      \
+        LOOPS##_tris_aos(shz_mdl_tris(mdl), hdr->num.tri_faces, env,           \
+                         dr_state);                                            \
+        return LOOPS##_quads_aos(shz_mdl_quads(mdl), hdr->num.quad_faces, env, \
+                                 spr_hdr, poly_hdr, dr_state);                 \
+    }
+
+/**
+ * Calls FACES_phong(), FACES_blinn() or FACES_diffuse() from
+ * SHZ_MDL_DEFINE_FACES for the lighting model of env, once per model
+ */
+#define SHZ_MDL_FACES_OF_MODEL(FACES, mdl, env, spr_hdr, poly_hdr, dr_state) \
+    ((env)->shade_model == SHADE_DIFFUSE                                     \
+         ? FACES##_diffuse(mdl, env, spr_hdr, poly_hdr, dr_state)            \
+     : (env)->shade_model == SHADE_BLINN                                     \
+         ? FACES##_blinn(mdl, env, spr_hdr, poly_hdr, dr_state)              \
+         : FACES##_phong(mdl, env, spr_hdr, poly_hdr, dr_state))
+
+/**
+ * The renderer of SHZ_MDL_DEFINE_RENDER() for one way of drawing the model,
+ * RENDER_FAN is render_fan() or render_fan_clipped() and SUFFIX picks the
+ * face loops, empty or _clipped.
+ */
+#define SHZ_MDL_DEFINE_RENDER_WITH(NAME, RENDER_FAN, SUFFIX)                   \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_lit, render##SUFFIX)                     \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_phong, render_phong##SUFFIX)             \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_blinn, render_blinn##SUFFIX)             \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_diffuse, render_diffuse##SUFFIX)         \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_unlit, render_unlit##SUFFIX)             \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_cached_phong,                            \
+                         render_cached_phong##SUFFIX)                          \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_cached_blinn,                            \
+                         render_cached_blinn##SUFFIX)                          \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_cached_diffuse,                          \
+                         render_cached_diffuse##SUFFIX)                        \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_intensity_phong,                         \
+                         render_intensity_phong##SUFFIX)                       \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_intensity_blinn,                         \
+                         render_intensity_blinn##SUFFIX)                       \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_intensity_diffuse,                       \
+                         render_intensity_diffuse##SUFFIX)                     \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_cached_intensity_phong,                  \
+                         render_cached_intensity_phong##SUFFIX)                \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_cached_intensity_blinn,                  \
+                         render_cached_intensity_blinn##SUFFIX)                \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_cached_intensity_diffuse,                \
+                         render_cached_intensity_diffuse##SUFFIX)              \
+    SHZ_MDL_DEFINE_FACES(NAME##_faces_highlight, render_highlight##SUFFIX)     \
+                                                                               \
+    /* the faces under env->intensity_hdr, the quads never become sprites */   \
+    static int NAME##_intensity(const shz_mdl_t* mdl, light_env_t* env,        \
+                                const pvr_sprite_hdr_t* spr_hdr,               \
+                                pvr_dr_state_t* dr_state) {                    \
+        const pvr_poly_hdr_t* poly_hdr = env->intensity_hdr;                   \
+        pvr_poly_hdr_t* hdr = (pvr_poly_hdr_t*)RK_TA_TARGET(dr_state);         \
+        *hdr = *poly_hdr;                                                      \
+        RK_TA_COMMIT(dr_state, hdr);                                           \
+        if (env->cache && light_cache_begin(env->cache, mdl, env)) {           \
+            SHZ_MDL_FACES_OF_MODEL(NAME##_faces_cached_intensity, mdl, env,    \
+                                   spr_hdr, poly_hdr, dr_state);               \
+            light_cache_end(env->cache);                                       \
+            return 1;                                                          \
+        }                                                                      \
+        SHZ_MDL_FACES_OF_MODEL(NAME##_faces_intensity, mdl, env, spr_hdr,      \
+                               poly_hdr, dr_state);                            \
+        return 1;                                                              \
+    }                                                                          \
+                                                                               \
+    static int NAME(const shz_mdl_t* mdl, fan_encoding_e fan_encoding,         \
+                    light_env_t* env, const pvr_sprite_hdr_t* fan_spr_hdr,     \
+                    const pvr_sprite_hdr_t* quad_spr_hdr,                      \
+                    const pvr_poly_hdr_t* poly_hdr,                            \
+                    pvr_dr_state_t* dr_state) {                                \
+        SHZ_MDL_FOREACH_FAN(mdl, fan) {                                        \
+            RENDER_FAN(fan_encoding, fan, env, fan_spr_hdr, dr_state);         \
+        }                                                                      \
+        if (fan_encoding == FAN2QUADS && mdl->hdr->offset.fans) {              \
+            /* the fan sprites left the TA in sprite mode */                   \
+            pvr_poly_hdr_t* hdr = (pvr_poly_hdr_t*)RK_TA_TARGET(dr_state);     \
+            *hdr = *poly_hdr;                                                  \
+            RK_TA_COMMIT(dr_state, hdr);                                       \
+        }                                                                      \
+                                                                               \
+        switch (mdl->hdr->type) {                                              \
+            case shzmdl_UNTEXTURED:                                            \
+                return NAME##_faces_unlit(mdl, env, quad_spr_hdr, poly_hdr,    \
+                                          dr_state);                           \
+            default: /* shzmdl_FACE_NORMALS, the loader rejects the rest */    \
+                if (env->highlight_hdr) {                                      \
+                    pvr_poly_hdr_t* hdr =                                      \
+                        (pvr_poly_hdr_t*)RK_TA_TARGET(dr_state);               \
+                    *hdr = *env->highlight_hdr;                                \
+                    RK_TA_COMMIT(dr_state, hdr);                               \
+                    NAME##_faces_highlight(mdl, env, quad_spr_hdr,             \
+                                           env->highlight_hdr, dr_state);      \
+                    return 1;                                                  \
+                }                                                              \
+                if (env->intensity_hdr) {                                      \
+                    return NAME##_intensity(mdl, env, quad_spr_hdr, dr_state); \
+                }                                                              \
+                if (env->cache && light_cache_begin(env->cache, mdl, env)) {   \
+                    const int sprite_mode = SHZ_MDL_FACES_OF_MODEL(            \
+                        NAME##_faces_cached, mdl, env, quad_spr_hdr, poly_hdr, \
+                        dr_state);                                             \
+                    light_cache_end(env->cache);                               \
+                    return sprite_mode;                                        \
+                }                                                              \
+                if (env->lights) {                                             \
+                    return NAME##_faces_lit(mdl, env, quad_spr_hdr, poly_hdr,  \
+                                            dr_state);                         \
+                }                                                              \
+                return SHZ_MDL_FACES_OF_MODEL(NAME##_faces, mdl, env,          \
+                                              quad_spr_hdr, poly_hdr,          \
+                                              dr_state);                       \
+        }                                                                      \
+    }
+
+/**
+ * Defines NAME with the signature of shz_mdl_render() around the RK_TA_TARGET
+ * and RK_TA_COMMIT in effect where render_kernels.h was included, so another
+ * translation unit can build the renderer for a different TA target.
+ *
+ * The bounding sphere of the model picks the renderer, only a model that
+ * crosses the near plane pays for clipping, see near_clip.h.
+ */
+#define SHZ_MDL_DEFINE_RENDER(NAME)                                            \
+    SHZ_MDL_DEFINE_RENDER_WITH(NAME##_unclipped, render_fan, )                 \
+    SHZ_MDL_DEFINE_RENDER_WITH(NAME##_clipped, render_fan_clipped, _clipped)   \
+                                                                               \
+    int NAME(const shz_mdl_t* mdl, fan_encoding_e fan_encoding,                \
+             light_env_t* env, const pvr_sprite_hdr_t* fan_spr_hdr,            \
+             const pvr_sprite_hdr_t* quad_spr_hdr,                             \
+             const pvr_poly_hdr_t* poly_hdr, pvr_dr_state_t* dr_state) {       \
+        switch (near_classify_sphere(&mdl->center, mdl->radius)) {             \
+            case NEAR_INSIDE:                                                  \
+                return NAME##_unclipped(mdl, fan_encoding, env, fan_spr_hdr,   \
+                                        quad_spr_hdr, poly_hdr, dr_state);     \
+            case NEAR_CROSSING:                                                \
+                return NAME##_clipped(mdl, fan_encoding, env, fan_spr_hdr,     \
+                                      quad_spr_hdr, poly_hdr, dr_state);       \
+            default: /* NEAR_OUTSIDE, all of it is behind the eye */           \
+                return 0;                                                      \
+        }                                                                      \
+    }
+
+#endif  // SHZ_MDL_RENDER_H
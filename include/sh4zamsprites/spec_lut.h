@@ -0,0 +1,45 @@
+#ifndef SPEC_LUT_H
+#define SPEC_LUT_H
+
+#include <stdint.h>
+
+/**
+ * pow(x, exponent) for the specular term, from a table instead of
+ * shz_powf(). Below start the power is under 1/1024 and taken as 0, the
+ * table spreads its entries over start to 1 where the curve is, so high
+ * exponents lose no more precision than low ones. Linear interpolation
+ * between entries stays well within an 8 bit color step.
+ */
+
+#define SPEC_LUT_SIZE 256
+#define SPEC_LUT_CUTOFF (1.0f / 1024.0f)
+
+typedef struct {
+    float exponent;
+    float start;  // x below which the power is taken as 0
+    float scale;  // entries per unit of x
+    float table[SPEC_LUT_SIZE + 1];
+} spec_lut_t;
+
+/**
+ * @brief Fill the table for an exponent
+ * @param lut The table to fill
+ * @param exponent The specular exponent, e.g. 32
+ */
+void spec_lut_init(spec_lut_t* lut, float exponent);
+
+/** pow(x, lut->exponent) for x in 0 to 1 */
+static inline float spec_lut_pow(const spec_lut_t* lut, float x) {
+    if (x <= lut->start) {
+        return 0.0f;
+    }
+    const float pos = (x - lut->start) * lut->scale;
+    const int index = (int)pos;
+    if (index >= SPEC_LUT_SIZE) {
+        return lut->table[SPEC_LUT_SIZE];
+    }
+    const float low = lut->table[index];
+    return low + (pos - (float)index) * (lut->table[index + 1] - low);
+}
+
+#endif  // SPEC_LUT_H
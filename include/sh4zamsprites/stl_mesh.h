@@ -0,0 +1,45 @@
+#ifndef STL_MESH_H
+#define STL_MESH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sh4zam/shz_sh4zam.h>
+
+/** Default weld distance, vertices closer than this become one */
+#define STL_MESH_WELD_EPSILON 0.0001f
+
+/**
+ * Indexed mesh rebuilt from a binary STL. All arrays live in a single 32 byte
+ * aligned block, each one starting on its own cache line.
+ */
+typedef struct {
+    shz_vec3_t* positions;       // num_verts welded vertices
+    shz_vec3_t* vertex_normals;  // num_verts, area weighted and normalized
+    shz_vec3_t* face_normals;    // num_faces, from the winding order
+    uint32_t* indices;           // num_faces * 3, counter-clockwise
+    uint32_t num_verts;
+    uint32_t num_faces;
+    void* block;
+} stl_mesh_t;
+
+/**
+ * @brief Build an indexed mesh from binary STL data. Vertices within
+ * weld_epsilon of each other are merged, faces that collapse are dropped and
+ * the normals stored in the STL are ignored in favour of recomputed ones.
+ * @param mesh The mesh to fill, free it with stl_mesh_free()
+ * @param data The STL file contents
+ * @param size Size of the data in bytes
+ * @param weld_epsilon Weld distance, e.g. STL_MESH_WELD_EPSILON
+ * @return int 1 on success, 0 on failure
+ */
+int stl_mesh_load(stl_mesh_t* mesh, const uint8_t* data, size_t size,
+                  float weld_epsilon);
+
+/**
+ * @brief Release the memory of a mesh loaded by stl_mesh_load()
+ * @param mesh The mesh to free
+ */
+void stl_mesh_free(stl_mesh_t* mesh);
+
+#endif  // STL_MESH_H
@@ -0,0 +1,13 @@
+#ifndef STRINGIFY_H
+#define STRINGIFY_H
+
+/**
+ * Macro values as string literals, e.g. the BASEPATH the Makefile passes on
+ * the command line: EXPAND_STRINGIFY(BASEPATH) is "/pc/..." where
+ * STRINGIFY(BASEPATH) would be "BASEPATH".
+ */
+
+#define STRINGIFY(x) #x
+#define EXPAND_STRINGIFY(x) STRINGIFY(x)
+
+#endif  // STRINGIFY_H
@@ -0,0 +1,75 @@
+#ifndef TA_USAGE_H
+#define TA_USAGE_H
+
+#include <dc/pvr.h>
+#include <stdint.h>
+
+/**
+ * Vertex buffer and OPB telemetry. The TA's write positions are read after
+ * every list, giving per list and per frame usage of the vertex buffer and
+ * of the overflow OPBs (the pvr_init_params_t opb_overflow_count area that
+ * takes over when a tile's bin is full). Peaks are kept over the whole run,
+ * and a frame that comes within TA_USAGE_WARN_PERCENT of either buffer gets
+ * a warning, before geometry goes missing.
+ *
+ * Select the mode at build time with TAUSAGE, e.g.
+ * `TAUSAGE=1 BASEPATH=/pc make part_6_specular_lighting.elf` prints the
+ * peaks and the pvr_init_params_t they call for on exit, and writes them to
+ * BASEPATH/<name>.tausage. Building with TAUSAGE=2 reads that profile at
+ * startup and initializes the PVR with it, so VRAM the part does not use is
+ * left for textures.
+ */
+typedef enum : uint8_t {
+    TA_USAGE_OFF = 0,      // no telemetry, the compiled pvr_init_params_t
+    TA_USAGE_RECORD = 1,   // measure, recommend and write a profile
+    TA_USAGE_PROFILE = 2,  // size the buffers from a profile and measure
+} ta_usage_mode_e;
+
+#ifndef TAUSAGE
+#define TAUSAGE TA_USAGE_OFF
+#endif
+
+#define TA_USAGE_LISTS 5          // PVR_LIST_OP_POLY to PVR_LIST_PT_POLY
+#define TA_USAGE_WARN_PERCENT 90  // of either buffer
+#define TA_USAGE_HEADROOM 4       // recommend peak + 1/4 of peak
+
+typedef struct {
+    uint32_t vertex_bytes[TA_USAGE_LISTS];
+    uint32_t opb_bytes[TA_USAGE_LISTS];  // overflow OPBs
+    uint32_t vertex_total;
+    uint32_t opb_total;
+} ta_usage_t;
+
+/**
+ * @brief Set up telemetry, call before pvr_init(). With TA_USAGE_PROFILE the
+ * buffer sizes in params are replaced by the profile's when there is one.
+ * @param mode One of ta_usage_mode_e, usually TAUSAGE
+ * @param name The profile is stored as BASEPATH/<name>.tausage
+ * @param params The parameters the PVR will be initialized with
+ * @return int 1 on success, 0 if a profile could not be read, in which case
+ * params are left as they were
+ */
+int ta_usage_init(ta_usage_mode_e mode, const char* name,
+                  pvr_init_params_t* params);
+
+/** @brief Note where the TA starts writing, call after pvr_scene_begin() */
+void ta_usage_scene_begin(void);
+
+/**
+ * @brief Account what the TA has written since the last list to this one,
+ * call after pvr_list_finish()
+ * @param list The list that was just finished
+ */
+void ta_usage_list_finish(pvr_list_t list);
+
+/** @brief Update the peaks and warn if close to full, call before
+ * pvr_scene_finish() */
+void ta_usage_scene_finish(void);
+
+/**
+ * @brief Print the peaks and the recommended pvr_init_params_t, and write
+ * the profile when recording
+ */
+void ta_usage_shutdown(void);
+
+#endif  // TA_USAGE_H
@@ -5,6 +5,8 @@
 #include <pvrtex/file_dctex.h>
 #include <stdint.h>
 
+#include <sh4zamsprites/tex_upload.h>
+
 typedef fDtHeader dt_header_t;
 
 typedef struct {
@@ -85,6 +87,28 @@ int pvrtex_load_palette_file(const char *filename, int fmt, size_t offset);
  */
 int pvrtex_load_blob(const void* data, dttex_info_t* texinfo);
 
+/**
+ * @brief Allocate a texture and upload its texels in the background, see
+ * tex_upload.h. Nothing may sample the texture before the fence completes.
+ * @param queue The upload queue
+ * @param data The raw data of the texture, valid until the fence completes
+ * @param texinfo The texture texinfo struct to fill
+ * @return tex_upload_fence_t The fence of the upload, 0 on failure
+ */
+tex_upload_fence_t pvrtex_load_async(tex_upload_queue_t* queue,
+                                     const void* data, dttex_info_t* texinfo);
+
+/**
+ * @brief Load a texture from an LZ4 frame of a .dt file, see lz4_stream.h.
+ * The texels are decompressed a block at a time and uploaded as they come, a
+ * full size copy never exists in RAM.
+ * @param data The LZ4 frame
+ * @param size Size of the frame in bytes
+ * @param texinfo The texture texinfo struct to fill
+ * @return int 1 on success, 0 on failure
+ */
+int pvrtex_load_lz4(const void* data, size_t size, dttex_info_t* texinfo);
+
 /**
  * @brief Unload a texture from memory
  * @param texinfo The texture texinfo struct
@@ -0,0 +1,148 @@
+#ifndef TEX_UPLOAD_H
+#define TEX_UPLOAD_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Background texture uploads. Jobs are copied in chunks into one of two 32 byte
+ * aligned staging buffers by a worker thread and sent to VRAM by the PVR DMA,
+ * so staging the next chunk overlaps the transfer of the previous one and the
+ * main loop only pays for submitting the job.
+ *
+ * Every job gets a fence, the renderer polls it with tex_upload_done() before
+ * the first use of the texture. Fences complete in submission order.
+ *
+ * The PVR DMA is shared with the vertex DMA, so the queue needs pvr_init()
+ * with dma_enabled at 0, as all the parts do. On the host the worker copies
+ * into plain memory instead, which is enough to exercise the API.
+ */
+
+#ifdef _arch_dreamcast
+#include <kos/sem.h>
+#include <kos/thread.h>
+
+typedef semaphore_t tex_upload_sem_t;
+typedef kthread_t* tex_upload_thread_t;
+typedef int tex_upload_lock_t;  // unused, irq_disable() guards the queue
+#else
+#include <pthread.h>
+#include <semaphore.h>
+
+typedef sem_t tex_upload_sem_t;
+typedef pthread_t tex_upload_thread_t;
+typedef pthread_mutex_t tex_upload_lock_t;
+#endif
+
+/** Jobs that can wait for the worker, submitting more fails */
+#define TEX_UPLOAD_MAX_JOBS 32
+/** Size of each of the two staging buffers, a multiple of 32 */
+#define TEX_UPLOAD_CHUNK_SIZE (32 * 1024)
+
+/** Completes when its job is in VRAM, 0 is never a valid fence */
+typedef uint32_t tex_upload_fence_t;
+
+typedef struct {
+    const uint8_t* src;
+    uint8_t* dst;
+    size_t size;
+    tex_upload_fence_t fence;
+} tex_upload_job_t;
+
+typedef struct {
+    uint32_t submitted;  // jobs
+    uint32_t completed;
+    uint32_t max_depth;  // most jobs submitted but not completed at once
+    uint64_t bytes;      // transferred to VRAM
+    uint64_t busy_ns;    // time with at least one job in flight
+} tex_upload_stats_t;
+
+typedef struct {
+    tex_upload_job_t jobs[TEX_UPLOAD_MAX_JOBS];
+    uint32_t head;  // next job to submit
+    uint32_t tail;  // next job for the worker
+    tex_upload_fence_t last_submitted;
+    _Atomic tex_upload_fence_t last_completed;
+    struct {
+        size_t size;
+        tex_upload_fence_t fence;  // of the job if this is its last chunk
+    } in_flight;
+    uint8_t* staging[2];
+    uint64_t busy_since_ns;
+    tex_upload_stats_t stats;
+    tex_upload_lock_t lock;
+    tex_upload_sem_t pending;   // one count per job in the ring
+    tex_upload_sem_t dma_idle;  // held while a chunk is in flight
+    tex_upload_thread_t worker;
+} tex_upload_queue_t;
+
+/**
+ * @brief Allocate the staging buffers and start the worker thread
+ * @param queue The queue to set up, stop it with tex_upload_shutdown()
+ * @return int 1 on success, 0 on failure
+ */
+int tex_upload_init(tex_upload_queue_t* queue);
+
+/**
+ * @brief Finish every submitted job, then stop the worker and free the
+ * staging buffers
+ * @param queue The queue to stop
+ */
+void tex_upload_shutdown(tex_upload_queue_t* queue);
+
+/**
+ * @brief Queue a copy of size bytes from src to dst in VRAM. src is read by
+ * the worker and must stay valid until the fence completes.
+ * @param queue The queue to submit to
+ * @param src Source data in RAM, any alignment
+ * @param dst Destination in VRAM, 32 byte aligned
+ * @param size Number of bytes, the last 32 byte burst may write past it
+ * @return tex_upload_fence_t The fence of the job, 0 if the queue is full
+ */
+tex_upload_fence_t tex_upload_submit(tex_upload_queue_t* queue, const void* src,
+                                     void* dst, size_t size);
+
+/**
+ * @brief Whether the job of a fence, and every job submitted before it, is in
+ * VRAM
+ * @param queue The queue the fence came from
+ * @param fence A fence returned by tex_upload_submit()
+ * @return int 1 if the data can be used, 0 if it is still in flight
+ */
+static inline int tex_upload_done(const tex_upload_queue_t* queue,
+                                  tex_upload_fence_t fence) {
+    /* acquire pairs with the release in the completion, so the texels are
+     * visible once the fence is */
+    return (int32_t)(atomic_load_explicit(&queue->last_completed,
+                                          memory_order_acquire) -
+                     fence) >= 0;
+}
+
+/**
+ * @brief Yield to the worker until a fence completes
+ * @param queue The queue the fence came from
+ * @param fence A fence returned by tex_upload_submit()
+ */
+void tex_upload_wait(tex_upload_queue_t* queue, tex_upload_fence_t fence);
+
+/**
+ * @brief Jobs submitted but not yet completed
+ * @param queue The queue to query
+ * @return uint32_t The current queue depth
+ */
+static inline uint32_t tex_upload_depth(const tex_upload_queue_t* queue) {
+    return queue->last_submitted -
+           atomic_load_explicit(&queue->last_completed, memory_order_relaxed);
+}
+
+/**
+ * @brief Print jobs, bytes, the deepest the queue got and the throughput
+ * while it was busy
+ * @param queue The queue to report on
+ * @param label Printed in front of the numbers
+ */
+void tex_upload_print_stats(const tex_upload_queue_t* queue,
+                            const char* label);
+
+#endif  // TEX_UPLOAD_H
@@ -0,0 +1,100 @@
+#ifndef TR_SORT_H
+#define TR_SORT_H
+
+#include <dc/pvr.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sh4zamsprites/arena.h>
+
+/**
+ * Translucent primitives sorted on the CPU. Each primitive's TA commands are
+ * written into a batch together with a depth key, the batch is radix sorted
+ * back to front and sent through the store queues in that order, so the TR
+ * list can be rendered with autosort off (pvr_init_params_t's
+ * autosort_disabled) and the ISP skips its per pixel sort.
+ *
+ * The order is per primitive, by the depth the caller gives it, which is
+ * enough for primitives that do not intersect.
+ */
+
+typedef struct {
+    uint32_t key;     // tr_depth_key(), sorted ascending
+    uint16_t slot;    // first 32 byte slot of the commands in the batch
+    uint16_t slots;   // number of 32 byte slots
+} tr_prim_t;
+
+typedef struct {
+    uint8_t* data;       // the commands, 32 byte aligned
+    tr_prim_t* prims;
+    tr_prim_t* scratch;  // the other half of the radix sort's ping-pong
+    uint32_t max_slots;
+    uint32_t used_slots;
+    uint32_t max_prims;
+    uint32_t count;
+    uint32_t dropped;    // primitives that did not fit
+} tr_batch_t;
+
+/**
+ * @brief Set up an empty batch in arena memory, usually the frame arena
+ * @param batch The batch to set up
+ * @param arena Where the commands and the sort buffers go
+ * @param max_prims Largest number of primitives
+ * @param max_slots Largest number of 32 byte command slots, at most 65536
+ * @return int 1 on success, 0 on failure
+ */
+int tr_batch_init(tr_batch_t* batch, arena_t* arena, uint32_t max_prims,
+                  uint32_t max_slots);
+
+/**
+ * @brief Radix sort the primitives back to front, stable for equal depths
+ * @param batch The batch to sort
+ */
+void tr_batch_sort(tr_batch_t* batch);
+
+/**
+ * @brief Send the commands of every primitive to the TA in batch order
+ * @param batch The batch to submit
+ * @param dr_state The direct render state
+ */
+void tr_batch_submit(const tr_batch_t* batch, pvr_dr_state_t* dr_state);
+
+/**
+ * Sort key of a screen space depth, the 1/w the TA gets as z. Bigger is
+ * nearer, and the bits of a positive float order the same way as its value.
+ */
+static inline uint32_t tr_depth_key(float inv_w) {
+    if (!(inv_w > 0.0f)) {
+        return 0;  // behind the eye or NaN, drawn first
+    }
+    uint32_t key;
+    memcpy(&key, &inv_w, sizeof(key));
+    return key;
+}
+
+/**
+ * @brief Room for the commands of one more primitive
+ * @param batch The batch to add to
+ * @param inv_w Depth of the primitive, e.g. the mean 1/w of its vertices
+ * @param slots Size of the commands in 32 byte slots
+ * @return void* Where to write the commands, NULL when the batch is full
+ */
+static inline void* tr_batch_add(tr_batch_t* batch, float inv_w,
+                                 uint32_t slots) {
+    if (__builtin_expect(batch->count == batch->max_prims ||
+                             batch->used_slots + slots > batch->max_slots,
+                         0)) {
+        batch->dropped++;
+        return NULL;
+    }
+    batch->prims[batch->count++] = (tr_prim_t){
+        .key = tr_depth_key(inv_w),
+        .slot = (uint16_t)batch->used_slots,
+        .slots = (uint16_t)slots,
+    };
+    void* cmds = batch->data + batch->used_slots * 32;
+    batch->used_slots += slots;
+    return cmds;
+}
+
+#endif  // TR_SORT_H